@@ -1,4 +1,4 @@
-import { rand, Tensor } from '@shumai/shumai'
+import { adopt, rand, Tensor } from '@shumai/shumai'
 
 function bench(description, f, iters = 1000) {
   const hist = new Float32Array(iters)
@@ -17,27 +17,61 @@ function bench(description, f, iters = 1000) {
   Bun.gc(true)
 }
 
-for (const N of [10, 1000, 100000]) {
+for (const N of [10, 1000, 100000, 10000000]) {
   console.log(`${N} elements...`)
-  bench(`JS create 0 tensor     `, () => {
-    const a = new Float32Array(N)
-    // eslint-disable-next-line @typescript-eslint/no-unused-vars
-    const t = new Tensor(a)
-  })
-  bench(`native create 0 tensor `, () => {
-    // eslint-disable-next-line @typescript-eslint/no-unused-vars
-    const t = new Tensor(N)
-  })
-  bench(`JS create random tensor`, () => {
-    const a = new Float32Array(N)
-    for (let i = 0; i < N; ++i) {
-      a[i] = Math.random()
-    }
-    // eslint-disable-next-line @typescript-eslint/no-unused-vars
-    const t = new Tensor(a)
-  })
-  bench(`native create random tensor`, () => {
-    // eslint-disable-next-line @typescript-eslint/no-unused-vars
-    const t = rand([N])
-  })
+  const iters = N > 100000 ? 50 : 1000
+  const data = new Float32Array(N)
+  bench(
+    `JS copy tensor         `,
+    () => {
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = new Tensor(data)
+    },
+    iters
+  )
+  bench(
+    `JS adopt tensor        `,
+    () => {
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = adopt(data)
+    },
+    iters
+  )
+  bench(
+    `JS create 0 tensor     `,
+    () => {
+      const a = new Float32Array(N)
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = new Tensor(a)
+    },
+    iters
+  )
+  bench(
+    `native create 0 tensor `,
+    () => {
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = new Tensor(N)
+    },
+    iters
+  )
+  bench(
+    `JS create random tensor`,
+    () => {
+      const a = new Float32Array(N)
+      for (let i = 0; i < N; ++i) {
+        a[i] = Math.random()
+      }
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = new Tensor(a)
+    },
+    iters
+  )
+  bench(
+    `native create random tensor`,
+    () => {
+      // eslint-disable-next-line @typescript-eslint/no-unused-vars
+      const t = rand([N])
+    },
+    iters
+  )
 }
@@ -0,0 +1,50 @@
+import { CommandBuffer, randn, scalar, Tensor } from '@shumai/shumai'
+
+function bench(description, f, iters = 1000) {
+  const hist = new Float32Array(iters)
+  for (let i = 0; i < iters; ++i) {
+    const t0 = performance.now()
+    f()
+    const t1 = performance.now()
+    hist[i] = 1e6 * (t1 - t0)
+  }
+  const t = new Tensor(hist)
+  console.log(
+    `${description} \t mean: ${Math.round(t.mean().toFloat32()) / 1e3}us    (min: ${
+      Math.round(t.amin().toFloat32()) / 1e3
+    }us, max: ${Math.round(t.amax().toFloat32()) / 1e3}us)`
+  )
+  Bun.gc(true)
+}
+
+// an SGD-with-momentum style update: 8 elementwise ops per parameter
+const lr = 1e-3
+const mu = 0.9
+const wd = 1e-4
+
+const cb = new CommandBuffer()
+const p_s = cb.input()
+const g_s = cb.input()
+const v_s = cb.input()
+const g_wd = cb.add(g_s, cb.mul(p_s, cb.scalar(wd)))
+const v_new = cb.add(cb.mul(v_s, cb.scalar(mu)), g_wd)
+cb.output(cb.sub(p_s, cb.mul(v_new, cb.scalar(lr))), v_new)
+
+for (const N of [10, 1000, 100000]) {
+  console.log(`${N} elements...`)
+  const p = randn([N])
+  const g = randn([N])
+  const v = randn([N])
+  bench(`per-op update          `, () => {
+    const decayed = g.add(p.mul(scalar(wd)))
+    const v_new = v.mul(scalar(mu)).add(decayed)
+    const p_new = p.sub(v_new.mul(scalar(lr)))
+    p_new.eval()
+    v_new.eval()
+  })
+  bench(`command buffer update  `, () => {
+    const [p_new, v_new] = cb.run(p, g, v)
+    p_new.eval()
+    v_new.eval()
+  })
+}
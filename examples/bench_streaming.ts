@@ -0,0 +1,98 @@
+import * as sm from '@shumai/shumai'
+
+// Buffered vs streamed tfetch between two local processes.
+//
+//   bun examples/bench_streaming.ts [MB ...]
+//
+// For each size, a Float32 tensor is uploaded to and downloaded from a server spawned from this
+// file. Reported are the mean latency and the peak RSS growth of either process during a
+// transfer: buffered transfers hold the whole message (and a copy) at once, streamed ones a few
+// chunks.
+
+const port = 3091
+const url = `127.0.0.1:${port}`
+const reps = 3
+
+function trackPeakRss() {
+  const rss = { base: process.memoryUsage().rss, peak: 0 }
+  rss.peak = rss.base
+  const timer = setInterval(() => (rss.peak = Math.max(rss.peak, process.memoryUsage().rss)), 1)
+  return {
+    // peak growth since the last reset
+    reset() {
+      Bun.gc(true)
+      const growth = Math.max(rss.peak, process.memoryUsage().rss) - rss.base
+      rss.base = rss.peak = process.memoryUsage().rss
+      return growth
+    },
+    stop: () => clearInterval(timer)
+  }
+}
+
+if (process.argv[2] === 'serve') {
+  const rss = trackPeakRss()
+  const tensors = new Map<number, sm.Tensor>()
+  sm.network.serve(
+    {
+      upload: (_, t: sm.Tensor) => sm.scalar(t.elements),
+      download: (_, t: sm.Tensor) => {
+        const n = t.toFloat32()
+        if (!tensors.has(n)) {
+          tensors.set(n, sm.randn([n]))
+        }
+        return tensors.get(n)
+      },
+      rss: () => ({ growth: rss.reset() })
+    },
+    { port }
+  )
+} else {
+  const sizes = process.argv.slice(2).map(Number).filter(Boolean)
+  const server = Bun.spawn(['bun', import.meta.path, 'serve'], { stdout: 'inherit' })
+  const serverRss = async () => (await (await fetch(`${url}/rss`)).json()).growth
+  for (;;) {
+    try {
+      await serverRss()
+      break
+    } catch (e) {
+      await Bun.sleep(50)
+    }
+  }
+
+  const rss = trackPeakRss()
+  const MB = (bytes: number) => `${(bytes / 2 ** 20).toFixed(1)}MB`.padStart(9)
+  try {
+    for (const mb of sizes.length ? sizes : [16, 128, 512]) {
+      const n = (mb * 2 ** 20) / 4
+      const t = sm.randn([n])
+      const request = { upload: t, download: sm.scalar(n) }
+      for (const direction of ['upload', 'download'] as const) {
+        for (const stream of [false, true]) {
+          let ms = 0
+          let clientPeak = 0
+          let serverPeak = 0
+          for (let i = 0; i < reps; ++i) {
+            rss.reset()
+            await serverRss()
+            const t0 = performance.now()
+            const out = await sm.network.tfetch(`${url}/${direction}`, request[direction], {
+              stream
+            })
+            ms += performance.now() - t0
+            clientPeak = Math.max(clientPeak, rss.reset())
+            serverPeak = Math.max(serverPeak, await serverRss())
+            out.dispose()
+          }
+          console.log(
+            `${mb}MB ${direction.padEnd(8)} ${stream ? 'streamed' : 'buffered'} \t` +
+              `${(ms / reps).toFixed(1).padStart(8)}ms  ` +
+              `peak RSS growth: client ${MB(clientPeak)}  server ${MB(serverPeak)}`
+          )
+        }
+      }
+    }
+  } finally {
+    rss.stop()
+    server.kill()
+  }
+}
@@ -215,12 +215,12 @@ op_aliases = {
 }
 
 # ops that need inputs transposed to work correctly
-# if g_row_major == true
+# if row-major layout is active
 reverse_args_row_major = [
   "matmul",
 ]
 
-# ops that need to be replaced with another when g_row_major == true
+# ops that need to be replaced with another when row-major layout is active
 op_overwrite_row_major = {
     "tril": "triu",
     "triu": "tril"
@@ -297,7 +297,7 @@ for op, args, ret in op_list:
     js_tensor_vector_args = []
     js_grad_args = []
     js_grad_arg_types = []
-    c_impl = ["LOCK_GUARD\n"]
+    c_impl = []
     c_op_args = []
     t_count = 0
 
@@ -370,9 +370,9 @@ for op, args, ret in op_list:
             c_sig.append(f"void* {n}_ptr")
             c_sig.append(f"int64_t {n}_len")
             if op == "transpose": # bug in flashlight
-                c_impl.append(f"auto {n} = arrayArg<long long>({n}_ptr, {n}_len, g_row_major, {first_tensor}->ndim());")
+                c_impl.append(f"auto {n} = arrayArg<long long>({n}_ptr, {n}_len, rowMajor(), {first_tensor}->ndim());")
             else:
-                c_impl.append(f"auto {n} = arrayArg<long long>({n}_ptr, {n}_len, g_row_major, false);")
+                c_impl.append(f"auto {n} = arrayArg<long long>({n}_ptr, {n}_len, rowMajor(), false);")
             c_op_args.append(f"fl::Shape({n})")
             ffi_sig.append("FFIType.ptr")
             ffi_sig.append("FFIType.i64")
@@ -389,7 +389,7 @@ for op, args, ret in op_list:
             first_axes = n
             c_sig.append(f"void* {n}_ptr")
             c_sig.append(f"int64_t {n}_len")
-            c_impl.append(f"auto {n} = arrayArg<int>({n}_ptr, {n}_len, g_row_major, {first_tensor}->ndim());")
+            c_impl.append(f"auto {n} = arrayArg<int>({n}_ptr, {n}_len, rowMajor(), {first_tensor}->ndim());")
             c_op_args.append(f"{n}")
             ffi_sig.append("FFIType.ptr")
             ffi_sig.append("FFIType.i64")
@@ -403,7 +403,7 @@ for op, args, ret in op_list:
         else:
             c_sig.append(f"{t} {n}")
             if n == "axis":
-                c_impl.append(f"auto used_{n} = axisArg(axis, g_row_major, {first_tensor}->ndim());")
+                c_impl.append(f"auto used_{n} = axisArg(axis, rowMajor(), {first_tensor}->ndim());")
                 c_op_args.append(f"used_axis")
                 first_axis = f"static_cast<int>(used_{n})"
             else:
@@ -456,7 +456,7 @@ for op, args, ret in op_list:
     if ret == "Tensor":
         c_impl.append("fl::Tensor t;")
         if op in reverse_args_row_major or op in op_overwrite_row_major:
-            c_impl.append("if (g_row_major) {")
+            c_impl.append("if (rowMajor()) {")
             if op in reverse_args_row_major:
                 c_args_reversed = ", ".join(c_op_args[::-1])
                 if op in op_overwrite_row_major:
@@ -473,8 +473,7 @@ for op, args, ret in op_list:
             c_impl.append(keep_dims_fix)
         if op in reverse_args_row_major or op in op_overwrite_row_major:
             c_impl.append("}")
-        c_impl.append(f"g_bytes_used += t.bytes();")
-        c_impl.append(f"return new fl::Tensor(t);")
+        c_impl.append(f"return shumai::newTensor(std::move(t));")
         c_ret = "void*"
         ffi_ret = f"FFIType.{to_ffi['void*']}"
     else:
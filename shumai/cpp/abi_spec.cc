@@ -9,6 +9,96 @@ size_t bytesUsed() {
   return 0;
 }
 
+size_t bytesPeak() {
+  return 0;
+}
+
+void resetBytesPeak() {}
+
+int64_t liveTensors() {
+  return 0;
+}
+
+int64_t threadTensors() {
+  return 0;
+}
+
+int64_t threadTensorBytes() {
+  return 0;
+}
+
+int64_t bytesByDtype(void* out, int64_t out_len) {
+  return 0;
+}
+
+size_t bytesShared() {
+  return 0;
+}
+
+size_t bytesReserved() {
+  return 0;
+}
+
+size_t bytesInUse() {
+  return 0;
+}
+
+void emptyCache() {}
+
+void setCacheHighWaterMark(size_t bytes) {}
+
+size_t cacheHighWaterMark() {
+  return 0;
+}
+
+int64_t tensorHandleStats(void* out, int64_t out_len) {
+  return 0;
+}
+
+bool canAdoptBuffers() {
+  return false;
+}
+
+void* tensorAdoptBuffer(int64_t numel, int type, void* ptr) {
+  return nullptr;
+}
+
+int64_t drainAdoptedBuffers(void* out, int64_t out_len) {
+  return 0;
+}
+
+int64_t _encodedSize(void* t, int64_t encoding) {
+  return 0;
+}
+
+int64_t _encodeInto(void* t,
+                    void* buffer,
+                    int64_t capacity,
+                    int64_t encoding,
+                    void* residual) {
+  return 0;
+}
+
+void* _decode(void* buffer, int64_t length, bool adopt, void* adopted_out) {
+  return nullptr;
+}
+
+int64_t _encodeHeader(void* t, void* buffer, int64_t capacity) {
+  return 0;
+}
+
+void* _decodeHeader(void* buffer, int64_t length) {
+  return nullptr;
+}
+
+int64_t _readAt(void* t, int64_t offset, void* out, int64_t length) {
+  return 0;
+}
+
+int64_t _writeAt(void* t, int64_t offset, void* data, int64_t length) {
+  return 0;
+}
+
 void* createTensor(void* shape_ptr, int64_t shape_len) {
   return nullptr;
 }
@@ -86,6 +176,43 @@ void* load(void* cstr_ptr, int length) {
   return nullptr;
 }
 
+int64_t _saveRaw(void* t, void* cstr_ptr, int length) {
+  return 0;
+}
+
+void* _loadRaw(void* cstr_ptr, int length, bool verify) {
+  return nullptr;
+}
+
+int64_t _saveAsync(void* t, void* cstr_ptr, int length, bool raw) {
+  return 0;
+}
+
+int64_t _flushSaves(int64_t ticket) {
+  return 0;
+}
+
+int64_t _writeAsync(void* cstr_ptr,
+                    int length,
+                    void* data,
+                    int64_t data_len,
+                    void* after,
+                    int64_t after_len) {
+  return 0;
+}
+
+int64_t _saveStatus(int64_t ticket) {
+  return 0;
+}
+
+int64_t pendingSaves() {
+  return 0;
+}
+
+uint64_t _contentHash(void* t) {
+  return 0;
+}
+
 void _eval(void* t) {}
 
 size_t _elements(void* t) {
@@ -96,6 +223,10 @@ size_t _bytes(void* t) {
   return 0;
 }
 
+size_t _uniqueBytes(void* tensors_ptr, int64_t tensors_len) {
+  return 0;
+}
+
 int _shape(void* t, void* out, int out_len) {
   return 0;
 }
@@ -200,6 +331,16 @@ unsigned* _uint64Buffer(void* t) {
   return nullptr;
 }
 
+void* _hostView(void* t, int type, void* data_out) {
+  return nullptr;
+}
+
+void destroyHostView(void* /*bytes*/, void* ctx) {}
+
+JSTypedArrayBytesDeallocator genHostViewDestroyer() {
+  return destroyHostView;
+}
+
 float _float16Scalar(void* t) {
   return 0;
 }
@@ -254,6 +395,13 @@ void* _index(void* t,
   return nullptr;
 }
 
+int64_t _indexedAssignInPlace(void* t,
+                              void* other,
+                              void* args_ptr,
+                              int64_t args_len) {
+  return 0;
+}
+
 void* _indexedAssign(void* t,
                      void* other,
                      void* starts,
@@ -285,6 +433,136 @@ void* _pad(void* t,
   return nullptr;
 }
 
+void* _gather(void* t, int64_t axis, void* index) {
+  return nullptr;
+}
+
+void* _scatterAdd(void* base, int64_t axis, void* index, void* src) {
+  return nullptr;
+}
+
+void* _indexSelect(void* t, int64_t axis, void* index) {
+  return nullptr;
+}
+
+void* _indexAdd(void* base, int64_t axis, void* index, void* src) {
+  return nullptr;
+}
+
+void* _softmax(void* t, int64_t axis) {
+  return nullptr;
+}
+
+void* _logSoftmax(void* t, int64_t axis) {
+  return nullptr;
+}
+
+void* _softmaxBackward(void* grad, void* out, int64_t axis) {
+  return nullptr;
+}
+
+void* _logSoftmaxBackward(void* grad, void* out, int64_t axis) {
+  return nullptr;
+}
+
+void* _attention(void* q,
+                 void* k,
+                 void* v,
+                 void* mask,
+                 double scale,
+                 bool causal,
+                 void* lse_out) {
+  return nullptr;
+}
+
+int64_t _attentionBackward(void* grad,
+                           void* q,
+                           void* k,
+                           void* v,
+                           void* out,
+                           void* lse,
+                           void* mask,
+                           double scale,
+                           bool causal,
+                           void* grads_out) {
+  return -1;
+}
+
+void* _crossEntropyWithLogits(void* logits, void* labels, void* lse_out) {
+  return nullptr;
+}
+
+void* _crossEntropyWithLogitsBackward(void* grad,
+                                      void* logits,
+                                      void* labels,
+                                      void* lse) {
+  return nullptr;
+}
+
+int64_t _lstm(void* x, void* h0, void* c0, void* w, void* u, void* b,
+              void* out) {
+  return -1;
+}
+
+int64_t _lstmBackward(void* grad_hs,
+                      void* grad_c,
+                      void* x,
+                      void* h0,
+                      void* c0,
+                      void* w,
+                      void* u,
+                      void* b,
+                      void* gates,
+                      void* cells,
+                      void* grads_out) {
+  return -1;
+}
+
+void* _layerNorm(void* x,
+                 void* gamma,
+                 void* beta,
+                 int64_t dims,
+                 double eps,
+                 void* stats_out) {
+  return nullptr;
+}
+
+int64_t _layerNormBackward(void* grad,
+                           void* x,
+                           void* gamma,
+                           void* mean,
+                           void* rstd,
+                           int64_t dims,
+                           bool param_grads,
+                           void* grads_out) {
+  return -1;
+}
+
+double _adamStep(void* params_ptr,
+                 void* grads_ptr,
+                 void* m_ptr,
+                 void* v_ptr,
+                 int64_t count,
+                 double step_size,
+                 double b1,
+                 double b2,
+                 double eps,
+                 double weight_decay,
+                 double max_grad_norm) {
+  return -1;
+}
+
+double _sgdStep(void* params_ptr,
+                void* grads_ptr,
+                void* buffers_ptr,
+                int64_t count,
+                double lr,
+                double momentum,
+                double weight_decay,
+                double max_grad_norm) {
+  return -1;
+}
+
 // `grad_in` is Shumai equivalent to Flashlight `gradOutput`
 void* _conv2dBackwardData(void* grad_in,
                           void* in,
@@ -300,6 +578,34 @@ void* _conv2dBackwardData(void* grad_in,
   return nullptr;
 }
 
+int64_t _runCommands(void* inputs_ptr,
+                     int64_t inputs_len,
+                     void* program_ptr,
+                     int64_t program_len,
+                     void* outputs_ptr,
+                     int64_t outputs_len) {
+  return -1;
+}
+
+int64_t _fused(void* inputs_ptr,
+               int64_t inputs_len,
+               void* program_ptr,
+               int64_t program_len,
+               void* outputs_ptr,
+               int64_t outputs_len) {
+  return -1;
+}
+
+int64_t _tapeBackward(void* tensors_ptr,
+                      int64_t tensors_len,
+                      void* program_ptr,
+                      int64_t program_len,
+                      void* jacobian,
+                      void* grads_ptr,
+                      int64_t grads_len) {
+  return -1;
+}
+
 void* _rand(void* shape_ptr, int64_t shape_len) {
   return nullptr;
 }
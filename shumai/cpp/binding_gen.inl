@@ -1,13 +1,10 @@
 
 void* _rand(void* shape_ptr, int64_t shape_len) {
   try {
-    LOCK_GUARD
-
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::rand(fl::Shape(shape));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -17,13 +14,10 @@ void* _rand(void* shape_ptr, int64_t shape_len) {
 
 void* _randn(void* shape_ptr, int64_t shape_len) {
   try {
-    LOCK_GUARD
-
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::randn(fl::Shape(shape));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -33,13 +27,10 @@ void* _randn(void* shape_ptr, int64_t shape_len) {
 
 void* _full(void* shape_ptr, int64_t shape_len, float val) {
   try {
-    LOCK_GUARD
-
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::full(fl::Shape(shape), val);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -49,12 +40,9 @@ void* _full(void* shape_ptr, int64_t shape_len, float val) {
 
 void* _identity(int64_t dim) {
   try {
-    LOCK_GUARD
-
     fl::Tensor t;
     t = fl::identity(dim);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -64,12 +52,9 @@ void* _identity(int64_t dim) {
 
 void* _arange(float start, float end, float step) {
   try {
-    LOCK_GUARD
-
     fl::Tensor t;
     t = fl::arange(start, end, step);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -82,15 +67,12 @@ void* _iota(void* dims_ptr,
             void* tileDims_ptr,
             int64_t tileDims_len) {
   try {
-    LOCK_GUARD
-
-    auto dims = arrayArg<long long>(dims_ptr, dims_len, g_row_major, false);
+    auto dims = arrayArg<long long>(dims_ptr, dims_len, rowMajor(), false);
     auto tileDims =
-        arrayArg<long long>(tileDims_ptr, tileDims_len, g_row_major, false);
+        arrayArg<long long>(tileDims_ptr, tileDims_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::iota(fl::Shape(dims), fl::Shape(tileDims));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -100,14 +82,11 @@ void* _iota(void* dims_ptr,
 
 void* _reshape(void* tensor, void* shape_ptr, int64_t shape_len) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::reshape(*tensor_ptr, fl::Shape(shape));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -117,15 +96,12 @@ void* _reshape(void* tensor, void* shape_ptr, int64_t shape_len) {
 
 void* _transpose(void* tensor, void* axes_ptr, int64_t axes_len) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto axes = arrayArg<long long>(axes_ptr, axes_len, g_row_major,
+    auto axes = arrayArg<long long>(axes_ptr, axes_len, rowMajor(),
                                     tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::transpose(*tensor_ptr, fl::Shape(axes));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -135,14 +111,11 @@ void* _transpose(void* tensor, void* axes_ptr, int64_t axes_len) {
 
 void* _tile(void* tensor, void* shape_ptr, int64_t shape_len) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
     fl::Tensor t;
     t = fl::tile(*tensor_ptr, fl::Shape(shape));
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -152,14 +125,11 @@ void* _tile(void* tensor, void* shape_ptr, int64_t shape_len) {
 
 void* _concatenate(void* tensors_ptr, int64_t tensors_len, int32_t axis) {
   try {
-    LOCK_GUARD
-
     auto tensors = ptrArrayArg<fl::Tensor>(tensors_ptr, tensors_len);
-    auto used_axis = axisArg(axis, g_row_major, (&tensors[0])->ndim());
+    auto used_axis = axisArg(axis, rowMajor(), (&tensors[0])->ndim());
     fl::Tensor t;
     t = fl::concatenate(tensors, used_axis);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -169,13 +139,10 @@ void* _concatenate(void* tensors_ptr, int64_t tensors_len, int32_t axis) {
 
 void* _nonzero(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::nonzero(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -185,13 +152,10 @@ void* _nonzero(void* tensor) {
 
 void* _negative(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::negative(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -201,13 +165,10 @@ void* _negative(void* tensor) {
 
 void* _logicalNot(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::logicalNot(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -217,13 +178,10 @@ void* _logicalNot(void* tensor) {
 
 void* _exp(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::exp(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -233,13 +191,10 @@ void* _exp(void* tensor) {
 
 void* _log(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::log(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -249,13 +204,10 @@ void* _log(void* tensor) {
 
 void* _log1p(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::log1p(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -265,13 +217,10 @@ void* _log1p(void* tensor) {
 
 void* _sin(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::sin(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -281,13 +230,10 @@ void* _sin(void* tensor) {
 
 void* _cos(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::cos(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -297,13 +243,10 @@ void* _cos(void* tensor) {
 
 void* _sqrt(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::sqrt(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -313,13 +256,10 @@ void* _sqrt(void* tensor) {
 
 void* _tanh(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::tanh(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -329,13 +269,10 @@ void* _tanh(void* tensor) {
 
 void* _floor(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::floor(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -345,13 +282,10 @@ void* _floor(void* tensor) {
 
 void* _ceil(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::ceil(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -361,13 +295,10 @@ void* _ceil(void* tensor) {
 
 void* _rint(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::rint(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -377,13 +308,10 @@ void* _rint(void* tensor) {
 
 void* _absolute(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::absolute(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -393,13 +321,10 @@ void* _absolute(void* tensor) {
 
 void* _sigmoid(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::sigmoid(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -409,13 +334,10 @@ void* _sigmoid(void* tensor) {
 
 void* _erf(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::erf(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -425,13 +347,10 @@ void* _erf(void* tensor) {
 
 void* _flip(void* tensor, uint32_t dim) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::flip(*tensor_ptr, dim);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -441,15 +360,12 @@ void* _flip(void* tensor, uint32_t dim) {
 
 void* _clip(void* tensor, void* low, void* high) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* low_ptr = reinterpret_cast<fl::Tensor*>(low);
     auto* high_ptr = reinterpret_cast<fl::Tensor*>(high);
     fl::Tensor t;
     t = fl::clip(*tensor_ptr, *low_ptr, *high_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -459,14 +375,11 @@ void* _clip(void* tensor, void* low, void* high) {
 
 void* _roll(void* tensor, int shift, int32_t axis) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto used_axis = axisArg(axis, g_row_major, tensor_ptr->ndim());
+    auto used_axis = axisArg(axis, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::roll(*tensor_ptr, shift, used_axis);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -476,13 +389,10 @@ void* _roll(void* tensor, int shift, int32_t axis) {
 
 void* _isnan(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::isnan(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -492,13 +402,10 @@ void* _isnan(void* tensor) {
 
 void* _isinf(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::isinf(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -508,13 +415,10 @@ void* _isinf(void* tensor) {
 
 void* _sign(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::sign(*tensor_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -524,17 +428,14 @@ void* _sign(void* tensor) {
 
 void* _tril(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
-    if (g_row_major) {
+    if (rowMajor()) {
       t = fl::triu(*tensor_ptr);
     } else {
       t = fl::tril(*tensor_ptr);
     }
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -544,17 +445,14 @@ void* _tril(void* tensor) {
 
 void* _triu(void* tensor) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
-    if (g_row_major) {
+    if (rowMajor()) {
       t = fl::tril(*tensor_ptr);
     } else {
       t = fl::triu(*tensor_ptr);
     }
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -564,15 +462,12 @@ void* _triu(void* tensor) {
 
 void* _where(void* cond, void* x, void* y) {
   try {
-    LOCK_GUARD
-
     auto* cond_ptr = reinterpret_cast<fl::Tensor*>(cond);
     auto* x_ptr = reinterpret_cast<fl::Tensor*>(x);
     auto* y_ptr = reinterpret_cast<fl::Tensor*>(y);
     fl::Tensor t;
     t = fl::where(cond_ptr->astype(fl::dtype::b8), *x_ptr, *y_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -582,13 +477,10 @@ void* _where(void* cond, void* x, void* y) {
 
 void* _sort(void* tensor, uint32_t dim) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     fl::Tensor t;
     t = fl::sort(*tensor_ptr, dim);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -598,14 +490,11 @@ void* _sort(void* tensor, uint32_t dim) {
 
 void* _add(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::add(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -615,14 +504,11 @@ void* _add(void* tensor, void* other) {
 
 void* _sub(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::sub(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -632,14 +518,11 @@ void* _sub(void* tensor, void* other) {
 
 void* _mul(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::mul(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -649,14 +532,11 @@ void* _mul(void* tensor, void* other) {
 
 void* _div(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::div(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -666,14 +546,11 @@ void* _div(void* tensor, void* other) {
 
 void* _eq(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::eq(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -683,14 +560,11 @@ void* _eq(void* tensor, void* other) {
 
 void* _neq(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::neq(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -700,14 +574,11 @@ void* _neq(void* tensor, void* other) {
 
 void* _lessThan(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::lessThan(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -717,14 +588,11 @@ void* _lessThan(void* tensor, void* other) {
 
 void* _lessThanEqual(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::lessThanEqual(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -734,14 +602,11 @@ void* _lessThanEqual(void* tensor, void* other) {
 
 void* _greaterThan(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::greaterThan(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -751,14 +616,11 @@ void* _greaterThan(void* tensor, void* other) {
 
 void* _greaterThanEqual(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::greaterThanEqual(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -768,14 +630,11 @@ void* _greaterThanEqual(void* tensor, void* other) {
 
 void* _logicalOr(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::logicalOr(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -785,14 +644,11 @@ void* _logicalOr(void* tensor, void* other) {
 
 void* _logicalAnd(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::logicalAnd(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -802,14 +658,11 @@ void* _logicalAnd(void* tensor, void* other) {
 
 void* _mod(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::mod(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -819,14 +672,11 @@ void* _mod(void* tensor, void* other) {
 
 void* _bitwiseAnd(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::bitwiseAnd(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -836,14 +686,11 @@ void* _bitwiseAnd(void* tensor, void* other) {
 
 void* _bitwiseOr(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::bitwiseOr(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -853,14 +700,11 @@ void* _bitwiseOr(void* tensor, void* other) {
 
 void* _bitwiseXor(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::bitwiseXor(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -870,14 +714,11 @@ void* _bitwiseXor(void* tensor, void* other) {
 
 void* _lShift(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::lShift(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -887,14 +728,11 @@ void* _lShift(void* tensor, void* other) {
 
 void* _rShift(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::rShift(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -904,14 +742,11 @@ void* _rShift(void* tensor, void* other) {
 
 void* _minimum(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::minimum(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -921,14 +756,11 @@ void* _minimum(void* tensor, void* other) {
 
 void* _maximum(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::maximum(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -938,14 +770,11 @@ void* _maximum(void* tensor, void* other) {
 
 void* _power(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
     t = fl::power(*tensor_ptr, *other_ptr);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -955,18 +784,15 @@ void* _power(void* tensor, void* other) {
 
 void* _matmul(void* tensor, void* other) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* other_ptr = reinterpret_cast<fl::Tensor*>(other);
     fl::Tensor t;
-    if (g_row_major) {
+    if (rowMajor()) {
       t = fl::matmul(*other_ptr, *tensor_ptr);
     } else {
       t = fl::matmul(*tensor_ptr, *other_ptr);
     }
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -984,14 +810,11 @@ void* _conv2d(void* tensor,
               int32_t dy,
               int32_t groups) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto* weights_ptr = reinterpret_cast<fl::Tensor*>(weights);
     fl::Tensor t;
     t = fl::conv2d(*tensor_ptr, *weights_ptr, sx, sy, px, py, dx, dy, groups);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1001,11 +824,9 @@ void* _conv2d(void* tensor,
 
 void* _amin(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::amin(*tensor_ptr, axes, keep_dims);
 
@@ -1025,8 +846,7 @@ void* _amin(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1036,11 +856,9 @@ void* _amin(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
 
 void* _amax(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::amax(*tensor_ptr, axes, keep_dims);
 
@@ -1060,8 +878,7 @@ void* _amax(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1071,10 +888,8 @@ void* _amax(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
 
 void* _argmin(void* tensor, int32_t axis, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto used_axis = axisArg(axis, g_row_major, tensor_ptr->ndim());
+    auto used_axis = axisArg(axis, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::argmin(*tensor_ptr, used_axis, keep_dims);
 
@@ -1093,8 +908,7 @@ void* _argmin(void* tensor, int32_t axis, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1104,10 +918,8 @@ void* _argmin(void* tensor, int32_t axis, bool keep_dims) {
 
 void* _argmax(void* tensor, int32_t axis, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto used_axis = axisArg(axis, g_row_major, tensor_ptr->ndim());
+    auto used_axis = axisArg(axis, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::argmax(*tensor_ptr, used_axis, keep_dims);
 
@@ -1126,8 +938,7 @@ void* _argmax(void* tensor, int32_t axis, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1137,11 +948,9 @@ void* _argmax(void* tensor, int32_t axis, bool keep_dims) {
 
 void* _sum(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::sum(*tensor_ptr, axes, keep_dims);
 
@@ -1161,8 +970,7 @@ void* _sum(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1172,14 +980,11 @@ void* _sum(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
 
 void* _cumsum(void* tensor, int32_t axis) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
-    auto used_axis = axisArg(axis, g_row_major, tensor_ptr->ndim());
+    auto used_axis = axisArg(axis, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::cumsum(*tensor_ptr, used_axis);
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1189,11 +994,9 @@ void* _cumsum(void* tensor, int32_t axis) {
 
 void* _mean(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::mean(*tensor_ptr, axes, keep_dims);
 
@@ -1213,8 +1016,7 @@ void* _mean(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1224,11 +1026,9 @@ void* _mean(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
 
 void* _median(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::median(*tensor_ptr, axes, keep_dims);
 
@@ -1248,8 +1048,7 @@ void* _median(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1263,11 +1062,9 @@ void* _var(void* tensor,
            bool bias,
            bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::var(*tensor_ptr, axes, bias, keep_dims);
 
@@ -1287,8 +1084,7 @@ void* _var(void* tensor,
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1298,11 +1094,9 @@ void* _var(void* tensor,
 
 void* _std(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::std(*tensor_ptr, axes, keep_dims);
 
@@ -1322,8 +1116,7 @@ void* _std(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1337,11 +1130,9 @@ void* _norm(void* tensor,
             double p,
             bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::norm(*tensor_ptr, axes, p, keep_dims);
 
@@ -1366,8 +1157,7 @@ void* _norm(void* tensor,
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1380,11 +1170,9 @@ void* _countNonzero(void* tensor,
                     int64_t axes_len,
                     bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::countNonzero(*tensor_ptr, axes, keep_dims);
 
@@ -1404,8 +1192,7 @@ void* _countNonzero(void* tensor,
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1415,11 +1202,9 @@ void* _countNonzero(void* tensor,
 
 void* _any(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::any(*tensor_ptr, axes, keep_dims);
 
@@ -1439,8 +1224,7 @@ void* _any(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -1450,11 +1234,9 @@ void* _any(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
 
 void* _all(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
   try {
-    LOCK_GUARD
-
     auto* tensor_ptr = reinterpret_cast<fl::Tensor*>(tensor);
     auto axes =
-        arrayArg<int>(axes_ptr, axes_len, g_row_major, tensor_ptr->ndim());
+        arrayArg<int>(axes_ptr, axes_len, rowMajor(), tensor_ptr->ndim());
     fl::Tensor t;
     t = fl::all(*tensor_ptr, axes, keep_dims);
 
@@ -1474,8 +1256,7 @@ void* _all(void* tensor, void* axes_ptr, int64_t axes_len, bool keep_dims) {
     const auto& shape = fl::Shape(new_shape);
     t = fl::reshape(t, shape);
 
-    g_bytes_used += t.bytes();
-    return new fl::Tensor(t);
+    return shumai::newTensor(std::move(t));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
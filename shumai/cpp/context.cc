@@ -0,0 +1,30 @@
+#include "context.h"
+
+namespace shumai {
+namespace {
+
+// Trivially destructible, so it can still be read while the thread's other
+// thread_local objects are being destroyed.
+thread_local bool t_context_destroyed = false;
+
+struct ContextHolder {
+  ~ContextHolder() {
+    // Set before the members' destructors run: flushing the caches back to
+    // the shared pools must not touch the context being destroyed.
+    t_context_destroyed = true;
+  }
+
+  ExecutionContext context;
+};
+
+}  // namespace
+
+ExecutionContext* currentContext() {
+  if (t_context_destroyed) {
+    return nullptr;
+  }
+  thread_local ContextHolder holder;
+  return &holder.context;
+}
+
+}  // namespace shumai
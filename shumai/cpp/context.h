@@ -0,0 +1,32 @@
+#pragma once
+
+#include "handle_pool.h"
+#include "memory.h"
+
+namespace shumai {
+
+// Per-thread execution state.  Every thread that calls into the binding (the
+// main JS thread and each Bun worker) works in its own context, so ops issued
+// from different threads run in parallel without a global lock.
+struct ExecutionContext {
+  // Whether shapes and axes passed in from JS are row-major, i.e. reversed
+  // relative to Flashlight's column-major order.
+  bool row_major = true;
+  HandleCache handles;
+  BlockCache blocks;
+  // Tensor handles (and their logical bytes) created minus deleted by this
+  // thread; see `threadTensors`.
+  int64_t tensors = 0;
+  int64_t tensor_bytes = 0;
+};
+
+// The calling thread's context, or nullptr while the thread is tearing down
+// its thread-local state (callers then fall back to the shared slow paths).
+ExecutionContext* currentContext();
+
+inline bool rowMajor() {
+  auto* ctx = currentContext();
+  return ctx ? ctx->row_major : true;
+}
+
+}  // namespace shumai
@@ -1,7 +1,14 @@
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
 #include "dltensor.h"
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/autograd/tensor/AutogradExtension.h"
@@ -15,6 +22,13 @@
 #include "flashlight/fl/tensor/Init.h"
 #include "flashlight/fl/tensor/Random.h"
 #include "flashlight/fl/tensor/TensorAdapter.h"
+#include "handle_pool.h"
+#include "context.h"
+#include "kernels/kernels.h"
+#include "memory.h"
+#include "raw_file.h"
+#include "save_queue.h"
+#include "wire.h"
 
 #define FMT_RESET "\033[0m"
 #define FMT_RED "\033[31m"
@@ -24,7 +38,7 @@
 #define FMT_BOLD_WHITE "\033[1m\033[97m"
 #define FMT_BOLD_ITALIC_WHITE "\033[1m\033[3m\033[97m"
 
-#define HANDLE_EXCEPTION(what)                                         \
+#define HANDLE_EXCEPTION_RETURNING(what, ret)                          \
   {                                                                    \
     std::cerr << FMT_RED << "native code error" << FMT_GRAY << ": "    \
               << FMT_BOLD_WHITE << what << FMT_RESET << FMT_GRAY       \
@@ -32,19 +46,12 @@
               << __func__ << FMT_RESET << FMT_GRAY << " (" << FMT_CYAN \
               << __FILE__ << FMT_GRAY << ":" << FMT_YELLOW << __LINE__ \
               << FMT_GRAY << ")" << FMT_RESET << std::endl;            \
-    return nullptr;                                                    \
+    return ret;                                                        \
   }
 
-#if 0
-#include <mutex>
-static std::mutex g_op_mutex;
-#define LOCK_GUARD std::lock_guard<std::mutex> guard(g_op_mutex);
-#else
-#define LOCK_GUARD
-#endif
+#define HANDLE_EXCEPTION(what) HANDLE_EXCEPTION_RETURNING(what, nullptr)
 
-static std::atomic<size_t> g_bytes_used = 0;
-static std::atomic<bool> g_row_major = true;
+using shumai::rowMajor;
 
 template <typename T>
 std::vector<T> arrayArg(const void* ptr, int len, bool reverse, int invert) {
@@ -75,6 +82,20 @@ std::vector<T> ptrArrayArg(const void* ptr, int len) {
   return out;
 }
 
+// Handles passed as an int64 array, without copying the tensors (unlike
+// `ptrArrayArg`).  A null array yields null handles.
+std::vector<fl::Tensor*> tensorPtrArrayArg(const void* ptr, int64_t len) {
+  std::vector<fl::Tensor*> out(len, nullptr);
+  if (!ptr) {
+    return out;
+  }
+  for (auto i = 0; i < len; ++i) {
+    auto ptrAsInt = reinterpret_cast<const int64_t*>(ptr)[i];
+    out[i] = reinterpret_cast<fl::Tensor*>(ptrAsInt);
+  }
+  return out;
+}
+
 uint32_t axisArg(int32_t axis, bool reverse, int ndim) {
   if (!reverse) {
     return static_cast<uint32_t>(axis);
@@ -86,23 +107,838 @@ uint32_t axisArg(int32_t axis, bool reverse, int ndim) {
   }
 }
 
+// Command buffers let JS record a short sequence of ops and run all of them
+// with a single FFI call (see shumai/tensor/command_buffer.ts).  A program is
+// one int64 array laid out as
+//
+//   [num_instructions, (op, dst, a, b, imm_offset, imm_len) * n, immediates]
+//
+// `dst`, `a` and `b` are slot indices.  The first slots hold the inputs and
+// every instruction writes a fresh slot.  Shapes and axes live in the trailing
+// immediates; float constants are stored bit-for-bit in `b`.
+// Keep the opcode values in sync with `CommandOp` in command_buffer.ts.
+enum class CommandOp : int64_t {
+  kFull = 0,
+  kNegative = 1,
+  kExp = 2,
+  kLog = 3,
+  kLog1p = 4,
+  kSin = 5,
+  kCos = 6,
+  kSqrt = 7,
+  kTanh = 8,
+  kFloor = 9,
+  kCeil = 10,
+  kRint = 11,
+  kAbsolute = 12,
+  kSigmoid = 13,
+  kErf = 14,
+  kAdd = 15,
+  kSub = 16,
+  kMul = 17,
+  kDiv = 18,
+  kMinimum = 19,
+  kMaximum = 20,
+  kPower = 21,
+  kMatmul = 22,
+  kEq = 23,
+  kNeq = 24,
+  kLessThan = 25,
+  kLessThanEqual = 26,
+  kGreaterThan = 27,
+  kGreaterThanEqual = 28,
+  kReshape = 29,
+  kTranspose = 30,
+  kSum = 31,
+  kMean = 32,
+  kAmin = 33,
+  kAmax = 34,
+  kAstype = 35,
+};
+
+constexpr int64_t kCommandWidth = 6;
+
+// Returns the slots read by an instruction (-1 when unused).
+std::pair<int64_t, int64_t> commandOperands(const int64_t* ins) {
+  const auto op = static_cast<CommandOp>(ins[0]);
+  if (op == CommandOp::kFull) {
+    return {-1, -1};
+  }
+  if (op >= CommandOp::kAdd && op <= CommandOp::kGreaterThanEqual) {
+    return {ins[2], ins[3]};
+  }
+  return {ins[2], -1};
+}
+
+// Mirrors the keep_dims handling of the generated reductions.
+fl::Tensor reshapeReduced(const fl::Tensor& reduced,
+                          const fl::Shape& base,
+                          const std::vector<int>& axes,
+                          bool keep_dims) {
+  auto axes_set = std::unordered_set<int>(axes.begin(), axes.end());
+  std::vector<fl::Dim> new_shape;
+  for (auto idx = 0; idx < base.ndim(); ++idx) {
+    if (axes_set.count(idx) || (axes_set.size() == 0)) {
+      if (keep_dims) {
+        new_shape.emplace_back(1);
+      }
+      continue;
+    }
+    new_shape.emplace_back(base[idx]);
+  }
+  return fl::reshape(reduced, fl::Shape(new_shape));
+}
+
+std::vector<fl::Tensor> runCommandProgram(std::vector<fl::Tensor> inputs,
+                                          const int64_t* program,
+                                          int64_t program_len,
+                                          const std::vector<int64_t>& outputs) {
+  if (program_len < 1) {
+    throw std::invalid_argument("empty command buffer");
+  }
+  const auto count = program[0];
+  const auto imm_base = 1 + count * kCommandWidth;
+  if (count < 0 || imm_base > program_len) {
+    throw std::invalid_argument("malformed command buffer");
+  }
+  const auto* code = program + 1;
+  const auto* imm = program + imm_base;
+  const auto imm_len = program_len - imm_base;
+
+  // Validate slots up front and record the last reader of every slot so
+  // intermediates can be released as soon as they are dead.
+  int64_t num_slots = inputs.size();
+  for (auto i = 0; i < count; ++i) {
+    const auto* ins = code + i * kCommandWidth;
+    if (ins[1] != num_slots) {
+      throw std::invalid_argument("command buffer slots must be sequential");
+    }
+    num_slots++;
+  }
+  std::vector<int64_t> last_use(num_slots, -1);
+  for (auto i = 0; i < count; ++i) {
+    const auto [a, b] = commandOperands(code + i * kCommandWidth);
+    for (auto operand : {a, b}) {
+      if (operand >= 0 && operand < num_slots) {
+        last_use[operand] = i;
+      }
+    }
+  }
+  for (auto slot : outputs) {
+    if (slot < 0 || slot >= num_slots) {
+      throw std::invalid_argument("command buffer output is out of range");
+    }
+    last_use[slot] = count;
+  }
+
+  std::vector<std::optional<fl::Tensor>> slots(num_slots);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    slots[i] = std::move(inputs[i]);
+  }
+  auto slot = [&](int64_t idx) -> const fl::Tensor& {
+    if (idx < 0 || idx >= num_slots || !slots[idx]) {
+      throw std::invalid_argument("command buffer read an empty slot");
+    }
+    return *slots[idx];
+  };
+
+  for (auto i = 0; i < count; ++i) {
+    const auto* ins = code + i * kCommandWidth;
+    const auto op = static_cast<CommandOp>(ins[0]);
+    const auto a = ins[2];
+    const auto b = ins[3];
+    const auto imm_off = ins[4];
+    const auto imm_count = ins[5];
+    if (imm_off < 0 || imm_count < 0 || imm_off + imm_count > imm_len) {
+      throw std::invalid_argument("command buffer immediate is out of range");
+    }
+    const auto* args = imm + imm_off;
+
+    fl::Tensor out;
+#define UNARY_COMMAND(name, fn) \
+  case CommandOp::name:         \
+    out = fn(slot(a));          \
+    break;
+#define BINARY_COMMAND(name, fn) \
+  case CommandOp::name:          \
+    out = fn(slot(a), slot(b));  \
+    break;
+#define REDUCE_COMMAND(name, fn)                                       \
+  case CommandOp::name: {                                              \
+    const auto& in = slot(a);                                          \
+    auto axes = arrayArg<int>(args, imm_count, rowMajor(), in.ndim()); \
+    out = reshapeReduced(fn(in, axes, b), in.shape(), axes, b);        \
+    break;                                                             \
+  }
+    switch (op) {
+      case CommandOp::kFull: {
+        double val;
+        std::memcpy(&val, &b, sizeof(val));
+        auto shape = arrayArg<long long>(args, imm_count, rowMajor(), false);
+        out = fl::full(fl::Shape(shape), static_cast<float>(val));
+        break;
+      }
+      UNARY_COMMAND(kNegative, fl::negative)
+      UNARY_COMMAND(kExp, fl::exp)
+      UNARY_COMMAND(kLog, fl::log)
+      UNARY_COMMAND(kLog1p, fl::log1p)
+      UNARY_COMMAND(kSin, fl::sin)
+      UNARY_COMMAND(kCos, fl::cos)
+      UNARY_COMMAND(kSqrt, fl::sqrt)
+      UNARY_COMMAND(kTanh, fl::tanh)
+      UNARY_COMMAND(kFloor, fl::floor)
+      UNARY_COMMAND(kCeil, fl::ceil)
+      UNARY_COMMAND(kRint, fl::rint)
+      UNARY_COMMAND(kAbsolute, fl::absolute)
+      UNARY_COMMAND(kSigmoid, fl::sigmoid)
+      UNARY_COMMAND(kErf, fl::erf)
+      BINARY_COMMAND(kAdd, fl::add)
+      BINARY_COMMAND(kSub, fl::sub)
+      BINARY_COMMAND(kMul, fl::mul)
+      BINARY_COMMAND(kDiv, fl::div)
+      BINARY_COMMAND(kMinimum, fl::minimum)
+      BINARY_COMMAND(kMaximum, fl::maximum)
+      BINARY_COMMAND(kPower, fl::power)
+      BINARY_COMMAND(kEq, fl::eq)
+      BINARY_COMMAND(kNeq, fl::neq)
+      BINARY_COMMAND(kLessThan, fl::lessThan)
+      BINARY_COMMAND(kLessThanEqual, fl::lessThanEqual)
+      BINARY_COMMAND(kGreaterThan, fl::greaterThan)
+      BINARY_COMMAND(kGreaterThanEqual, fl::greaterThanEqual)
+      case CommandOp::kMatmul:
+        if (rowMajor()) {
+          out = fl::matmul(slot(b), slot(a));
+        } else {
+          out = fl::matmul(slot(a), slot(b));
+        }
+        break;
+      case CommandOp::kReshape: {
+        auto shape = arrayArg<long long>(args, imm_count, rowMajor(), false);
+        out = fl::reshape(slot(a), fl::Shape(shape));
+        break;
+      }
+      case CommandOp::kTranspose: {
+        const auto& in = slot(a);
+        auto axes =
+            arrayArg<long long>(args, imm_count, rowMajor(), in.ndim());
+        out = fl::transpose(in, fl::Shape(axes));
+        break;
+      }
+      REDUCE_COMMAND(kSum, fl::sum)
+      REDUCE_COMMAND(kMean, fl::mean)
+      REDUCE_COMMAND(kAmin, fl::amin)
+      REDUCE_COMMAND(kAmax, fl::amax)
+      case CommandOp::kAstype:
+        out = slot(a).astype(static_cast<fl::dtype>(b));
+        break;
+      default:
+        throw std::invalid_argument("unknown command buffer opcode " +
+                                    std::to_string(ins[0]));
+    }
+#undef UNARY_COMMAND
+#undef BINARY_COMMAND
+#undef REDUCE_COMMAND
+    slots[ins[1]] = std::move(out);
+
+    const auto [read_a, read_b] = commandOperands(ins);
+    for (auto operand : {read_a, read_b}) {
+      if (operand >= 0 && operand < num_slots && last_use[operand] == i) {
+        slots[operand].reset();
+      }
+    }
+  }
+
+  std::vector<fl::Tensor> results;
+  results.reserve(outputs.size());
+  for (auto idx : outputs) {
+    results.emplace_back(slot(idx));
+  }
+  return results;
+}
+
+// Adds `grad` to the gradient of `input`, summing out broadcast dimensions
+// and converting to the input's dtype as Flashlight's `addGrad` requires.
+void addTapeGrad(fl::Variable& input, const fl::Tensor& grad) {
+  if (!input.isCalcGrad()) {
+    return;
+  }
+  auto g = fl::detail::sumAs(grad, input.shape());
+  if (g.type() != input.type()) {
+    g = g.astype(input.type());
+  }
+  input.addGrad(fl::Variable(g, false));
+}
+
+// `fl::matmul` treats a 1D lhs as a row vector and a 1D rhs as a column
+// vector; the gradients are computed on the promoted operands.
+void matmulTapeGrad(fl::Variable& lhs,
+                    fl::Variable& rhs,
+                    const fl::Tensor& grad) {
+  const auto& lt = lhs.tensor();
+  const auto& rt = rhs.tensor();
+  const auto l =
+      lt.ndim() == 1 ? fl::reshape(lt, fl::Shape({1, lt.dim(0)})) : lt;
+  const auto r =
+      rt.ndim() == 1 ? fl::reshape(rt, fl::Shape({rt.dim(0), 1})) : rt;
+  auto dims = grad.shape().get();
+  if (lt.ndim() == 1) {
+    dims.insert(dims.begin(), 1);
+  }
+  if (rt.ndim() == 1) {
+    dims.insert(dims.begin() + 1, 1);
+  }
+  const auto g = fl::reshape(grad, fl::Shape(dims));
+  if (lhs.isCalcGrad()) {
+    auto dl = fl::matmul(g, r, fl::MatrixProperty::None,
+                         fl::MatrixProperty::Transpose);
+    addTapeGrad(lhs, fl::reshape(fl::detail::sumAs(dl, l.shape()), lt.shape()));
+  }
+  if (rhs.isCalcGrad()) {
+    auto dr = fl::matmul(l, g, fl::MatrixProperty::Transpose,
+                         fl::MatrixProperty::None);
+    addTapeGrad(rhs, fl::reshape(fl::detail::sumAs(dr, r.shape()), rt.shape()));
+  }
+}
+
+// Shape of a reduction's input with the reduced axes kept as 1.
+fl::Shape keptShape(const fl::Shape& base, const std::vector<int>& axes) {
+  auto dims = base.get();
+  for (int idx = 0; idx < static_cast<int>(dims.size()); ++idx) {
+    if (axes.empty() || std::count(axes.begin(), axes.end(), idx)) {
+      dims[idx] = 1;
+    }
+  }
+  return fl::Shape(dims);
+}
+
+// A node of the native tape: the op, its forward result, the axes of
+// transposes and reductions (in Flashlight order) and whether a matmul ran
+// with its operands swapped (row major).
+struct TapeNode {
+  CommandOp op;
+  fl::Tensor out;
+  std::vector<long long> axes;
+  bool swap_matmul;
+};
+
+// d/dx erf(x) = 2 / sqrt(pi) * exp(-x^2)
+constexpr double kTwoOverSqrtPi = 1.1283791670955126;
+
+bool tapeUnary(CommandOp op) {
+  switch (op) {
+    case CommandOp::kFloor:
+    case CommandOp::kCeil:
+    case CommandOp::kRint:
+      return false;
+    case CommandOp::kReshape:
+    case CommandOp::kTranspose:
+    case CommandOp::kSum:
+    case CommandOp::kMean:
+      return true;
+    default:
+      return op >= CommandOp::kNegative && op <= CommandOp::kErf;
+  }
+}
+
+bool tapeBinary(CommandOp op) {
+  return (op >= CommandOp::kAdd && op <= CommandOp::kPower) ||
+         op == CommandOp::kMatmul;
+}
+
+void tapeGradient(const TapeNode& node,
+                  std::vector<fl::Variable>& inputs,
+                  const fl::Variable& grad_output) {
+  const auto& g = grad_output.tensor();
+  const auto& y = node.out;
+  auto& va = inputs[0];
+  const auto& a = va.tensor();
+  switch (node.op) {
+    case CommandOp::kNegative:
+      addTapeGrad(va, -g);
+      return;
+    case CommandOp::kExp:
+      addTapeGrad(va, g * y);
+      return;
+    case CommandOp::kLog:
+      addTapeGrad(va, g / a);
+      return;
+    case CommandOp::kLog1p:
+      addTapeGrad(va, g / (a + 1));
+      return;
+    case CommandOp::kSin:
+      addTapeGrad(va, g * fl::cos(a));
+      return;
+    case CommandOp::kCos:
+      addTapeGrad(va, -g * fl::sin(a));
+      return;
+    case CommandOp::kSqrt:
+      addTapeGrad(va, g / (y * 2));
+      return;
+    case CommandOp::kTanh:
+      addTapeGrad(va, g * (1 - y * y));
+      return;
+    case CommandOp::kAbsolute:
+      addTapeGrad(va, g * fl::sign(a));
+      return;
+    case CommandOp::kSigmoid:
+      addTapeGrad(va, g * y * (1 - y));
+      return;
+    case CommandOp::kErf:
+      addTapeGrad(va, g * kTwoOverSqrtPi * fl::exp(-(a * a)));
+      return;
+    case CommandOp::kReshape:
+      addTapeGrad(va, fl::reshape(g, a.shape()));
+      return;
+    case CommandOp::kTranspose: {
+      std::vector<long long> inverse(node.axes.size());
+      for (size_t i = 0; i < node.axes.size(); ++i) {
+        inverse[node.axes[i]] = i;
+      }
+      addTapeGrad(va, fl::transpose(g, fl::Shape(inverse)));
+      return;
+    }
+    case CommandOp::kSum:
+    case CommandOp::kMean: {
+      const std::vector<int> axes(node.axes.begin(), node.axes.end());
+      const auto kept = keptShape(a.shape(), axes);
+      auto spread = fl::detail::tileAs(fl::reshape(g, kept), a.shape());
+      if (node.op == CommandOp::kMean) {
+        spread = spread / static_cast<double>(a.elements() / g.elements());
+      }
+      addTapeGrad(va, spread);
+      return;
+    }
+    default:
+      break;
+  }
+
+  // Gradients of constant inputs are skipped rather than computed and then
+  // dropped by `addTapeGrad`.
+  auto& vb = inputs[1];
+  const auto& b = vb.tensor();
+  const bool da = va.isCalcGrad();
+  const bool db = vb.isCalcGrad();
+  switch (node.op) {
+    case CommandOp::kAdd:
+      addTapeGrad(va, g);
+      addTapeGrad(vb, g);
+      return;
+    case CommandOp::kSub:
+      addTapeGrad(va, g);
+      if (db) {
+        addTapeGrad(vb, -g);
+      }
+      return;
+    case CommandOp::kMul:
+      if (da) {
+        addTapeGrad(va, g * b);
+      }
+      if (db) {
+        addTapeGrad(vb, g * a);
+      }
+      return;
+    case CommandOp::kDiv:
+      if (da) {
+        addTapeGrad(va, g / b);
+      }
+      if (db) {
+        addTapeGrad(vb, -g * y / b);
+      }
+      return;
+    case CommandOp::kMinimum:
+    case CommandOp::kMaximum: {
+      const auto mask =
+          (node.op == CommandOp::kMinimum ? a < b : a > b).astype(g.type());
+      if (da) {
+        addTapeGrad(va, g * mask);
+      }
+      if (db) {
+        addTapeGrad(vb, g * (1 - mask));
+      }
+      return;
+    }
+    case CommandOp::kPower:
+      if (da) {
+        addTapeGrad(va, g * b * fl::power(a, b - 1));
+      }
+      if (db) {
+        addTapeGrad(vb, g * y * fl::log(a));
+      }
+      return;
+    case CommandOp::kMatmul:
+      if (node.swap_matmul) {
+        matmulTapeGrad(vb, va, g);
+      } else {
+        matmulTapeGrad(va, vb, g);
+      }
+      return;
+    default:
+      throw std::logic_error("unreachable native tape opcode");
+  }
+}
+
+// Runs the backward pass of a graph recorded in JS (see `backward` in
+// shumai/tensor/tensor.ts) in one call.  The program reuses the command
+// buffer layout
+//
+//   [num_nodes, (op, out, a, b, imm_offset, imm_len) * n, immediates]
+//
+// but `out`, `a` and `b` index `tensors`, which holds the forward result of
+// every node and everything the nodes read (`b` is -1 for unary ops, shapes
+// and axes live in the immediates).  Nodes come in forward order and the last
+// one is differentiated.  Each node becomes an `fl::Variable` holding its
+// forward result and a gradient function, so Flashlight's autograd sorts the
+// graph and accumulates the gradients.  Returns the gradients of `wanted`,
+// which also marks the leaves to differentiate (empty where none reached).
+std::vector<std::optional<fl::Tensor>> runTape(
+    const std::vector<fl::Tensor>& tensors,
+    const int64_t* program,
+    int64_t program_len,
+    const fl::Tensor& jacobian,
+    const std::vector<int64_t>& wanted) {
+  if (program_len < 1 || program[0] < 1) {
+    throw std::invalid_argument("empty native tape");
+  }
+  const auto count = program[0];
+  const auto imm_base = 1 + count * kCommandWidth;
+  if (imm_base > program_len) {
+    throw std::invalid_argument("malformed native tape");
+  }
+  const auto* code = program + 1;
+  const auto* imm = program + imm_base;
+  const auto imm_len = program_len - imm_base;
+  const int64_t num_tensors = tensors.size();
+
+  std::vector<bool> leaf_grad(num_tensors, false);
+  for (auto idx : wanted) {
+    if (idx < 0 || idx >= num_tensors) {
+      throw std::invalid_argument("native tape gradient is out of range");
+    }
+    leaf_grad[idx] = true;
+  }
+  std::vector<std::optional<fl::Variable>> vars(num_tensors);
+  auto var = [&](int64_t idx) -> fl::Variable& {
+    if (idx < 0 || idx >= num_tensors) {
+      throw std::invalid_argument("native tape read an invalid tensor");
+    }
+    if (!vars[idx]) {
+      vars[idx] = fl::Variable(tensors[idx], leaf_grad[idx]);
+    }
+    return *vars[idx];
+  };
+
+  for (auto i = 0; i < count; ++i) {
+    const auto* ins = code + i * kCommandWidth;
+    const auto out = ins[1];
+    const auto imm_off = ins[4];
+    const auto imm_count = ins[5];
+    if (out < 0 || out >= num_tensors || vars[out]) {
+      throw std::invalid_argument("native tape outputs must be fresh");
+    }
+    if (imm_off < 0 || imm_count < 0 || imm_off + imm_count > imm_len) {
+      throw std::invalid_argument("native tape immediate is out of range");
+    }
+    TapeNode node{static_cast<CommandOp>(ins[0]), tensors[out], {}, rowMajor()};
+    if (!tapeUnary(node.op) && !tapeBinary(node.op)) {
+      throw std::invalid_argument("native tape cannot differentiate opcode " +
+                                  std::to_string(ins[0]));
+    }
+    std::vector<fl::Variable> inputs{var(ins[2])};
+    if (tapeBinary(node.op)) {
+      inputs.push_back(var(ins[3]));
+    } else if (node.op == CommandOp::kTranspose ||
+               node.op == CommandOp::kSum || node.op == CommandOp::kMean) {
+      node.axes = arrayArg<long long>(imm + imm_off, imm_count, rowMajor(),
+                                      inputs[0].tensor().ndim());
+    }
+    vars[out] = fl::Variable(
+        tensors[out], std::move(inputs),
+        [node = std::move(node)](std::vector<fl::Variable>& deps,
+                                 const fl::Variable& grad) {
+          tapeGradient(node, deps, grad);
+        });
+  }
+
+  auto& root = *vars[code[(count - 1) * kCommandWidth + 1]];
+  if (jacobian.elements() != root.tensor().elements()) {
+    throw std::invalid_argument("jacobian does not match the tape's output");
+  }
+  auto seed = fl::reshape(jacobian, root.shape());
+  if (seed.type() != root.type()) {
+    seed = seed.astype(root.type());
+  }
+  root.backward(fl::Variable(seed, false));
+
+  std::vector<std::optional<fl::Tensor>> grads;
+  grads.reserve(wanted.size());
+  for (auto idx : wanted) {
+    if (vars[idx] && vars[idx]->isGradAvailable()) {
+      grads.emplace_back(vars[idx]->grad().tensor());
+    } else {
+      grads.emplace_back();
+    }
+  }
+  return grads;
+}
+
+// Backing storage for an ArrayBuffer handed to JS by `_hostView`.  `tensor`
+// either shares the source tensor's buffer (borrowed) or holds the result of a
+// single cast+copy.  Host-resident data stays locked until JS releases the
+// view; device-resident data is copied into `copy`.
+struct HostView {
+  fl::Tensor tensor;
+  bool locked = false;
+  std::vector<uint8_t> copy;
+};
+
+void* lockHostData(const fl::Tensor& tensor) {
+#define X(fl_type, real_type) \
+  case fl::dtype::fl_type:    \
+    return tensor.device<real_type>();
+  switch (tensor.type()) {
+    X(f32, float)
+    X(f64, double)
+    X(b8, char)
+    X(s16, int16_t)
+    X(s32, int32_t)
+    X(s64, int64_t)
+    X(u8, uint8_t)
+    X(u16, uint16_t)
+    X(u32, uint32_t)
+    X(u64, uint64_t)
+    default:
+      throw std::invalid_argument("unsupported datatype for host views");
+  }
+#undef X
+}
+
 extern "C" {
+// Safe to call from every thread (each Bun worker loads the library again);
+// only the first call initializes Flashlight.
 void init() {
-  fl::init();
+  static std::once_flag initialized;
+  std::call_once(initialized, [] {
+    fl::init();
+    shumai::installMemoryManager();
+  });
 }
 
 size_t bytesUsed() {
-  return g_bytes_used;
+  return shumai::bytesUsed();
+}
+
+size_t bytesPeak() {
+  return shumai::bytesPeak();
+}
+
+void resetBytesPeak() {
+  shumai::resetBytesPeak();
+}
+
+int64_t liveTensors() {
+  return shumai::liveTensors();
+}
+
+int64_t threadTensors() {
+  return shumai::threadTensors();
+}
+
+int64_t threadTensorBytes() {
+  return shumai::threadTensorBytes();
+}
+
+// Writes the logical bytes of live tensors for every dtype (indexed by its
+// fl::dtype value) into `out` and returns how many entries were written.
+int64_t bytesByDtype(void* out, int64_t out_len) {
+  auto* values = reinterpret_cast<int64_t*>(out);
+  const int64_t count = std::min<int64_t>(out_len, shumai::kNumDtypes);
+  for (int64_t i = 0; i < count; ++i) {
+    values[i] = shumai::tensorBytes(static_cast<fl::dtype>(i));
+  }
+  return count;
+}
+
+size_t bytesShared() {
+  return shumai::adoptedBytes();
+}
+
+size_t bytesReserved() {
+  return shumai::bytesReserved();
+}
+
+size_t bytesInUse() {
+  return shumai::bytesInUse();
+}
+
+void emptyCache() {
+  shumai::emptyCache();
+}
+
+void setCacheHighWaterMark(size_t bytes) {
+  shumai::setCacheHighWaterMark(bytes);
+}
+
+size_t cacheHighWaterMark() {
+  return shumai::cacheHighWaterMark();
+}
+
+// Writes [live, capacity, slabs, allocations, reused] of the tensor handle
+// pool into `out` and returns how many entries were written.
+int64_t tensorHandleStats(void* out, int64_t out_len) {
+  const auto stats = shumai::handleStats();
+  const int64_t values[] = {stats.live, stats.capacity, stats.slabs,
+                            stats.allocations, stats.reused};
+  const int64_t count =
+      std::min<int64_t>(out_len, sizeof(values) / sizeof(values[0]));
+  std::memcpy(out, values, count * sizeof(int64_t));
+  return count;
+}
+
+bool canAdoptBuffers() {
+  return shumai::hostIsDevice();
+}
+
+// Wraps `ptr` without copying.  The caller keeps the memory alive until the
+// pointer is reported by `drainAdoptedBuffers`.
+void* tensorAdoptBuffer(int64_t numel, int type, void* ptr) {
+  try {
+    if (!shumai::hostIsDevice()) {
+      throw std::runtime_error("this backend cannot adopt host buffers");
+    }
+    const auto dtype = static_cast<fl::dtype>(type);
+    const auto bytes = numel * fl::getTypeSize(dtype);
+    shumai::adoptBuffer(ptr, bytes);
+    try {
+      return shumai::newTensor(fl::Shape({numel}), dtype, ptr,
+                               fl::MemoryLocation::Device);
+    } catch (...) {
+      shumai::forgetBuffer(ptr);
+      throw;
+    }
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+int64_t drainAdoptedBuffers(void* out, int64_t out_len) {
+  return shumai::drainReleasedBuffers(reinterpret_cast<int64_t*>(out),
+                                      out_len);
+}
+
+// Size of the wire record of a tensor (see wire.h), or -1 on failure.
+int64_t _encodedSize(void* t, int64_t encoding) {
+  try {
+    return shumai::encodedSize(*reinterpret_cast<fl::Tensor*>(t), encoding);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Writes the wire record of a tensor to `buffer` and returns its size, or -1
+// on failure.  `residual` (a tensor updated in place) may be null.
+int64_t _encodeInto(void* t,
+                    void* buffer,
+                    int64_t capacity,
+                    int64_t encoding,
+                    void* residual) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    return shumai::encodeInto(*tensor, buffer, capacity, encoding,
+                              reinterpret_cast<fl::Tensor*>(residual));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Decodes the wire record at `buffer`.  When its data was adopted rather than
+// copied, the pointer (reported by `drainAdoptedBuffers` once released) is
+// written to `adopted_out`, and 0 otherwise.
+void* _decode(void* buffer, int64_t length, bool adopt, void* adopted_out) {
+  try {
+    void* adopted = nullptr;
+    auto tensor = shumai::decode(buffer, length, adopt, &adopted);
+    try {
+      auto* handle = shumai::newTensor(std::move(tensor));
+      *reinterpret_cast<int64_t*>(adopted_out) =
+          reinterpret_cast<int64_t>(adopted);
+      return handle;
+    } catch (...) {
+      if (adopted) {
+        shumai::forgetBuffer(adopted);
+      }
+      throw;
+    }
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Writes the header of the raw wire record of a tensor (the record without
+// its data) and returns its size, or -1 on failure.
+int64_t _encodeHeader(void* t, void* buffer, int64_t capacity) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    return shumai::encodeHeader(*tensor, buffer, capacity);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Allocates the (uninitialized) tensor of a raw record header, to be filled
+// with `_writeAt`.
+void* _decodeHeader(void* buffer, int64_t length) {
+  try {
+    return shumai::newTensor(shumai::decodeHeader(buffer, length));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Copies `length` bytes of tensor data at byte `offset` to `out`.  Returns 0,
+// or -1 on failure.
+int64_t _readAt(void* t, int64_t offset, void* out, int64_t length) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    shumai::readData(*tensor, offset, out, length);
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Copies `length` bytes from `data` into tensor data at byte `offset`.
+// Returns 0, or -1 on failure.
+int64_t _writeAt(void* t, int64_t offset, void* data, int64_t length) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    shumai::writeData(*tensor, offset, data, length);
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
 }
 
 void* createTensor(void* shape_ptr, int64_t shape_len) {
   try {
-    LOCK_GUARD
     static_assert(sizeof(long long) == sizeof(int64_t));
-    auto shape = arrayArg<long long>(shape_ptr, shape_len, g_row_major, false);
-    auto* t = new fl::Tensor(fl::Shape(shape));
-    g_bytes_used += t->bytes();
-    return t;
+    auto shape = arrayArg<long long>(shape_ptr, shape_len, rowMajor(), false);
+    return shumai::newTensor(fl::Shape(shape));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -115,7 +951,7 @@ void* fromDLTensor(void* ptr) {
   auto* dlmtensor = (DLManagedTensor*)ptr;
   auto& dltensor = dlmtensor->dl_tensor;
   auto shape =
-      arrayArg<long long>(dltensor.shape, dltensor.ndim, g_row_major, false);
+      arrayArg<long long>(dltensor.shape, dltensor.ndim, rowMajor(), false);
   auto dtype = dltensor.dtype;
   // TODO utilize the device ID
   auto location = (dltensor.device.device_type == kDLCPU)
@@ -164,26 +1000,22 @@ void* fromDLTensor(void* ptr) {
   if (error) {
     HANDLE_EXCEPTION("Unsupported datatype in DLTensor");
   }
-  auto* t = new fl::Tensor(tensor);
-  g_bytes_used += t->bytes();
-  return t;
+  return shumai::newTensor(tensor);
 }
 
 void deleteDLTensor(struct DLManagedTensor* self) {
   auto* tensor = reinterpret_cast<fl::Tensor*>(self->manager_ctx);
-  g_bytes_used -= tensor->bytes();
   tensor->unlock();
-  delete tensor;
+  shumai::deleteTensor(tensor);
   delete self->dl_tensor.shape;
   delete self;
 }
 
 void* toDLTensor(void* ptr) {
-  LOCK_GUARD
   DLManagedTensor* dlmtensor = new DLManagedTensor();
   DLTensor& dltensor = dlmtensor->dl_tensor;
   const auto* tensor =
-      new fl::Tensor(reinterpret_cast<fl::Tensor*>(ptr)->copy());
+      shumai::newTensor(reinterpret_cast<fl::Tensor*>(ptr)->copy());
 #define X(fl_prefix, dl_type, real_type, bits)   \
   case fl::dtype::fl_prefix##bits: {             \
     dltensor.data = tensor->device<real_type>(); \
@@ -212,7 +1044,7 @@ void* toDLTensor(void* ptr) {
     dltensor.device.device_type = kDLCUDA;
   }
   for (auto i = 0; i < ndim; ++i) {
-    const auto fl_i = g_row_major ? ndim - 1 - i : i;
+    const auto fl_i = rowMajor() ? ndim - 1 - i : i;
     dltensor.shape[i] = tensor->shape()[fl_i];
   }
   dlmtensor->manager_ctx = (void*)tensor;
@@ -222,12 +1054,9 @@ void* toDLTensor(void* ptr) {
 
 void* tensorFromFloat16Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(
+    return shumai::newTensor(
         fl::Tensor::fromBuffer({numel}, (float*)ptr, fl::MemoryLocation::Host)
             .astype(fl::dtype::f16));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -237,11 +1066,8 @@ void* tensorFromFloat16Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromFloat32Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(
-        fl::Tensor::fromBuffer({numel}, (float*)ptr, fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (float*)ptr,
+                                                    fl::MemoryLocation::Host));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -251,11 +1077,8 @@ void* tensorFromFloat32Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromFloat64Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (double*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (double*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -265,11 +1088,8 @@ void* tensorFromFloat64Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromInt8Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(
-        fl::Tensor::fromBuffer({numel}, (char*)ptr, fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (char*)ptr,
+                                                    fl::MemoryLocation::Host));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -279,11 +1099,8 @@ void* tensorFromInt8Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromInt16Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (int16_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (int16_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -293,11 +1110,8 @@ void* tensorFromInt16Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromInt32Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (int32_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (int32_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -307,11 +1121,8 @@ void* tensorFromInt32Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromInt64Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (int64_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (int64_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -321,11 +1132,8 @@ void* tensorFromInt64Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromUint8Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (uint8_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (uint8_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -335,11 +1143,8 @@ void* tensorFromUint8Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromUint16Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (uint16_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (uint16_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -349,11 +1154,8 @@ void* tensorFromUint16Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromUint32Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (uint32_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (uint32_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -363,11 +1165,8 @@ void* tensorFromUint32Buffer(int64_t numel, void* ptr) {
 
 void* tensorFromUint64Buffer(int64_t numel, void* ptr) {
   try {
-    LOCK_GUARD
-    auto* t = new fl::Tensor(fl::Tensor::fromBuffer({numel}, (uint64_t*)ptr,
+    return shumai::newTensor(fl::Tensor::fromBuffer({numel}, (uint64_t*)ptr,
                                                     fl::MemoryLocation::Host));
-    g_bytes_used += t->bytes();
-    return t;
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -376,18 +1175,15 @@ void* tensorFromUint64Buffer(int64_t numel, void* ptr) {
 }
 
 void destroyTensor(void* t, void* /*ignore*/) {
-  LOCK_GUARD
-  auto* tensor = reinterpret_cast<fl::Tensor*>(t);
-  if (tensor->hasAdapter()) {
-    g_bytes_used -= tensor->bytes();
-  }
-  delete tensor;
+  shumai::deleteTensor(reinterpret_cast<fl::Tensor*>(t));
 }
 
 void dispose(void* t) {
-  LOCK_GUARD
   auto& tensor = *reinterpret_cast<fl::Tensor*>(t);
-  g_bytes_used -= tensor.bytes();
+  if (!tensor.hasAdapter()) {
+    return;
+  }
+  shumai::untrackTensor(tensor);
   fl::detail::releaseAdapterUnsafe(tensor);
 }
 
@@ -398,24 +1194,28 @@ JSTypedArrayBytesDeallocator genTensorDestroyer() {
   return destroyTensor;
 }
 
+// The layout is a property of the calling thread's execution context.
 void setRowMajor() {
-  g_row_major = true;
+  if (auto* ctx = shumai::currentContext()) {
+    ctx->row_major = true;
+  }
 }
 
 void setColMajor() {
-  g_row_major = false;
+  if (auto* ctx = shumai::currentContext()) {
+    ctx->row_major = false;
+  }
 }
 
 bool isRowMajor() {
-  return g_row_major;
+  return rowMajor();
 }
 
 bool isColMajor() {
-  return !g_row_major;
+  return !rowMajor();
 }
 
 void _save(void* t, void* cstr_ptr, int length) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   const char* cstr = reinterpret_cast<char*>(cstr_ptr);
   auto filename = std::string(cstr, length);
@@ -424,14 +1224,39 @@ void _save(void* t, void* cstr_ptr, int length) {
 
 void* load(void* cstr_ptr, int length) {
   try {
-    LOCK_GUARD
     const char* cstr = reinterpret_cast<char*>(cstr_ptr);
     auto filename = std::string(cstr, length);
+    if (shumai::isRawFile(filename)) {
+      return shumai::newTensor(shumai::loadRaw(filename, false));
+    }
     fl::Tensor tensor;
     fl::load(filename, tensor);
-    auto* t = new fl::Tensor(tensor);
-    g_bytes_used += t->bytes();
-    return t;
+    return shumai::newTensor(tensor);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Returns the size of the written file, or -1 on failure.
+int64_t _saveRaw(void* t, void* cstr_ptr, int length) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    const char* cstr = reinterpret_cast<char*>(cstr_ptr);
+    return shumai::saveRaw(*tensor, std::string(cstr, length));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+void* _loadRaw(void* cstr_ptr, int length, bool verify) {
+  try {
+    const char* cstr = reinterpret_cast<char*>(cstr_ptr);
+    return shumai::newTensor(
+        shumai::loadRaw(std::string(cstr, length), verify));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -439,51 +1264,126 @@ void* load(void* cstr_ptr, int length) {
   }
 }
 
+// Queues a save on the background writer (see save_queue.h) and returns its
+// ticket for `_flushSaves`, or -1 on failure.
+int64_t _saveAsync(void* t, void* cstr_ptr, int length, bool raw) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    const char* cstr = reinterpret_cast<char*>(cstr_ptr);
+    return shumai::saveAsync(*tensor, std::string(cstr, length), raw);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Returns 0 once the save with `ticket` (all saves for 0) is written, or -1
+// if a save failed.
+int64_t _flushSaves(int64_t ticket) {
+  try {
+    shumai::flushSaves(ticket);
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Queues `data` to be written to the file after the saves queued before it,
+// unless one of the `after_len` saves in `after` failed.
+int64_t _writeAsync(void* cstr_ptr,
+                    int length,
+                    void* data,
+                    int64_t data_len,
+                    void* after,
+                    int64_t after_len) {
+  try {
+    const char* cstr = reinterpret_cast<char*>(cstr_ptr);
+    return shumai::writeAsync(
+        std::string(cstr, length),
+        std::string(reinterpret_cast<char*>(data), data_len),
+        arrayArg<int64_t>(after, after_len, false, false));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// 0 while the save with `ticket` is pending, 1 once written, -1 if it failed.
+int64_t _saveStatus(int64_t ticket) {
+  return shumai::saveStatus(ticket);
+}
+
+int64_t pendingSaves() {
+  return shumai::pendingSaves();
+}
+
+// Returns 0 on failure.
+uint64_t _contentHash(void* t) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    return shumai::contentHash(*tensor);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), 0);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", 0);
+  }
+}
+
 void _eval(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   fl::eval(*tensor);
 }
 
 size_t _elements(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->elements();
 }
 
 size_t _bytes(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->bytes();
 }
 
+// Bytes of the distinct buffers behind an array of tensor handles (see
+// shumai::uniqueBytes).  Returns 0 on error.
+size_t _uniqueBytes(void* tensors_ptr, int64_t tensors_len) {
+  try {
+    return shumai::uniqueBytes(
+        ptrArrayArg<fl::Tensor>(tensors_ptr, tensors_len));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), 0);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", 0);
+  }
+}
+
 int _shape(void* t, void* out, int out_len) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   if (out_len != tensor->ndim()) {
     return -1;
   }
   for (auto i = 0; i < out_len; ++i) {
-    const auto idx = g_row_major ? out_len - i - 1 : i;
+    const auto idx = rowMajor() ? out_len - i - 1 : i;
     reinterpret_cast<int64_t*>(out)[i] = tensor->shape()[idx];
   }
   return 0;
 }
 
 int _ndim(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->ndim();
 }
 
 void* _astype(void* t, int type) {
   try {
-    LOCK_GUARD
     auto dtype = static_cast<fl::dtype>(type);
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     auto new_tensor = tensor->astype(dtype);
-    g_bytes_used += new_tensor.bytes();
-    return new fl::Tensor(new_tensor);
+    return shumai::newTensor(new_tensor);
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -553,7 +1453,6 @@ int dtypeUint64() {
 
 float* _float16Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::f32).host<float>();
   } catch (std::exception const& e) {
@@ -565,7 +1464,6 @@ float* _float16Buffer(void* t) {
 
 float* _float32Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::f32).host<float>();
   } catch (std::exception const& e) {
@@ -577,7 +1475,6 @@ float* _float32Buffer(void* t) {
 
 float* _float64Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::f64).host<float>();
   } catch (std::exception const& e) {
@@ -589,7 +1486,6 @@ float* _float64Buffer(void* t) {
 
 int* _boolInt8Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::b8).host<int>();
   } catch (std::exception const& e) {
@@ -601,7 +1497,6 @@ int* _boolInt8Buffer(void* t) {
 
 int* _int16Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::s16).host<int>();
   } catch (std::exception const& e) {
@@ -613,7 +1508,6 @@ int* _int16Buffer(void* t) {
 
 int* _int32Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::s32).host<int>();
   } catch (std::exception const& e) {
@@ -625,7 +1519,6 @@ int* _int32Buffer(void* t) {
 
 int* _int64Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::s64).host<int>();
   } catch (std::exception const& e) {
@@ -637,7 +1530,6 @@ int* _int64Buffer(void* t) {
 
 unsigned* _uint8Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::u8).host<unsigned>();
   } catch (std::exception const& e) {
@@ -649,7 +1541,6 @@ unsigned* _uint8Buffer(void* t) {
 
 unsigned* _uint16Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::u16).host<unsigned>();
   } catch (std::exception const& e) {
@@ -661,7 +1552,6 @@ unsigned* _uint16Buffer(void* t) {
 
 unsigned* _uint32Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::u32).host<unsigned>();
   } catch (std::exception const& e) {
@@ -673,7 +1563,6 @@ unsigned* _uint32Buffer(void* t) {
 
 unsigned* _uint64Buffer(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     return tensor->astype(fl::dtype::u64).host<unsigned>();
   } catch (std::exception const& e) {
@@ -683,75 +1572,119 @@ unsigned* _uint64Buffer(void* t) {
   }
 }
 
+// Exposes the tensor's data as host memory for readback.  When the tensor
+// already has the requested dtype, is contiguous and lives on the host, the
+// existing buffer is borrowed; otherwise a single fused cast+copy is made.
+// The data pointer is written to `data_out` and the returned view must be
+// released with the deallocator from `genHostViewDestroyer`.
+void* _hostView(void* t, int type, void* data_out) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    const auto dtype = static_cast<fl::dtype>(type);
+    auto* data = reinterpret_cast<int64_t*>(data_out);
+    auto view = std::make_unique<HostView>();
+    if (tensor->type() == dtype && tensor->isContiguous() &&
+        tensor->location() == fl::MemoryLocation::Host) {
+      // Locking an unshared buffer hands out its pointer without copying, the
+      // shallow copy keeps it alive after the source handle is destroyed.
+      data[0] = reinterpret_cast<int64_t>(lockHostData(*tensor));
+      view->tensor = *tensor;
+      view->locked = true;
+      return view.release();
+    }
+    if (tensor->type() == dtype) {
+      view->tensor = tensor->asContiguousTensor();
+    } else {
+      view->tensor = tensor->astype(dtype);
+      if (!view->tensor.isContiguous()) {
+        view->tensor = view->tensor.asContiguousTensor();
+      }
+    }
+    if (view->tensor.location() == fl::MemoryLocation::Host) {
+      data[0] = reinterpret_cast<int64_t>(lockHostData(view->tensor));
+      view->locked = true;
+    } else {
+      view->copy.resize(view->tensor.bytes());
+      view->tensor.host(view->copy.data());
+      data[0] = reinterpret_cast<int64_t>(view->copy.data());
+    }
+    return view.release();
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void destroyHostView(void* /*bytes*/, void* ctx) {
+  auto* view = reinterpret_cast<HostView*>(ctx);
+  if (view->locked) {
+    view->tensor.unlock();
+  }
+  delete view;
+}
+
+JSTypedArrayBytesDeallocator genHostViewDestroyer() {
+  return destroyHostView;
+}
+
 float _float16Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<float>();
 }
 
 float _float32Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<float>();
 }
 
 float _float64Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<float>();
 }
 
 char _boolInt8Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<char>();
 }
 
 int16_t _int16Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<int16_t>();
 }
 
 int32_t _int32Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<int32_t>();
 }
 
 int64_t _int64Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<int64_t>();
 }
 
 uint8_t _uint8Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<uint8_t>();
 }
 
 uint16_t _uint16Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<uint16_t>();
 }
 
 uint32_t _uint32Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<uint32_t>();
 }
 
 uint64_t _uint64Scalar(void* t) {
-  LOCK_GUARD
   auto* tensor = reinterpret_cast<fl::Tensor*>(t);
   return tensor->asScalar<uint64_t>();
 }
 
 void* _index(void* t, void* args_ptr, int64_t args_len) {
   try {
-    LOCK_GUARD
     auto args = arrayArg<int64_t>(args_ptr, args_len, false, false);
     std::vector<int64_t> start;
     std::vector<int64_t> end;
@@ -760,7 +1693,7 @@ void* _index(void* t, void* args_ptr, int64_t args_len) {
       throw std::exception();
     }
     for (auto i = 0; i < (args.size() - 2); i += 3) {
-      if (g_row_major) {
+      if (rowMajor()) {
         start.emplace(start.begin(), args[i + 0]);
         end.emplace(end.begin(), args[i + 1]);
         stride.emplace(stride.begin(), args[i + 2]);
@@ -793,9 +1726,7 @@ void* _index(void* t, void* args_ptr, int64_t args_len) {
         }
       }
     }
-    auto* new_tensor = new fl::Tensor(tensor->operator()(indices));
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    return shumai::newTensor(tensor->operator()(indices));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -803,48 +1734,49 @@ void* _index(void* t, void* args_ptr, int64_t args_len) {
   }
 }
 
-void* _indexedAssign(void* t, void* other, void* args_ptr, int64_t args_len) {
-  try {
-    LOCK_GUARD
-    auto args = arrayArg<int64_t>(args_ptr, args_len, false, false);
-    std::vector<int64_t> start;
-    std::vector<int64_t> end;
-    std::vector<int64_t> stride;
-    if (args.size() % 3 != 0) {
-      throw std::exception();
-    }
-    for (auto i = 0; i < (args.size() - 2); i += 3) {
-      if (g_row_major) {
-        start.emplace(start.begin(), args[i + 0]);
-        end.emplace(end.begin(), args[i + 1]);
-        stride.emplace(stride.begin(), args[i + 2]);
-      } else {
-        start.emplace_back(args[i + 0]);
-        end.emplace_back(args[i + 1]);
-        stride.emplace_back(args[i + 2]);
-      }
+std::vector<fl::Index> assignIndices(void* args_ptr, int64_t args_len) {
+  auto args = arrayArg<int64_t>(args_ptr, args_len, false, false);
+  std::vector<int64_t> start;
+  std::vector<int64_t> end;
+  std::vector<int64_t> stride;
+  if (args.size() % 3 != 0) {
+    throw std::exception();
+  }
+  for (auto i = 0; i < (args.size() - 2); i += 3) {
+    if (rowMajor()) {
+      start.emplace(start.begin(), args[i + 0]);
+      end.emplace(end.begin(), args[i + 1]);
+      stride.emplace(stride.begin(), args[i + 2]);
+    } else {
+      start.emplace_back(args[i + 0]);
+      end.emplace_back(args[i + 1]);
+      stride.emplace_back(args[i + 2]);
     }
+  }
 
-    std::vector<fl::Index> indices;
-    indices.reserve(start.size());
-    for (auto i = 0; i < start.size(); ++i) {
-      if (start[i] == -1 && end[i] == -1) {
-        indices.emplace_back(fl::span);
-      } else if (start[i] + 1 == end[i]) {
-        indices.emplace_back(start[i]);
-      } else {
-        indices.emplace_back(
-            fl::range(start[i], end[i], stride.size() ? stride[i] : 1));
-      }
+  std::vector<fl::Index> indices;
+  indices.reserve(start.size());
+  for (auto i = 0; i < start.size(); ++i) {
+    if (start[i] == -1 && end[i] == -1) {
+      indices.emplace_back(fl::span);
+    } else if (start[i] + 1 == end[i]) {
+      indices.emplace_back(start[i]);
+    } else {
+      indices.emplace_back(
+          fl::range(start[i], end[i], stride.size() ? stride[i] : 1));
     }
+  }
+  return indices;
+}
+
+void* _indexedAssign(void* t, void* other, void* args_ptr, int64_t args_len) {
+  try {
+    auto indices = assignIndices(args_ptr, args_len);
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
     auto new_t = tensor->copy();
     auto* assign = reinterpret_cast<fl::Tensor*>(other);
-    new_t(indices) *= 0;
-    new_t(indices) += *assign;
-    auto* new_tensor = new fl::Tensor(new_t);
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    new_t(indices) = *assign;
+    return shumai::newTensor(new_t);
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -852,13 +1784,40 @@ void* _indexedAssign(void* t, void* other, void* args_ptr, int64_t args_len) {
   }
 }
 
+// Writes `other` into the indexed region of `t` itself, touching only that
+// region.  ArrayFire copies the buffer first if other arrays (views, borrowed
+// host views) still share it; adopted JS memory is never written to.
+int64_t _indexedAssignInPlace(void* t,
+                              void* other,
+                              void* args_ptr,
+                              int64_t args_len) {
+  try {
+    auto indices = assignIndices(args_ptr, args_len);
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    auto* assign = reinterpret_cast<fl::Tensor*>(other);
+    if (shumai::hostIsDevice() && tensor->elements()) {
+      // device() hands out the buffer the assignment will write to, after
+      // making it unique to this tensor.
+      void* data = nullptr;
+      tensor->device(&data);
+      tensor->unlock();
+      if (shumai::isAdopted(data)) {
+        *tensor = tensor->copy();
+      }
+    }
+    (*tensor)(indices) = *assign;
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
 void* _flatten(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
-    auto* new_tensor = new fl::Tensor(tensor->flatten());
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    return shumai::newTensor(tensor->flatten());
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -868,11 +1827,8 @@ void* _flatten(void* t) {
 
 void* _asContiguousTensor(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
-    auto* new_tensor = new fl::Tensor(tensor->asContiguousTensor());
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    return shumai::newTensor(tensor->asContiguousTensor());
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -882,11 +1838,8 @@ void* _asContiguousTensor(void* t) {
 
 void* _copy(void* t) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
-    auto* new_tensor = new fl::Tensor(tensor->copy());
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    return shumai::newTensor(tensor->copy());
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -900,18 +1853,114 @@ void* _pad(void* t,
            void* after,
            int64_t after_len) {
   try {
-    LOCK_GUARD
     auto* tensor = reinterpret_cast<fl::Tensor*>(t);
-    auto before_vec = arrayArg<int64_t>(before, before_len, g_row_major, false);
-    auto after_vec = arrayArg<int64_t>(after, after_len, g_row_major, false);
+    auto before_vec = arrayArg<int64_t>(before, before_len, rowMajor(), false);
+    auto after_vec = arrayArg<int64_t>(after, after_len, rowMajor(), false);
     std::vector<std::pair<int, int>> pair_vec;
     pair_vec.reserve(after_vec.size());
     for (auto i = 0; i < after_vec.size(); ++i) {
       pair_vec.emplace_back(before_vec[i], after_vec[i]);
     }
-    auto* new_tensor = new fl::Tensor(fl::pad(*tensor, pair_vec));
-    g_bytes_used += new_tensor->bytes();
-    return new_tensor;
+    return shumai::newTensor(fl::pad(*tensor, pair_vec));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Gather/scatter along a JS axis with integer index tensors (see
+// kernels/kernels.h for the exact semantics).
+void* _gather(void* t, int64_t axis, void* index) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    auto* idx = reinterpret_cast<fl::Tensor*>(index);
+    auto dim = axisArg(axis, rowMajor(), tensor->ndim());
+    return shumai::newTensor(shumai::kernels::gather(*tensor, dim, *idx));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _scatterAdd(void* base, int64_t axis, void* index, void* src) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(base);
+    auto* idx = reinterpret_cast<fl::Tensor*>(index);
+    auto* source = reinterpret_cast<fl::Tensor*>(src);
+    auto dim = axisArg(axis, rowMajor(), tensor->ndim());
+    return shumai::newTensor(
+        shumai::kernels::scatterAdd(*tensor, dim, *idx, *source));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _indexSelect(void* t, int64_t axis, void* index) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    auto* idx = reinterpret_cast<fl::Tensor*>(index);
+    auto dim = axisArg(axis, rowMajor(), tensor->ndim());
+    return shumai::newTensor(shumai::kernels::indexSelect(*tensor, dim, *idx));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _indexAdd(void* base, int64_t axis, void* index, void* src) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(base);
+    auto* idx = reinterpret_cast<fl::Tensor*>(index);
+    auto* source = reinterpret_cast<fl::Tensor*>(src);
+    auto dim = axisArg(axis, rowMajor(), tensor->ndim());
+    return shumai::newTensor(
+        shumai::kernels::indexAdd(*tensor, dim, *idx, *source));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// The Flashlight dim of JS `axis` for softmax.  Negative axes count from the
+// end and scalars accept any axis, like the reductions softmax used to be
+// built from.
+int softmaxDim(int64_t axis, int ndim) {
+  if (ndim == 0) {
+    return 0;
+  }
+  if (axis < -ndim || axis >= ndim) {
+    throw std::invalid_argument("softmax axis " + std::to_string(axis) +
+                                " out of range for tensor of rank " +
+                                std::to_string(ndim));
+  }
+  return axisArg(axis < 0 ? axis + ndim : axis, rowMajor(), ndim);
+}
+
+// Native softmax and log-softmax along a JS axis (see kernels/softmax.cc).
+// Their backward passes take the forward output rather than the input.
+void* _softmax(void* t, int64_t axis) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    auto dim = softmaxDim(axis, tensor->ndim());
+    return shumai::newTensor(shumai::kernels::softmax(*tensor, dim, false));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _logSoftmax(void* t, int64_t axis) {
+  try {
+    auto* tensor = reinterpret_cast<fl::Tensor*>(t);
+    auto dim = softmaxDim(axis, tensor->ndim());
+    return shumai::newTensor(shumai::kernels::softmax(*tensor, dim, true));
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -919,10 +1968,357 @@ void* _pad(void* t,
   }
 }
 
+void* _softmaxBackward(void* grad, void* out, int64_t axis) {
+  try {
+    auto* g = reinterpret_cast<fl::Tensor*>(grad);
+    auto* y = reinterpret_cast<fl::Tensor*>(out);
+    auto dim = softmaxDim(axis, y->ndim());
+    return shumai::newTensor(
+        shumai::kernels::softmaxBackward(*g, *y, dim, false));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _logSoftmaxBackward(void* grad, void* out, int64_t axis) {
+  try {
+    auto* g = reinterpret_cast<fl::Tensor*>(grad);
+    auto* y = reinterpret_cast<fl::Tensor*>(out);
+    auto dim = softmaxDim(axis, y->ndim());
+    return shumai::newTensor(
+        shumai::kernels::softmaxBackward(*g, *y, dim, true));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// The attention and loss kernels want features (or classes) innermost, which
+// is the Flashlight layout of row-major JS shapes; column-major tensors are
+// reversed on the way in and out.
+fl::Tensor featuresInner(const fl::Tensor& t) {
+  return rowMajor() ? t : fl::transpose(t);
+}
+
+// Fused scaled dot-product attention over JS shapes [..., tokens, dim] (see
+// kernels/attention.cc).  `mask` may be null.  The log-sum-exp of every score
+// row is returned through `lse_out` (one handle) for the backward pass.
+void* _attention(void* q,
+                 void* k,
+                 void* v,
+                 void* mask,
+                 double scale,
+                 bool causal,
+                 void* lse_out) {
+  try {
+    fl::Tensor mask_t;
+    if (mask) {
+      mask_t = featuresInner(*reinterpret_cast<fl::Tensor*>(mask));
+    }
+    auto [out, lse] = shumai::kernels::attention(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(q)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(k)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(v)),
+        mask ? &mask_t : nullptr, scale, causal);
+    auto* lse_ptr = shumai::newTensor(featuresInner(lse));
+    reinterpret_cast<int64_t*>(lse_out)[0] = reinterpret_cast<int64_t>(lse_ptr);
+    return shumai::newTensor(featuresInner(out));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Writes the handles of the q, k and v gradients to `grads_out`.  Returns 0,
+// or -1 on error.
+int64_t _attentionBackward(void* grad,
+                           void* q,
+                           void* k,
+                           void* v,
+                           void* out,
+                           void* lse,
+                           void* mask,
+                           double scale,
+                           bool causal,
+                           void* grads_out) {
+  try {
+    fl::Tensor mask_t;
+    if (mask) {
+      mask_t = featuresInner(*reinterpret_cast<fl::Tensor*>(mask));
+    }
+    auto [dq, dk, dv] = shumai::kernels::attentionBackward(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(grad)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(q)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(k)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(v)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(out)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(lse)),
+        mask ? &mask_t : nullptr, scale, causal);
+    auto* handles = reinterpret_cast<int64_t*>(grads_out);
+    for (auto* t : {&dq, &dk, &dv}) {
+      auto* handle = shumai::newTensor(featuresInner(*t));
+      *handles++ = reinterpret_cast<int64_t>(handle);
+    }
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Mean cross-entropy of logits with JS shape [..., classes] against integer
+// `labels` of shape [...] (see kernels/loss.cc).  The log-sum-exp of every row
+// is returned through `lse_out` (one handle) for the backward pass.
+void* _crossEntropyWithLogits(void* logits, void* labels, void* lse_out) {
+  try {
+    auto [loss, lse] = shumai::kernels::crossEntropyWithLogits(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(logits)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(labels)));
+    auto* lse_ptr = shumai::newTensor(featuresInner(lse));
+    reinterpret_cast<int64_t*>(lse_out)[0] = reinterpret_cast<int64_t>(lse_ptr);
+    return shumai::newTensor(loss);
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+void* _crossEntropyWithLogitsBackward(void* grad,
+                                      void* logits,
+                                      void* labels,
+                                      void* lse) {
+  try {
+    auto dx = shumai::kernels::crossEntropyWithLogitsBackward(
+        *reinterpret_cast<fl::Tensor*>(grad),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(logits)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(labels)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(lse)));
+    return shumai::newTensor(featuresInner(dx));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// One LSTM layer over a whole sequence (see kernels/lstm.cc), with JS shapes
+// x [steps, batch, inp], h0 and c0 [batch, out] and the gate weights packed
+// as w [inp, 4 out], u [out, 4 out] and b [4 out].  Writes four handles to
+// `out`: the hidden states [steps, batch, out], the final cell state, and the
+// gates and cells saved for the backward pass.  Returns 0, or -1 on error.
+int64_t _lstm(void* x, void* h0, void* c0, void* w, void* u, void* b,
+              void* out) {
+  try {
+    auto result = shumai::kernels::lstm(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(x)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(h0)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(c0)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(w)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(u)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(b)));
+    auto* handles = reinterpret_cast<int64_t*>(out);
+    for (auto* t : {&result.hs, &result.c, &result.gates, &result.cells}) {
+      auto* handle = shumai::newTensor(featuresInner(*t));
+      *handles++ = reinterpret_cast<int64_t>(handle);
+    }
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Writes the handles of the x, h0, c0, w, u and b gradients to `grads_out`.
+// Either of `grad_hs` and `grad_c` may be null.  Returns 0, or -1 on error.
+int64_t _lstmBackward(void* grad_hs,
+                      void* grad_c,
+                      void* x,
+                      void* h0,
+                      void* c0,
+                      void* w,
+                      void* u,
+                      void* b,
+                      void* gates,
+                      void* cells,
+                      void* grads_out) {
+  try {
+    fl::Tensor grad_hs_t;
+    fl::Tensor grad_c_t;
+    if (grad_hs) {
+      grad_hs_t = featuresInner(*reinterpret_cast<fl::Tensor*>(grad_hs));
+    }
+    if (grad_c) {
+      grad_c_t = featuresInner(*reinterpret_cast<fl::Tensor*>(grad_c));
+    }
+    auto grads = shumai::kernels::lstmBackward(
+        grad_hs ? &grad_hs_t : nullptr, grad_c ? &grad_c_t : nullptr,
+        featuresInner(*reinterpret_cast<fl::Tensor*>(x)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(h0)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(c0)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(w)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(u)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(b)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(gates)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(cells)));
+    auto* handles = reinterpret_cast<int64_t*>(grads_out);
+    for (auto* t :
+         {&grads.x, &grads.h0, &grads.c0, &grads.w, &grads.u, &grads.b}) {
+      auto* handle = shumai::newTensor(featuresInner(*t));
+      *handles++ = reinterpret_cast<int64_t>(handle);
+    }
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Layer normalization over the trailing `dims` JS axes (see kernels/norm.cc).
+// `gamma` and `beta` may be null.  The mean and reciprocal standard deviation
+// of every row are returned through `stats_out` (two handles) for the
+// backward pass.
+void* _layerNorm(void* x,
+                 void* gamma,
+                 void* beta,
+                 int64_t dims,
+                 double eps,
+                 void* stats_out) {
+  try {
+    fl::Tensor gamma_t;
+    fl::Tensor beta_t;
+    if (gamma) {
+      gamma_t = featuresInner(*reinterpret_cast<fl::Tensor*>(gamma));
+    }
+    if (beta) {
+      beta_t = featuresInner(*reinterpret_cast<fl::Tensor*>(beta));
+    }
+    auto result = shumai::kernels::layerNorm(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(x)),
+        gamma ? &gamma_t : nullptr, beta ? &beta_t : nullptr, dims, eps);
+    auto* handles = reinterpret_cast<int64_t*>(stats_out);
+    for (auto* t : {&result.mean, &result.rstd}) {
+      auto* handle = shumai::newTensor(featuresInner(*t));
+      *handles++ = reinterpret_cast<int64_t>(handle);
+    }
+    return shumai::newTensor(featuresInner(result.out));
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION(e.what());
+  } catch (...) {
+    HANDLE_EXCEPTION("[unknown]");
+  }
+}
+
+// Writes the handles of the x, gamma and beta gradients to `grads_out`; those
+// of gamma and beta are 0 unless `param_grads`.  Returns 0, or -1 on error.
+int64_t _layerNormBackward(void* grad,
+                           void* x,
+                           void* gamma,
+                           void* mean,
+                           void* rstd,
+                           int64_t dims,
+                           bool param_grads,
+                           void* grads_out) {
+  try {
+    fl::Tensor gamma_t;
+    if (gamma) {
+      gamma_t = featuresInner(*reinterpret_cast<fl::Tensor*>(gamma));
+    }
+    auto grads = shumai::kernels::layerNormBackward(
+        featuresInner(*reinterpret_cast<fl::Tensor*>(grad)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(x)),
+        gamma ? &gamma_t : nullptr,
+        featuresInner(*reinterpret_cast<fl::Tensor*>(mean)),
+        featuresInner(*reinterpret_cast<fl::Tensor*>(rstd)), dims,
+        param_grads);
+    auto* handles = reinterpret_cast<int64_t*>(grads_out);
+    for (auto* t : {&grads.x, &grads.gamma, &grads.beta}) {
+      if (t != &grads.x && !param_grads) {
+        *handles++ = 0;
+        continue;
+      }
+      auto* handle = shumai::newTensor(featuresInner(*t));
+      *handles++ = reinterpret_cast<int64_t>(handle);
+    }
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Fused optimizer steps over `count` parameters (see kernels/optim.cc).  The
+// tensor arguments are arrays of handles, as for `_concatenate`; `params` and
+// the optimizer state are updated in place.  Returns the global gradient norm
+// (before clipping), or -1 on error.
+double _adamStep(void* params_ptr,
+                 void* grads_ptr,
+                 void* m_ptr,
+                 void* v_ptr,
+                 int64_t count,
+                 double step_size,
+                 double b1,
+                 double b2,
+                 double eps,
+                 double weight_decay,
+                 double max_grad_norm) {
+  try {
+    auto params = tensorPtrArrayArg(params_ptr, count);
+    auto grads = tensorPtrArrayArg(grads_ptr, count);
+    auto m = tensorPtrArrayArg(m_ptr, count);
+    auto v = tensorPtrArrayArg(v_ptr, count);
+    std::vector<shumai::kernels::ParamSlot> slots;
+    slots.reserve(count);
+    for (auto i = 0; i < count; ++i) {
+      slots.push_back({params[i], grads[i], {m[i], v[i]}});
+    }
+    return shumai::kernels::adamStep(
+        slots, {step_size, b1, b2, eps, weight_decay, max_grad_norm});
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// `buffers_ptr` may be null when `momentum` is 0.
+double _sgdStep(void* params_ptr,
+                void* grads_ptr,
+                void* buffers_ptr,
+                int64_t count,
+                double lr,
+                double momentum,
+                double weight_decay,
+                double max_grad_norm) {
+  try {
+    auto params = tensorPtrArrayArg(params_ptr, count);
+    auto grads = tensorPtrArrayArg(grads_ptr, count);
+    auto buffers = tensorPtrArrayArg(buffers_ptr, count);
+    std::vector<shumai::kernels::ParamSlot> slots;
+    slots.reserve(count);
+    for (auto i = 0; i < count; ++i) {
+      slots.push_back({params[i], grads[i], {buffers[i], nullptr}});
+    }
+    return shumai::kernels::sgdStep(
+        slots, {lr, momentum, weight_decay, max_grad_norm});
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
 // `grad_in` is Shumai equivalent to Flashlight `gradOutput`
 void* _conv2dBackwardData(void* grad_in, void* in, void* wt, int* params) {
   try {
-    LOCK_GUARD
     int sx = params[0];
     int sy = params[1];
     int px = params[2];
@@ -941,8 +2337,7 @@ void* _conv2dBackwardData(void* grad_in, void* in, void* wt, int* params) {
         *used_grad_in, *used_in, *used_wt, sx, sy, px, py, dx, dy, groups,
         dataBench, payload);
 
-    g_bytes_used += result.bytes();
-    return new fl::Tensor(result);
+    return shumai::newTensor(result);
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -953,7 +2348,6 @@ void* _conv2dBackwardData(void* grad_in, void* in, void* wt, int* params) {
 // `grad_in` is Shumai equivalent to Flashlight `gradOutput`
 void* _conv2dBackwardFilter(void* grad_in, void* in, void* wt, int* params) {
   try {
-    LOCK_GUARD
     int sx = params[0];
     int sy = params[1];
     int px = params[2];
@@ -974,8 +2368,7 @@ void* _conv2dBackwardFilter(void* grad_in, void* in, void* wt, int* params) {
         *used_grad_in, *used_in, *used_wt, bs, sx, sy, px, py, dx, dy, groups,
         biasBench, filterBench, payload));
 
-    g_bytes_used += result.bytes();
-    return new fl::Tensor(result);
+    return shumai::newTensor(result);
   } catch (std::exception const& e) {
     HANDLE_EXCEPTION(e.what());
   } catch (...) {
@@ -983,5 +2376,106 @@ void* _conv2dBackwardFilter(void* grad_in, void* in, void* wt, int* params) {
   }
 }
 
+int64_t _runCommands(void* inputs_ptr,
+                     int64_t inputs_len,
+                     void* program_ptr,
+                     int64_t program_len,
+                     void* outputs_ptr,
+                     int64_t outputs_len) {
+  try {
+    auto inputs = ptrArrayArg<fl::Tensor>(inputs_ptr, inputs_len);
+    auto* outputs = reinterpret_cast<int64_t*>(outputs_ptr);
+    auto results = runCommandProgram(
+        std::move(inputs), reinterpret_cast<const int64_t*>(program_ptr),
+        program_len, std::vector<int64_t>(outputs, outputs + outputs_len));
+    // Only the requested outputs become handles; every intermediate slot has
+    // already been released inside the program.
+    for (auto i = 0; i < outputs_len; ++i) {
+      auto* t = shumai::newTensor(results[i]);
+      outputs[i] = reinterpret_cast<int64_t>(t);
+    }
+    return outputs_len;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Runs a native backward pass (see `runTape`).  `grads` holds the indices
+// into `tensors` whose gradients are wanted and is overwritten with their
+// handles (0 where no gradient reached).  Returns 0, or -1 on error.
+int64_t _tapeBackward(void* tensors_ptr,
+                      int64_t tensors_len,
+                      void* program_ptr,
+                      int64_t program_len,
+                      void* jacobian,
+                      void* grads_ptr,
+                      int64_t grads_len) {
+  try {
+    auto tensors = ptrArrayArg<fl::Tensor>(tensors_ptr, tensors_len);
+    auto* grads = reinterpret_cast<int64_t*>(grads_ptr);
+    auto results =
+        runTape(tensors, reinterpret_cast<const int64_t*>(program_ptr),
+                program_len, *reinterpret_cast<fl::Tensor*>(jacobian),
+                std::vector<int64_t>(grads, grads + grads_len));
+    for (auto i = 0; i < grads_len; ++i) {
+      grads[i] = results[i] ? reinterpret_cast<int64_t>(
+                                  shumai::newTensor(std::move(*results[i])))
+                            : 0;
+    }
+    return 0;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
+// Fused elementwise programs (see kernels/fuse.cc and shumai/tensor/fuse.ts)
+// share the command buffer calling convention, except that the number of
+// outputs is part of the program.  Returns it, or -1 on error.
+int64_t _fused(void* inputs_ptr,
+               int64_t inputs_len,
+               void* program_ptr,
+               int64_t program_len,
+               void* outputs_ptr,
+               int64_t outputs_len) {
+  try {
+    auto inputs = ptrArrayArg<fl::Tensor>(inputs_ptr, inputs_len);
+    // The kernel pads missing trailing Flashlight dims, i.e. leading JS dims
+    // in row-major mode, as broadcasting (and fuse.ts) expects.  Column-major
+    // shapes would be aligned the other way, so their ranks must match.
+    if (!rowMajor()) {
+      int ndim = -1;
+      for (const auto& t : inputs) {
+        if (t.elements() == 1) {
+          continue;
+        }
+        if (ndim >= 0 && t.ndim() != ndim) {
+          throw std::invalid_argument(
+              "fused inputs must have the same rank in column-major mode");
+        }
+        ndim = t.ndim();
+      }
+    }
+    auto results = shumai::kernels::fused(
+        inputs, reinterpret_cast<const int64_t*>(program_ptr), program_len);
+    if (static_cast<int64_t>(results.size()) != outputs_len) {
+      throw std::invalid_argument("fused program output count mismatch");
+    }
+    auto* outputs = reinterpret_cast<int64_t*>(outputs_ptr);
+    for (auto i = 0; i < outputs_len; ++i) {
+      auto* t = shumai::newTensor(std::move(results[i]));
+      outputs[i] = reinterpret_cast<int64_t>(t);
+    }
+    return outputs_len;
+  } catch (std::exception const& e) {
+    HANDLE_EXCEPTION_RETURNING(e.what(), -1);
+  } catch (...) {
+    HANDLE_EXCEPTION_RETURNING("[unknown]", -1);
+  }
+}
+
 #include "binding_gen.inl"
 };
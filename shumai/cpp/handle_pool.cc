@@ -0,0 +1,156 @@
+#include "handle_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "context.h"
+#include "sharded_counter.h"
+
+namespace shumai {
+namespace {
+
+constexpr size_t kHandlesPerSlab = 1024;
+// Slots moved between a thread's cache and the shared pool at once.
+constexpr size_t kBatch = 64;
+constexpr size_t kCacheLimit = 4 * kBatch;
+
+union HandleSlot {
+  HandleSlot* next;
+  alignas(fl::Tensor) unsigned char storage[sizeof(fl::Tensor)];
+};
+
+std::mutex g_pool_mutex;
+std::vector<std::unique_ptr<HandleSlot[]>> g_slabs;
+// Slots that have been handed out before, so the free list only ever holds
+// reused memory and fresh slots are carved off the newest slab.
+HandleSlot* g_free = nullptr;
+size_t g_slab_used = kHandlesPerSlab;
+
+std::atomic<int64_t> g_capacity = 0;
+std::atomic<int64_t> g_slab_count = 0;
+ShardedCounter g_live;
+ShardedCounter g_allocations;
+ShardedCounter g_reused;
+
+HandleSlot* pop(HandleSlot*& list) {
+  HandleSlot* slot = list;
+  list = slot->next;
+  return slot;
+}
+
+void push(HandleSlot*& list, HandleSlot* slot) {
+  slot->next = list;
+  list = slot;
+}
+
+// Carves up to `count` never-used slots off the newest slab.
+HandleSlot* takeFreshLocked(size_t& count) {
+  if (g_slab_used == kHandlesPerSlab) {
+    g_slabs.emplace_back(std::make_unique<HandleSlot[]>(kHandlesPerSlab));
+    g_slab_used = 0;
+    g_slab_count++;
+    g_capacity += kHandlesPerSlab;
+  }
+  count = std::min(count, kHandlesPerSlab - g_slab_used);
+  HandleSlot* fresh = &g_slabs.back()[g_slab_used];
+  g_slab_used += count;
+  return fresh;
+}
+
+void refill(HandleCache& cache) {
+  std::lock_guard<std::mutex> guard(g_pool_mutex);
+  auto* recycled = static_cast<HandleSlot*>(cache.recycled);
+  while (g_free && cache.recycled_count < kBatch) {
+    push(recycled, pop(g_free));
+    cache.recycled_count++;
+  }
+  cache.recycled = recycled;
+  if (!cache.recycled_count) {
+    size_t count = kBatch;
+    cache.fresh = takeFreshLocked(count);
+    cache.fresh_count = count;
+  }
+}
+
+void spill(HandleCache& cache, size_t count) {
+  auto* recycled = static_cast<HandleSlot*>(cache.recycled);
+  std::lock_guard<std::mutex> guard(g_pool_mutex);
+  for (; count && recycled; --count) {
+    push(g_free, pop(recycled));
+    cache.recycled_count--;
+  }
+  cache.recycled = recycled;
+}
+
+}  // namespace
+
+HandleCache::~HandleCache() {
+  spill(*this, recycled_count);
+  // Never-used slots join the free list too; they are simply counted as
+  // reused when handed out later.
+  std::lock_guard<std::mutex> guard(g_pool_mutex);
+  auto* fresh_slots = static_cast<HandleSlot*>(fresh);
+  for (size_t i = 0; i < fresh_count; ++i) {
+    push(g_free, &fresh_slots[i]);
+  }
+  fresh_count = 0;
+}
+
+void* allocateHandle() {
+  g_live.add(1);
+  g_allocations.add(1);
+  auto* ctx = currentContext();
+  if (!ctx) {
+    std::lock_guard<std::mutex> guard(g_pool_mutex);
+    if (g_free) {
+      g_reused.add(1);
+      return pop(g_free);
+    }
+    size_t count = 1;
+    return takeFreshLocked(count);
+  }
+  auto& cache = ctx->handles;
+  if (!cache.recycled_count && !cache.fresh_count) {
+    refill(cache);
+  }
+  if (cache.recycled_count) {
+    auto* recycled = static_cast<HandleSlot*>(cache.recycled);
+    HandleSlot* slot = pop(recycled);
+    cache.recycled = recycled;
+    cache.recycled_count--;
+    g_reused.add(1);
+    return slot;
+  }
+  auto* slot = static_cast<HandleSlot*>(cache.fresh);
+  cache.fresh = slot + 1;
+  cache.fresh_count--;
+  return slot;
+}
+
+void freeHandle(void* ptr) {
+  auto* slot = static_cast<HandleSlot*>(ptr);
+  g_live.add(-1);
+  auto* ctx = currentContext();
+  if (!ctx) {
+    std::lock_guard<std::mutex> guard(g_pool_mutex);
+    push(g_free, slot);
+    return;
+  }
+  auto& cache = ctx->handles;
+  auto* recycled = static_cast<HandleSlot*>(cache.recycled);
+  push(recycled, slot);
+  cache.recycled = recycled;
+  if (++cache.recycled_count > kCacheLimit) {
+    spill(cache, kCacheLimit - kBatch);
+  }
+}
+
+HandleStats handleStats() {
+  return HandleStats{g_live.load(), g_capacity, g_slab_count,
+                     g_allocations.load(), g_reused.load()};
+}
+
+}  // namespace shumai
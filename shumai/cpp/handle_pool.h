@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "flashlight/fl/tensor/TensorBase.h"
+#include "memory.h"
+
+namespace shumai {
+
+// Every tensor handed to JS is a heap-allocated fl::Tensor.  These handles are
+// small, short-lived and allocated at op rate, so they come from fixed-size
+// slabs with a free list instead of the general purpose allocator.  Each
+// thread keeps a cache of slots (see ExecutionContext) and only takes the
+// shared lock to move batches in and out of it.
+void* allocateHandle();
+void freeHandle(void* slot);
+
+struct HandleCache {
+  HandleCache() = default;
+  HandleCache(const HandleCache&) = delete;
+  HandleCache& operator=(const HandleCache&) = delete;
+  // Returns the cached slots to the shared free list.
+  ~HandleCache();
+
+  // Intrusive list of freed slots.
+  void* recycled = nullptr;
+  size_t recycled_count = 0;
+  // Slots of the current slab that were never handed out.
+  void* fresh = nullptr;
+  size_t fresh_count = 0;
+};
+
+struct HandleStats {
+  int64_t live;         // handles currently in use
+  int64_t capacity;     // slots across all slabs
+  int64_t slabs;        // slabs allocated so far (never returned)
+  int64_t allocations;  // handles handed out since startup
+  int64_t reused;       // allocations served from the free list
+};
+
+HandleStats handleStats();
+
+template <typename... Args>
+fl::Tensor* newTensor(Args&&... args) {
+  void* slot = allocateHandle();
+  fl::Tensor* tensor = nullptr;
+  try {
+    tensor = new (slot) fl::Tensor(std::forward<Args>(args)...);
+  } catch (...) {
+    freeHandle(slot);
+    throw;
+  }
+  trackTensor(*tensor);
+  return tensor;
+}
+
+inline void deleteTensor(fl::Tensor* tensor) {
+  if (!tensor) {
+    return;
+  }
+  // Disposed tensors were untracked when their adapter was released.
+  if (tensor->hasAdapter()) {
+    untrackTensor(*tensor);
+  }
+  tensor->~Tensor();
+  freeHandle(tensor);
+}
+
+}  // namespace shumai
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace shumai {
+
+// XXH64 (https://github.com/Cyan4973/xxHash), bit-compatible with the
+// reference implementation.  Used to checksum tensor data on disk.
+uint64_t xxh64(const void* data, size_t len, uint64_t seed = 0);
+
+}  // namespace shumai
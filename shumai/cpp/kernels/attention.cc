@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+// FlashAttention-style kernels: queries are processed in blocks against
+// blocks of keys, keeping a running max and sum per query row (online
+// softmax), so only a small tile of scores exists at any time.  The backward
+// pass recomputes probabilities from the saved log-sum-exp, once per query
+// block for dq and once per key block for dk/dv, so no two threads ever
+// accumulate into the same row.
+namespace shumai {
+namespace kernels {
+namespace {
+
+constexpr int64_t kQueryBlock = 16;
+constexpr int64_t kKeyBlock = 64;
+
+struct Dims {
+  int64_t d;
+  int64_t dv;
+  int64_t tq;
+  int64_t tk;
+  int64_t batch;
+};
+
+Dims attentionDims(const fl::Tensor& q,
+                   const fl::Tensor& k,
+                   const fl::Tensor& v,
+                   const fl::Tensor* mask) {
+  if (q.ndim() < 2 || k.ndim() != q.ndim() || v.ndim() != q.ndim()) {
+    throw std::invalid_argument(
+        "attention inputs must have the same rank, at least 2");
+  }
+  Dims n{q.dim(0), v.dim(0), q.dim(1), k.dim(1), 1};
+  for (int i = 2; i < q.ndim(); ++i) {
+    if (k.dim(i) != q.dim(i) || v.dim(i) != q.dim(i)) {
+      throw std::invalid_argument("attention inputs must share batch dims");
+    }
+    n.batch *= q.dim(i);
+  }
+  if (k.dim(0) != n.d || v.dim(1) != n.tk) {
+    throw std::invalid_argument(
+        "keys must match the queries' dim and values the keys' tokens");
+  }
+  if (mask && (mask->ndim() != 2 || mask->dim(0) != n.tk ||
+               mask->dim(1) != n.tq)) {
+    throw std::invalid_argument(
+        "attention mask must be [queryTokens, keyTokens]");
+  }
+  return n;
+}
+
+fl::Shape tokensShape(const fl::Tensor& q, int64_t features) {
+  auto dims = q.shape().get();
+  if (features) {
+    dims[0] = features;
+  } else {
+    dims.erase(dims.begin());
+  }
+  return fl::Shape(dims);
+}
+
+// Host copy of the mask as one byte per (query, key), key-contiguous.
+std::vector<uint8_t> maskBytes(const fl::Tensor* mask) {
+  if (!mask) {
+    return {};
+  }
+  const auto bytes = mask->astype(fl::dtype::u8);
+  HostInput<uint8_t> in(bytes);
+  return std::vector<uint8_t>(in.data(), in.data() + bytes.elements());
+}
+
+struct Masking {
+  const uint8_t* mask;
+  int64_t tk;
+  bool causal;
+
+  bool allowed(int64_t i, int64_t j) const {
+    return !(causal && j > i) && !(mask && mask[i * tk + j]);
+  }
+
+  // Keys past this one are masked for every query before `i_end`.
+  int64_t keyEnd(int64_t i_end) const {
+    return causal ? std::min(tk, i_end) : tk;
+  }
+};
+
+template <typename T>
+inline T dot(const T* __restrict a, const T* __restrict b, int64_t n) {
+  T sum = 0;
+  for (int64_t x = 0; x < n; ++x) {
+    sum += a[x] * b[x];
+  }
+  return sum;
+}
+
+template <typename T>
+inline void axpy(T alpha, const T* __restrict x, T* __restrict y, int64_t n) {
+  for (int64_t i = 0; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+}
+
+template <typename T>
+void forward(const T* q,
+             const T* k,
+             const T* v,
+             const Masking& masking,
+             const Dims& n,
+             T scale,
+             T* out,
+             T* lse) {
+  constexpr T kNegInf = -std::numeric_limits<T>::infinity();
+  const int64_t blocks = (n.tq + kQueryBlock - 1) / kQueryBlock;
+  parallelFor(n.batch * blocks, 1, [&](int64_t begin, int64_t end) {
+    std::vector<T> scores(kKeyBlock);
+    std::vector<T> acc(kQueryBlock * n.dv);
+    std::vector<T> row_max(kQueryBlock);
+    std::vector<T> row_sum(kQueryBlock);
+    for (int64_t item = begin; item < end; ++item) {
+      const int64_t b = item / blocks;
+      const int64_t i0 = (item % blocks) * kQueryBlock;
+      const int64_t i1 = std::min(n.tq, i0 + kQueryBlock);
+      const T* qb = q + b * n.tq * n.d;
+      const T* kb = k + b * n.tk * n.d;
+      const T* vb = v + b * n.tk * n.dv;
+      std::fill(acc.begin(), acc.end(), T(0));
+      std::fill(row_max.begin(), row_max.end(), kNegInf);
+      std::fill(row_sum.begin(), row_sum.end(), T(0));
+      const int64_t j_end = masking.keyEnd(i1);
+      for (int64_t j0 = 0; j0 < j_end; j0 += kKeyBlock) {
+        const int64_t j1 = std::min(j_end, j0 + kKeyBlock);
+        for (int64_t i = i0; i < i1; ++i) {
+          const int64_t r = i - i0;
+          const T* qi = qb + i * n.d;
+          T block_max = kNegInf;
+          for (int64_t j = j0; j < j1; ++j) {
+            T s = kNegInf;
+            if (masking.allowed(i, j)) {
+              s = scale * dot(qi, kb + j * n.d, n.d);
+              block_max = std::max(block_max, s);
+            }
+            scores[j - j0] = s;
+          }
+          if (block_max == kNegInf) {
+            continue;
+          }
+          const T new_max = std::max(row_max[r], block_max);
+          const T correction = std::exp(row_max[r] - new_max);
+          T* a = acc.data() + r * n.dv;
+          if (correction != T(1)) {
+            for (int64_t x = 0; x < n.dv; ++x) {
+              a[x] *= correction;
+            }
+          }
+          T sum = row_sum[r] * correction;
+          for (int64_t j = j0; j < j1; ++j) {
+            const T p = std::exp(scores[j - j0] - new_max);
+            if (p != T(0)) {
+              sum += p;
+              axpy(p, vb + j * n.dv, a, n.dv);
+            }
+          }
+          row_sum[r] = sum;
+          row_max[r] = new_max;
+        }
+      }
+      for (int64_t i = i0; i < i1; ++i) {
+        const int64_t r = i - i0;
+        // Fully masked rows come out as NaN, like softmax over all -inf.
+        T* o = out + (b * n.tq + i) * n.dv;
+        for (int64_t x = 0; x < n.dv; ++x) {
+          o[x] = acc[r * n.dv + x] / row_sum[r];
+        }
+        lse[b * n.tq + i] = row_max[r] + std::log(row_sum[r]);
+      }
+    }
+  });
+}
+
+template <typename T>
+void backward(const T* grad_out,
+              const T* q,
+              const T* k,
+              const T* v,
+              const T* out,
+              const T* lse,
+              const Masking& masking,
+              const Dims& n,
+              T scale,
+              T* dq,
+              T* dk,
+              T* dv) {
+  constexpr T kNegInf = -std::numeric_limits<T>::infinity();
+  // delta_i = dO_i . O_i, the softmax backward's row correction
+  std::vector<T> delta(n.batch * n.tq);
+  parallelFor(delta.size(), 1024, [&](int64_t begin, int64_t end) {
+    for (int64_t row = begin; row < end; ++row) {
+      delta[row] = dot(grad_out + row * n.dv, out + row * n.dv, n.dv);
+    }
+  });
+
+  // dq_i = scale * sum_j p_ij (dp_ij - delta_i) k_j
+  const int64_t q_blocks = (n.tq + kQueryBlock - 1) / kQueryBlock;
+  parallelFor(n.batch * q_blocks, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t item = begin; item < end; ++item) {
+      const int64_t b = item / q_blocks;
+      const int64_t i0 = (item % q_blocks) * kQueryBlock;
+      const int64_t i1 = std::min(n.tq, i0 + kQueryBlock);
+      std::fill(dq + (b * n.tq + i0) * n.d, dq + (b * n.tq + i1) * n.d, T(0));
+      const int64_t j_end = masking.keyEnd(i1);
+      for (int64_t j0 = 0; j0 < j_end; j0 += kKeyBlock) {
+        const int64_t j1 = std::min(j_end, j0 + kKeyBlock);
+        for (int64_t i = i0; i < i1; ++i) {
+          const int64_t row = b * n.tq + i;
+          if (lse[row] == kNegInf) {
+            continue;
+          }
+          const T* qi = q + row * n.d;
+          const T* doi = grad_out + row * n.dv;
+          T* dqi = dq + row * n.d;
+          for (int64_t j = j0; j < j1; ++j) {
+            if (!masking.allowed(i, j)) {
+              continue;
+            }
+            const T* kj = k + (b * n.tk + j) * n.d;
+            const T p = std::exp(scale * dot(qi, kj, n.d) - lse[row]);
+            const T dp = dot(doi, v + (b * n.tk + j) * n.dv, n.dv);
+            axpy(scale * p * (dp - delta[row]), kj, dqi, n.d);
+          }
+        }
+      }
+    }
+  });
+
+  // dv_j = sum_i p_ij dO_i, dk_j = scale * sum_i p_ij (dp_ij - delta_i) q_i
+  const int64_t k_blocks = (n.tk + kKeyBlock - 1) / kKeyBlock;
+  parallelFor(n.batch * k_blocks, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t item = begin; item < end; ++item) {
+      const int64_t b = item / k_blocks;
+      const int64_t j0 = (item % k_blocks) * kKeyBlock;
+      const int64_t j1 = std::min(n.tk, j0 + kKeyBlock);
+      std::fill(dk + (b * n.tk + j0) * n.d, dk + (b * n.tk + j1) * n.d, T(0));
+      std::fill(dv + (b * n.tk + j0) * n.dv, dv + (b * n.tk + j1) * n.dv,
+                T(0));
+      // Causal queries before j0 never see this block.
+      const int64_t i_begin = masking.causal ? std::min(n.tq, j0) : 0;
+      for (int64_t i = i_begin; i < n.tq; ++i) {
+        const int64_t row = b * n.tq + i;
+        if (lse[row] == kNegInf) {
+          continue;
+        }
+        const T* qi = q + row * n.d;
+        const T* doi = grad_out + row * n.dv;
+        for (int64_t j = j0; j < j1; ++j) {
+          if (!masking.allowed(i, j)) {
+            continue;
+          }
+          const int64_t col = b * n.tk + j;
+          const T p = std::exp(scale * dot(qi, k + col * n.d, n.d) - lse[row]);
+          const T dp = dot(doi, v + col * n.dv, n.dv);
+          axpy(p, doi, dv + col * n.dv, n.dv);
+          axpy(scale * p * (dp - delta[row]), qi, dk + col * n.d, n.d);
+        }
+      }
+    }
+  });
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+}  // namespace
+
+std::pair<fl::Tensor, fl::Tensor> attention(const fl::Tensor& q,
+                                            const fl::Tensor& k,
+                                            const fl::Tensor& v,
+                                            const fl::Tensor* mask,
+                                            double scale,
+                                            bool causal) {
+  const auto n = attentionDims(q, k, v, mask);
+  const auto type = q.type();
+  if (type != fl::dtype::f32 && type != fl::dtype::f64) {
+    throw std::invalid_argument("attention supports f32 and f64 inputs");
+  }
+  const auto keys = sameType(k, type);
+  const auto values = sameType(v, type);
+  const auto mask_bytes = maskBytes(mask);
+  const Masking masking{mask ? mask_bytes.data() : nullptr, n.tk, causal};
+  std::pair<fl::Tensor, fl::Tensor> result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> qh(q);
+    HostInput<T> kh(keys);
+    HostInput<T> vh(values);
+    HostOutput<T> out(tokensShape(q, n.dv), type);
+    HostOutput<T> lse(tokensShape(q, 0), type);
+    forward<T>(qh.data(), kh.data(), vh.data(), masking, n, scale, out.data(),
+               lse.data());
+    result = {out.finish(), lse.finish()};
+  });
+  return result;
+}
+
+std::tuple<fl::Tensor, fl::Tensor, fl::Tensor> attentionBackward(
+    const fl::Tensor& grad_out,
+    const fl::Tensor& q,
+    const fl::Tensor& k,
+    const fl::Tensor& v,
+    const fl::Tensor& out,
+    const fl::Tensor& lse,
+    const fl::Tensor* mask,
+    double scale,
+    bool causal) {
+  const auto n = attentionDims(q, k, v, mask);
+  const auto type = q.type();
+  if (type != fl::dtype::f32 && type != fl::dtype::f64) {
+    throw std::invalid_argument("attention supports f32 and f64 inputs");
+  }
+  if (grad_out.elements() != out.elements() ||
+      static_cast<int64_t>(out.elements()) != n.batch * n.tq * n.dv ||
+      static_cast<int64_t>(lse.elements()) != n.batch * n.tq) {
+    throw std::invalid_argument(
+        "attention gradient does not match the forward pass");
+  }
+  const auto grad = sameType(grad_out, type);
+  const auto keys = sameType(k, type);
+  const auto values = sameType(v, type);
+  const auto output = sameType(out, type);
+  const auto row_lse = sameType(lse, type);
+  const auto mask_bytes = maskBytes(mask);
+  const Masking masking{mask ? mask_bytes.data() : nullptr, n.tk, causal};
+  std::tuple<fl::Tensor, fl::Tensor, fl::Tensor> result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> gh(grad);
+    HostInput<T> qh(q);
+    HostInput<T> kh(keys);
+    HostInput<T> vh(values);
+    HostInput<T> oh(output);
+    HostInput<T> lh(row_lse);
+    HostOutput<T> dq(q.shape(), type);
+    HostOutput<T> dk(k.shape(), type);
+    HostOutput<T> dv(v.shape(), type);
+    backward<T>(gh.data(), qh.data(), kh.data(), vh.data(), oh.data(),
+                lh.data(), masking, n, scale, dq.data(), dk.data(), dv.data());
+    result = {dq.finish(), dk.finish(), dv.finish()};
+  });
+  return result;
+}
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "kernels.h"
+#include "parallel.h"
+
+// Conversions between f32 and the wire codecs.  Every loop works on one
+// element (or one block) at a time with plain integer and float arithmetic,
+// so that it auto-vectorizes; the half conversions are the usual bit tricks
+// (magic-number rounding for subnormals) instead of lookups.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Roughly how many elements a parallelFor chunk should touch.
+constexpr int64_t kGrainElements = 1 << 15;
+
+inline uint32_t bitsOf(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+inline float floatOf(uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline uint16_t toHalf(float f) {
+  uint32_t u = bitsOf(f);
+  const uint32_t sign = u & 0x80000000u;
+  u ^= sign;
+  uint16_t h;
+  if (u >= (127u + 16) << 23) {
+    // overflow to infinity; NaNs stay (quiet) NaNs
+    h = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (u < 113u << 23) {
+    // subnormal or zero: let the FPU round the mantissa into place
+    const float magic = floatOf(((127u - 15) + (23 - 10) + 1) << 23);
+    h = bitsOf(floatOf(u) + magic) - bitsOf(magic);
+  } else {
+    u += ((15u - 127) << 23) + 0xfff + ((u >> 13) & 1);
+    h = u >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+inline float fromHalf(uint16_t h) {
+  constexpr uint32_t kExponent = 0x7c00u << 13;
+  uint32_t u = (h & 0x7fffu) << 13;
+  const uint32_t exponent = u & kExponent;
+  u += (127u - 15) << 23;
+  if (exponent == kExponent) {
+    u += (128u - 16) << 23;
+  } else if (exponent == 0) {
+    u += 1u << 23;
+    u = bitsOf(floatOf(u) - floatOf(113u << 23));
+  }
+  return floatOf(u | (uint32_t(h & 0x8000u) << 16));
+}
+
+inline uint16_t toBFloat16(float f) {
+  const uint32_t u = bitsOf(f);
+  if ((u & 0x7fffffffu) > 0x7f800000u) {
+    return (u >> 16) | 0x40;
+  }
+  return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+}
+
+inline float fromBFloat16(uint16_t b) {
+  return floatOf(uint32_t(b) << 16);
+}
+
+// What was lost encoding `sent` as `decoded`.  Non-finite values are not
+// carried over, or a single overflow would poison every later transfer.
+inline float lost(float sent, float decoded) {
+  const float e = sent - decoded;
+  return std::isfinite(e) ? e : 0.0f;
+}
+
+template <uint16_t (*Encode)(float), float (*Decode)(uint16_t)>
+void encode16(const float* x, float* residual, int64_t n, uint16_t* out) {
+  parallelFor(n, kGrainElements, [&](int64_t begin, int64_t end) {
+    if (!residual) {
+      for (int64_t i = begin; i < end; ++i) {
+        out[i] = Encode(x[i]);
+      }
+      return;
+    }
+    for (int64_t i = begin; i < end; ++i) {
+      const float v = x[i] + residual[i];
+      out[i] = Encode(v);
+      residual[i] = lost(v, Decode(out[i]));
+    }
+  });
+}
+
+template <float (*Decode)(uint16_t)>
+void decode16(const uint16_t* in, int64_t n, float* out) {
+  parallelFor(n, kGrainElements, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      out[i] = Decode(in[i]);
+    }
+  });
+}
+
+int64_t numBlocks(int64_t n) {
+  return (n + kCodecBlock - 1) / kCodecBlock;
+}
+
+void encodeInt8(const float* x, float* residual, int64_t n, void* out) {
+  auto* scales = static_cast<float*>(out);
+  auto* q = reinterpret_cast<int8_t*>(scales + numBlocks(n));
+  const int64_t grain = kGrainElements / kCodecBlock;
+  parallelFor(numBlocks(n), grain, [&](int64_t begin, int64_t end) {
+    float v[kCodecBlock];
+    for (int64_t b = begin; b < end; ++b) {
+      const int64_t offset = b * kCodecBlock;
+      const int64_t len = std::min(kCodecBlock, n - offset);
+      float amax = 0;
+      for (int64_t i = 0; i < len; ++i) {
+        v[i] = x[offset + i] + (residual ? residual[offset + i] : 0.0f);
+        amax = std::max(amax, std::abs(v[i]));
+      }
+      const float scale = std::isfinite(amax) ? amax / 127 : 0.0f;
+      const float inverse = scale > 0 ? 1 / scale : 0.0f;
+      scales[b] = scale;
+      for (int64_t i = 0; i < len; ++i) {
+        // NaN (or a block scaled by 0 because of an infinity) encodes as 0
+        float r = std::nearbyint(v[i] * inverse);
+        r = std::isnan(r) ? 0.0f : r;
+        q[offset + i] = static_cast<int8_t>(std::clamp(r, -127.0f, 127.0f));
+      }
+      if (residual) {
+        for (int64_t i = 0; i < len; ++i) {
+          residual[offset + i] = lost(v[i], q[offset + i] * scale);
+        }
+      }
+    }
+  });
+}
+
+void decodeInt8(const void* in, int64_t n, float* out) {
+  const auto* scales = static_cast<const float*>(in);
+  const auto* q = reinterpret_cast<const int8_t*>(scales + numBlocks(n));
+  const int64_t grain = kGrainElements / kCodecBlock;
+  parallelFor(numBlocks(n), grain, [&](int64_t begin, int64_t end) {
+    for (int64_t b = begin; b < end; ++b) {
+      const int64_t offset = b * kCodecBlock;
+      const int64_t len = std::min(kCodecBlock, n - offset);
+      const float scale = scales[b];
+      for (int64_t i = 0; i < len; ++i) {
+        out[offset + i] = q[offset + i] * scale;
+      }
+    }
+  });
+}
+
+}  // namespace
+
+size_t codecBytes(Codec codec, int64_t n) {
+  switch (codec) {
+    case Codec::kFloat16:
+    case Codec::kBFloat16:
+      return n * sizeof(uint16_t);
+    case Codec::kInt8Block:
+      return numBlocks(n) * sizeof(float) + n;
+  }
+  throw std::invalid_argument("unknown wire codec");
+}
+
+void encodeValues(Codec codec,
+                  const float* x,
+                  float* residual,
+                  int64_t n,
+                  void* out) {
+  switch (codec) {
+    case Codec::kFloat16:
+      return encode16<toHalf, fromHalf>(x, residual, n,
+                                        static_cast<uint16_t*>(out));
+    case Codec::kBFloat16:
+      return encode16<toBFloat16, fromBFloat16>(x, residual, n,
+                                                static_cast<uint16_t*>(out));
+    case Codec::kInt8Block:
+      return encodeInt8(x, residual, n, out);
+  }
+  throw std::invalid_argument("unknown wire codec");
+}
+
+void decodeValues(Codec codec, const void* in, int64_t n, float* out) {
+  switch (codec) {
+    case Codec::kFloat16:
+      return decode16<fromHalf>(static_cast<const uint16_t*>(in), n, out);
+    case Codec::kBFloat16:
+      return decode16<fromBFloat16>(static_cast<const uint16_t*>(in), n, out);
+    case Codec::kInt8Block:
+      return decodeInt8(in, n, out);
+  }
+  throw std::invalid_argument("unknown wire codec");
+}
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+// Fused elementwise programs.  A program is compiled once (operands checked,
+// intermediates assigned to scratch buffers by liveness) and cached by its
+// encoding.  Running it walks the broadcast output in blocks small enough for
+// every live intermediate to stay in cache and evaluates the whole expression
+// on one block before moving to the next, so memory traffic is the inputs and
+// the outputs, however long the chain.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Elements evaluated together; every live intermediate takes one block.
+constexpr int64_t kBlock = 512;
+// Blocks per parallelFor chunk at minimum.
+constexpr int64_t kGrainBlocks = 16;
+// Programs differing only in baked-in constants would otherwise grow the
+// cache without bound.
+constexpr size_t kMaxCachedPrograms = 1024;
+
+bool isUnary(FuseOp op) {
+  return op >= FuseOp::kNegative && op <= FuseOp::kErf;
+}
+
+bool isBinary(FuseOp op) {
+  return (op >= FuseOp::kAdd && op <= FuseOp::kPower) ||
+         (op >= FuseOp::kEq && op <= FuseOp::kGreaterThanEqual);
+}
+
+struct Step {
+  FuseOp op;
+  // Operand value ids (`b` is -1 for unary ops).
+  int64_t a;
+  int64_t b;
+  // Scratch block the result is written to.
+  int64_t slot;
+};
+
+struct CompiledProgram {
+  int64_t inputs = 0;
+  std::vector<double> constants;
+  std::vector<Step> steps;
+  std::vector<int64_t> outputs;
+  int64_t slots = 0;
+};
+
+CompiledProgram compile(const int64_t* program, int64_t len) {
+  if (len < 4) {
+    throw std::invalid_argument("malformed fused program");
+  }
+  CompiledProgram p;
+  p.inputs = program[0];
+  const int64_t num_constants = program[1];
+  const int64_t num_steps = program[2];
+  const int64_t num_outputs = program[3];
+  if (p.inputs < 0 || num_constants < 0 || num_steps < 0 || num_outputs < 1 ||
+      len != 4 + num_constants + 3 * num_steps + num_outputs) {
+    throw std::invalid_argument("malformed fused program");
+  }
+  const int64_t* constants = program + 4;
+  const int64_t* code = constants + num_constants;
+  const int64_t* outputs = code + 3 * num_steps;
+  p.constants.resize(num_constants);
+  std::memcpy(p.constants.data(), constants, num_constants * sizeof(double));
+
+  const int64_t first_step = p.inputs + num_constants;
+  const int64_t num_values = first_step + num_steps;
+  auto check = [&](int64_t value, int64_t limit) {
+    if (value < 0 || value >= limit) {
+      throw std::invalid_argument("fused program operand is out of range");
+    }
+  };
+  for (int64_t i = 0; i < num_steps; ++i) {
+    const auto op = static_cast<FuseOp>(code[3 * i]);
+    if (!isUnary(op) && !isBinary(op)) {
+      throw std::invalid_argument("unknown fused opcode " +
+                                  std::to_string(code[3 * i]));
+    }
+    const int64_t a = code[3 * i + 1];
+    const int64_t b = isBinary(op) ? code[3 * i + 2] : -1;
+    check(a, first_step + i);
+    if (b >= 0 || isBinary(op)) {
+      check(b, first_step + i);
+    }
+    p.steps.push_back({op, a, b, -1});
+  }
+  for (int64_t i = 0; i < num_outputs; ++i) {
+    check(outputs[i], num_values);
+    p.outputs.push_back(outputs[i]);
+  }
+
+  // Step results live in scratch blocks from their step to their last use;
+  // outputs stay live to the end.  A block freed by a step's operands can
+  // hold its own result, since every op is elementwise.
+  std::vector<int64_t> last_use(num_values, -1);
+  for (int64_t i = 0; i < num_steps; ++i) {
+    last_use[p.steps[i].a] = i;
+    if (p.steps[i].b >= 0) {
+      last_use[p.steps[i].b] = i;
+    }
+  }
+  for (auto v : p.outputs) {
+    last_use[v] = num_steps;
+  }
+  std::vector<int64_t> free_slots;
+  std::vector<int64_t> slot_of(num_values, -1);
+  for (int64_t i = 0; i < num_steps; ++i) {
+    auto& step = p.steps[i];
+    for (auto v : {step.a, step.b}) {
+      if (v >= first_step && last_use[v] == i && slot_of[v] >= 0) {
+        free_slots.push_back(slot_of[v]);
+        slot_of[v] = -1;
+      }
+    }
+    if (free_slots.empty()) {
+      step.slot = p.slots++;
+    } else {
+      step.slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    // Results nobody reads still need somewhere to go, but not for long.
+    if (last_use[first_step + i] < 0) {
+      free_slots.push_back(step.slot);
+    } else {
+      slot_of[first_step + i] = step.slot;
+    }
+  }
+  return p;
+}
+
+std::shared_ptr<const CompiledProgram> cachedProgram(const int64_t* program,
+                                                     int64_t len) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string,
+                            std::shared_ptr<const CompiledProgram>>
+      cache;
+  std::string key(reinterpret_cast<const char*>(program),
+                  std::max<int64_t>(0, len) * sizeof(int64_t));
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  auto compiled =
+      std::make_shared<const CompiledProgram>(compile(program, len));
+  if (cache.size() >= kMaxCachedPrograms) {
+    cache.clear();
+  }
+  cache.emplace(std::move(key), compiled);
+  return compiled;
+}
+
+// Missing trailing dims count as 1 and dims of size 1 stretch.
+fl::Shape broadcastShape(const std::vector<fl::Tensor>& inputs) {
+  int ndim = 0;
+  for (const auto& t : inputs) {
+    ndim = std::max(ndim, static_cast<int>(t.ndim()));
+  }
+  std::vector<fl::Dim> dims(ndim, 1);
+  for (const auto& t : inputs) {
+    for (int d = 0; d < t.ndim(); ++d) {
+      if (t.dim(d) == 1 || t.dim(d) == dims[d]) {
+        continue;
+      }
+      if (dims[d] != 1) {
+        throw std::invalid_argument(
+            "fused inputs cannot be broadcast to a common shape");
+      }
+      dims[d] = t.dim(d);
+    }
+  }
+  return fl::Shape(dims);
+}
+
+// How an input is read: in place when it has the output's shape, as a single
+// value, or through per-dim strides (0 along broadcast dims).
+template <typename T>
+struct Operand {
+  const T* data = nullptr;
+  bool direct = false;
+  bool scalar = false;
+  std::vector<int64_t> strides;
+};
+
+template <typename T>
+Operand<T> operand(const T* data,
+                   const fl::Tensor& t,
+                   const std::vector<int64_t>& dims,
+                   int64_t elements) {
+  Operand<T> in;
+  in.data = data;
+  in.scalar = t.elements() == 1;
+  in.direct = !in.scalar && static_cast<int64_t>(t.elements()) == elements;
+  int64_t stride = 1;
+  for (size_t d = 0; d < dims.size(); ++d) {
+    const int64_t size = d < static_cast<size_t>(t.ndim()) ? t.dim(d) : 1;
+    in.strides.push_back(size == 1 ? 0 : stride);
+    stride *= size;
+  }
+  return in;
+}
+
+template <typename T>
+void load(const Operand<T>& in,
+          const std::vector<int64_t>& dims,
+          int64_t begin,
+          int64_t n,
+          T* out) {
+  std::vector<int64_t> coord(dims.size());
+  int64_t offset = 0;
+  int64_t rest = begin;
+  for (size_t d = 0; d < dims.size(); ++d) {
+    coord[d] = rest % dims[d];
+    rest /= dims[d];
+    offset += coord[d] * in.strides[d];
+  }
+  for (int64_t i = 0; i < n; ++i) {
+    out[i] = in.data[offset];
+    for (size_t d = 0; d < dims.size(); ++d) {
+      offset += in.strides[d];
+      if (++coord[d] < dims[d]) {
+        break;
+      }
+      offset -= coord[d] * in.strides[d];
+      coord[d] = 0;
+    }
+  }
+}
+
+template <typename T>
+void apply(FuseOp op, const T* a, const T* b, int64_t n, T* y) {
+#define UNARY(name, expr)             \
+  case FuseOp::name:                  \
+    for (int64_t i = 0; i < n; ++i) { \
+      const T x = a[i];               \
+      y[i] = expr;                    \
+    }                                 \
+    break;
+#define BINARY(name, expr)            \
+  case FuseOp::name:                  \
+    for (int64_t i = 0; i < n; ++i) { \
+      const T x = a[i];               \
+      const T z = b[i];               \
+      y[i] = expr;                    \
+    }                                 \
+    break;
+  switch (op) {
+    UNARY(kNegative, -x)
+    UNARY(kExp, std::exp(x))
+    UNARY(kLog, std::log(x))
+    UNARY(kLog1p, std::log1p(x))
+    UNARY(kSin, std::sin(x))
+    UNARY(kCos, std::cos(x))
+    UNARY(kSqrt, std::sqrt(x))
+    UNARY(kTanh, std::tanh(x))
+    UNARY(kFloor, std::floor(x))
+    UNARY(kCeil, std::ceil(x))
+    UNARY(kRint, std::nearbyint(x))
+    UNARY(kAbsolute, x < 0 ? -x : x)
+    UNARY(kSigmoid, T(1) / (T(1) + std::exp(-x)))
+    UNARY(kErf, std::erf(x))
+    BINARY(kAdd, x + z)
+    BINARY(kSub, x - z)
+    BINARY(kMul, x * z)
+    BINARY(kDiv, x / z)
+    BINARY(kMinimum, std::min(x, z))
+    BINARY(kMaximum, std::max(x, z))
+    BINARY(kPower, std::pow(x, z))
+    BINARY(kEq, T(x == z))
+    BINARY(kNeq, T(x != z))
+    BINARY(kLessThan, T(x < z))
+    BINARY(kLessThanEqual, T(x <= z))
+    BINARY(kGreaterThan, T(x > z))
+    BINARY(kGreaterThanEqual, T(x >= z))
+    default:
+      throw std::invalid_argument("unknown fused opcode");
+  }
+#undef UNARY
+#undef BINARY
+}
+
+template <typename T>
+void evaluate(const CompiledProgram& p,
+              const std::vector<Operand<T>>& inputs,
+              const std::vector<int64_t>& dims,
+              int64_t elements,
+              const std::vector<T*>& outputs) {
+  const int64_t num_constants = p.constants.size();
+  const int64_t first_step = p.inputs + num_constants;
+  const int64_t blocks = (elements + kBlock - 1) / kBlock;
+  parallelFor(blocks, kGrainBlocks, [&](int64_t begin, int64_t end) {
+    // Step results, then gathered inputs, then constants.
+    std::vector<T> scratch((p.slots + p.inputs + num_constants) * kBlock);
+    T* slots = scratch.data();
+    T* loaded = slots + p.slots * kBlock;
+    T* constants = loaded + p.inputs * kBlock;
+    std::vector<const T*> values(first_step + p.steps.size());
+    for (int64_t c = 0; c < num_constants; ++c) {
+      std::fill(constants + c * kBlock, constants + (c + 1) * kBlock,
+                static_cast<T>(p.constants[c]));
+      values[p.inputs + c] = constants + c * kBlock;
+    }
+    for (int64_t i = 0; i < p.inputs; ++i) {
+      if (inputs[i].scalar) {
+        std::fill(loaded + i * kBlock, loaded + (i + 1) * kBlock,
+                  inputs[i].data[0]);
+        values[i] = loaded + i * kBlock;
+      }
+    }
+    for (int64_t block = begin; block < end; ++block) {
+      const int64_t start = block * kBlock;
+      const int64_t n = std::min(kBlock, elements - start);
+      for (int64_t i = 0; i < p.inputs; ++i) {
+        if (inputs[i].direct) {
+          values[i] = inputs[i].data + start;
+        } else if (!inputs[i].scalar) {
+          load(inputs[i], dims, start, n, loaded + i * kBlock);
+          values[i] = loaded + i * kBlock;
+        }
+      }
+      for (size_t k = 0; k < p.steps.size(); ++k) {
+        const auto& step = p.steps[k];
+        T* y = slots + step.slot * kBlock;
+        apply<T>(step.op, values[step.a],
+                 step.b >= 0 ? values[step.b] : nullptr, n, y);
+        values[first_step + k] = y;
+      }
+      for (size_t o = 0; o < outputs.size(); ++o) {
+        std::memcpy(outputs[o] + start, values[p.outputs[o]], n * sizeof(T));
+      }
+    }
+  });
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+}  // namespace
+
+std::vector<fl::Tensor> fused(const std::vector<fl::Tensor>& inputs,
+                              const int64_t* program,
+                              int64_t program_len) {
+  const auto compiled = cachedProgram(program, program_len);
+  const auto& p = *compiled;
+  if (static_cast<int64_t>(inputs.size()) != p.inputs) {
+    throw std::invalid_argument("fused program expects " +
+                                std::to_string(p.inputs) + " inputs, got " +
+                                std::to_string(inputs.size()));
+  }
+  auto type = fl::dtype::f32;
+  for (const auto& t : inputs) {
+    if (t.type() == fl::dtype::f64) {
+      type = fl::dtype::f64;
+    }
+  }
+  const auto shape = broadcastShape(inputs);
+  const int64_t elements = shape.elements();
+  const std::vector<int64_t> dims(shape.get().begin(), shape.get().end());
+  std::vector<fl::Tensor> converted;
+  converted.reserve(inputs.size());
+  for (const auto& t : inputs) {
+    converted.push_back(sameType(t, type));
+  }
+  std::vector<fl::Tensor> results;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    std::vector<std::unique_ptr<HostInput<T>>> hosts;
+    std::vector<Operand<T>> operands;
+    for (const auto& t : converted) {
+      hosts.push_back(std::make_unique<HostInput<T>>(t));
+      operands.push_back(operand<T>(hosts.back()->data(), t, dims, elements));
+    }
+    std::vector<std::unique_ptr<HostOutput<T>>> outs;
+    std::vector<T*> out_data;
+    for (size_t o = 0; o < p.outputs.size(); ++o) {
+      outs.push_back(std::make_unique<HostOutput<T>>(shape, type));
+      out_data.push_back(outs.back()->data());
+    }
+    evaluate<T>(p, operands, dims, elements, out_data);
+    for (auto& out : outs) {
+      results.push_back(out->finish());
+    }
+  });
+  return results;
+}
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+#include "split.h"
+
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Roughly how many elements a parallelFor chunk should touch.
+constexpr int64_t kGrainElements = 1 << 15;
+// Contiguous run of a slice handled by one scatterAdd work item.
+constexpr int64_t kBlock = 256;
+
+int64_t grainFor(int64_t row) {
+  return std::max<int64_t>(1, kGrainElements / std::max<int64_t>(1, row));
+}
+
+void checkShapes(const fl::Shape& base,
+                 const fl::Shape& other,
+                 int dim,
+                 const char* what) {
+  bool ok = base.ndim() == other.ndim();
+  for (int i = 0; ok && i < base.ndim(); ++i) {
+    ok = i == dim || base[i] == other[i];
+  }
+  if (!ok) {
+    throw std::invalid_argument(std::string(what) +
+                                " must match the tensor's shape except along "
+                                "the indexed axis");
+  }
+}
+
+fl::Shape withDim(const fl::Shape& shape, int dim, int64_t size) {
+  auto dims = shape.get();
+  dims[dim] = size;
+  return fl::Shape(dims);
+}
+
+fl::Tensor indexValues(const fl::Tensor& index) {
+  switch (index.type()) {
+    case fl::dtype::s64:
+      return index;
+    case fl::dtype::s32:
+      return index.astype(fl::dtype::s64);
+    default:
+      throw std::invalid_argument("index tensor must be int32 or int64");
+  }
+}
+
+inline int64_t wrapIndex(int64_t i, int64_t size) {
+  const int64_t wrapped = i < 0 ? i + size : i;
+  if (wrapped < 0 || wrapped >= size) {
+    throw std::out_of_range("index " + std::to_string(i) +
+                            " out of range for axis of size " +
+                            std::to_string(size));
+  }
+  return wrapped;
+}
+
+// Validated, non-negative values of a 1D index tensor.
+std::vector<int64_t> indexRows(const fl::Tensor& index, int64_t size) {
+  if (index.ndim() > 1) {
+    throw std::invalid_argument("index tensor must be 1D");
+  }
+  const auto values = indexValues(index);
+  HostInput<int64_t> idx(values);
+  std::vector<int64_t> rows(values.elements());
+  for (size_t k = 0; k < rows.size(); ++k) {
+    rows[k] = wrapIndex(idx[k], size);
+  }
+  return rows;
+}
+
+fl::Tensor sameType(const fl::Tensor& src, const fl::Tensor& base) {
+  return src.type() == base.type() ? src : src.astype(base.type());
+}
+
+}  // namespace
+
+fl::Tensor gather(const fl::Tensor& x, int dim, const fl::Tensor& index) {
+  checkShapes(x.shape(), index.shape(), dim, "gather index");
+  const auto split = splitAt(x.shape(), dim);
+  const int64_t inner = split.inner;
+  const int64_t count = index.dim(dim);
+  const auto values = indexValues(index);
+  HostInput<int64_t> idx(values);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(x.type(), T, {
+    HostInput<T> in(x);
+    HostOutput<T> out(index.shape(), x.type());
+    const int64_t rows = split.outer * count;
+    parallelFor(rows, grainFor(inner), [&](int64_t b, int64_t e) {
+      for (int64_t r = b; r < e; ++r) {
+        const T* src = in.data() + (r / count) * split.size * inner;
+        const int64_t* row = idx.data() + r * inner;
+        T* dst = out.data() + r * inner;
+        for (int64_t i = 0; i < inner; ++i) {
+          dst[i] = src[wrapIndex(row[i], split.size) * inner + i];
+        }
+      }
+    });
+    result = out.finish();
+  });
+  return result;
+}
+
+fl::Tensor scatterAdd(const fl::Tensor& base,
+                      int dim,
+                      const fl::Tensor& index,
+                      const fl::Tensor& src) {
+  checkShapes(base.shape(), index.shape(), dim, "scatterAdd index");
+  checkShapes(index.shape(), src.shape(), -1, "scatterAdd source");
+  const auto split = splitAt(base.shape(), dim);
+  const int64_t inner = split.inner;
+  const int64_t count = index.dim(dim);
+  // Work items own a run of positions within the slice of one outer index,
+  // so no two threads ever add to the same element.
+  const int64_t blocks = (inner + kBlock - 1) / kBlock;
+  const auto values = indexValues(index);
+  const auto source = sameType(src, base);
+  HostInput<int64_t> idx(values);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(base.type(), T, {
+    HostInput<T> in(source);
+    HostOutput<T> out(base);
+    const int64_t grain = grainFor(count * std::min(inner, kBlock));
+    parallelFor(split.outer * blocks, grain, [&](int64_t b, int64_t e) {
+      for (int64_t item = b; item < e; ++item) {
+        const int64_t o = item / blocks;
+        const int64_t i0 = (item % blocks) * kBlock;
+        const int64_t i1 = std::min(inner, i0 + kBlock);
+        T* dst = out.data() + o * split.size * inner;
+        for (int64_t j = 0; j < count; ++j) {
+          const int64_t offset = (o * count + j) * inner;
+          const int64_t* row = idx.data() + offset;
+          const T* add = in.data() + offset;
+          for (int64_t i = i0; i < i1; ++i) {
+            dst[wrapIndex(row[i], split.size) * inner + i] += add[i];
+          }
+        }
+      }
+    });
+    result = out.finish();
+  });
+  return result;
+}
+
+fl::Tensor indexSelect(const fl::Tensor& x, int dim, const fl::Tensor& index) {
+  const auto split = splitAt(x.shape(), dim);
+  const int64_t inner = split.inner;
+  const auto rows = indexRows(index, split.size);
+  const int64_t count = rows.size();
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(x.type(), T, {
+    HostInput<T> in(x);
+    HostOutput<T> out(withDim(x.shape(), dim, count), x.type());
+    const int64_t slices = split.outer * count;
+    parallelFor(slices, grainFor(inner), [&](int64_t b, int64_t e) {
+      for (int64_t r = b; r < e; ++r) {
+        const int64_t o = r / count;
+        const T* src = in.data() + (o * split.size + rows[r % count]) * inner;
+        std::memcpy(out.data() + r * inner, src, inner * sizeof(T));
+      }
+    });
+    result = out.finish();
+  });
+  return result;
+}
+
+fl::Tensor indexAdd(const fl::Tensor& base,
+                    int dim,
+                    const fl::Tensor& index,
+                    const fl::Tensor& src) {
+  const auto split = splitAt(base.shape(), dim);
+  const int64_t inner = split.inner;
+  const auto rows = indexRows(index, split.size);
+  const int64_t count = rows.size();
+  checkShapes(withDim(base.shape(), dim, count), src.shape(), -1,
+              "indexAdd source");
+  // Work items own a range of destination slices and scan the whole index,
+  // so repeated indices (e.g. embedding gradients) never race.
+  const int64_t ranges =
+      std::max<int64_t>(1, std::min<int64_t>(split.size, 4 * numThreads()));
+  const int64_t per_range = (split.size + ranges - 1) / ranges;
+  const auto source = sameType(src, base);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(base.type(), T, {
+    HostInput<T> in(source);
+    HostOutput<T> out(base);
+    parallelFor(split.outer * ranges, 1, [&](int64_t b, int64_t e) {
+      for (int64_t item = b; item < e; ++item) {
+        const int64_t o = item / ranges;
+        const int64_t m0 = (item % ranges) * per_range;
+        const int64_t m1 = std::min(split.size, m0 + per_range);
+        for (int64_t k = 0; k < count; ++k) {
+          if (rows[k] < m0 || rows[k] >= m1) {
+            continue;
+          }
+          T* dst = out.data() + (o * split.size + rows[k]) * inner;
+          const T* add = in.data() + (o * count + k) * inner;
+          for (int64_t i = 0; i < inner; ++i) {
+            dst[i] += add[i];
+          }
+        }
+      }
+    });
+    result = out.finish();
+  });
+  return result;
+}
+
+}  // namespace kernels
+}  // namespace shumai
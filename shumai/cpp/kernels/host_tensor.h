@@ -0,0 +1,249 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include "../memory.h"
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+namespace kernels {
+
+// Read-only, contiguous host view of a tensor for the duration of a kernel.
+// On the CPU backend this is the tensor's own buffer (locked until the view
+// is destroyed); other backends copy to host.  `T` must match the dtype.
+template <typename T>
+class HostInput {
+ public:
+  explicit HostInput(const fl::Tensor& tensor) {
+    if (tensor.elements() == 0) {
+      return;
+    }
+    if (!hostIsDevice()) {
+      copy_ = tensor.toHostVector<T>();
+      data_ = copy_.data();
+      return;
+    }
+    if (tensor.isContiguous()) {
+      locked_ = &tensor;
+    } else {
+      contiguous_ = tensor.asContiguousTensor();
+      locked_ = &contiguous_;
+    }
+    data_ = locked_->device<T>();
+  }
+
+  HostInput(const HostInput&) = delete;
+  HostInput& operator=(const HostInput&) = delete;
+
+  ~HostInput() {
+    if (locked_) {
+      locked_->unlock();
+    }
+  }
+
+  const T* data() const {
+    return data_;
+  }
+
+  const T& operator[](int64_t i) const {
+    return data_[i];
+  }
+
+ private:
+  const T* data_ = nullptr;
+  const fl::Tensor* locked_ = nullptr;
+  fl::Tensor contiguous_;
+  std::vector<T> copy_;
+};
+
+// Like HostInput, for the raw bytes of a tensor of any dtype.
+class HostBytes {
+ public:
+  explicit HostBytes(const fl::Tensor& tensor) {
+    if (tensor.elements() == 0) {
+      return;
+    }
+    bytes_ = tensor.bytes();
+    if (!hostIsDevice()) {
+      copy_.resize(bytes_);
+      tensor.host(copy_.data());
+      data_ = copy_.data();
+      return;
+    }
+    if (tensor.isContiguous()) {
+      locked_ = &tensor;
+    } else {
+      contiguous_ = tensor.asContiguousTensor();
+      locked_ = &contiguous_;
+    }
+    void* data = nullptr;
+    locked_->device(&data);
+    data_ = data;
+  }
+
+  HostBytes(const HostBytes&) = delete;
+  HostBytes& operator=(const HostBytes&) = delete;
+
+  ~HostBytes() {
+    if (locked_) {
+      locked_->unlock();
+    }
+  }
+
+  const void* data() const {
+    return data_;
+  }
+
+  size_t bytes() const {
+    return bytes_;
+  }
+
+ private:
+  const void* data_ = nullptr;
+  size_t bytes_ = 0;
+  const fl::Tensor* locked_ = nullptr;
+  fl::Tensor contiguous_;
+  std::vector<char> copy_;
+};
+
+// Writable host buffer that becomes a new tensor once the kernel is done.  On
+// the CPU backend kernels write straight into the result's buffer.
+template <typename T>
+class HostOutput {
+ public:
+  // Uninitialized output.
+  HostOutput(const fl::Shape& shape, fl::dtype type) : shape_(shape) {
+    if (hostIsDevice()) {
+      tensor_ = fl::Tensor(shape, type);
+      lock();
+    } else {
+      buffer_.resize(shape.elements());
+      data_ = buffer_.data();
+    }
+  }
+
+  // Output starting out as a copy of `init`.
+  explicit HostOutput(const fl::Tensor& init) : shape_(init.shape()) {
+    if (hostIsDevice()) {
+      tensor_ = init.copy();
+      lock();
+    } else {
+      buffer_ = init.toHostVector<T>();
+      data_ = buffer_.data();
+    }
+  }
+
+  HostOutput(const HostOutput&) = delete;
+  HostOutput& operator=(const HostOutput&) = delete;
+
+  ~HostOutput() {
+    if (locked_) {
+      tensor_.unlock();
+    }
+  }
+
+  T* data() {
+    return data_;
+  }
+
+  T& operator[](int64_t i) {
+    return data_[i];
+  }
+
+  fl::Tensor finish() {
+    if (!hostIsDevice()) {
+      return fl::Tensor::fromBuffer(shape_, buffer_.data(),
+                                    fl::MemoryLocation::Host);
+    }
+    if (locked_) {
+      tensor_.unlock();
+      locked_ = false;
+    }
+    return tensor_;
+  }
+
+ private:
+  void lock() {
+    if (tensor_.elements()) {
+      data_ = tensor_.device<T>();
+      locked_ = true;
+    }
+  }
+
+  fl::Shape shape_;
+  fl::Tensor tensor_;
+  T* data_ = nullptr;
+  bool locked_ = false;
+  std::vector<T> buffer_;
+};
+
+// Writable view of a tensor's own buffer, for kernels that update state in
+// place.  CPU backend only.  device() first makes the buffer unique to
+// `tensor`, so views and shallow copies keep their old values, and adopted
+// JS memory is copied rather than written to.  `T` must match the dtype.
+template <typename T>
+class HostInPlace {
+ public:
+  explicit HostInPlace(fl::Tensor& tensor) : tensor_(tensor) {
+    if (tensor.elements() == 0) {
+      return;
+    }
+    if (!tensor.isContiguous()) {
+      tensor = tensor.asContiguousTensor();
+    }
+    data_ = tensor.device<T>();
+    if (isAdopted(data_)) {
+      tensor.unlock();
+      tensor = tensor.copy();
+      data_ = tensor.device<T>();
+    }
+  }
+
+  HostInPlace(const HostInPlace&) = delete;
+  HostInPlace& operator=(const HostInPlace&) = delete;
+
+  ~HostInPlace() {
+    if (data_) {
+      tensor_.unlock();
+    }
+  }
+
+  T* data() {
+    return data_;
+  }
+
+ private:
+  fl::Tensor& tensor_;
+  T* data_ = nullptr;
+};
+
+// Invokes `body` with `T` aliased to the C++ type of `type`, for the dtypes
+// the native kernels are instantiated for.
+#define SHUMAI_KERNEL_DISPATCH(type, T, ...)                        \
+  switch (type) {                                                   \
+    case fl::dtype::f32: {                                          \
+      using T = float;                                              \
+      __VA_ARGS__;                                                  \
+      break;                                                        \
+    }                                                               \
+    case fl::dtype::f64: {                                          \
+      using T = double;                                             \
+      __VA_ARGS__;                                                  \
+      break;                                                        \
+    }                                                               \
+    case fl::dtype::s32: {                                          \
+      using T = int32_t;                                            \
+      __VA_ARGS__;                                                  \
+      break;                                                        \
+    }                                                               \
+    case fl::dtype::s64: {                                          \
+      using T = int64_t;                                            \
+      __VA_ARGS__;                                                  \
+      break;                                                        \
+    }                                                               \
+    default:                                                        \
+      throw std::invalid_argument("dtype not supported by kernel"); \
+  }
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+// Native CPU kernels for ops Flashlight has no (or no fast) equivalent of.
+// They are written against host memory and parallelized with parallelFor;
+// on other backends inputs round-trip through host memory.
+//
+// Axes (`dim`) are Flashlight dimensions, i.e. already converted from JS axes
+// by the binding.  Index tensors hold s32 or s64 values; negative indices
+// count from the end of `dim`.
+namespace shumai {
+namespace kernels {
+
+// out[..., j, ...] = x[..., index[..., j, ...], ...] along `dim`.  `index` has
+// the shape of `x` except along `dim`, and so does the result.
+fl::Tensor gather(const fl::Tensor& x, int dim, const fl::Tensor& index);
+
+// A copy of `base` with every element of `src` added at the position `index`
+// (shaped like `src`) names along `dim`.  Repeated indices accumulate.
+fl::Tensor scatterAdd(const fl::Tensor& base,
+                      int dim,
+                      const fl::Tensor& index,
+                      const fl::Tensor& src);
+
+// The slices of `x` along `dim` named by the 1D `index`, in order.
+fl::Tensor indexSelect(const fl::Tensor& x, int dim, const fl::Tensor& index);
+
+// A copy of `base` with slice k of `src` added to slice index[k] along `dim`.
+// Repeated indices accumulate.
+fl::Tensor indexAdd(const fl::Tensor& base,
+                    int dim,
+                    const fl::Tensor& index,
+                    const fl::Tensor& src);
+
+// One parameter of an optimizer step: the parameter, its gradient and up to
+// two state tensors (Adam's moments, or SGD's momentum buffer), all with the
+// parameter's number of elements.  Unused state is null.
+struct ParamSlot {
+  fl::Tensor* param;
+  const fl::Tensor* grad;
+  fl::Tensor* state[2];
+};
+
+struct AdamOptions {
+  // Learning rate with the bias correction for the current step folded in.
+  double step_size;
+  double b1;
+  double b2;
+  double eps;
+  // L2 penalty added to the gradient.
+  double weight_decay;
+  // Gradients are scaled so their global L2 norm is at most this; 0 disables
+  // clipping.
+  double max_grad_norm;
+};
+
+struct SgdOptions {
+  double lr;
+  // 0 means no momentum, in which case the slots carry no state.
+  double momentum;
+  double weight_decay;
+  double max_grad_norm;
+};
+
+// Adam and SGD steps over any number of parameters, updating parameters and
+// state in place.  All parameters are processed as one parallel job over
+// host memory; each element is read and written once (plus one extra read of
+// the gradients when clipping).  Returns the global L2 norm of the gradients
+// before clipping.
+double adamStep(const std::vector<ParamSlot>& slots,
+                const AdamOptions& options);
+double sgdStep(const std::vector<ParamSlot>& slots, const SgdOptions& options);
+
+// Scaled dot-product attention, softmax(scale * q k^T) v, without ever
+// materializing the score matrix.  In Flashlight dims, `q` is [d, tq, ...],
+// `k` is [d, tk, ...] and `v` is [dv, tk, ...] with matching batch dims.
+// Query i ignores key j where `mask` ([tk, tq], any dtype, shared by every
+// batch) is non-zero, and, if `causal`, where j > i.  Returns the output
+// ([dv, tq, ...]) and the log-sum-exp of every score row ([tq, ...]), which
+// the backward pass uses to recompute probabilities.
+std::pair<fl::Tensor, fl::Tensor> attention(const fl::Tensor& q,
+                                            const fl::Tensor& k,
+                                            const fl::Tensor& v,
+                                            const fl::Tensor* mask,
+                                            double scale,
+                                            bool causal);
+
+// Gradients of `attention` with respect to q, k and v, given the gradient of
+// its output and the output and log-sum-exp the forward pass returned.
+std::tuple<fl::Tensor, fl::Tensor, fl::Tensor> attentionBackward(
+    const fl::Tensor& grad_out,
+    const fl::Tensor& q,
+    const fl::Tensor& k,
+    const fl::Tensor& v,
+    const fl::Tensor& out,
+    const fl::Tensor& lse,
+    const fl::Tensor* mask,
+    double scale,
+    bool causal);
+
+// The results of `lstm`: the hidden state of every step ([out, batch, steps]),
+// the final cell state ([out, batch]), and the gate activations and cell
+// states of every step, which the backward pass needs.
+struct LstmOutputs {
+  fl::Tensor hs;
+  fl::Tensor c;
+  fl::Tensor gates;
+  fl::Tensor cells;
+};
+
+// One LSTM layer over a whole sequence.  In Flashlight dims `x` is
+// [inp, batch, steps], `h0` and `c0` are [out, batch], and the gate weights
+// are packed as `w` [4 out, inp], `u` [4 out, out] and `b` [4 out], in the
+// order input, forget, cell, output:
+//   i, f, g, o = sigmoid, sigmoid, tanh, sigmoid of (w x_t + u h_{t-1} + b)
+//   c_t = f c_{t-1} + i g,  h_t = o tanh(c_t)
+LstmOutputs lstm(const fl::Tensor& x,
+                 const fl::Tensor& h0,
+                 const fl::Tensor& c0,
+                 const fl::Tensor& w,
+                 const fl::Tensor& u,
+                 const fl::Tensor& b);
+
+struct LstmGrads {
+  fl::Tensor x;
+  fl::Tensor h0;
+  fl::Tensor c0;
+  fl::Tensor w;
+  fl::Tensor u;
+  fl::Tensor b;
+};
+
+// Gradients of `lstm` with respect to all of its inputs (backpropagation
+// through time), given the gradients of its hidden states and/or of its final
+// cell state (either may be null) and the gates and cells it saved.
+LstmGrads lstmBackward(const fl::Tensor* grad_hs,
+                       const fl::Tensor* grad_c,
+                       const fl::Tensor& x,
+                       const fl::Tensor& h0,
+                       const fl::Tensor& c0,
+                       const fl::Tensor& w,
+                       const fl::Tensor& u,
+                       const fl::Tensor& b,
+                       const fl::Tensor& gates,
+                       const fl::Tensor& cells);
+
+struct LayerNormOutputs {
+  fl::Tensor out;
+  fl::Tensor mean;
+  fl::Tensor rstd;
+};
+
+// Layer normalization over the first `dims` Flashlight dimensions of `x`
+// (the trailing JS axes): every row is normalized to zero mean and unit
+// variance, then scaled by `gamma` and shifted by `beta` (either may be null),
+// which have the shape of those dims.  Also returns the mean and reciprocal
+// standard deviation of every row (shaped like the remaining dims) for the
+// backward pass.
+LayerNormOutputs layerNorm(const fl::Tensor& x,
+                           const fl::Tensor* gamma,
+                           const fl::Tensor* beta,
+                           int dims,
+                           double eps);
+
+struct LayerNormGrads {
+  fl::Tensor x;
+  fl::Tensor gamma;
+  fl::Tensor beta;
+};
+
+// Gradients of `layerNorm` with respect to x, gamma and beta, given the
+// gradient of its output and the row statistics it returned.  The gamma and
+// beta gradients are only computed if `param_grads` (they are empty tensors
+// otherwise), and then even when those were null.
+LayerNormGrads layerNormBackward(const fl::Tensor& grad_out,
+                                 const fl::Tensor& x,
+                                 const fl::Tensor* gamma,
+                                 const fl::Tensor& mean,
+                                 const fl::Tensor& rstd,
+                                 int dims,
+                                 bool param_grads);
+
+// Softmax (or, if `log`, log-softmax) along `dim`.  f64 is computed in f64,
+// everything else in f32; f16 results are converted back to f16.
+fl::Tensor softmax(const fl::Tensor& x, int dim, bool log);
+
+// Gradient of `softmax` given the gradient of its output and the output.
+fl::Tensor softmaxBackward(const fl::Tensor& grad_out,
+                           const fl::Tensor& out,
+                           int dim,
+                           bool log);
+
+// Mean cross-entropy of `logits` ([classes, rows...] in Flashlight dims)
+// against integer class `labels` (one per row, any shape with that many
+// elements).  Returns the loss (a scalar) and the log-sum-exp of every row
+// (shaped like the row dims), which the backward pass uses to recompute the
+// probabilities.  Dtypes are handled as in `softmax`.
+std::pair<fl::Tensor, fl::Tensor> crossEntropyWithLogits(
+    const fl::Tensor& logits,
+    const fl::Tensor& labels);
+
+// Gradient of `crossEntropyWithLogits` with respect to the logits, given the
+// (scalar) gradient of the loss and the log-sum-exp it returned.
+fl::Tensor crossEntropyWithLogitsBackward(const fl::Tensor& grad_out,
+                                          const fl::Tensor& logits,
+                                          const fl::Tensor& labels,
+                                          const fl::Tensor& lse);
+
+// Opcodes of fused elementwise programs: the elementwise subset of the command
+// buffer opcodes in flashlight_binding.cc, with the same values, so that
+// shumai/tensor/fuse.ts can share `CommandOp`.
+enum class FuseOp : int64_t {
+  kNegative = 1,
+  kExp = 2,
+  kLog = 3,
+  kLog1p = 4,
+  kSin = 5,
+  kCos = 6,
+  kSqrt = 7,
+  kTanh = 8,
+  kFloor = 9,
+  kCeil = 10,
+  kRint = 11,
+  kAbsolute = 12,
+  kSigmoid = 13,
+  kErf = 14,
+  kAdd = 15,
+  kSub = 16,
+  kMul = 17,
+  kDiv = 18,
+  kMinimum = 19,
+  kMaximum = 20,
+  kPower = 21,
+  kEq = 23,
+  kNeq = 24,
+  kLessThan = 25,
+  kLessThanEqual = 26,
+  kGreaterThan = 27,
+  kGreaterThanEqual = 28,
+};
+
+// Runs a fused elementwise program over `inputs` in one pass over their
+// broadcast shape (dims of size 1 stretch and missing trailing Flashlight
+// dims count as 1).  `program` is laid out as
+//
+//   [num_inputs, num_constants, num_steps, num_outputs,
+//    constants (f64 bits), (op, a, b) * num_steps, outputs]
+//
+// with values numbered inputs first, then constants, then one per step; a
+// step may only read earlier values and unary steps ignore `b`.  Comparisons
+// yield 0 or 1.  Everything is computed and returned in f64 if any input is
+// f64 and in f32 otherwise.  Compiled programs are cached by their encoding.
+std::vector<fl::Tensor> fused(const std::vector<fl::Tensor>& inputs,
+                              const int64_t* program,
+                              int64_t program_len);
+
+// Lossy encodings of f32 values for the wire (see wire.h), numbered as there.
+// Float16 and BFloat16 round to nearest even.  Int8Block splits the values
+// into blocks of kCodecBlock that share one f32 scale (max |x| / 127) and is
+// laid out as all the scales, then all the int8 values; it has no room for
+// non-finite values, which zero out their block.
+enum class Codec : int64_t {
+  kFloat16 = 1,
+  kBFloat16 = 2,
+  kInt8Block = 3,
+};
+
+constexpr int64_t kCodecBlock = 128;
+
+// Bytes of `n` values encoded with `codec`.
+size_t codecBytes(Codec codec, int64_t n);
+
+// Encodes `n` values of `x` into `out`.  With a `residual`, x + residual is
+// encoded instead and `residual` is overwritten with what that lost (error
+// feedback: the loss is sent along with the next values, so repeated
+// transfers of a quantity add up to the exact sum).
+void encodeValues(Codec codec,
+                  const float* x,
+                  float* residual,
+                  int64_t n,
+                  void* out);
+
+void decodeValues(Codec codec, const void* in, int64_t n, float* out);
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+// Cross-entropy of logits against integer class labels.  Each row of logits
+// is read twice, once for its max and once for the sum of exp(x - max), and
+// yields its log-sum-exp and loss; the probabilities are never stored.  The
+// backward pass recomputes them from the saved log-sum-exp and writes
+// softmax - onehot without building the one-hot matrix.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Roughly how many elements a parallelFor chunk should touch.
+constexpr int64_t kGrainElements = 1 << 15;
+
+struct Rows {
+  int64_t count;
+  int64_t classes;
+};
+
+Rows lossRows(const fl::Tensor& logits, const fl::Tensor& labels) {
+  if (logits.ndim() < 1 || logits.dim(0) < 1) {
+    throw std::invalid_argument(
+        "cross-entropy logits must have at least one class");
+  }
+  Rows rows{static_cast<int64_t>(logits.elements()) / logits.dim(0),
+            logits.dim(0)};
+  if (static_cast<int64_t>(labels.elements()) != rows.count) {
+    throw std::invalid_argument(
+        "cross-entropy labels must have one class per row of logits");
+  }
+  return rows;
+}
+
+fl::Shape rowShape(const fl::Tensor& logits) {
+  const auto& all = logits.shape().get();
+  return fl::Shape(std::vector<fl::Dim>(all.begin() + 1, all.end()));
+}
+
+int64_t grainFor(const Rows& rows) {
+  return std::max<int64_t>(1, kGrainElements / rows.classes);
+}
+
+fl::Tensor labelValues(const fl::Tensor& labels) {
+  switch (labels.type()) {
+    case fl::dtype::s64:
+      return labels;
+    case fl::dtype::s32:
+      return labels.astype(fl::dtype::s64);
+    default:
+      throw std::invalid_argument(
+          "cross-entropy labels must be int32 or int64");
+  }
+}
+
+inline int64_t checkLabel(int64_t label, int64_t classes) {
+  if (label < 0 || label >= classes) {
+    throw std::out_of_range("label " + std::to_string(label) +
+                            " out of range for " + std::to_string(classes) +
+                            " classes");
+  }
+  return label;
+}
+
+template <typename T>
+void forward(const T* x,
+             const int64_t* labels,
+             const Rows& rows,
+             T* lse,
+             double* row_loss) {
+  parallelFor(rows.count, grainFor(rows), [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const T* xr = x + r * rows.classes;
+      const int64_t label = checkLabel(labels[r], rows.classes);
+      T m = -std::numeric_limits<T>::infinity();
+      for (int64_t i = 0; i < rows.classes; ++i) {
+        m = std::max(m, xr[i]);
+      }
+      T sum = 0;
+      for (int64_t i = 0; i < rows.classes; ++i) {
+        sum += std::exp(xr[i] - m);
+      }
+      lse[r] = m + std::log(sum);
+      row_loss[r] = static_cast<double>(lse[r]) - xr[label];
+    }
+  });
+}
+
+// dx = scale * (exp(x - lse) - onehot(label))
+template <typename T>
+void backward(const T* x,
+              const int64_t* labels,
+              const T* lse,
+              const Rows& rows,
+              T scale,
+              T* dx) {
+  parallelFor(rows.count, grainFor(rows), [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const T* xr = x + r * rows.classes;
+      T* dxr = dx + r * rows.classes;
+      for (int64_t i = 0; i < rows.classes; ++i) {
+        dxr[i] = scale * std::exp(xr[i] - lse[r]);
+      }
+      dxr[checkLabel(labels[r], rows.classes)] -= scale;
+    }
+  });
+}
+
+// Kernels run in f32 or f64; other dtypes are computed in f32 (half
+// precision results are converted back).
+fl::dtype computeType(fl::dtype type) {
+  return type == fl::dtype::f64 ? fl::dtype::f64 : fl::dtype::f32;
+}
+
+fl::Tensor resultType(const fl::Tensor& t, fl::dtype type) {
+  return type == fl::dtype::f16 && t.type() != type ? t.astype(type) : t;
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+}  // namespace
+
+std::pair<fl::Tensor, fl::Tensor> crossEntropyWithLogits(
+    const fl::Tensor& logits,
+    const fl::Tensor& labels) {
+  const auto rows = lossRows(logits, labels);
+  const auto type = computeType(logits.type());
+  const auto input = sameType(logits, type);
+  const auto classes = labelValues(labels);
+  std::vector<double> row_loss(rows.count);
+  fl::Tensor loss;
+  fl::Tensor lse;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> xh(input);
+    HostInput<int64_t> yh(classes);
+    HostOutput<T> lse_out(rowShape(logits), type);
+    forward<T>(xh.data(), yh.data(), rows, lse_out.data(), row_loss.data());
+    // Rows are summed in order so the loss does not depend on threading.
+    double total = 0;
+    for (double l : row_loss) {
+      total += l;
+    }
+    HostOutput<T> loss_out(fl::Shape(), type);
+    loss_out[0] = rows.count ? total / rows.count : 0;
+    loss = loss_out.finish();
+    lse = lse_out.finish();
+  });
+  return {resultType(loss, logits.type()), resultType(lse, logits.type())};
+}
+
+fl::Tensor crossEntropyWithLogitsBackward(const fl::Tensor& grad_out,
+                                          const fl::Tensor& logits,
+                                          const fl::Tensor& labels,
+                                          const fl::Tensor& lse) {
+  const auto rows = lossRows(logits, labels);
+  if (grad_out.elements() != 1 ||
+      static_cast<int64_t>(lse.elements()) != rows.count) {
+    throw std::invalid_argument(
+        "cross-entropy gradient does not match the forward pass");
+  }
+  const auto type = computeType(logits.type());
+  const auto input = sameType(logits, type);
+  const auto row_lse = sameType(lse, type);
+  const auto grad = sameType(grad_out, type);
+  const auto classes = labelValues(labels);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> gh(grad);
+    HostInput<T> xh(input);
+    HostInput<int64_t> yh(classes);
+    HostInput<T> lh(row_lse);
+    HostOutput<T> dx(logits.shape(), type);
+    const T scale = gh[0] / static_cast<T>(std::max<int64_t>(1, rows.count));
+    backward<T>(xh.data(), yh.data(), lh.data(), rows, scale, dx.data());
+    result = dx.finish();
+  });
+  return resultType(result, logits.type());
+}
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+// A whole LSTM layer per call.  The input projection of every step is one
+// GEMM up front; each step then does one [4 out, out] x [out, batch] GEMM for
+// the recurrence and a single fused pass computing all four gates and the new
+// states.  The backward pass runs BPTT the same way: one fused pass and one
+// GEMM per step, then the weight gradients as three GEMMs over all steps.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Elementwise work per step is tiny; only large layers are split up.
+constexpr int64_t kGrain = 4096;
+
+struct Dims {
+  int64_t inp;
+  int64_t out;
+  int64_t batch;
+  int64_t steps;
+};
+
+Dims lstmDims(const fl::Tensor& x,
+              const fl::Tensor& h0,
+              const fl::Tensor& c0,
+              const fl::Tensor& w,
+              const fl::Tensor& u,
+              const fl::Tensor& b) {
+  if (x.ndim() != 3) {
+    throw std::invalid_argument(
+        "lstm input must be [steps, batch, features]");
+  }
+  Dims n{x.dim(0), h0.ndim() ? h0.dim(0) : 0, x.dim(1), x.dim(2)};
+  if (n.steps == 0) {
+    throw std::invalid_argument("lstm input must have at least one step");
+  }
+  if (h0.ndim() != 2 || h0.dim(1) != n.batch || c0.shape() != h0.shape()) {
+    throw std::invalid_argument(
+        "lstm hidden and cell states must be [batch, out]");
+  }
+  if (w.ndim() != 2 || w.dim(0) != 4 * n.out || w.dim(1) != n.inp ||
+      u.ndim() != 2 || u.dim(0) != 4 * n.out || u.dim(1) != n.out ||
+      static_cast<int64_t>(b.elements()) != 4 * n.out) {
+    throw std::invalid_argument(
+        "lstm weights must be [inp, 4 out], [out, 4 out] and [4 out]");
+  }
+  return n;
+}
+
+template <typename T>
+inline T sigmoid(T z) {
+  return T(1) / (T(1) + std::exp(-z));
+}
+
+// Gates are stored per (step, batch) row as [i | f | g | o], each `out` wide,
+// already passed through their nonlinearities.
+template <typename T>
+void forward(const fl::Tensor& x,
+             const fl::Tensor& h0,
+             const fl::Tensor& c0,
+             const fl::Tensor& w,
+             const fl::Tensor& u,
+             const fl::Tensor& b,
+             const Dims& n,
+             T* hs,
+             T* c_last,
+             T* gates,
+             T* cells) {
+  const int64_t width = 4 * n.out;
+  const int64_t states = n.batch * n.out;
+  const auto xw =
+      fl::matmul(w, fl::reshape(x, fl::Shape({n.inp, n.batch * n.steps})),
+                 fl::MatrixProperty::None, fl::MatrixProperty::None);
+  HostInput<T> xwh(xw);
+  HostInput<T> bh(b);
+  HostInput<T> c0h(c0);
+  fl::Tensor h = h0;
+  for (int64_t t = 0; t < n.steps; ++t) {
+    const auto hu = fl::matmul(u, h, fl::MatrixProperty::None,
+                               fl::MatrixProperty::None);
+    HostInput<T> huh(hu);
+    const T* xt = xwh.data() + t * n.batch * width;
+    const T* c_prev = t ? cells + (t - 1) * states : c0h.data();
+    T* gt = gates + t * n.batch * width;
+    T* ct = cells + t * states;
+    T* ht = hs + t * states;
+    parallelFor(states, kGrain, [&](int64_t begin, int64_t end) {
+      for (int64_t s = begin; s < end; ++s) {
+        const int64_t j = s % n.out;
+        const int64_t row = (s / n.out) * width + j;
+        T z[4];
+        for (int64_t k = 0; k < 4; ++k) {
+          const int64_t col = row + k * n.out;
+          z[k] = xt[col] + huh[col] + bh[j + k * n.out];
+        }
+        const T i = sigmoid(z[0]);
+        const T f = sigmoid(z[1]);
+        const T g = std::tanh(z[2]);
+        const T o = sigmoid(z[3]);
+        ct[s] = f * c_prev[s] + i * g;
+        ht[s] = o * std::tanh(ct[s]);
+        gt[row] = i;
+        gt[row + n.out] = f;
+        gt[row + 2 * n.out] = g;
+        gt[row + 3 * n.out] = o;
+      }
+    });
+    h = fl::Tensor::fromBuffer({n.out, n.batch}, ht, fl::MemoryLocation::Host);
+  }
+  const T* last = cells + (n.steps - 1) * states;
+  std::copy(last, last + states, c_last);
+}
+
+// Fills `dz` with the gradients of the gate pre-activations and `h_prev` with
+// the hidden state every step started from, which is all the weight
+// gradients need; `dh` and `dc` end up as the gradients of h0 and c0.
+template <typename T>
+void backward(const T* grad_hs,
+              const T* grad_c,
+              const fl::Tensor& u,
+              const T* h0,
+              const T* c0,
+              const T* gates,
+              const T* cells,
+              const Dims& n,
+              T* dz,
+              T* h_prev,
+              std::vector<T>& dh,
+              std::vector<T>& dc) {
+  const int64_t width = 4 * n.out;
+  const int64_t states = n.batch * n.out;
+  dh.assign(states, T(0));
+  if (grad_c) {
+    dc.assign(grad_c, grad_c + states);
+  } else {
+    dc.assign(states, T(0));
+  }
+  for (int64_t t = n.steps - 1; t >= 0; --t) {
+    const T* gt = gates + t * n.batch * width;
+    const T* ct = cells + t * states;
+    const T* c_prev = t ? ct - states : c0;
+    const T* gh = grad_hs ? grad_hs + t * states : nullptr;
+    T* dzt = dz + t * n.batch * width;
+    T* hp = h_prev + t * states;
+    parallelFor(states, kGrain, [&](int64_t begin, int64_t end) {
+      for (int64_t s = begin; s < end; ++s) {
+        const int64_t row = (s / n.out) * width + s % n.out;
+        const T i = gt[row];
+        const T f = gt[row + n.out];
+        const T g = gt[row + 2 * n.out];
+        const T o = gt[row + 3 * n.out];
+        const T tc = std::tanh(ct[s]);
+        const T dht = dh[s] + (gh ? gh[s] : T(0));
+        const T dct = dc[s] + dht * o * (T(1) - tc * tc);
+        dzt[row] = dct * g * i * (T(1) - i);
+        dzt[row + n.out] = dct * c_prev[s] * f * (T(1) - f);
+        dzt[row + 2 * n.out] = dct * i * (T(1) - g * g);
+        dzt[row + 3 * n.out] = dht * tc * o * (T(1) - o);
+        dc[s] = dct * f;
+        hp[s] = t ? gt[row - n.batch * width + 3 * n.out] * std::tanh(c_prev[s])
+                  : h0[s];
+      }
+    });
+    const auto dzt_fl =
+        fl::Tensor::fromBuffer({width, n.batch}, dzt, fl::MemoryLocation::Host);
+    const auto dh_prev = fl::matmul(u, dzt_fl, fl::MatrixProperty::Transpose,
+                                    fl::MatrixProperty::None);
+    dh = dh_prev.template toHostVector<T>();
+  }
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+void checkType(fl::dtype type) {
+  if (type != fl::dtype::f32 && type != fl::dtype::f64) {
+    throw std::invalid_argument("lstm supports f32 and f64 inputs");
+  }
+}
+
+}  // namespace
+
+LstmOutputs lstm(const fl::Tensor& x,
+                 const fl::Tensor& h0,
+                 const fl::Tensor& c0,
+                 const fl::Tensor& w,
+                 const fl::Tensor& u,
+                 const fl::Tensor& b) {
+  const auto n = lstmDims(x, h0, c0, w, u, b);
+  const auto type = x.type();
+  checkType(type);
+  const auto h_init = sameType(h0, type);
+  const auto c_init = sameType(c0, type);
+  const auto weights = sameType(w, type);
+  const auto recurrent = sameType(u, type);
+  const auto bias = sameType(b, type);
+  const fl::Shape states({n.out, n.batch, n.steps});
+  LstmOutputs result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostOutput<T> hs(states, type);
+    HostOutput<T> c_last(h0.shape(), type);
+    HostOutput<T> gates({4 * n.out, n.batch, n.steps}, type);
+    HostOutput<T> cells(states, type);
+    forward<T>(x, h_init, c_init, weights, recurrent, bias, n, hs.data(),
+               c_last.data(), gates.data(), cells.data());
+    result = {hs.finish(), c_last.finish(), gates.finish(), cells.finish()};
+  });
+  return result;
+}
+
+LstmGrads lstmBackward(const fl::Tensor* grad_hs,
+                       const fl::Tensor* grad_c,
+                       const fl::Tensor& x,
+                       const fl::Tensor& h0,
+                       const fl::Tensor& c0,
+                       const fl::Tensor& w,
+                       const fl::Tensor& u,
+                       const fl::Tensor& b,
+                       const fl::Tensor& gates,
+                       const fl::Tensor& cells) {
+  const auto n = lstmDims(x, h0, c0, w, u, b);
+  const auto type = x.type();
+  checkType(type);
+  const int64_t states = n.batch * n.out;
+  if ((grad_hs &&
+       static_cast<int64_t>(grad_hs->elements()) != states * n.steps) ||
+      (grad_c && static_cast<int64_t>(grad_c->elements()) != states) ||
+      static_cast<int64_t>(gates.elements()) != 4 * states * n.steps ||
+      static_cast<int64_t>(cells.elements()) != states * n.steps) {
+    throw std::invalid_argument(
+        "lstm gradient does not match the forward pass");
+  }
+  const auto h_init = sameType(h0, type);
+  const auto c_init = sameType(c0, type);
+  const auto weights = sameType(w, type);
+  const auto recurrent = sameType(u, type);
+  const auto saved_gates = sameType(gates, type);
+  const auto saved_cells = sameType(cells, type);
+  fl::Tensor grad_h_t;
+  fl::Tensor grad_c_t;
+  if (grad_hs) {
+    grad_h_t = sameType(*grad_hs, type);
+  }
+  if (grad_c) {
+    grad_c_t = sameType(*grad_c, type);
+  }
+  const int64_t rows = n.batch * n.steps;
+  fl::Tensor dz;
+  fl::Tensor h_prev;
+  LstmGrads result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> ghh(grad_h_t);
+    HostInput<T> gch(grad_c_t);
+    HostInput<T> h0h(h_init);
+    HostInput<T> c0h(c_init);
+    HostInput<T> gatesh(saved_gates);
+    HostInput<T> cellsh(saved_cells);
+    HostOutput<T> dz_out({4 * n.out, rows}, type);
+    HostOutput<T> h_prev_out({n.out, rows}, type);
+    std::vector<T> dh;
+    std::vector<T> dc;
+    backward<T>(grad_hs ? ghh.data() : nullptr, grad_c ? gch.data() : nullptr,
+                recurrent, h0h.data(), c0h.data(), gatesh.data(),
+                cellsh.data(), n, dz_out.data(), h_prev_out.data(), dh, dc);
+    dz = dz_out.finish();
+    h_prev = h_prev_out.finish();
+    result.h0 =
+        fl::Tensor::fromBuffer(h0.shape(), dh.data(), fl::MemoryLocation::Host);
+    result.c0 =
+        fl::Tensor::fromBuffer(c0.shape(), dc.data(), fl::MemoryLocation::Host);
+  });
+  result.x = fl::reshape(fl::matmul(weights, dz, fl::MatrixProperty::Transpose,
+                                    fl::MatrixProperty::None),
+                         x.shape());
+  result.w =
+      fl::matmul(dz, fl::reshape(x, fl::Shape({n.inp, rows})),
+                 fl::MatrixProperty::None, fl::MatrixProperty::Transpose);
+  result.u = fl::matmul(dz, h_prev, fl::MatrixProperty::None,
+                        fl::MatrixProperty::Transpose);
+  result.b = fl::reshape(fl::sum(dz, std::vector<int>{1}), b.shape());
+  return result;
+}
+
+}  // namespace kernels
+}  // namespace shumai
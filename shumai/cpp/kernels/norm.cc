@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+// Layer normalization over the innermost `dims` dimensions.  Each row is read
+// once for its statistics (Welford's algorithm, accumulated in double) and
+// once more, while still in cache, to write the normalized, scaled and shifted
+// output.  The per-row mean and reciprocal standard deviation are kept for the
+// backward pass, which needs no other reductions over x.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Rows are independent; chunks are sized to keep scheduling cheap.
+constexpr int64_t kChunkElements = 1 << 14;
+
+struct Rows {
+  int64_t count;
+  int64_t size;
+};
+
+Rows normRows(const fl::Tensor& x, int dims) {
+  if (dims < 1 || dims > x.ndim()) {
+    throw std::invalid_argument(
+        "layer norm must normalize between 1 and ndim dimensions");
+  }
+  Rows rows{1, 1};
+  for (int i = 0; i < x.ndim(); ++i) {
+    (i < dims ? rows.size : rows.count) *= x.dim(i);
+  }
+  return rows;
+}
+
+fl::Shape innerShape(const fl::Tensor& x, int dims) {
+  const auto& all = x.shape().get();
+  return fl::Shape(std::vector<fl::Dim>(all.begin(), all.begin() + dims));
+}
+
+fl::Shape outerShape(const fl::Tensor& x, int dims) {
+  const auto& all = x.shape().get();
+  return fl::Shape(std::vector<fl::Dim>(all.begin() + dims, all.end()));
+}
+
+int64_t rowGrain(const Rows& rows) {
+  return std::max<int64_t>(1, kChunkElements / std::max<int64_t>(1, rows.size));
+}
+
+template <typename T>
+void forward(const T* x,
+             const T* gamma,
+             const T* beta,
+             const Rows& rows,
+             double eps,
+             T* out,
+             T* mean,
+             T* rstd) {
+  parallelFor(rows.count, rowGrain(rows), [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const T* xr = x + r * rows.size;
+      T* yr = out + r * rows.size;
+      double mu = 0;
+      double m2 = 0;
+      for (int64_t i = 0; i < rows.size; ++i) {
+        const double delta = xr[i] - mu;
+        mu += delta / (i + 1);
+        m2 += delta * (xr[i] - mu);
+      }
+      const double inv = 1 / std::sqrt(m2 / rows.size + eps);
+      const T m = mu;
+      const T s = inv;
+      for (int64_t i = 0; i < rows.size; ++i) {
+        T y = (xr[i] - m) * s;
+        if (gamma) {
+          y *= gamma[i];
+        }
+        if (beta) {
+          y += beta[i];
+        }
+        yr[i] = y;
+      }
+      mean[r] = m;
+      rstd[r] = s;
+    }
+  });
+}
+
+// dx = rstd * (g - mean(g) - xhat * mean(g * xhat)) with g = dy * gamma.  The
+// rows are split into `parts` contiguous spans; if `dgamma_parts` is not null,
+// each span also writes its partial sums of dy * xhat and dy (`rows.size` of
+// each), which the caller adds up in a fixed order.
+template <typename T>
+void backward(const T* grad,
+              const T* x,
+              const T* gamma,
+              const T* mean,
+              const T* rstd,
+              const Rows& rows,
+              int64_t parts,
+              T* dx,
+              double* dgamma_parts,
+              double* dbeta_parts) {
+  const int64_t span = (rows.count + parts - 1) / parts;
+  parallelFor(parts, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t p = begin; p < end; ++p) {
+      double* dg = dgamma_parts ? dgamma_parts + p * rows.size : nullptr;
+      double* db = dbeta_parts ? dbeta_parts + p * rows.size : nullptr;
+      if (dg) {
+        std::fill(dg, dg + rows.size, 0.0);
+        std::fill(db, db + rows.size, 0.0);
+      }
+      const int64_t r_end = std::min(rows.count, (p + 1) * span);
+      for (int64_t r = p * span; r < r_end; ++r) {
+        const T* xr = x + r * rows.size;
+        const T* gr = grad + r * rows.size;
+        T* dxr = dx + r * rows.size;
+        const double m = mean[r];
+        const double s = rstd[r];
+        double sum_g = 0;
+        double sum_gx = 0;
+        for (int64_t i = 0; i < rows.size; ++i) {
+          const double xhat = (xr[i] - m) * s;
+          const double g = gamma ? gr[i] * gamma[i] : gr[i];
+          sum_g += g;
+          sum_gx += g * xhat;
+          if (dg) {
+            dg[i] += gr[i] * xhat;
+            db[i] += gr[i];
+          }
+        }
+        const double mean_g = sum_g / rows.size;
+        const double mean_gx = sum_gx / rows.size;
+        for (int64_t i = 0; i < rows.size; ++i) {
+          const double xhat = (xr[i] - m) * s;
+          const double g = gamma ? gr[i] * gamma[i] : gr[i];
+          dxr[i] = s * (g - mean_g - xhat * mean_gx);
+        }
+      }
+    }
+  });
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+void checkType(fl::dtype type) {
+  if (type != fl::dtype::f32 && type != fl::dtype::f64) {
+    throw std::invalid_argument("layer norm supports f32 and f64 inputs");
+  }
+}
+
+void checkParam(const fl::Tensor* param, const Rows& rows) {
+  if (param && static_cast<int64_t>(param->elements()) != rows.size) {
+    throw std::invalid_argument(
+        "layer norm scale and shift must match the normalized dims");
+  }
+}
+
+}  // namespace
+
+LayerNormOutputs layerNorm(const fl::Tensor& x,
+                           const fl::Tensor* gamma,
+                           const fl::Tensor* beta,
+                           int dims,
+                           double eps) {
+  const auto rows = normRows(x, dims);
+  const auto type = x.type();
+  checkType(type);
+  checkParam(gamma, rows);
+  checkParam(beta, rows);
+  fl::Tensor scale;
+  fl::Tensor shift;
+  if (gamma) {
+    scale = sameType(*gamma, type);
+  }
+  if (beta) {
+    shift = sameType(*beta, type);
+  }
+  LayerNormOutputs result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> xh(x);
+    HostInput<T> gh(scale);
+    HostInput<T> bh(shift);
+    HostOutput<T> out(x.shape(), type);
+    HostOutput<T> mean(outerShape(x, dims), type);
+    HostOutput<T> rstd(outerShape(x, dims), type);
+    forward<T>(xh.data(), gamma ? gh.data() : nullptr,
+               beta ? bh.data() : nullptr, rows, eps, out.data(), mean.data(),
+               rstd.data());
+    result = {out.finish(), mean.finish(), rstd.finish()};
+  });
+  return result;
+}
+
+LayerNormGrads layerNormBackward(const fl::Tensor& grad_out,
+                                 const fl::Tensor& x,
+                                 const fl::Tensor* gamma,
+                                 const fl::Tensor& mean,
+                                 const fl::Tensor& rstd,
+                                 int dims,
+                                 bool param_grads) {
+  const auto rows = normRows(x, dims);
+  const auto type = x.type();
+  checkType(type);
+  checkParam(gamma, rows);
+  if (grad_out.elements() != x.elements() ||
+      static_cast<int64_t>(mean.elements()) != rows.count ||
+      static_cast<int64_t>(rstd.elements()) != rows.count) {
+    throw std::invalid_argument(
+        "layer norm gradient does not match the forward pass");
+  }
+  const auto grad = sameType(grad_out, type);
+  const auto row_mean = sameType(mean, type);
+  const auto row_rstd = sameType(rstd, type);
+  fl::Tensor scale;
+  if (gamma) {
+    scale = sameType(*gamma, type);
+  }
+  // Without parameter gradients the rows are split as in the forward pass.
+  // Otherwise each span needs its own partial sums, so there is one span per
+  // kernel thread: the partial buffers stay small, and the sums depend only on
+  // the configured thread count.
+  const int64_t grain = rowGrain(rows);
+  int64_t parts = std::max<int64_t>(1, (rows.count + grain - 1) / grain);
+  std::vector<double> dgamma_parts;
+  std::vector<double> dbeta_parts;
+  if (param_grads) {
+    parts = std::min<int64_t>(parts, numThreads());
+    dgamma_parts.resize(parts * rows.size);
+    dbeta_parts.resize(parts * rows.size);
+  }
+  LayerNormGrads result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> gh(grad);
+    HostInput<T> xh(x);
+    HostInput<T> sh(scale);
+    HostInput<T> mh(row_mean);
+    HostInput<T> rh(row_rstd);
+    HostOutput<T> dx(x.shape(), type);
+    backward<T>(gh.data(), xh.data(), gamma ? sh.data() : nullptr, mh.data(),
+                rh.data(), rows, parts, dx.data(),
+                param_grads ? dgamma_parts.data() : nullptr,
+                param_grads ? dbeta_parts.data() : nullptr);
+    if (!param_grads) {
+      result = {dx.finish(), fl::Tensor(), fl::Tensor()};
+    } else {
+      HostOutput<T> dgamma(innerShape(x, dims), type);
+      HostOutput<T> dbeta(innerShape(x, dims), type);
+      T* dg = dgamma.data();
+      T* db = dbeta.data();
+      parallelFor(rows.size, kChunkElements, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+          double g = 0;
+          double b = 0;
+          for (int64_t p = 0; p < parts; ++p) {
+            g += dgamma_parts[p * rows.size + i];
+            b += dbeta_parts[p * rows.size + i];
+          }
+          dg[i] = g;
+          db[i] = b;
+        }
+      });
+      result = {dx.finish(), dgamma.finish(), dbeta.finish()};
+    }
+  });
+  return result;
+}
+
+}  // namespace kernels
+}  // namespace shumai
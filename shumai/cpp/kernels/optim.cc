@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "flashlight/fl/tensor/Compute.h"
+#include "flashlight/fl/tensor/TensorBase.h"
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Elementwise updates are memory bound, so work is split into large runs.
+constexpr int64_t kSegmentElements = 1 << 16;
+
+// Sum of squares of g[begin, end) in double, kept in independent partial
+// sums so that the reduction vectorizes without reassociating math flags.
+template <typename T>
+double sumSquares(const T* __restrict g, int64_t begin, int64_t end) {
+  constexpr int kLanes = 8;
+  double lanes[kLanes] = {};
+  int64_t i = begin;
+  for (; i + kLanes <= end; i += kLanes) {
+    for (int l = 0; l < kLanes; ++l) {
+      lanes[l] += static_cast<double>(g[i + l]) * g[i + l];
+    }
+  }
+  double sum = 0;
+  for (; i < end; ++i) {
+    sum += static_cast<double>(g[i]) * g[i];
+  }
+  for (double lane : lanes) {
+    sum += lane;
+  }
+  return sum;
+}
+
+// A slot with gradient and state converted to the parameter's dtype.
+// Converted gradients live in `owned`, which must outlive the result.
+ParamSlot prepare(const ParamSlot& slot, std::deque<fl::Tensor>& owned) {
+  const auto& param = *slot.param;
+  if (slot.grad->elements() != param.elements()) {
+    throw std::invalid_argument(
+        "gradient must have as many elements as the parameter");
+  }
+  ParamSlot prepared = slot;
+  if (slot.grad->type() != param.type()) {
+    owned.push_back(slot.grad->astype(param.type()));
+    prepared.grad = &owned.back();
+  }
+  for (auto* state : prepared.state) {
+    if (!state) {
+      continue;
+    }
+    if (state->elements() != param.elements()) {
+      throw std::invalid_argument(
+          "optimizer state must have as many elements as the parameter");
+    }
+    if (state->type() != param.type()) {
+      *state = state->astype(param.type());
+    }
+  }
+  return prepared;
+}
+
+// Parameters of one floating point dtype, locked in host memory and updated
+// as one parallel job.  Each tensor is cut into segments so that large and
+// small parameters balance across threads.
+template <typename T>
+class HostBatch {
+ public:
+  void add(const ParamSlot& p) {
+    const int64_t index = params_.size();
+    const int64_t n = p.param->elements();
+    grads_.push_back(std::make_unique<HostInput<T>>(*p.grad));
+    params_.push_back(std::make_unique<HostInPlace<T>>(*p.param));
+    for (int s = 0; s < 2; ++s) {
+      state_[s].push_back(
+          p.state[s] ? std::make_unique<HostInPlace<T>>(*p.state[s]) : nullptr);
+    }
+    for (int64_t b = 0; b < n; b += kSegmentElements) {
+      segments_.push_back({index, b, std::min(n, b + kSegmentElements)});
+    }
+  }
+
+  double sumSquares() const {
+    return run([&](const Segment& seg) {
+      return kernels::sumSquares(grads_[seg.tensor]->data(), seg.begin,
+                                 seg.end);
+    });
+  }
+
+  // Calls `fn(param, grad, state0, state1, begin, end)` for every segment and
+  // returns the sum of what it returns.
+  template <typename Fn>
+  double apply(const Fn& fn) {
+    return run([&](const Segment& seg) {
+      auto* s0 = state_[0][seg.tensor].get();
+      auto* s1 = state_[1][seg.tensor].get();
+      return fn(params_[seg.tensor]->data(), grads_[seg.tensor]->data(),
+                s0 ? s0->data() : nullptr, s1 ? s1->data() : nullptr,
+                seg.begin, seg.end);
+    });
+  }
+
+ private:
+  struct Segment {
+    int64_t tensor;
+    int64_t begin;
+    int64_t end;
+  };
+
+  // Per-segment partial results are summed in order, so the result does not
+  // depend on how segments were spread over threads.
+  template <typename Fn>
+  double run(const Fn& fn) const {
+    std::vector<double> partial(segments_.size());
+    parallelFor(segments_.size(), 1, [&](int64_t b, int64_t e) {
+      for (int64_t i = b; i < e; ++i) {
+        partial[i] = fn(segments_[i]);
+      }
+    });
+    double total = 0;
+    for (double p : partial) {
+      total += p;
+    }
+    return total;
+  }
+
+  std::vector<std::unique_ptr<HostInput<T>>> grads_;
+  std::vector<std::unique_ptr<HostInPlace<T>>> params_;
+  std::vector<std::unique_ptr<HostInPlace<T>>> state_[2];
+  std::vector<Segment> segments_;
+};
+
+// Splits a step into host batches (CPU backend, f32/f64) and parameters that
+// are updated with ArrayFire expressions instead.
+struct Plan {
+  explicit Plan(const std::vector<ParamSlot>& slots) {
+    for (const auto& slot : slots) {
+      auto p = prepare(slot, converted);
+      const auto type = p.param->type();
+      if (hostIsDevice() && type == fl::dtype::f32) {
+        f32.add(p);
+      } else if (hostIsDevice() && type == fl::dtype::f64) {
+        f64.add(p);
+      } else {
+        other.push_back(p);
+      }
+    }
+  }
+
+  double sumSquares() const {
+    double sum = f32.sumSquares() + f64.sumSquares();
+    for (const auto& p : other) {
+      sum += fl::sum(*p.grad * *p.grad).asScalar<double>();
+    }
+    return sum;
+  }
+
+  // Declared first: the batches below lock tensors stored here.
+  std::deque<fl::Tensor> converted;
+  HostBatch<float> f32;
+  HostBatch<double> f64;
+  std::vector<ParamSlot> other;
+};
+
+// Gradient scale for clipping; `sum_squares` is recomputed up front only when
+// clipping needs it before the update.
+double clipScale(Plan& plan, double max_grad_norm, double* sum_squares) {
+  if (max_grad_norm <= 0) {
+    return 1;
+  }
+  *sum_squares = plan.sumSquares();
+  const double norm = std::sqrt(*sum_squares);
+  return norm > max_grad_norm ? max_grad_norm / norm : 1;
+}
+
+template <typename T>
+double adamHost(HostBatch<T>& batch, const AdamOptions& o, T scale) {
+  const T step_size = o.step_size;
+  const T b1 = o.b1;
+  const T b2 = o.b2;
+  const T eps = o.eps;
+  const T weight_decay = o.weight_decay;
+  // The norm is reduced over the segment first, while it is cached, so that
+  // the update loop carries no dependency across iterations and vectorizes
+  // (std::sqrt too, as this file is built with -fno-math-errno).
+  return batch.apply([&](T* __restrict p, const T* __restrict g,
+                         T* __restrict m, T* __restrict v, int64_t begin,
+                         int64_t end) {
+    const double sum = sumSquares(g, begin, end);
+    for (int64_t i = begin; i < end; ++i) {
+      const T gi = scale * g[i] + weight_decay * p[i];
+      const T mi = b1 * m[i] + (1 - b1) * gi;
+      const T vi = b2 * v[i] + (1 - b2) * gi * gi;
+      m[i] = mi;
+      v[i] = vi;
+      p[i] -= step_size * mi / (std::sqrt(vi) + eps);
+    }
+    return sum;
+  });
+}
+
+template <typename T>
+double sgdHost(HostBatch<T>& batch, const SgdOptions& o, T scale) {
+  const T lr = o.lr;
+  const T momentum = o.momentum;
+  const T weight_decay = o.weight_decay;
+  return batch.apply([&](T* __restrict p, const T* __restrict g,
+                         T* __restrict buf, T*, int64_t begin, int64_t end) {
+    const double sum = sumSquares(g, begin, end);
+    if (!buf) {
+      for (int64_t i = begin; i < end; ++i) {
+        p[i] -= lr * (scale * g[i] + weight_decay * p[i]);
+      }
+      return sum;
+    }
+    for (int64_t i = begin; i < end; ++i) {
+      const T b = momentum * buf[i] + scale * g[i] + weight_decay * p[i];
+      buf[i] = b;
+      p[i] -= lr * b;
+    }
+    return sum;
+  });
+}
+
+fl::Tensor scaledGrad(const ParamSlot& p, double scale, double weight_decay) {
+  auto g = scale != 1 ? *p.grad * scale : *p.grad;
+  return weight_decay ? g + weight_decay * *p.param : g;
+}
+
+}  // namespace
+
+double adamStep(const std::vector<ParamSlot>& slots,
+                const AdamOptions& options) {
+  for (const auto& slot : slots) {
+    if (!slot.state[0] || !slot.state[1]) {
+      throw std::invalid_argument("Adam needs both moment tensors");
+    }
+  }
+  Plan plan(slots);
+  double sum_squares = 0;
+  const double scale = clipScale(plan, options.max_grad_norm, &sum_squares);
+  const double host_sum = adamHost<float>(plan.f32, options, scale) +
+                          adamHost<double>(plan.f64, options, scale);
+  if (options.max_grad_norm <= 0) {
+    sum_squares = host_sum;
+  }
+  // Elsewhere each parameter is one JIT-fused ArrayFire expression.
+  for (auto& p : plan.other) {
+    if (options.max_grad_norm <= 0) {
+      sum_squares += fl::sum(*p.grad * *p.grad).asScalar<double>();
+    }
+    auto& m = *p.state[0];
+    auto& v = *p.state[1];
+    const auto g = scaledGrad(p, scale, options.weight_decay);
+    m = options.b1 * m + (1 - options.b1) * g;
+    v = options.b2 * v + (1 - options.b2) * g * g;
+    *p.param =
+        *p.param - options.step_size * m / (fl::sqrt(v) + options.eps);
+    fl::eval(m);
+    fl::eval(v);
+    fl::eval(*p.param);
+  }
+  return std::sqrt(sum_squares);
+}
+
+double sgdStep(const std::vector<ParamSlot>& slots, const SgdOptions& options) {
+  for (const auto& slot : slots) {
+    if (options.momentum && !slot.state[0]) {
+      throw std::invalid_argument("SGD with momentum needs a momentum buffer");
+    }
+  }
+  Plan plan(slots);
+  double sum_squares = 0;
+  const double scale = clipScale(plan, options.max_grad_norm, &sum_squares);
+  const double host_sum = sgdHost<float>(plan.f32, options, scale) +
+                          sgdHost<double>(plan.f64, options, scale);
+  if (options.max_grad_norm <= 0) {
+    sum_squares = host_sum;
+  }
+  for (auto& p : plan.other) {
+    if (options.max_grad_norm <= 0) {
+      sum_squares += fl::sum(*p.grad * *p.grad).asScalar<double>();
+    }
+    auto step = scaledGrad(p, scale, options.weight_decay);
+    if (auto* buf = options.momentum ? p.state[0] : nullptr) {
+      *buf = options.momentum * *buf + step;
+      fl::eval(*buf);
+      step = *buf;
+    }
+    *p.param = *p.param - options.lr * step;
+    fl::eval(*p.param);
+  }
+  return std::sqrt(sum_squares);
+}
+
+}  // namespace kernels
+}  // namespace shumai
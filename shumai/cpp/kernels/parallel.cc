@@ -0,0 +1,173 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace shumai {
+namespace kernels {
+namespace {
+
+thread_local bool t_pool_thread = false;
+
+struct Job {
+  const std::function<void(int64_t, int64_t)>* fn;
+  int64_t n;
+  int64_t chunk;
+  int64_t chunks;
+  std::atomic<int64_t> next = 0;
+  std::atomic<int64_t> done = 0;
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::exception_ptr error;
+
+  bool exhausted() const {
+    return next >= chunks;
+  }
+
+  // Runs chunks until every chunk has been claimed.
+  void work() {
+    int64_t c;
+    while ((c = next.fetch_add(1)) < chunks) {
+      try {
+        (*fn)(c * chunk, std::min(n, (c + 1) * chunk));
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      if (done.fetch_add(1) + 1 == chunks) {
+        std::lock_guard<std::mutex> guard(mutex);
+        finished.notify_all();
+      }
+    }
+  }
+};
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(int threads) {
+    for (int i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { loop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  int size() const {
+    return static_cast<int>(workers_.size());
+  }
+
+  void run(const std::shared_ptr<Job>& job) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      jobs_.push_back(job);
+    }
+    wake_.notify_all();
+    job->work();
+    {
+      std::unique_lock<std::mutex> lock(job->mutex);
+      job->finished.wait(lock, [&] { return job->done == job->chunks; });
+    }
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      auto it = std::find(jobs_.begin(), jobs_.end(), job);
+      if (it != jobs_.end()) {
+        jobs_.erase(it);
+      }
+    }
+    if (job->error) {
+      std::rethrow_exception(job->error);
+    }
+  }
+
+ private:
+  void loop() {
+    t_pool_thread = true;
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+          return;
+        }
+        job = jobs_.front();
+        if (job->exhausted()) {
+          jobs_.pop_front();
+          continue;
+        }
+      }
+      job->work();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  bool stop_ = false;
+};
+
+int configuredThreads() {
+  if (const char* env = std::getenv("SHUMAI_KERNEL_THREADS")) {
+    const int threads = std::atoi(env);
+    if (threads > 0) {
+      return threads;
+    }
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool& pool() {
+  static ThreadPool pool(configuredThreads() - 1);
+  return pool;
+}
+
+}  // namespace
+
+int numThreads() {
+  return pool().size() + 1;
+}
+
+void parallelFor(int64_t n,
+                 int64_t grain,
+                 const std::function<void(int64_t, int64_t)>& fn) {
+  if (n <= 0) {
+    return;
+  }
+  grain = std::max<int64_t>(grain, 1);
+  const int threads = numThreads();
+  if (t_pool_thread || threads == 1 || n <= grain) {
+    fn(0, n);
+    return;
+  }
+  // A few chunks per thread keeps threads busy when chunks run unevenly.
+  const int64_t chunk = std::max(grain, (n + 4 * threads - 1) / (4 * threads));
+  auto job = std::make_shared<Job>();
+  job->fn = &fn;
+  job->n = n;
+  job->chunk = chunk;
+  job->chunks = (n + chunk - 1) / chunk;
+  pool().run(job);
+}
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace shumai {
+namespace kernels {
+
+// Threads a kernel is split across, including the calling thread.  Defaults
+// to the hardware concurrency; SHUMAI_KERNEL_THREADS overrides it.
+int numThreads();
+
+// Calls `fn(begin, end)` on disjoint chunks covering [0, n), spread over the
+// kernel thread pool and the calling thread.  Chunks hold at least `grain`
+// items.  Runs inline when there is too little work or when called from a
+// pool thread.  The first exception thrown by `fn` is rethrown here.
+void parallelFor(int64_t n,
+                 int64_t grain,
+                 const std::function<void(int64_t, int64_t)>& fn);
+
+}  // namespace kernels
+}  // namespace shumai
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "host_tensor.h"
+#include "kernels.h"
+#include "parallel.h"
+#include "split.h"
+
+// Softmax and log-softmax in two sweeps over each slice: one for the max and
+// one computing exp(x - max), its sum and (after one more pass over the
+// output, which is still in cache) the normalized result.  Slices along the
+// contiguous axis are processed as rows with several independent
+// accumulators; slices along a strided axis are processed in blocks of
+// adjacent slices, so the innermost loops run over contiguous lanes either
+// way.  The backward passes only need the saved output.
+namespace shumai {
+namespace kernels {
+namespace {
+
+// Adjacent slices handled together when the softmax axis is strided.
+constexpr int64_t kLanes = 256;
+// Independent partial results per row, to keep reductions pipelined.
+constexpr int kUnroll = 8;
+// Roughly how many elements a parallelFor chunk should touch.
+constexpr int64_t kGrainElements = 1 << 15;
+
+Split softmaxSplit(const fl::Tensor& x, int dim) {
+  // Scalars are a single slice of one element along any axis.
+  return x.ndim() ? splitAt(x.shape(), dim) : Split{};
+}
+
+int64_t grainFor(int64_t elements) {
+  return std::max<int64_t>(1,
+                           kGrainElements / std::max<int64_t>(1, elements));
+}
+
+template <typename T>
+T rowMax(const T* x, int64_t n) {
+  T m[kUnroll];
+  std::fill(m, m + kUnroll, -std::numeric_limits<T>::infinity());
+  int64_t i = 0;
+  for (; i + kUnroll <= n; i += kUnroll) {
+    for (int u = 0; u < kUnroll; ++u) {
+      m[u] = std::max(m[u], x[i + u]);
+    }
+  }
+  for (; i < n; ++i) {
+    m[0] = std::max(m[0], x[i]);
+  }
+  return *std::max_element(m, m + kUnroll);
+}
+
+// Sum of a[i] * b[i] (or of a[i] when `b` is null).
+template <typename T>
+T rowSum(const T* a, const T* b, int64_t n) {
+  T s[kUnroll] = {};
+  int64_t i = 0;
+  for (; i + kUnroll <= n; i += kUnroll) {
+    for (int u = 0; u < kUnroll; ++u) {
+      s[u] += b ? a[i + u] * b[i + u] : a[i + u];
+    }
+  }
+  for (; i < n; ++i) {
+    s[0] += b ? a[i] * b[i] : a[i];
+  }
+  T sum = 0;
+  for (int u = 0; u < kUnroll; ++u) {
+    sum += s[u];
+  }
+  return sum;
+}
+
+template <typename T>
+void forwardRows(const T* x, const Split& s, bool log, T* y) {
+  parallelFor(s.outer, grainFor(s.size), [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const T* xr = x + r * s.size;
+      T* yr = y + r * s.size;
+      const T m = rowMax(xr, s.size);
+      for (int64_t i = 0; i < s.size; ++i) {
+        yr[i] = std::exp(xr[i] - m);
+      }
+      const T sum = rowSum<T>(yr, nullptr, s.size);
+      if (log) {
+        const T shift = m + std::log(sum);
+        for (int64_t i = 0; i < s.size; ++i) {
+          yr[i] = xr[i] - shift;
+        }
+      } else {
+        const T inv = T(1) / sum;
+        for (int64_t i = 0; i < s.size; ++i) {
+          yr[i] *= inv;
+        }
+      }
+    }
+  });
+}
+
+template <typename T>
+void forwardLanes(const T* x, const Split& s, bool log, T* y) {
+  const int64_t blocks = (s.inner + kLanes - 1) / kLanes;
+  const int64_t grain = grainFor(s.size * std::min(s.inner, kLanes));
+  parallelFor(s.outer * blocks, grain, [&](int64_t begin, int64_t end) {
+    std::vector<T> m(kLanes);
+    std::vector<T> sum(kLanes);
+    for (int64_t item = begin; item < end; ++item) {
+      const int64_t o = item / blocks;
+      const int64_t j0 = (item % blocks) * kLanes;
+      const int64_t n = std::min(kLanes, s.inner - j0);
+      const int64_t base = o * s.size * s.inner + j0;
+      std::fill(m.begin(), m.end(), -std::numeric_limits<T>::infinity());
+      std::fill(sum.begin(), sum.end(), T(0));
+      for (int64_t k = 0; k < s.size; ++k) {
+        const T* xk = x + base + k * s.inner;
+        for (int64_t j = 0; j < n; ++j) {
+          m[j] = std::max(m[j], xk[j]);
+        }
+      }
+      for (int64_t k = 0; k < s.size; ++k) {
+        const T* xk = x + base + k * s.inner;
+        T* yk = y + base + k * s.inner;
+        for (int64_t j = 0; j < n; ++j) {
+          yk[j] = std::exp(xk[j] - m[j]);
+          sum[j] += yk[j];
+        }
+      }
+      for (int64_t j = 0; j < n; ++j) {
+        sum[j] = log ? m[j] + std::log(sum[j]) : T(1) / sum[j];
+      }
+      for (int64_t k = 0; k < s.size; ++k) {
+        const T* xk = x + base + k * s.inner;
+        T* yk = y + base + k * s.inner;
+        for (int64_t j = 0; j < n; ++j) {
+          yk[j] = log ? xk[j] - sum[j] : yk[j] * sum[j];
+        }
+      }
+    }
+  });
+}
+
+// softmax:     dx = y * (dy - sum(dy * y))
+// log-softmax: dx = dy - exp(y) * sum(dy)
+template <typename T>
+void backwardRows(const T* dy, const T* y, const Split& s, bool log, T* dx) {
+  parallelFor(s.outer, grainFor(s.size), [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const T* dyr = dy + r * s.size;
+      const T* yr = y + r * s.size;
+      T* dxr = dx + r * s.size;
+      const T dot = rowSum(dyr, log ? nullptr : yr, s.size);
+      for (int64_t i = 0; i < s.size; ++i) {
+        dxr[i] = log ? dyr[i] - std::exp(yr[i]) * dot : yr[i] * (dyr[i] - dot);
+      }
+    }
+  });
+}
+
+template <typename T>
+void backwardLanes(const T* dy, const T* y, const Split& s, bool log, T* dx) {
+  const int64_t blocks = (s.inner + kLanes - 1) / kLanes;
+  const int64_t grain = grainFor(s.size * std::min(s.inner, kLanes));
+  parallelFor(s.outer * blocks, grain, [&](int64_t begin, int64_t end) {
+    std::vector<T> dot(kLanes);
+    for (int64_t item = begin; item < end; ++item) {
+      const int64_t o = item / blocks;
+      const int64_t j0 = (item % blocks) * kLanes;
+      const int64_t n = std::min(kLanes, s.inner - j0);
+      const int64_t base = o * s.size * s.inner + j0;
+      std::fill(dot.begin(), dot.end(), T(0));
+      for (int64_t k = 0; k < s.size; ++k) {
+        const T* dyk = dy + base + k * s.inner;
+        const T* yk = y + base + k * s.inner;
+        for (int64_t j = 0; j < n; ++j) {
+          dot[j] += log ? dyk[j] : dyk[j] * yk[j];
+        }
+      }
+      for (int64_t k = 0; k < s.size; ++k) {
+        const T* dyk = dy + base + k * s.inner;
+        const T* yk = y + base + k * s.inner;
+        T* dxk = dx + base + k * s.inner;
+        for (int64_t j = 0; j < n; ++j) {
+          dxk[j] = log ? dyk[j] - std::exp(yk[j]) * dot[j]
+                       : yk[j] * (dyk[j] - dot[j]);
+        }
+      }
+    }
+  });
+}
+
+// Kernels run in f32 or f64; other dtypes are computed in f32 (half
+// precision results are converted back).
+fl::dtype computeType(fl::dtype type) {
+  return type == fl::dtype::f64 ? fl::dtype::f64 : fl::dtype::f32;
+}
+
+fl::Tensor resultType(const fl::Tensor& t, fl::dtype type) {
+  return type == fl::dtype::f16 && t.type() != type ? t.astype(type) : t;
+}
+
+fl::Tensor sameType(const fl::Tensor& t, fl::dtype type) {
+  return t.type() == type ? t : t.astype(type);
+}
+
+}  // namespace
+
+fl::Tensor softmax(const fl::Tensor& x, int dim, bool log) {
+  const auto split = softmaxSplit(x, dim);
+  const auto type = computeType(x.type());
+  const auto input = sameType(x, type);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> xh(input);
+    HostOutput<T> out(x.shape(), type);
+    if (split.inner == 1) {
+      forwardRows<T>(xh.data(), split, log, out.data());
+    } else {
+      forwardLanes<T>(xh.data(), split, log, out.data());
+    }
+    result = out.finish();
+  });
+  return resultType(result, x.type());
+}
+
+fl::Tensor softmaxBackward(const fl::Tensor& grad_out,
+                           const fl::Tensor& out,
+                           int dim,
+                           bool log) {
+  if (grad_out.elements() != out.elements()) {
+    throw std::invalid_argument(
+        "softmax gradient does not match the forward pass");
+  }
+  const auto split = softmaxSplit(out, dim);
+  const auto type = computeType(out.type());
+  const auto grad = sameType(grad_out, type);
+  const auto output = sameType(out, type);
+  fl::Tensor result;
+  SHUMAI_KERNEL_DISPATCH(type, T, {
+    HostInput<T> gh(grad);
+    HostInput<T> yh(output);
+    HostOutput<T> dx(out.shape(), type);
+    if (split.inner == 1) {
+      backwardRows<T>(gh.data(), yh.data(), split, log, dx.data());
+    } else {
+      backwardLanes<T>(gh.data(), yh.data(), split, log, dx.data());
+    }
+    result = dx.finish();
+  });
+  return resultType(result, out.type());
+}
+
+}  // namespace kernels
+}  // namespace shumai
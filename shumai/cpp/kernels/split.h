@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+namespace kernels {
+
+// `shape` viewed as [inner, size, outer] around `dim` (column-major, so
+// `inner` is the contiguous extent).
+struct Split {
+  int64_t inner = 1;
+  int64_t size = 1;
+  int64_t outer = 1;
+};
+
+inline Split splitAt(const fl::Shape& shape, int dim) {
+  if (dim < 0 || dim >= shape.ndim()) {
+    throw std::invalid_argument("axis " + std::to_string(dim) +
+                                " out of range for tensor of rank " +
+                                std::to_string(shape.ndim()));
+  }
+  Split split;
+  for (int i = 0; i < shape.ndim(); ++i) {
+    if (i < dim) {
+      split.inner *= shape[i];
+    } else if (i == dim) {
+      split.size = shape[i];
+    } else {
+      split.outer *= shape[i];
+    }
+  }
+  return split;
+}
+
+}  // namespace kernels
+}  // namespace shumai
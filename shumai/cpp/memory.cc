@@ -0,0 +1,622 @@
+#include "memory.h"
+
+#include <af/backend.h>
+#include <af/device.h>
+#include <af/internal.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_set>
+#include "context.h"
+#include "flashlight/fl/tensor/backend/af/ArrayFireTensor.h"
+#include "flashlight/fl/tensor/backend/af/mem/MemoryManagerAdapter.h"
+#include "flashlight/fl/tensor/backend/af/mem/MemoryManagerInstaller.h"
+#include "sharded_counter.h"
+
+namespace shumai {
+namespace {
+
+constexpr size_t kAlignment = 64;
+constexpr size_t kSmallLimit = 1024;
+// Per-thread block caches only hold blocks up to this size, and at most
+// kThreadCacheBytes in total.
+constexpr size_t kThreadCacheMaxBlock = 256 << 10;
+constexpr size_t kThreadCacheBytes = 4 << 20;
+constexpr size_t kBlockShards = 16;
+
+struct AdoptedBuffer {
+  size_t bytes;
+  size_t refs;
+  bool user_locked;
+  std::thread::id owner;
+  // Frees the memory once unreferenced, for buffers owned by native code.
+  std::function<void()> release;
+};
+
+std::mutex g_adopted_mutex;
+std::unordered_map<const void*, AdoptedBuffer> g_adopted;
+std::unordered_map<std::thread::id, std::vector<void*>> g_released;
+std::atomic<size_t> g_adopted_bytes = 0;
+std::atomic<bool> g_any_adopted = false;
+
+ShardedCounter g_live_tensors;
+std::array<ShardedCounter, kNumDtypes> g_tensor_bytes;
+
+// Updated on every allocation, so sharded like the tensor counters above.
+// The peak is only raised when a thread's shard of `g_used_bytes` reaches a
+// new high, and when it is read.
+ShardedCounter g_used_bytes;
+ShardedCounter g_reserved_bytes;
+ShardedCounter g_in_use_bytes;
+std::atomic<size_t> g_peak_bytes = 0;
+std::atomic<size_t> g_high_water_mark = std::numeric_limits<size_t>::max();
+
+// Multiples of 64 bytes up to 1KB, then four classes per power of two, which
+// bounds the padding of a block to 25% of its size.
+size_t sizeClass(size_t bytes) {
+  if (bytes <= kSmallLimit) {
+    return ((bytes + kAlignment - 1) / kAlignment) * kAlignment;
+  }
+  size_t pow2 = kSmallLimit;
+  while (pow2 * 2 < bytes) {
+    pow2 *= 2;
+  }
+  const size_t step = pow2 / 4;
+  return ((bytes + step - 1) / step) * step;
+}
+
+// Shards may be transiently negative when blocks are freed by other threads
+// than the ones that allocated them; their sum is not.
+size_t total(const ShardedCounter& counter) {
+  return std::max<int64_t>(counter.load(), 0);
+}
+
+void updatePeak() {
+  const size_t used = total(g_used_bytes);
+  size_t peak = g_peak_bytes;
+  while (used > peak && !g_peak_bytes.compare_exchange_weak(peak, used)) {
+  }
+}
+
+// A caching allocator for ArrayFire buffers.  Freed blocks are kept in free
+// lists keyed by size class and handed out again instead of going back to the
+// OS, until the reserved total exceeds the high-water mark.  Small blocks are
+// cached per thread first; the shared per-device pools and the sharded block
+// table are only locked on a miss, so threads allocate in parallel.
+//
+// Adopted memory (see `adoptBuffer`) is never freed or pooled: ArrayFire
+// treats unknown pointers as user allocations and would otherwise free (or,
+// once user-locked, recycle) memory owned by JS.
+class HostMemoryManager : public fl::MemoryManagerAdapter {
+ public:
+  HostMemoryManager(std::shared_ptr<fl::MemoryManagerDeviceInterface> itf,
+                    bool host)
+      : fl::MemoryManagerAdapter(itf), host_(host) {}
+
+  void initialize() override {}
+
+  void shutdown() override {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    releasePoolsLocked();
+  }
+
+  void* alloc(bool user_lock,
+              const unsigned ndims,
+              dim_t* dims,
+              const unsigned element_size) override {
+    size_t bytes = element_size;
+    for (unsigned i = 0; i < ndims; ++i) {
+      bytes *= dims[i];
+    }
+    if (bytes == 0) {
+      return nullptr;
+    }
+    const size_t size = sizeClass(bytes);
+    const int device = deviceInterface->getActiveDeviceId();
+
+    void* ptr = nullptr;
+    auto* ctx = currentContext();
+    if (ctx && cacheable(size, device)) {
+      ptr = takeCached(ctx->blocks, size, device);
+    }
+    if (!ptr) {
+      ptr = allocateShared(size, device);
+    }
+    {
+      auto& shard = shardFor(ptr);
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      // As in ArrayFire, a user-locked allocation is not also manager-locked.
+      shard.blocks[ptr] =
+          Block{bytes, size, device, !user_lock, user_lock, false};
+    }
+    g_in_use_bytes.add(size);
+    if (g_used_bytes.addReachesHigh(bytes)) {
+      updatePeak();
+    }
+    return ptr;
+  }
+
+  size_t allocated(void* ptr) override {
+    auto& shard = shardFor(ptr);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.blocks.find(ptr);
+    return it == shard.blocks.end() ? 0 : it->second.size;
+  }
+
+  // The bytes `alloc` was asked for, or 0 if `ptr` was not allocated here.
+  size_t requested(void* ptr) {
+    auto& shard = shardFor(ptr);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.blocks.find(ptr);
+    return it == shard.blocks.end() ? 0 : it->second.bytes;
+  }
+
+  void unlock(void* ptr, bool user_unlock) override {
+    if (!ptr || unlockAdopted(ptr, user_unlock)) {
+      return;
+    }
+    Block released;
+    {
+      auto& shard = shardFor(ptr);
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      auto it = shard.blocks.find(ptr);
+      if (it == shard.blocks.end()) {
+        // Probably came from the user, who handed ownership to ArrayFire.
+        deviceInterface->nativeFree(ptr);
+        return;
+      }
+      auto& block = it->second;
+      if (user_unlock) {
+        block.user_locked = false;
+      } else {
+        block.manager_locked = false;
+      }
+      if (block.manager_locked || block.user_locked) {
+        return;
+      }
+      released = block;
+      shard.blocks.erase(it);
+    }
+    if (released.foreign) {
+      deviceInterface->nativeFree(ptr);
+      return;
+    }
+    g_in_use_bytes.add(-static_cast<int64_t>(released.size));
+    g_used_bytes.add(-static_cast<int64_t>(released.bytes));
+    if (overHighWaterMark()) {
+      freeNative(ptr);
+      g_reserved_bytes.add(-static_cast<int64_t>(released.size));
+      return;
+    }
+    auto* ctx = currentContext();
+    if (ctx && cacheable(released.size, released.device) &&
+        ctx->blocks.bytes + released.size <= kThreadCacheBytes) {
+      ctx->blocks.free[cacheKey(released.size, released.device)].emplace_back(
+          ptr);
+      ctx->blocks.bytes += released.size;
+      return;
+    }
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    pools_[released.device][released.size].emplace_back(ptr);
+  }
+
+  void signalMemoryCleanup() override {
+    if (auto* ctx = currentContext()) {
+      returnToPools(ctx->blocks);
+    }
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    releasePoolsLocked();
+  }
+
+  void printInfo(const char* msg, const int device) override {
+    std::cout << msg << "\n  reserved: " << total(g_reserved_bytes)
+              << " bytes\n  in use: " << total(g_in_use_bytes) << " bytes"
+              << "\n  adopted: " << g_adopted_bytes << " bytes" << std::endl;
+  }
+
+  void userLock(const void* ptr) override {
+    if (setAdoptedUserLocked(ptr, true)) {
+      return;
+    }
+    auto* key = const_cast<void*>(ptr);
+    auto& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.blocks.find(key);
+    if (it != shard.blocks.end()) {
+      it->second.user_locked = true;
+    } else {
+      shard.blocks[key] =
+          Block{0, 0, deviceInterface->getActiveDeviceId(), false, true, true};
+    }
+  }
+
+  void userUnlock(const void* ptr) override {
+    unlock(const_cast<void*>(ptr), true);
+  }
+
+  bool isUserLocked(const void* ptr) override {
+    if (g_any_adopted) {
+      std::lock_guard<std::mutex> guard(g_adopted_mutex);
+      auto it = g_adopted.find(ptr);
+      if (it != g_adopted.end()) {
+        return it->second.user_locked;
+      }
+    }
+    auto* key = const_cast<void*>(ptr);
+    auto& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.blocks.find(key);
+    return it != shard.blocks.end() && it->second.user_locked;
+  }
+
+  float getMemoryPressure() override {
+    return 0.0f;
+  }
+
+  bool jitTreeExceedsMemoryPressure(size_t bytes) override {
+    return 2 * bytes > total(g_in_use_bytes);
+  }
+
+  void addMemoryManagement(int device) override {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    pools_[device];
+  }
+
+  void removeMemoryManagement(int device) override {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    auto it = pools_.find(device);
+    if (it != pools_.end()) {
+      releasePoolLocked(it->second);
+      pools_.erase(it);
+    }
+  }
+
+  // Moves a thread's cached blocks into the shared pools.
+  void returnToPools(BlockCache& cache) {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    for (auto& [key, free_list] : cache.free) {
+      const int device = key % kAlignment;
+      auto& pool_list = pools_[device][key - device];
+      pool_list.insert(pool_list.end(), free_list.begin(), free_list.end());
+      free_list.clear();
+    }
+    cache.bytes = 0;
+  }
+
+ private:
+  struct Block {
+    size_t bytes;
+    size_t size;
+    int device;
+    bool manager_locked;
+    bool user_locked;
+    // Registered through userLock without being allocated here.
+    bool foreign;
+  };
+  using Pool = std::unordered_map<size_t, std::vector<void*>>;
+
+  struct BlockShard {
+    std::mutex mutex;
+    std::unordered_map<void*, Block> blocks;
+  };
+
+  // Only sums the reserved bytes when a high-water mark is set.
+  static bool overHighWaterMark() {
+    const size_t mark = g_high_water_mark;
+    return mark != std::numeric_limits<size_t>::max() &&
+           total(g_reserved_bytes) > mark;
+  }
+
+  static bool cacheable(size_t size, int device) {
+    return size <= kThreadCacheMaxBlock && device >= 0 &&
+           device < static_cast<int>(kAlignment);
+  }
+
+  // Size classes are multiples of 64, which leaves room for the device id.
+  static size_t cacheKey(size_t size, int device) {
+    return size + device;
+  }
+
+  static void* takeCached(BlockCache& cache, size_t size, int device) {
+    auto it = cache.free.find(cacheKey(size, device));
+    if (it == cache.free.end() || it->second.empty()) {
+      return nullptr;
+    }
+    void* ptr = it->second.back();
+    it->second.pop_back();
+    cache.bytes -= size;
+    return ptr;
+  }
+
+  BlockShard& shardFor(const void* ptr) {
+    const auto bits = reinterpret_cast<uintptr_t>(ptr);
+    return shards_[((bits >> 6) ^ (bits >> 12)) % kBlockShards];
+  }
+
+  void* allocateShared(size_t size, int device) {
+    {
+      std::lock_guard<std::mutex> guard(pool_mutex_);
+      auto& free_list = pools_[device][size];
+      if (!free_list.empty()) {
+        void* ptr = free_list.back();
+        free_list.pop_back();
+        return ptr;
+      }
+    }
+    void* ptr = allocateNative(size);
+    if (!ptr) {
+      signalMemoryCleanup();
+      ptr = allocateNative(size);
+    }
+    if (!ptr) {
+      throw std::bad_alloc();
+    }
+    g_reserved_bytes.add(size);
+    return ptr;
+  }
+
+  void* allocateNative(size_t size) {
+    try {
+      // Size classes are multiples of the alignment, as aligned_alloc needs.
+      return host_ ? std::aligned_alloc(kAlignment, size)
+                   : deviceInterface->nativeAlloc(size);
+    } catch (...) {
+      return nullptr;
+    }
+  }
+
+  void freeNative(void* ptr) {
+    if (host_) {
+      std::free(ptr);
+    } else {
+      deviceInterface->nativeFree(ptr);
+    }
+  }
+
+  void releasePoolLocked(Pool& pool) {
+    for (auto& [size, free_list] : pool) {
+      for (auto* ptr : free_list) {
+        freeNative(ptr);
+        g_reserved_bytes.add(-static_cast<int64_t>(size));
+      }
+      free_list.clear();
+    }
+  }
+
+  void releasePoolsLocked() {
+    for (auto& [device, pool] : pools_) {
+      releasePoolLocked(pool);
+    }
+  }
+
+  static bool unlockAdopted(void* ptr, bool user_unlock) {
+    if (!g_any_adopted) {
+      return false;
+    }
+    std::function<void()> release;
+    {
+      std::lock_guard<std::mutex> guard(g_adopted_mutex);
+      auto it = g_adopted.find(ptr);
+      if (it == g_adopted.end()) {
+        return false;
+      }
+      if (user_unlock) {
+        it->second.user_locked = false;
+      } else if (--it->second.refs == 0) {
+        g_adopted_bytes -= it->second.bytes;
+        if (it->second.release) {
+          release = std::move(it->second.release);
+        } else {
+          g_released[it->second.owner].emplace_back(ptr);
+        }
+        g_adopted.erase(it);
+        g_any_adopted = !g_adopted.empty();
+      }
+    }
+    // Outside the lock: releasing may unmap memory, which is not cheap.
+    if (release) {
+      release();
+    }
+    return true;
+  }
+
+  static bool setAdoptedUserLocked(const void* ptr, bool locked) {
+    if (!g_any_adopted) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard(g_adopted_mutex);
+    auto it = g_adopted.find(ptr);
+    if (it == g_adopted.end()) {
+      return false;
+    }
+    it->second.user_locked = locked;
+    return true;
+  }
+
+  const bool host_;
+  std::array<BlockShard, kBlockShards> shards_;
+  std::mutex pool_mutex_;
+  std::unordered_map<int, Pool> pools_;
+};
+
+std::shared_ptr<HostMemoryManager> g_manager;
+
+}  // namespace
+
+BlockCache::~BlockCache() {
+  if (g_manager) {
+    g_manager->returnToPools(*this);
+  }
+}
+
+void installMemoryManager() {
+  auto device_interface = std::make_shared<fl::MemoryManagerDeviceInterface>();
+  g_manager =
+      std::make_shared<HostMemoryManager>(device_interface, hostIsDevice());
+  static fl::MemoryManagerInstaller installer(g_manager);
+  installer.setAsMemoryManager();
+}
+
+bool hostIsDevice() {
+  return af::getActiveBackend() == AF_BACKEND_CPU;
+}
+
+size_t bytesUsed() {
+  return total(g_used_bytes);
+}
+
+size_t bytesPeak() {
+  updatePeak();
+  return g_peak_bytes;
+}
+
+void resetBytesPeak() {
+  g_used_bytes.resetHighs();
+  g_peak_bytes = total(g_used_bytes);
+}
+
+size_t uniqueBytes(const std::vector<fl::Tensor>& tensors) {
+  std::unordered_set<void*> seen;
+  size_t bytes = 0;
+  for (const auto& tensor : tensors) {
+    if (!g_manager || !tensor.elements()) {
+      continue;
+    }
+    // The start of the underlying buffer (shared by views), without the copy
+    // that device() makes of shared buffers.
+    void* ptr = af::getRawPtr(fl::toArray(tensor));
+    if (seen.insert(ptr).second) {
+      bytes += g_manager->requested(ptr);
+    }
+  }
+  return bytes;
+}
+
+void trackTensor(const fl::Tensor& tensor) {
+  const int64_t bytes = tensor.bytes();
+  g_live_tensors.add(1);
+  g_tensor_bytes[static_cast<int>(tensor.type())].add(bytes);
+  if (auto* ctx = currentContext()) {
+    ctx->tensors++;
+    ctx->tensor_bytes += bytes;
+  }
+}
+
+void untrackTensor(const fl::Tensor& tensor) {
+  const int64_t bytes = tensor.bytes();
+  g_live_tensors.add(-1);
+  g_tensor_bytes[static_cast<int>(tensor.type())].add(-bytes);
+  if (auto* ctx = currentContext()) {
+    ctx->tensors--;
+    ctx->tensor_bytes -= bytes;
+  }
+}
+
+int64_t liveTensors() {
+  return g_live_tensors.load();
+}
+
+int64_t threadTensors() {
+  auto* ctx = currentContext();
+  return ctx ? ctx->tensors : 0;
+}
+
+int64_t threadTensorBytes() {
+  auto* ctx = currentContext();
+  return ctx ? ctx->tensor_bytes : 0;
+}
+
+int64_t tensorBytes(fl::dtype type) {
+  return g_tensor_bytes[static_cast<int>(type)].load();
+}
+
+size_t bytesReserved() {
+  return total(g_reserved_bytes);
+}
+
+size_t bytesInUse() {
+  return total(g_in_use_bytes);
+}
+
+void emptyCache() {
+  if (g_manager) {
+    g_manager->signalMemoryCleanup();
+  }
+}
+
+void setCacheHighWaterMark(size_t bytes) {
+  g_high_water_mark = bytes;
+  if (total(g_reserved_bytes) > bytes) {
+    emptyCache();
+  }
+}
+
+size_t cacheHighWaterMark() {
+  return g_high_water_mark;
+}
+
+void adoptBuffer(void* ptr, size_t bytes, std::function<void()> release) {
+  std::lock_guard<std::mutex> guard(g_adopted_mutex);
+  auto it = g_adopted.find(ptr);
+  if (it != g_adopted.end()) {
+    it->second.refs++;
+    return;
+  }
+  g_adopted.emplace(ptr, AdoptedBuffer{bytes, 1, false,
+                                       std::this_thread::get_id(),
+                                       std::move(release)});
+  g_adopted_bytes += bytes;
+  g_any_adopted = true;
+}
+
+void forgetBuffer(void* ptr) {
+  std::lock_guard<std::mutex> guard(g_adopted_mutex);
+  auto it = g_adopted.find(ptr);
+  if (it == g_adopted.end()) {
+    return;
+  }
+  if (--it->second.refs == 0) {
+    g_adopted_bytes -= it->second.bytes;
+    g_adopted.erase(it);
+    g_any_adopted = !g_adopted.empty();
+  }
+}
+
+bool isAdopted(const void* ptr) {
+  if (!g_any_adopted) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(g_adopted_mutex);
+  return g_adopted.count(ptr) > 0;
+}
+
+size_t drainReleasedBuffers(int64_t* out, size_t capacity) {
+  std::lock_guard<std::mutex> guard(g_adopted_mutex);
+  auto it = g_released.find(std::this_thread::get_id());
+  if (it == g_released.end()) {
+    return 0;
+  }
+  auto& released = it->second;
+  size_t count = 0;
+  while (count < capacity && !released.empty()) {
+    out[count++] = reinterpret_cast<int64_t>(released.back());
+    released.pop_back();
+  }
+  if (released.empty()) {
+    g_released.erase(it);
+  }
+  return count;
+}
+
+size_t adoptedBytes() {
+  return g_adopted_bytes;
+}
+
+}  // namespace shumai
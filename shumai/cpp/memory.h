@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+
+// Installs shumai's caching memory manager into the ArrayFire backend.  Must
+// be called after fl::init(), before any tensor is created.
+void installMemoryManager();
+
+// True when ArrayFire's device memory is plain host memory (CPU backend),
+// which is what allows tensors to adopt externally owned buffers.
+bool hostIsDevice();
+
+// Bytes requested for live buffers.  Every buffer counts once, no matter how
+// many tensors (views, reshapes, shallow copies) reference it, and adopted
+// memory is not included.
+size_t bytesUsed();
+// High-water mark of `bytesUsed` since startup or the last reset.  Sampled
+// whenever one thread's share of `bytesUsed` reaches a new high (and on
+// read), so a peak only reached through several threads at once may be
+// missed.
+size_t bytesPeak();
+void resetBytesPeak();
+// Bytes requested for the distinct buffers behind `tensors`, counted as in
+// `bytesUsed`: views of one buffer count once and adopted memory not at all.
+size_t uniqueBytes(const std::vector<fl::Tensor>& tensors);
+
+// Bytes held by the memory manager: blocks backing live buffers plus freed
+// blocks cached for reuse.
+size_t bytesReserved();
+// Bytes of blocks backing live buffers (rounded up to their size class).
+size_t bytesInUse();
+
+// Returns the blocks cached by the shared pools and by the calling thread to
+// the OS (or device driver).  Other threads keep their (small) caches.
+void emptyCache();
+
+// Small freed blocks kept by one thread (see ExecutionContext), so that steady
+// state allocation never touches the shared pools.
+struct BlockCache {
+  BlockCache() = default;
+  BlockCache(const BlockCache&) = delete;
+  BlockCache& operator=(const BlockCache&) = delete;
+  // Returns the cached blocks to the shared pools.
+  ~BlockCache();
+
+  // Keyed by size class plus device id (size classes are multiples of 64).
+  std::unordered_map<size_t, std::vector<void*>> free;
+  size_t bytes = 0;
+};
+
+// Freed blocks are returned to the OS instead of cached while more than
+// `bytes` are reserved.  Unlimited by default.
+void setCacheHighWaterMark(size_t bytes);
+size_t cacheHighWaterMark();
+
+// Live tensor handles and their logical bytes (elements x element size) by
+// dtype.  Unlike `bytesUsed`, views count here once per handle.  Maintained
+// by `newTensor`/`deleteTensor` in handle_pool.h, lock-free and sharded.
+constexpr int kNumDtypes = 11;
+void trackTensor(const fl::Tensor& tensor);
+void untrackTensor(const fl::Tensor& tensor);
+int64_t liveTensors();
+int64_t tensorBytes(fl::dtype type);
+// The same, net of what the calling thread created and deleted: e.g. zero
+// after a worker released everything it allocated, whatever other threads do.
+int64_t threadTensors();
+int64_t threadTensorBytes();
+
+// Registers `ptr` as externally owned memory: ArrayFire may reference it but
+// never frees or recycles it.  Adopting the same pointer again bumps a
+// reference count; `forgetBuffer` undoes a registration that was not used.
+//
+// Once ArrayFire drops its last reference, `release` is called (on whichever
+// thread unlocked the buffer) if given; otherwise the pointer is queued for
+// `drainReleasedBuffers`.  `forgetBuffer` never calls `release`.
+void adoptBuffer(void* ptr,
+                 size_t bytes,
+                 std::function<void()> release = nullptr);
+void forgetBuffer(void* ptr);
+bool isAdopted(const void* ptr);
+
+// Moves adopted pointers that ArrayFire no longer references into `out` and
+// returns how many were written.  Only pointers adopted by the calling thread
+// are reported, since only that thread's JS realm holds their arrays.
+size_t drainReleasedBuffers(int64_t* out, size_t capacity);
+
+// Bytes of adopted memory still referenced by tensors.
+size_t adoptedBytes();
+
+}  // namespace shumai
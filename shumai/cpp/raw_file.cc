@@ -0,0 +1,268 @@
+#include "raw_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "hash.h"
+#include "kernels/host_tensor.h"
+#include "memory.h"
+
+namespace shumai {
+namespace {
+
+constexpr char kMagic[8] = {'S', 'H', 'M', 'A', 'I', 'R', 'A', 'W'};
+constexpr uint32_t kVersion = 1;
+// Also the offset of the data.  A multiple of the page size on every
+// platform we run on, so the data can be mapped where it lies.
+constexpr size_t kHeaderBytes = 4096;
+constexpr int kMaxDims = 32;
+
+struct RawHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t data_offset;
+  int32_t dtype;
+  int32_t ndim;
+  uint64_t data_bytes;
+  uint64_t checksum;
+  // Column-major (Flashlight) order; strides are in elements.
+  int64_t shape[kMaxDims];
+  int64_t strides[kMaxDims];
+};
+static_assert(sizeof(RawHeader) <= kHeaderBytes, "header must fit its page");
+
+std::runtime_error ioError(const std::string& what, const std::string& path) {
+  return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+// Closes a file descriptor on scope exit.
+struct FileDescriptor {
+  int fd;
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+void writeAll(int fd, const void* data, size_t bytes, const std::string& path) {
+  const auto* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const auto written = ::write(fd, p, bytes);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw ioError("cannot write", path);
+    }
+    p += written;
+    bytes -= written;
+  }
+}
+
+void syncFile(int fd, const std::string& path) {
+  while (::fsync(fd) != 0) {
+    if (errno != EINTR) {
+      throw ioError("cannot sync", path);
+    }
+  }
+}
+
+// Makes a rename in the directory of `path` durable.
+void syncDirectory(const std::string& path) {
+  const auto slash = path.rfind('/');
+  std::string dir = ".";
+  if (slash != std::string::npos) {
+    dir = slash == 0 ? "/" : path.substr(0, slash);
+  }
+  FileDescriptor file{::open(dir.c_str(), O_RDONLY | O_DIRECTORY)};
+  if (file.fd < 0) {
+    throw ioError("cannot open", dir);
+  }
+  syncFile(file.fd, dir);
+}
+
+// Creates a temporary file next to `path` that no other thread or process is
+// writing, and sets `tmp` to its name.
+int createTemporary(const std::string& path, std::string& tmp) {
+  static std::atomic<uint64_t> counter = 0;
+  const auto prefix = path + ".tmp" + std::to_string(::getpid()) + ".";
+  while (true) {
+    tmp = prefix + std::to_string(counter++);
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    // A leftover of a process that crashed with the same pid.
+    if (fd >= 0 || errno != EEXIST) {
+      return fd;
+    }
+  }
+}
+
+bool readHeader(int fd, RawHeader& header) {
+  return ::pread(fd, &header, sizeof(header), 0) ==
+             static_cast<ssize_t>(sizeof(header)) &&
+         std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+fl::Shape headerShape(const RawHeader& header, const std::string& path) {
+  if (header.version != kVersion || header.data_offset != kHeaderBytes ||
+      header.ndim < 0 || header.ndim > kMaxDims) {
+    throw std::runtime_error("unsupported raw tensor file '" + path + "'");
+  }
+  std::vector<fl::Dim> dims(header.shape, header.shape + header.ndim);
+  fl::Shape shape(dims);
+  // Only dense data is written today; strides leave room for other layouts.
+  int64_t stride = 1;
+  for (int i = 0; i < header.ndim; ++i) {
+    if (header.strides[i] != stride) {
+      throw std::runtime_error("raw tensor file '" + path +
+                               "' is not densely packed");
+    }
+    stride *= header.shape[i];
+  }
+  const auto dtype = static_cast<fl::dtype>(header.dtype);
+  if (header.data_bytes !=
+      static_cast<uint64_t>(shape.elements()) * fl::getTypeSize(dtype)) {
+    throw std::runtime_error("raw tensor file '" + path +
+                             "' does not match its header");
+  }
+  return shape;
+}
+
+}  // namespace
+
+void replaceFile(const std::string& path,
+                 const std::function<void(const std::string&, int)>& write) {
+  std::string tmp;
+  FileDescriptor file{createTemporary(path, tmp)};
+  if (file.fd < 0) {
+    throw ioError("cannot create", tmp);
+  }
+  try {
+    write(tmp, file.fd);
+    syncFile(file.fd, tmp);
+    if (::rename(tmp.c_str(), path.c_str()) != 0) {
+      throw ioError("cannot rename to", path);
+    }
+  } catch (...) {
+    ::unlink(tmp.c_str());
+    throw;
+  }
+  syncDirectory(path);
+}
+
+uint64_t contentHash(const fl::Tensor& tensor) {
+  // Seeded with the dtype and shape, so tensors that merely share their bytes
+  // hash differently.
+  std::vector<int64_t> meta = {static_cast<int64_t>(tensor.type())};
+  for (int i = 0; i < tensor.ndim(); ++i) {
+    meta.push_back(tensor.shape()[i]);
+  }
+  kernels::HostBytes dense(tensor);
+  const auto seed = xxh64(meta.data(), meta.size() * sizeof(int64_t));
+  return xxh64(dense.data(), dense.bytes(), seed);
+}
+
+size_t saveRaw(const fl::Tensor& tensor, const std::string& path) {
+  const auto& shape = tensor.shape();
+  if (shape.ndim() > kMaxDims) {
+    throw std::invalid_argument("raw tensor files support up to " +
+                                std::to_string(kMaxDims) + " dimensions");
+  }
+  kernels::HostBytes dense(tensor);
+
+  std::vector<char> page(kHeaderBytes, 0);
+  auto& header = *reinterpret_cast<RawHeader*>(page.data());
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.data_offset = kHeaderBytes;
+  header.dtype = static_cast<int32_t>(tensor.type());
+  header.ndim = shape.ndim();
+  header.data_bytes = dense.bytes();
+  header.checksum = xxh64(dense.data(), dense.bytes());
+  int64_t stride = 1;
+  for (int i = 0; i < shape.ndim(); ++i) {
+    header.shape[i] = shape[i];
+    header.strides[i] = stride;
+    stride *= shape[i];
+  }
+
+  replaceFile(path, [&](const std::string& tmp, int fd) {
+    writeAll(fd, page.data(), page.size(), tmp);
+    writeAll(fd, dense.data(), dense.bytes(), tmp);
+  });
+  return kHeaderBytes + dense.bytes();
+}
+
+fl::Tensor loadRaw(const std::string& path, bool verify) {
+  FileDescriptor file{::open(path.c_str(), O_RDONLY)};
+  if (file.fd < 0) {
+    throw ioError("cannot open", path);
+  }
+  RawHeader header;
+  if (!readHeader(file.fd, header)) {
+    throw std::runtime_error("'" + path + "' is not a raw tensor file");
+  }
+  const auto shape = headerShape(header, path);
+  const auto dtype = static_cast<fl::dtype>(header.dtype);
+  const size_t bytes = header.data_bytes;
+  if (bytes == 0) {
+    return fl::Tensor(shape, dtype);
+  }
+
+  struct stat info;
+  if (::fstat(file.fd, &info) != 0) {
+    throw ioError("cannot stat", path);
+  }
+  const size_t size = kHeaderBytes + bytes;
+  if (static_cast<size_t>(info.st_size) < size) {
+    throw std::runtime_error("raw tensor file '" + path + "' is truncated");
+  }
+
+  // Private and writable: pages stay shared with the page cache (and other
+  // processes) until something writes to them, and writes never reach the
+  // file.
+  void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      file.fd, 0);
+  if (base == MAP_FAILED) {
+    throw ioError("cannot map", path);
+  }
+  void* data = static_cast<char*>(base) + kHeaderBytes;
+  try {
+    if (verify && xxh64(data, bytes) != header.checksum) {
+      throw std::runtime_error("checksum mismatch in raw tensor file '" +
+                               path + "'");
+    }
+    if (!hostIsDevice()) {
+      fl::Tensor tensor(shape, dtype, data, fl::MemoryLocation::Host);
+      ::munmap(base, size);
+      return tensor;
+    }
+  } catch (...) {
+    ::munmap(base, size);
+    throw;
+  }
+
+  adoptBuffer(data, bytes, [base, size]() { ::munmap(base, size); });
+  try {
+    return fl::Tensor(shape, dtype, data, fl::MemoryLocation::Device);
+  } catch (...) {
+    forgetBuffer(data);
+    ::munmap(base, size);
+    throw;
+  }
+}
+
+bool isRawFile(const std::string& path) {
+  FileDescriptor file{::open(path.c_str(), O_RDONLY)};
+  RawHeader header;
+  return file.fd >= 0 && readHeader(file.fd, header);
+}
+
+}  // namespace shumai
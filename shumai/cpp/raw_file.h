@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+
+// A tensor file that can be mapped instead of read: a fixed 4KB header (magic,
+// dtype, shape and strides in Flashlight's column-major order, and an XXH64
+// checksum of the data) followed by the raw, dense data, which therefore
+// starts on a page boundary.
+
+// Replaces `path` atomically and durably: `write` fills a new, uniquely
+// named file next to `path` (given its name and an open descriptor), which
+// is synced to disk and renamed over `path`, and the directory is synced
+// after.  A crash leaves either the old or the new file, never a partial one,
+// and concurrent writers to the same path never share a temporary file.
+void replaceFile(const std::string& path,
+                 const std::function<void(const std::string&, int)>& write);
+
+// Writes `tensor` to `path` (see `replaceFile`) and returns the size of the
+// file.  Processes that mapped the previous version keep seeing consistent
+// data.
+size_t saveRaw(const fl::Tensor& tensor, const std::string& path);
+
+// Maps `path` (copy-on-write) and returns a tensor backed directly by the page
+// cache, so the data is neither read up front nor duplicated across
+// processes loading the same file.  The mapping is released with the last
+// tensor referencing it and counts as adopted memory (see `adoptBuffer`).
+// Backends that cannot address host memory get a copy.  With `verify`, the
+// checksum is checked first (which reads every page).
+fl::Tensor loadRaw(const std::string& path, bool verify);
+
+// XXH64 of the dense data of `tensor`, seeded with its dtype and shape: equal
+// for tensors with the same contents, whatever their memory layout.
+uint64_t contentHash(const fl::Tensor& tensor);
+
+// Whether `path` starts with the header written by `saveRaw`.
+bool isRawFile(const std::string& path);
+
+}  // namespace shumai
@@ -0,0 +1,235 @@
+#include "save_queue.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "flashlight/fl/common/Serialization.h"
+#include "raw_file.h"
+
+namespace shumai {
+namespace {
+
+constexpr size_t kMaxQueuedBytes = size_t(1) << 30;
+
+enum class SaveFormat { Flashlight, Raw, Contents };
+
+struct SaveJob {
+  int64_t ticket;
+  SaveFormat format;
+  fl::Tensor tensor;
+  std::string contents;
+  std::string path;
+  size_t bytes;
+  // Saves that must have succeeded for this one to be written.
+  std::vector<int64_t> after;
+};
+
+void write(const SaveJob& job) {
+  if (job.format == SaveFormat::Raw) {
+    saveRaw(job.tensor, job.path);
+    return;
+  }
+  replaceFile(job.path, [&](const std::string& tmp, int) {
+    if (job.format == SaveFormat::Flashlight) {
+      fl::save(tmp, job.tensor);
+      return;
+    }
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    file.write(job.contents.data(), job.contents.size());
+    file.close();
+    if (!file) {
+      throw std::runtime_error("cannot write '" + tmp + "'");
+    }
+  });
+}
+
+class SaveQueue {
+ public:
+  // Static destruction waits for the saves still queued.
+  ~SaveQueue() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    if (writer_.joinable()) {
+      writer_.join();
+    }
+  }
+
+  // `job.ticket` is assigned here.
+  int64_t push(SaveJob job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Don't let snapshots pile up faster than the disk takes them.
+    done_.wait(lock, [&] {
+      return jobs_.empty() || queued_bytes_ + job.bytes <= kMaxQueuedBytes;
+    });
+    if (!writer_.joinable()) {
+      writer_ = std::thread([this] { loop(); });
+    }
+    job.ticket = next_ticket_++;
+    latest_[job.path] = job.ticket;
+    unfinished_.insert(job.ticket);
+    queued_bytes_ += job.bytes;
+    jobs_.push_back(std::move(job));
+    wake_.notify_all();
+    return next_ticket_ - 1;
+  }
+
+  void flush(int64_t ticket) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (ticket <= 0 || ticket >= next_ticket_) {
+      ticket = next_ticket_ - 1;
+    }
+    done_.wait(lock, [&] { return !unfinished_.count(ticket); });
+    if (errors_.empty()) {
+      return;
+    }
+    std::string what = "failed to save";
+    for (const auto& error : errors_) {
+      what += "\n  " + error;
+    }
+    errors_.clear();
+    throw std::runtime_error(what);
+  }
+
+  int status(int64_t ticket) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (failed_.count(ticket)) {
+      return -1;
+    }
+    return unfinished_.count(ticket) ? 0 : 1;
+  }
+
+  int64_t pending() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return unfinished_.size();
+  }
+
+ private:
+  void loop() {
+    while (true) {
+      SaveJob job;
+      bool superseded;
+      std::string error;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+        superseded = latest_.at(job.path) != job.ticket;
+        for (auto ticket : job.after) {
+          if (failed_.count(ticket)) {
+            error = job.path + ": not written, a save it depends on failed";
+            break;
+          }
+        }
+      }
+      if (!superseded && error.empty()) {
+        try {
+          write(job);
+        } catch (std::exception const& e) {
+          error = job.path + ": " + e.what();
+        } catch (...) {
+          error = job.path + ": [unknown]";
+        }
+      }
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (superseded) {
+          // Done once the newer save for the path is.
+          superseded_[job.path].push_back(job.ticket);
+        } else {
+          // A newer save of the path may have been queued while writing.
+          auto latest = latest_.find(job.path);
+          if (latest->second == job.ticket) {
+            latest_.erase(latest);
+          }
+          unfinished_.erase(job.ticket);
+          if (!error.empty()) {
+            failed_.insert(job.ticket);
+          }
+          auto it = superseded_.find(job.path);
+          if (it != superseded_.end()) {
+            for (auto ticket : it->second) {
+              unfinished_.erase(ticket);
+              if (!error.empty()) {
+                failed_.insert(ticket);
+              }
+            }
+            superseded_.erase(it);
+          }
+          if (!error.empty()) {
+            errors_.push_back(std::move(error));
+          }
+        }
+        queued_bytes_ -= job.bytes;
+        // Drop the snapshot before waking anyone waiting on this save.
+        job.tensor = fl::Tensor();
+        job.contents.clear();
+      }
+      done_.notify_all();
+    }
+  }
+
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::deque<SaveJob> jobs_;
+  // Ticket of the most recent save queued for each path.
+  std::unordered_map<std::string, int64_t> latest_;
+  // Tickets of skipped saves, waiting for the latest save of their path.
+  std::unordered_map<std::string, std::vector<int64_t>> superseded_;
+  // Tickets whose save has not been written (or failed) yet.
+  std::unordered_set<int64_t> unfinished_;
+  // Tickets whose save failed (only failures are kept, so this stays small).
+  std::unordered_set<int64_t> failed_;
+  std::vector<std::string> errors_;
+  int64_t next_ticket_ = 1;
+  size_t queued_bytes_ = 0;
+  bool stop_ = false;
+};
+
+SaveQueue& queue() {
+  static SaveQueue queue;
+  return queue;
+}
+
+}  // namespace
+
+int64_t saveAsync(const fl::Tensor& tensor, const std::string& path, bool raw) {
+  const auto format = raw ? SaveFormat::Raw : SaveFormat::Flashlight;
+  return queue().push({0, format, tensor, {}, path, tensor.bytes(), {}});
+}
+
+int64_t writeAsync(const std::string& path,
+                   std::string contents,
+                   std::vector<int64_t> after) {
+  const auto bytes = contents.size();
+  return queue().push({0, SaveFormat::Contents, fl::Tensor(),
+                       std::move(contents), path, bytes, std::move(after)});
+}
+
+void flushSaves(int64_t ticket) {
+  queue().flush(ticket);
+}
+
+int saveStatus(int64_t ticket) {
+  return queue().status(ticket);
+}
+
+int64_t pendingSaves() {
+  return queue().pending();
+}
+
+}  // namespace shumai
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+
+// Tensors saved in the background by a single writer thread, in the order
+// they were queued.  A save holds a shallow copy of the tensor: ArrayFire
+// copies a shared buffer before writing to it, so later in-place updates
+// don't change what gets written.  Files are replaced with `replaceFile`, so
+// a file is always either the old or the new version, even after a crash.
+
+// Queues `tensor` to be written to `path` (with `fl::save`, or `saveRaw` when
+// `raw`) and returns a ticket for `flushSaves`.  If `path` is queued again
+// before the writer gets to it, only the latest version is written.  Blocks
+// while the queued tensors hold more than 1GB.
+int64_t saveAsync(const fl::Tensor& tensor, const std::string& path, bool raw);
+
+// Queues `contents` to be written to `path`, after the saves queued before
+// it (e.g. a manifest after the tensors it lists).  It is not written, and
+// fails, if any of the saves with the tickets in `after` failed.
+int64_t writeAsync(const std::string& path,
+                   std::string contents,
+                   std::vector<int64_t> after = {});
+
+// Blocks until the save with `ticket` (every save queued so far for 0) has
+// been written; a save that was skipped for a later one to the same path
+// counts once that one is written.  Throws if any save failed since the last
+// flush.
+void flushSaves(int64_t ticket);
+
+// 0 while the save with `ticket` is queued or being written, 1 once it has
+// been written and -1 if it failed.  Unlike `flushSaves`, never blocks.
+int saveStatus(int64_t ticket);
+
+// Saves queued or being written.
+int64_t pendingSaves();
+
+}  // namespace shumai
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace shumai {
+
+// Counter updated from many threads at op rate.  Each thread adds into its
+// own cache line and reads sum over all of them.
+class ShardedCounter {
+ public:
+  void add(int64_t value) {
+    shards_[shardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Adds `value` and returns whether the calling thread's shard reached a new
+  // high, i.e. whether the sum may have reached one.  Lets callers track a
+  // peak without summing the shards on every update.
+  bool addReachesHigh(int64_t value) {
+    auto& shard = shards_[shardIndex()];
+    const int64_t now =
+        shard.value.fetch_add(value, std::memory_order_relaxed) + value;
+    if (now <= shard.high.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    shard.high.store(now, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Restarts `addReachesHigh` from the current values.
+  void resetHighs() {
+    for (auto& shard : shards_) {
+      shard.high.store(shard.value.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    }
+  }
+
+  int64_t load() const {
+    int64_t sum = 0;
+    for (const auto& shard : shards_) {
+      sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  static constexpr size_t kShards = 16;
+
+  struct alignas(64) Shard {
+    std::atomic<int64_t> value = 0;
+    std::atomic<int64_t> high = 0;
+  };
+
+  static size_t shardIndex() {
+    static std::atomic<size_t> next_shard = 0;
+    thread_local const size_t shard = next_shard++ % kShards;
+    return shard;
+  }
+
+  std::array<Shard, kShards> shards_;
+};
+
+}  // namespace shumai
@@ -0,0 +1,288 @@
+#include "wire.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "kernels/host_tensor.h"
+#include "kernels/kernels.h"
+#include "memory.h"
+
+namespace shumai {
+namespace {
+
+constexpr size_t kWord = sizeof(int64_t);
+
+size_t headerSize(int64_t ndim) {
+  return kWord * (3 + ndim);
+}
+
+bool isLossy(fl::dtype type) {
+  return type == fl::dtype::f32 || type == fl::dtype::f64;
+}
+
+// The encoding `tensor` is sent with when `encoding` is asked for.
+int64_t encodingFor(const fl::Tensor& tensor, int64_t encoding) {
+  if (encoding < 0 ||
+      encoding > static_cast<int64_t>(kernels::Codec::kInt8Block)) {
+    throw std::invalid_argument("unknown wire encoding " +
+                                std::to_string(encoding));
+  }
+  return isLossy(tensor.type()) ? encoding : 0;
+}
+
+size_t dataSize(const fl::Tensor& tensor, int64_t encoding) {
+  if (encoding == 0) {
+    return tensor.bytes();
+  }
+  return kernels::codecBytes(static_cast<kernels::Codec>(encoding),
+                             tensor.elements());
+}
+
+void encodeLossy(const fl::Tensor& tensor,
+                 int64_t encoding,
+                 fl::Tensor* residual,
+                 void* data) {
+  const auto codec = static_cast<kernels::Codec>(encoding);
+  const auto n = tensor.elements();
+  const auto x = tensor.type() == fl::dtype::f32
+                     ? tensor
+                     : tensor.astype(fl::dtype::f32);
+  kernels::HostInput<float> in(x);
+  if (!residual) {
+    kernels::encodeValues(codec, in.data(), nullptr, n, data);
+    return;
+  }
+  if (residual->elements() != n || residual->type() != fl::dtype::f32) {
+    // `residual` is a handle, so keep the tensor accounting right
+    auto zeros = fl::full(x.shape(), 0.0f, fl::dtype::f32);
+    untrackTensor(*residual);
+    *residual = std::move(zeros);
+    trackTensor(*residual);
+  }
+  kernels::HostOutput<float> r(*residual);
+  kernels::encodeValues(codec, in.data(), r.data(), n, data);
+  *residual = r.finish();
+}
+
+size_t writeHeader(const fl::Tensor& tensor, int64_t encoding, void* buffer) {
+  const int64_t ndim = tensor.ndim();
+  std::vector<int64_t> header = {
+      static_cast<int64_t>(tensor.type()) | encoding << 32, ndim};
+  for (int64_t i = ndim - 1; i >= 0; --i) {
+    header.push_back(tensor.shape()[i]);
+  }
+  header.push_back(dataSize(tensor, encoding));
+  std::memcpy(buffer, header.data(), header.size() * kWord);
+  return header.size() * kWord;
+}
+
+struct Header {
+  fl::dtype type;
+  int64_t encoding;
+  fl::Shape shape;
+  // of the data
+  size_t bytes;
+  // of the header
+  size_t size;
+};
+
+// Parses and checks the header of the record at `buffer`, which holds at
+// least `length` bytes (not necessarily all of the data).
+Header readHeader(const void* buffer, size_t length) {
+  const auto* words = static_cast<const int64_t*>(buffer);
+  if (length < headerSize(0)) {
+    throw std::invalid_argument("tensor record is too short");
+  }
+  const auto type = words[0] & 0xffffffff;
+  const auto encoding = words[0] >> 32;
+  const auto ndim = words[1];
+  if (type < 0 || type >= kNumDtypes || ndim < 0 ||
+      static_cast<size_t>(ndim) > length / kWord - 3) {
+    throw std::invalid_argument("invalid tensor record header");
+  }
+  const auto dtype = static_cast<fl::dtype>(type);
+  if (encoding != 0 &&
+      (!isLossy(dtype) ||
+       encoding > static_cast<int64_t>(kernels::Codec::kInt8Block))) {
+    throw std::invalid_argument("invalid tensor record encoding");
+  }
+  std::vector<fl::Dim> dims(ndim);
+  for (int64_t i = 0; i < ndim; ++i) {
+    dims[ndim - 1 - i] = words[2 + i];
+  }
+  const fl::Shape shape(dims);
+  const auto bytes = static_cast<size_t>(words[2 + ndim]);
+  const auto expected =
+      encoding == 0 ? shape.elements() * fl::getTypeSize(dtype)
+                    : kernels::codecBytes(static_cast<kernels::Codec>(encoding),
+                                          shape.elements());
+  if (bytes != expected) {
+    throw std::invalid_argument("tensor record expected " +
+                                std::to_string(bytes) + "B of data");
+  }
+  return {dtype, encoding, shape, bytes, headerSize(ndim)};
+}
+
+// Checks that [offset, offset + length) covers whole elements of `tensor`.
+void checkRange(const fl::Tensor& tensor, size_t offset, size_t length) {
+  const auto size = fl::getTypeSize(tensor.type());
+  if (offset % size || length % size || offset + length > tensor.bytes()) {
+    throw std::invalid_argument(
+        "cannot access " + std::to_string(length) + "B at " +
+        std::to_string(offset) + " of a tensor of " +
+        std::to_string(tensor.bytes()) + "B");
+  }
+}
+
+}  // namespace
+
+size_t encodedSize(const fl::Tensor& tensor, int64_t encoding) {
+  return headerSize(tensor.ndim()) +
+         dataSize(tensor, encodingFor(tensor, encoding));
+}
+
+size_t encodeInto(const fl::Tensor& tensor,
+                  void* buffer,
+                  size_t capacity,
+                  int64_t encoding,
+                  fl::Tensor* residual) {
+  encoding = encodingFor(tensor, encoding);
+  const auto size = encodedSize(tensor, encoding);
+  if (capacity < size) {
+    throw std::invalid_argument("encoding needs " + std::to_string(size) +
+                                " bytes, buffer has " +
+                                std::to_string(capacity));
+  }
+  auto* data =
+      static_cast<char*>(buffer) + writeHeader(tensor, encoding, buffer);
+  if (encoding != 0) {
+    encodeLossy(tensor, encoding, residual, data);
+    return size;
+  }
+  if (tensor.bytes() == 0) {
+    return size;
+  }
+  if (!hostIsDevice() && tensor.isContiguous()) {
+    tensor.host(data);
+  } else {
+    kernels::HostBytes bytes(tensor);
+    std::memcpy(data, bytes.data(), bytes.bytes());
+  }
+  return size;
+}
+
+fl::Tensor decode(const void* buffer,
+                  size_t length,
+                  bool adopt,
+                  void** adopted) {
+  *adopted = nullptr;
+  const auto header = readHeader(buffer, length);
+  const auto dtype = header.type;
+  const auto& shape = header.shape;
+  const auto bytes = header.bytes;
+  if (length - header.size < bytes) {
+    throw std::invalid_argument("tensor record expected " +
+                                std::to_string(bytes) + "B of data");
+  }
+
+  auto* data = const_cast<char*>(static_cast<const char*>(buffer)) +
+               header.size;
+  const auto encoding = header.encoding;
+  if (encoding != 0) {
+    // lossy data is always decoded into a new tensor
+    std::vector<char> aligned;
+    if (reinterpret_cast<uintptr_t>(data) % sizeof(float) != 0) {
+      aligned.assign(data, data + bytes);
+      data = aligned.data();
+    }
+    kernels::HostOutput<float> out(shape, fl::dtype::f32);
+    kernels::decodeValues(static_cast<kernels::Codec>(encoding), data,
+                          shape.elements(), out.data());
+    auto tensor = out.finish();
+    return dtype == fl::dtype::f32 ? tensor : tensor.astype(dtype);
+  }
+  const bool aligned =
+      reinterpret_cast<uintptr_t>(data) % fl::getTypeSize(dtype) == 0;
+  if (!adopt || !hostIsDevice() || !aligned || bytes == 0) {
+    return fl::Tensor(shape, dtype, data, fl::MemoryLocation::Host);
+  }
+  adoptBuffer(data, bytes);
+  try {
+    auto tensor = fl::Tensor(shape, dtype, data, fl::MemoryLocation::Device);
+    *adopted = data;
+    return tensor;
+  } catch (...) {
+    forgetBuffer(data);
+    throw;
+  }
+}
+
+size_t encodeHeader(const fl::Tensor& tensor, void* buffer, size_t capacity) {
+  const auto size = headerSize(tensor.ndim());
+  if (capacity < size) {
+    throw std::invalid_argument("record header needs " +
+                                std::to_string(size) + " bytes");
+  }
+  return writeHeader(tensor, 0, buffer);
+}
+
+fl::Tensor decodeHeader(const void* buffer, size_t length) {
+  const auto header = readHeader(buffer, length);
+  if (header.encoding != 0) {
+    throw std::invalid_argument("only raw records can be streamed");
+  }
+  return fl::Tensor(header.shape, header.type);
+}
+
+void readData(const fl::Tensor& tensor,
+              size_t offset,
+              void* out,
+              size_t length) {
+  checkRange(tensor, offset, length);
+  if (length == 0) {
+    return;
+  }
+  if (hostIsDevice() && tensor.isContiguous()) {
+    kernels::HostBytes bytes(tensor);
+    std::memcpy(out, static_cast<const char*>(bytes.data()) + offset, length);
+    return;
+  }
+  const auto begin = offset / fl::getTypeSize(tensor.type());
+  const auto end = begin + length / fl::getTypeSize(tensor.type());
+  tensor.flat(fl::range(begin, end)).asContiguousTensor().host(out);
+}
+
+void writeData(fl::Tensor& tensor,
+               size_t offset,
+               const void* data,
+               size_t length) {
+  checkRange(tensor, offset, length);
+  if (length == 0) {
+    return;
+  }
+  if (hostIsDevice()) {
+    // as in kernels::HostInPlace
+    if (!tensor.isContiguous()) {
+      tensor = tensor.asContiguousTensor();
+    }
+    void* dst = nullptr;
+    tensor.device(&dst);
+    if (isAdopted(dst)) {
+      tensor.unlock();
+      tensor = tensor.copy();
+      tensor.device(&dst);
+    }
+    std::memcpy(static_cast<char*>(dst) + offset, data, length);
+    tensor.unlock();
+    return;
+  }
+  const auto n = length / fl::getTypeSize(tensor.type());
+  const auto begin = offset / fl::getTypeSize(tensor.type());
+  tensor.flat(fl::range(begin, begin + n)) =
+      fl::Tensor(fl::Shape({static_cast<fl::Dim>(n)}), tensor.type(), data,
+                 fl::MemoryLocation::Host);
+}
+
+}  // namespace shumai
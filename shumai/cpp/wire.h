@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "flashlight/fl/tensor/TensorBase.h"
+
+namespace shumai {
+
+// A tensor on the wire (see shumai/io/encode.ts) is a record of int64 words
+//
+//   dtype | encoding << 32, ndim, shape[ndim], data bytes
+//
+// followed by the data.  The shape is always row-major (Flashlight's
+// reversed), so peers agree whatever their layout setting, and the data
+// starts 8-byte aligned relative to the record.  Encoding 0 is the raw data
+// in memory order; the others are the lossy codecs of kernels::Codec, used
+// for f32 and f64 tensors only (other dtypes are always sent raw).
+
+size_t encodedSize(const fl::Tensor& tensor, int64_t encoding = 0);
+
+// Writes the record of `tensor` to `buffer` and returns its size.  Raw data
+// is copied once, straight from tensor memory.  A `residual` carries the error
+// feedback of a lossy encoding (see kernels::encodeValues) between calls; it
+// is reset to zeros when it does not match `tensor`.
+size_t encodeInto(const fl::Tensor& tensor,
+                  void* buffer,
+                  size_t capacity,
+                  int64_t encoding = 0,
+                  fl::Tensor* residual = nullptr);
+
+// Reads the record at `buffer`.  With `adopt` (and a backend that can), a raw
+// tensor wraps the data in place (see `adoptBuffer`) and `*adopted` is set to
+// the adopted pointer; otherwise the data is copied and `*adopted` is null.
+fl::Tensor decode(const void* buffer,
+                  size_t length,
+                  bool adopt,
+                  void** adopted);
+
+// Streaming, for tensors too large to hold twice: the header of a raw record
+// (`encodedSize` minus the data), then the data copied in pieces.  The
+// receiver allocates the tensor from the header and writes every piece into
+// place as it arrives.
+size_t encodeHeader(const fl::Tensor& tensor, void* buffer, size_t capacity);
+
+// An uninitialized tensor for the raw record whose header is at `buffer`.
+fl::Tensor decodeHeader(const void* buffer, size_t length);
+
+// Copy `length` bytes of the data of `tensor` (in memory order, as in a raw
+// record) from or to byte `offset`.  Both must be multiples of the element
+// size.
+void readData(const fl::Tensor& tensor,
+              size_t offset,
+              void* out,
+              size_t length);
+void writeData(fl::Tensor& tensor,
+               size_t offset,
+               const void* data,
+               size_t length);
+
+}  // namespace shumai
@@ -5,6 +5,82 @@ const ffi_tensor = {
   bytesUsed: {
     returns: FFIType.u64
   },
+  bytesPeak: {
+    returns: FFIType.u64
+  },
+  resetBytesPeak: {},
+  liveTensors: {
+    returns: FFIType.i64
+  },
+  threadTensors: {
+    returns: FFIType.i64
+  },
+  threadTensorBytes: {
+    returns: FFIType.i64
+  },
+  bytesByDtype: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  bytesShared: {
+    returns: FFIType.u64
+  },
+  bytesReserved: {
+    returns: FFIType.u64
+  },
+  bytesInUse: {
+    returns: FFIType.u64
+  },
+  emptyCache: {},
+  setCacheHighWaterMark: {
+    args: [FFIType.u64]
+  },
+  cacheHighWaterMark: {
+    returns: FFIType.u64
+  },
+  tensorHandleStats: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  canAdoptBuffers: {
+    returns: FFIType.bool
+  },
+  tensorAdoptBuffer: {
+    args: [FFIType.i64, FFIType.int, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  drainAdoptedBuffers: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  _encodedSize: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  _encodeInto: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.i64, FFIType.i64, FFIType.ptr],
+    returns: FFIType.i64
+  },
+  _decode: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.bool, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _encodeHeader: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  _decodeHeader: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.ptr
+  },
+  _readAt: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  _writeAt: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
   dtypeFloat16: {
     returns: FFIType.int
   },
@@ -107,6 +183,10 @@ const ffi_tensor = {
     args: [FFIType.ptr, FFIType.int],
     returns: FFIType.ptr
   },
+  _loadRaw: {
+    args: [FFIType.ptr, FFIType.int, FFIType.bool],
+    returns: FFIType.ptr
+  },
   toDLTensor: {
     args: [FFIType.ptr],
     returns: FFIType.ptr
@@ -115,6 +195,154 @@ const ffi_tensor = {
     args: [FFIType.ptr],
     returns: FFIType.ptr
   },
+  _gather: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _scatterAdd: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _indexSelect: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _indexAdd: {
+    args: [FFIType.ptr, FFIType.i64, FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _softmax: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.ptr
+  },
+  _logSoftmax: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.ptr
+  },
+  _softmaxBackward: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.i64],
+    returns: FFIType.ptr
+  },
+  _logSoftmaxBackward: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.i64],
+    returns: FFIType.ptr
+  },
+  _attention: {
+    args: [
+      FFIType.ptr, // q
+      FFIType.ptr, // k
+      FFIType.ptr, // v
+      FFIType.ptr, // mask (nullable)
+      FFIType.f64, // scale
+      FFIType.bool, // causal
+      FFIType.ptr // lse_out
+    ],
+    returns: FFIType.ptr
+  },
+  _attentionBackward: {
+    args: [
+      FFIType.ptr, // grad
+      FFIType.ptr, // q
+      FFIType.ptr, // k
+      FFIType.ptr, // v
+      FFIType.ptr, // out
+      FFIType.ptr, // lse
+      FFIType.ptr, // mask (nullable)
+      FFIType.f64, // scale
+      FFIType.bool, // causal
+      FFIType.ptr // grads_out
+    ],
+    returns: FFIType.i64
+  },
+  _crossEntropyWithLogits: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _crossEntropyWithLogitsBackward: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  _lstm: {
+    args: [
+      FFIType.ptr, // x
+      FFIType.ptr, // h0
+      FFIType.ptr, // c0
+      FFIType.ptr, // w
+      FFIType.ptr, // u
+      FFIType.ptr, // b
+      FFIType.ptr // out
+    ],
+    returns: FFIType.i64
+  },
+  _lstmBackward: {
+    args: [
+      FFIType.ptr, // grad_hs (nullable)
+      FFIType.ptr, // grad_c (nullable)
+      FFIType.ptr, // x
+      FFIType.ptr, // h0
+      FFIType.ptr, // c0
+      FFIType.ptr, // w
+      FFIType.ptr, // u
+      FFIType.ptr, // b
+      FFIType.ptr, // gates
+      FFIType.ptr, // cells
+      FFIType.ptr // grads_out
+    ],
+    returns: FFIType.i64
+  },
+  _layerNorm: {
+    args: [
+      FFIType.ptr, // x
+      FFIType.ptr, // gamma (nullable)
+      FFIType.ptr, // beta (nullable)
+      FFIType.i64, // dims
+      FFIType.f64, // eps
+      FFIType.ptr // stats_out
+    ],
+    returns: FFIType.ptr
+  },
+  _layerNormBackward: {
+    args: [
+      FFIType.ptr, // grad
+      FFIType.ptr, // x
+      FFIType.ptr, // gamma (nullable)
+      FFIType.ptr, // mean
+      FFIType.ptr, // rstd
+      FFIType.i64, // dims
+      FFIType.bool, // param_grads
+      FFIType.ptr // grads_out
+    ],
+    returns: FFIType.i64
+  },
+  _adamStep: {
+    args: [
+      FFIType.ptr, // params
+      FFIType.ptr, // grads
+      FFIType.ptr, // m
+      FFIType.ptr, // v
+      FFIType.i64, // count
+      FFIType.f64, // step_size
+      FFIType.f64, // b1
+      FFIType.f64, // b2
+      FFIType.f64, // eps
+      FFIType.f64, // weight_decay
+      FFIType.f64 // max_grad_norm
+    ],
+    returns: FFIType.f64
+  },
+  _sgdStep: {
+    args: [
+      FFIType.ptr, // params
+      FFIType.ptr, // grads
+      FFIType.ptr, // momentum buffers (nullable)
+      FFIType.i64, // count
+      FFIType.f64, // lr
+      FFIType.f64, // momentum
+      FFIType.f64, // weight_decay
+      FFIType.f64 // max_grad_norm
+    ],
+    returns: FFIType.f64
+  },
   _conv2dBackwardData: {
     args: [
       FFIType.ptr, // grad
@@ -140,6 +368,33 @@ const ffi_tensor = {
   _save: {
     args: [FFIType.ptr, FFIType.ptr, FFIType.int]
   },
+  _saveRaw: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.int],
+    returns: FFIType.i64
+  },
+  _saveAsync: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.int, FFIType.bool],
+    returns: FFIType.i64
+  },
+  _writeAsync: {
+    args: [FFIType.ptr, FFIType.int, FFIType.ptr, FFIType.i64, FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
+  _saveStatus: {
+    args: [FFIType.i64],
+    returns: FFIType.i64
+  },
+  _flushSaves: {
+    args: [FFIType.i64],
+    returns: FFIType.i64
+  },
+  pendingSaves: {
+    returns: FFIType.i64
+  },
+  _contentHash: {
+    args: [FFIType.ptr],
+    returns: FFIType.u64
+  },
   _eval: {
     args: [FFIType.ptr]
   },
@@ -183,6 +438,13 @@ const ffi_tensor = {
     args: [FFIType.ptr],
     returns: FFIType.ptr
   },
+  _hostView: {
+    args: [FFIType.ptr, FFIType.int, FFIType.ptr],
+    returns: FFIType.ptr
+  },
+  genHostViewDestroyer: {
+    returns: FFIType.ptr
+  },
   _index: {
     args: [FFIType.ptr, FFIType.ptr, FFIType.i64],
     returns: FFIType.ptr
@@ -191,6 +453,10 @@ const ffi_tensor = {
     args: [FFIType.ptr, FFIType.ptr, FFIType.ptr, FFIType.i64],
     returns: FFIType.ptr
   },
+  _indexedAssignInPlace: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.ptr, FFIType.i64],
+    returns: FFIType.i64
+  },
   _flatten: {
     args: [FFIType.ptr],
     returns: FFIType.ptr
@@ -259,6 +525,10 @@ const ffi_tensor = {
     args: [FFIType.ptr],
     returns: FFIType.u64
   },
+  _uniqueBytes: {
+    args: [FFIType.ptr, FFIType.i64],
+    returns: FFIType.u64
+  },
   _ndim: {
     args: [FFIType.ptr],
     returns: FFIType.i32
@@ -270,6 +540,40 @@ const ffi_tensor = {
   _shape: {
     args: [FFIType.ptr, FFIType.ptr, FFIType.i32],
     returns: FFIType.i32
+  },
+  _runCommands: {
+    args: [
+      FFIType.ptr, // input tensors
+      FFIType.i64,
+      FFIType.ptr, // program
+      FFIType.i64,
+      FFIType.ptr, // output slots (overwritten with tensor handles)
+      FFIType.i64
+    ],
+    returns: FFIType.i64
+  },
+  _fused: {
+    args: [
+      FFIType.ptr, // input tensors
+      FFIType.i64,
+      FFIType.ptr, // program
+      FFIType.i64,
+      FFIType.ptr, // output tensor handles
+      FFIType.i64
+    ],
+    returns: FFIType.i64
+  },
+  _tapeBackward: {
+    args: [
+      FFIType.ptr, // tensors read or produced by the recorded ops
+      FFIType.i64,
+      FFIType.ptr, // program
+      FFIType.i64,
+      FFIType.ptr, // jacobian
+      FFIType.ptr, // wanted tensor indices (overwritten with gradient handles)
+      FFIType.i64
+    ],
+    returns: FFIType.i64
   }
 }
 
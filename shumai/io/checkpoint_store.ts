@@ -0,0 +1,203 @@
+import { existsSync, mkdirSync, readdirSync, readFileSync } from 'fs'
+import * as path from 'path'
+import { arrayArg } from '../ffi/ffi_bind_utils'
+import { fl } from '../ffi/ffi_flashlight'
+import { loadRaw, Tensor } from '../tensor/tensor'
+
+type Manifest = { step: number; tensors: { [name: string]: string } }
+
+const manifestPattern = /^manifest_(\d+)\.json$/
+
+function latestManifest(dir: string): Manifest | null {
+  let latest = -1
+  for (const file of readdirSync(dir)) {
+    const match = manifestPattern.exec(file)
+    if (match) {
+      latest = Math.max(latest, Number(match[1]))
+    }
+  }
+  if (latest < 0) {
+    return null
+  }
+  return JSON.parse(readFileSync(path.join(dir, `manifest_${latest}.json`), 'utf8'))
+}
+
+/**
+ * A directory of checkpoints that only writes the tensors whose contents changed.
+ *
+ * Every tensor is stored once per distinct value in `chunks/`, as a raw file (see
+ * {@link loadRaw}) named after its {@link Tensor.contentHash}. Each step writes a manifest
+ * (`manifest_<step>.json`) mapping tensor names to chunks, so frozen or unchanged tensors
+ * cost one hash per update and no I/O. Chunks and manifests are written in the background
+ * (see {@link Tensor.saveAsync}), and a manifest only after the chunks it references, and
+ * only if they were written.
+ *
+ * Tensors are added with {@link Tensor.checkpoint} (or `Module.checkpoint`), which restores
+ * them from the latest manifest when they are in it. A step is committed once the updates
+ * issued synchronously are done, or when a tensor is updated again before that; call
+ * {@link CheckpointStore.commit} to commit explicitly.
+ *
+ * @example
+ * ```javascript
+ * const store = new sm.io.CheckpointStore('checkpoints')
+ * model.checkpoint(store)
+ * for (const [x, y] of batches) {
+ *   // a step is committed once every parameter was updated
+ *   sm.optim.sgd(sm.loss.mse(model(x), y).backward(), 1e-3)
+ * }
+ * ```
+ */
+export class CheckpointStore {
+  readonly dir: string
+  /** Step of the latest manifest queued (0 before the first one is). */
+  step = 0
+  /** Bytes of tensor data queued for writing by this store. */
+  bytesWritten = 0n
+  private tensors = new Map<string, Tensor>()
+  private names = new Map<Tensor, string>()
+  // Chunk of every tensor in the latest manifest, by name.
+  private hashes = new Map<string, string>()
+  // Chunks on disk, and chunks queued for writing with the ticket of their save.
+  private chunks: Set<string>
+  private pending = new Map<string, number>()
+  private changed = new Set<Tensor>()
+  private scheduled = false
+
+  constructor(dir: string) {
+    this.dir = dir
+    const chunks = path.join(dir, 'chunks')
+    if (!existsSync(chunks)) {
+      mkdirSync(chunks, { recursive: true })
+    }
+    this.chunks = new Set(
+      readdirSync(chunks)
+        .filter((f) => f.endsWith('.raw'))
+        .map((f) => f.slice(0, -'.raw'.length))
+    )
+    const manifest = latestManifest(dir)
+    if (manifest) {
+      this.step = manifest.step
+      for (const [name, hash] of Object.entries(manifest.tensors)) {
+        this.hashes.set(name, hash)
+      }
+    }
+  }
+
+  chunkFile(hash: string) {
+    return path.join(this.dir, 'chunks', `${hash}.raw`)
+  }
+
+  manifestFile(step: number) {
+    return path.join(this.dir, `manifest_${step}.json`)
+  }
+
+  /** @private Add `tensor` as `name`, restoring it if the latest manifest has it. */
+  track(name: string, tensor: Tensor) {
+    const tracked = this.tensors.get(name)
+    if (tracked && tracked !== tensor) {
+      throw new Error(`Another tensor is checkpointed as ${name}`)
+    }
+    this.tensors.set(name, tensor)
+    this.names.set(tensor, name)
+    const hash = this.hashes.get(name)
+    if (hash === undefined) {
+      this.updated(tensor)
+      return
+    }
+    const t = loadRaw(this.chunkFile(hash))
+    if (t.elements != tensor.elements) {
+      throw new Error(
+        `Cannot load ${name}, mismatched dimensions ${t.shape} (expected ${tensor.shape})`
+      )
+    }
+    tensor.update(t)
+  }
+
+  /** @private Called when a tracked tensor was updated. */
+  updated(tensor: Tensor) {
+    if (this.changed.has(tensor)) {
+      // updated again, so the previous step is complete
+      this.commit()
+    }
+    this.changed.add(tensor)
+    if (!this.scheduled) {
+      this.scheduled = true
+      queueMicrotask(() => {
+        this.scheduled = false
+        this.commit()
+      })
+    }
+  }
+
+  // Moves the chunks whose saves are done to `chunks`. If one failed, the manifests that
+  // reference it were not written: the tensors stored in it are marked as changed, so that
+  // the next commit writes them again, and this throws.
+  private settle() {
+    const failed = new Set<string>()
+    for (const [hash, ticket] of this.pending) {
+      const status = Number(fl._saveStatus.native(ticket))
+      if (status > 0) {
+        this.chunks.add(hash)
+      } else if (status < 0) {
+        failed.add(hash)
+      }
+      if (status !== 0) {
+        this.pending.delete(hash)
+      }
+    }
+    if (!failed.size) {
+      return
+    }
+    for (const [name, hash] of this.hashes) {
+      if (failed.has(hash)) {
+        this.hashes.delete(name)
+        this.changed.add(this.tensors.get(name))
+      }
+    }
+    throw new Error(
+      `Failed to write checkpoint chunks ${[...failed]}, the steps using them are lost`
+    )
+  }
+
+  /**
+   * Write the tensors updated since the last commit whose contents changed, and a manifest
+   * if any did. Throws if chunks queued by an earlier commit could not be written; their
+   * tensors are written again by the next commit.
+   *
+   * @returns The step of the latest manifest.
+   */
+  commit(): number {
+    this.settle()
+    let modified = false
+    for (const tensor of this.changed) {
+      const name = this.names.get(tensor)
+      const hash = tensor.contentHash().toString(16).padStart(16, '0')
+      if (this.hashes.get(name) === hash) {
+        continue
+      }
+      if (!this.chunks.has(hash) && !this.pending.has(hash)) {
+        this.pending.set(hash, tensor.saveAsync(this.chunkFile(hash), true))
+        this.bytesWritten += fl._bytes.native(tensor.ptr)
+      }
+      this.hashes.set(name, hash)
+      modified = true
+    }
+    this.changed.clear()
+    if (!modified) {
+      return this.step
+    }
+    this.step += 1
+    const manifest: Manifest = { step: this.step, tensors: Object.fromEntries(this.hashes) }
+    const contents = new TextEncoder().encode(JSON.stringify(manifest))
+    const file = new TextEncoder().encode(this.manifestFile(this.step))
+    // the manifest is only written if the chunks it references that are not on disk yet are
+    const after = [...this.hashes.values()].filter((h) => this.pending.has(h))
+    const [after_ptr, after_len] = arrayArg(after.map((h) => this.pending.get(h)))
+    if (
+      fl._writeAsync.native(file, file.length, contents, contents.length, after_ptr, after_len) < 0
+    ) {
+      throw new Error(`Failed to queue ${this.manifestFile(this.step)}`)
+    }
+    return this.step
+  }
+}
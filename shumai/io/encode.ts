@@ -17,67 +17,61 @@ export function jsonParseHandler(key: string, value: any) {
   return value
 }
 
-export function encodeBinary(tensor: sm.Tensor, props?: object): ArrayBuffer {
-  const shape = tensor.shape64
+/**
+ * @private The envelope around the tensor: provenance, flags and the length of the props that
+ * follow the tensor. Eight bytes per word, which keeps the tensor data aligned.
+ */
+export const envelope_len = 3
+
+/** @private The envelope words of `tensor` followed by `props_len` bytes of props. */
+export function envelopeOf(tensor: sm.Tensor, props_len: number): bigint[] {
   const provenance = tensor.provenance ? BigInt('0x' + tensor.provenance) : BigInt(0xffffffff)
   const flags = Number(tensor.requires_grad) & 0x1
-  // meta_data: ndim, provenance, flags, props_len
+  return [provenance, BigInt(flags), BigInt(props_len)]
+}
+
+/** @private Mark `t` as received with the envelope words `provenance` and `flags`. */
+export function fromEnvelope(t: sm.Tensor, provenance: bigint, flags: bigint) {
+  const p = provenance.toString(16)
+  t.op = 'network'
+  t.provenance = p ? p : null
+  t.requires_grad = !!(Number(flags) & 0x1)
+  return t
+}
+
+export function encodeBinary(
+  tensor: sm.Tensor,
+  props?: object,
+  options?: sm.EncodeOptions
+): ArrayBuffer {
   const props_buf = props && Buffer.from(JSON.stringify(props, jsonStringifyHandler))
   const props_len = props_buf ? props_buf.byteLength : 0
-  const tensor_buf = new Uint8Array(tensor.toFloat32Array().buffer)
-  const tensor_len = tensor_buf.byteLength
-  const meta_data = new BigInt64Array([
-    BigInt(shape.length),
-    provenance,
-    BigInt(flags),
-    BigInt(tensor_len),
-    BigInt(props_len)
-  ])
-  const meta_data_buf = new Uint8Array(meta_data.buffer)
-  const shape_buf = new Uint8Array(new BigInt64Array(shape).buffer)
-  const buf = new Uint8Array(
-    meta_data_buf.length + shape_buf.length + tensor_buf.length + props_len
-  )
-  let byteOffset = 0
-  buf.set(meta_data_buf, byteOffset)
-  byteOffset += meta_data_buf.byteLength
-  buf.set(shape_buf, byteOffset)
-  byteOffset += shape_buf.byteLength
-  buf.set(tensor_buf, byteOffset)
-  byteOffset += tensor_buf.byteLength
-  if (props_buf) buf.set(props_buf, byteOffset)
+  const tensor_len = sm.encodedSize(tensor, options)
+  const buf = new Uint8Array(8 * envelope_len + tensor_len + props_len)
+  new BigInt64Array(buf.buffer, 0, envelope_len).set(envelopeOf(tensor, props_len))
+  sm.encodeInto(tensor, buf, 8 * envelope_len, options)
+  if (props_buf) buf.set(props_buf, 8 * envelope_len + tensor_len)
   return buf.buffer
 }
 
 export function decodeBinary(buf: ArrayBuffer): { tensor: sm.Tensor; props?: object } {
-  if (buf.byteLength < 16) {
+  if (buf.byteLength < 8 * envelope_len) {
     throw 'buffer cannot be decoded, too short to parse'
   }
-  // meta_data: ndim, provenance, flags
-  const meta_data_len = 5
-  const meta_data = new BigInt64Array(buf, 0, meta_data_len)
-  let byteOffset = 8 * meta_data_len
-  const shape_len = Number(meta_data[0])
-  const provenance = meta_data[1].toString(16)
-  const flags = Number(meta_data[2])
-  const tensor_len = Number(meta_data[3])
-  const props_len = Number(meta_data[4])
-  const requires_grad = flags & 0x1
-  const actual_tensor_len = buf.byteLength - 8 * meta_data_len - 8 * shape_len - props_len
-  if (tensor_len != actual_tensor_len) {
-    throw `buffer cannot be decoded, tensor expected ${tensor_len}B but received ${actual_tensor_len}B`
+  const envelope = new BigInt64Array(buf, 0, envelope_len)
+  const props_len = Number(envelope[2])
+  const tensor_len = buf.byteLength - 8 * envelope_len - props_len
+  if (tensor_len < 0) {
+    throw `buffer cannot be decoded, expected ${props_len}B of props`
   }
-  const shape = new BigInt64Array(buf, byteOffset, shape_len)
-  byteOffset += 8 * shape_len
-  const t = sm.tensor(new Float32Array(buf, byteOffset, tensor_len / 4)).reshape(shape)
-  byteOffset += tensor_len
+  const t = sm.decode(buf, 8 * envelope_len, tensor_len)
   const props = props_len
-    ? JSON.parse(Buffer.from(buf, byteOffset, props_len).toString(), jsonParseHandler)
+    ? JSON.parse(
+        Buffer.from(buf, 8 * envelope_len + tensor_len, props_len).toString(),
+        jsonParseHandler
+      )
     : void 0
-  t.op = 'network'
-  t.provenance = provenance ? provenance : null
-  t.requires_grad = !!requires_grad
-  return { tensor: t, props }
+  return { tensor: fromEnvelope(t, envelope[0], envelope[1]), props }
 }
 
 /** @private */
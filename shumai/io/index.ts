@@ -1,2 +1,4 @@
+export * from './checkpoint_store'
 export * from './encode'
 export * from './file'
+export * from './stream'
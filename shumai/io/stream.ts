@@ -0,0 +1,209 @@
+import { ptr } from 'bun:ffi'
+import { fl } from '../ffi/ffi_flashlight'
+import * as sm from '../tensor'
+import {
+  envelope_len,
+  envelopeOf,
+  fromEnvelope,
+  jsonParseHandler,
+  jsonStringifyHandler
+} from './encode'
+
+/** Content type of tensors sent with {@link encodeStream}. */
+export const streamContentType = 'application/x-shumai-stream'
+
+// A stream is a sequence of frames, each an 8 byte header (kind and payload length, both
+// little-endian uint32) and its payload: one Head frame (the envelope of `encodeBinary`, with
+// no props, followed by the header of a raw tensor record), Data frames carrying the tensor
+// data in order, and optionally a Props frame with the props as JSON.
+enum Frame {
+  Head = 1,
+  Data = 2,
+  Props = 3
+}
+
+const frame_header = 8
+
+function frame(kind: Frame, length: number) {
+  const f = new Uint8Array(frame_header + length)
+  const view = new DataView(f.buffer)
+  view.setUint32(0, kind, true)
+  view.setUint32(4, length, true)
+  return f
+}
+
+export type StreamOptions = {
+  /** Bytes of tensor data per frame (1 MiB by default). */
+  chunkBytes?: number
+}
+
+/**
+ * Encode `tensor` (and `props`) like {@link encodeBinary}, as a stream of frames that are only
+ * read from tensor memory as the stream is consumed. Sending a tensor this way needs a few
+ * frames of memory rather than a copy of the whole tensor; {@link decodeStream} likewise
+ * writes every frame into place as it arrives. `tensor` must not be modified until the
+ * stream is done. Lossy encodings (see {@link WireEncoding}) are not streamed.
+ */
+export function encodeStream(
+  tensor: sm.Tensor,
+  props?: object,
+  { chunkBytes = 1 << 20 }: StreamOptions = {}
+): ReadableStream<Uint8Array> {
+  // frames hold whole elements
+  chunkBytes = Math.min(Math.max(8, chunkBytes - (chunkBytes % 8)), 1 << 30)
+  const header_len = 8 * (3 + tensor.ndim)
+  const head = frame(Frame.Head, 8 * envelope_len + header_len)
+  new BigInt64Array(head.buffer, frame_header, envelope_len).set(envelopeOf(tensor, 0))
+  const at = frame_header + 8 * envelope_len
+  if (fl._encodeHeader.native(tensor.ptr, ptr(head, at), header_len) < 0) {
+    throw new Error('Failed to encode tensor; native code likely threw an error...')
+  }
+  const bytes = Number(fl._bytes.native(tensor.ptr))
+  const props_buf = props && new TextEncoder().encode(JSON.stringify(props, jsonStringifyHandler))
+
+  function* frames() {
+    yield head
+    for (let offset = 0; offset < bytes; offset += chunkBytes) {
+      const length = Math.min(chunkBytes, bytes - offset)
+      const data = frame(Frame.Data, length)
+      if (fl._readAt.native(tensor.ptr, offset, ptr(data, frame_header), length) < 0) {
+        throw new Error('Failed to read tensor data; native code likely threw an error...')
+      }
+      yield data
+    }
+    if (props_buf) {
+      const f = frame(Frame.Props, props_buf.byteLength)
+      f.set(props_buf, frame_header)
+      yield f
+    }
+  }
+  const it = frames()
+  return new ReadableStream<Uint8Array>({
+    pull(controller) {
+      const { done, value } = it.next()
+      if (done) {
+        controller.close()
+      } else {
+        controller.enqueue(value)
+      }
+    }
+  })
+}
+
+// Splits a byte stream into frames, whatever the sizes of the chunks it arrives in.
+class FrameReader {
+  #reader: ReadableStreamDefaultReader<Uint8Array>
+  #chunk = new Uint8Array(0)
+  #staging = new Uint8Array(0)
+
+  constructor(stream: ReadableStream<Uint8Array>) {
+    this.#reader = stream.getReader()
+  }
+
+  // Makes sure some bytes are at hand; false at the end of the stream.
+  async #fill(): Promise<boolean> {
+    while (!this.#chunk.byteLength) {
+      const { done, value } = await this.#reader.read()
+      if (done) {
+        return false
+      }
+      this.#chunk = value
+    }
+    return true
+  }
+
+  // Passes the next `n` bytes to `fn` in the pieces they were received in, without copying.
+  async consume(n: number, fn: (part: Uint8Array) => void) {
+    while (n > 0) {
+      if (!(await this.#fill())) {
+        throw 'stream cannot be decoded, ended within a frame'
+      }
+      const take = Math.min(n, this.#chunk.byteLength)
+      fn(this.#chunk.subarray(0, take))
+      this.#chunk = this.#chunk.subarray(take)
+      n -= take
+    }
+  }
+
+  // The next `n` bytes: a view of the chunk received when it holds all of them, and
+  // otherwise a copy in a staging buffer that the next call reuses.
+  async read(n: number): Promise<Uint8Array> {
+    if (n && !(await this.#fill())) {
+      throw 'stream cannot be decoded, ended within a frame'
+    }
+    if (this.#chunk.byteLength >= n) {
+      const bytes = this.#chunk.subarray(0, n)
+      this.#chunk = this.#chunk.subarray(n)
+      return bytes
+    }
+    if (this.#staging.byteLength < n) {
+      this.#staging = new Uint8Array(n)
+    }
+    const out = this.#staging.subarray(0, n)
+    let filled = 0
+    await this.consume(n, (part) => {
+      out.set(part, filled)
+      filled += part.byteLength
+    })
+    return out
+  }
+
+  // The kind and payload length of the next frame, or null at the end of the stream. Its
+  // payload must be taken with `read` or `consume` before the next call.
+  async next(): Promise<{ kind: Frame; length: number } | null> {
+    if (!(await this.#fill())) {
+      return null
+    }
+    const header = await this.read(frame_header)
+    const view = new DataView(header.buffer, header.byteOffset, frame_header)
+    return { kind: view.getUint32(0, true), length: view.getUint32(4, true) }
+  }
+}
+
+/**
+ * Read a tensor (and props) sent with {@link encodeStream}. The tensor is allocated from the
+ * header, and data is copied into place straight from the chunks received as soon as they
+ * arrive, so decoding overlaps with receiving and tensor data is never buffered.
+ */
+export async function decodeStream(
+  stream: ReadableStream<Uint8Array>
+): Promise<{ tensor: sm.Tensor; props?: object }> {
+  const frames = new FrameReader(stream)
+  const head = await frames.next()
+  if (!head || head.kind !== Frame.Head || head.length < 8 * envelope_len) {
+    throw 'stream cannot be decoded, expected a header'
+  }
+  const payload = await frames.read(head.length)
+  const envelope = new DataView(payload.buffer, payload.byteOffset, 8 * envelope_len)
+  const provenance = envelope.getBigInt64(0, true)
+  const flags = envelope.getBigInt64(8, true)
+  const record = payload.subarray(8 * envelope_len)
+  const _ptr = fl._decodeHeader.native(ptr(record), record.byteLength)
+  if (!_ptr) {
+    throw new Error('Failed to decode tensor; native code likely threw an error...')
+  }
+  const t = new sm.Tensor({ _ptr: _ptr, _deps: [] })
+  const bytes = Number(fl._bytes.native(t.ptr))
+  let offset = 0
+  let props: object
+  for (let f = await frames.next(); f; f = await frames.next()) {
+    if (f.kind === Frame.Data) {
+      // written piece by piece as received, even when a frame straddles several reads
+      await frames.consume(f.length, (part) => {
+        if (fl._writeAt.native(t.ptr, offset, ptr(part), part.byteLength) < 0) {
+          throw new Error('Failed to write tensor data; native code likely threw an error...')
+        }
+        offset += part.byteLength
+      })
+    } else if (f.kind === Frame.Props) {
+      const payload = await frames.read(f.length)
+      props = JSON.parse(new TextDecoder().decode(payload), jsonParseHandler)
+    } else {
+      throw `stream cannot be decoded, unexpected frame of kind ${f.kind}`
+    }
+  }
+  if (offset !== bytes) {
+    throw `stream cannot be decoded, expected ${bytes}B of data, got ${offset}B`
+  }
+  return { tensor: fromEnvelope(t, provenance, flags), props }
+}
@@ -23,6 +23,18 @@ export function crossEntropy(): LossFn {
   return (y, p) => sm.mul(sm.scalar(-1), sm.mean(sm.sum(sm.mul(y, clippedLog(p)), [1])))
 }
 
+/**
+ * Cross-entropy loss for multi-class classification, computed from unnormalized logits and
+ * integer class labels (see {@link sm.crossEntropyWithLogits}).
+ * Use without softmax on the final layer; labels are Int32 or Int64 class indices rather
+ * than one-hot vectors.
+ *
+ * $$\log\sum_{k=1}^Ke^{z_{i,k}}-z_{i,y_i}$$
+ */
+export function crossEntropyWithLogits(): LossFn {
+  return (y, p) => sm.crossEntropyWithLogits(p, y)
+}
+
 /**
  * Binary cross-entropy loss for two-class classification
  * Use with sigmoid on the final activation layer
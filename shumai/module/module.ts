@@ -1,13 +1,17 @@
 import * as fs from 'node:fs'
 import * as path from 'path'
+import { CheckpointStore } from '../io/checkpoint_store'
 import { Tensor } from '../tensor'
 
 function traverse(obj, dir, callback, prefix = 'model') {
   for (const [key, value] of Object.entries(obj)) {
     const file_key = `${prefix}.${key}`
     if (value instanceof Tensor) {
-      const fn = path.join(dir, `${file_key}.tensor`)
-      value.checkpoint(fn, callback)
+      if (dir instanceof CheckpointStore) {
+        value.checkpoint(dir, callback, file_key)
+      } else {
+        value.checkpoint(path.join(dir, `${file_key}.tensor`), callback)
+      }
       continue
     }
     if (value instanceof Object) {
@@ -16,8 +20,12 @@ function traverse(obj, dir, callback, prefix = 'model') {
   }
 }
 
-export function checkpoint(model, dir, callback = () => true) {
-  if (!fs.existsSync(dir)) {
+/**
+ * Checkpoint every tensor of `model` (see {@link Tensor.checkpoint}), either as one file per
+ * tensor in the directory `dir` or in a {@link CheckpointStore}.
+ */
+export function checkpoint(model, dir: string | CheckpointStore, callback = () => true) {
+  if (typeof dir === 'string' && !fs.existsSync(dir)) {
     fs.mkdirSync(dir)
   }
   traverse(model, dir, callback)
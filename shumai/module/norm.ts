@@ -9,6 +9,7 @@ export class LayerNorm extends Module {
   private dims: number[]
   private axes: number[]
   private eps: Tensor
+  private epsValue: number
   private gamma: Tensor
   private beta: Tensor
 
@@ -31,6 +32,7 @@ export class LayerNorm extends Module {
     if (this.eps.greaterThan(sm.scalar(0)).toUint8Array()[0] === 0) {
       throw new Error(`Parameter eps (${eps}) must be greater than 0`)
     }
+    this.epsValue = this.eps.toFloat64()
 
     this.resetParameters()
   }
@@ -50,6 +52,10 @@ export class LayerNorm extends Module {
       }
     }
 
+    if (tensor.dtype === sm.dtype.Float32 || tensor.dtype === sm.dtype.Float64) {
+      return sm.layerNorm(tensor, this.dims.length, this.gamma, this.beta, this.epsValue)
+    }
+
     const mean = tensor.mean(this.axes, true)
     const std = tensor.variance(this.axes, false, true).add(this.eps).sqrt()
 
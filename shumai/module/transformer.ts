@@ -190,16 +190,43 @@ export class TransformerDotProductAttention extends Module {
    * @param keys - Tensor of key embeddings, shape `[..., keyTokens, dim]`
    * @param values - Tensor of value embeddings each corresponding to a key, shape `[..., keyTokens, dim]`
    * @param mask - Tensor mask of shape `[queryTokens, keyTokens]` where a 1 in position $(i, j)$ indicates that the $i$th query should not attend to the $j$th key
+   * @param causal - If true, the $i$th query also does not attend to any key after the $i$th (without building a mask)
    * @returns A Tensor of shape `[..., queryTokens, dim]`
    */
-  forward(queries: Tensor, keys: Tensor, values: Tensor, mask?: Tensor): Tensor {
+  forward(queries: Tensor, keys: Tensor, values: Tensor, mask?: Tensor, causal = false): Tensor {
     // queries shape [..., queryTokens, dim]
     // keys and values shape [..., keyTokens, dim]
     // mask shape [queryTokens, keyTokens]
     checkAttentionInputs(this.dim, queries, keys, values, mask)
 
+    // The fused kernel never materializes the [queryTokens, keyTokens] scores; subclasses
+    // overriding `scale` take the generic path
+    const fusable =
+      (queries.dtype === sm.dtype.Float32 || queries.dtype === sm.dtype.Float64) &&
+      this.scale === TransformerDotProductAttention.prototype.scale
+    if (fusable) {
+      return sm.scaledDotProductAttention(
+        queries,
+        keys,
+        values,
+        mask,
+        causal,
+        1 / Math.sqrt(this.dim)
+      )
+    }
+
     let output = queries.matmul(keys.T()) // shape [..., queryTokens, keyTokens]
 
+    if (causal) {
+      const [queryTokens, keyTokens] = output.shape.slice(-2)
+      const causalMask = sm
+        .full([queryTokens, keyTokens], 1)
+        .astype(sm.dtype.BoolInt8)
+        .tril()
+        .logicalNot()
+      mask = mask === undefined ? causalMask : mask.logicalOr(causalMask)
+    }
+
     if (mask !== undefined) {
       if (output.shape.length > 2) {
         // mask.shape.length is always 2
@@ -264,9 +291,10 @@ export class TransformerMultiheadAttention extends Module {
    * @param keys - Tensor of key vectors, shape `[..., keyTokens, dim]`
    * @param values - Tensor of value vectors each corresponding to a key, shape `[..., keyTokens, dim]`
    * @param mask - Tensor mask of shape `[queryTokens, keyTokens]` for the {@link TransformerDotProductAttention}
+   * @param causal - Apply a causal mask in the {@link TransformerDotProductAttention}
    * @returns A Tensor of shape `[..., queryTokens, dim]`
    */
-  forward(queries: Tensor, keys: Tensor, values: Tensor, mask?: Tensor): Tensor {
+  forward(queries: Tensor, keys: Tensor, values: Tensor, mask?: Tensor, causal = false): Tensor {
     // queries shape [..., queryTokens, dim]
     // keys and values shape [..., keyTokens, dim]
     checkAttentionInputs(this.dim, queries, keys, values)
@@ -294,7 +322,7 @@ export class TransformerMultiheadAttention extends Module {
     const reverseReshape = [...originalShape]
     reverseReshape[reverseReshape.length - 1] = this.heads * this.attentionDim
 
-    let output = this.attention(queries, keys, values, mask) // shape [..., heads, queryTokens, attentionDim]
+    let output = this.attention(queries, keys, values, mask, causal) // shape [..., heads, queryTokens, attentionDim]
     output = output.transpose(reverseTranspose) // shape [..., queryTokens, heads, attentionDim]
     output = output.reshape(reverseReshape) // shape [..., queryTokens, heads * attentionDim]
     output = this.concatEmbed(output) // shape [..., queryTokens, dim]
@@ -528,11 +556,9 @@ export class TransformerDecoderLayer extends Module {
    * @returns A Tensor of shape `[..., tokens, dim]`
    */
   forward(input: Tensor, encoderOutput: Tensor): Tensor {
-    const decoderLength = input.shape[input.shape.length - 2]
-    const mask = TransformerDecoderLayer.getSelfAttentionMask(decoderLength)
-
+    // causal self-attention, equivalent to masking with getSelfAttentionMask(tokens)
     let residual = input
-    let output = this.maskedSelfAttention(input, input, input, mask) // shape [..., tokens, dim]
+    let output = this.maskedSelfAttention(input, input, input, undefined, true) // shape [..., tokens, dim]
     output = this.maskedSelfAttentionNorm(residual.add(output))
 
     residual = output
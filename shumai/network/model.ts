@@ -1,14 +1,19 @@
 import type { Errorlike, Server } from 'bun'
-import { decodeBinary, encodeBinary } from '../io'
+import { decodeBinary, decodeStream, encodeBinary, encodeStream, streamContentType } from '../io'
 import { Module } from '../module'
 import { OptimizerFn } from '../optim'
 import { Stats, stats } from '../stats'
 import * as sm from '../tensor'
-import { backoff, tfetch } from './tensor'
+import { backoff, logTransfer, tfetch } from './tensor'
 
 export type RemoteModelOptions = {
   backwardUrl?: string
   errorHandler?: (err: Errorlike) => Promise<void>
+  /**
+   * Encoding of the activations and gradients exchanged (see {@link WireEncoding}); gradients
+   * are sent with error feedback.
+   */
+  encoding?: sm.WireEncoding
 }
 
 export type RemoteModelForwardOptions = {
@@ -50,7 +55,7 @@ export type RemoteModelForwardOptions = {
  */
 export function remote_model(
   url: string,
-  { backwardUrl, errorHandler }: RemoteModelOptions = {}
+  { backwardUrl, errorHandler, encoding }: RemoteModelOptions = {}
 ): (t: sm.Tensor) => Promise<sm.Tensor> {
   let forwardUrl = `${url}/forward`
   if (!backwardUrl) {
@@ -61,7 +66,8 @@ export function remote_model(
   const backward = async (ctx): Promise<sm.Tensor> => {
     const collectStats = stats.enabled
     const t: sm.Tensor = await backoff(
-      () => tfetch(backwardUrl, ctx.backward_input, { collectStats }),
+      () =>
+        tfetch(backwardUrl, ctx.backward_input, { collectStats, encoding, errorFeedback: true }),
       errorHandler
     )
 
@@ -77,7 +83,7 @@ export function remote_model(
     { collectStats = stats.enabled }: RemoteModelForwardOptions = {}
   ): Promise<sm.Tensor> {
     const t: sm.Tensor = await backoff(
-      () => tfetch(forwardUrl, tensor, { collectStats, grad_fn: backward }),
+      () => tfetch(forwardUrl, tensor, { collectStats, encoding, grad_fn: backward }),
       errorHandler
     )
 
@@ -152,12 +158,20 @@ export function serve(request_dict: Record<string, ServeRequest>, options: Netwo
   }
 
   /* TODO: specify a better type than any as its a function */
-  const serve_request = async (req: Request, fn: ServeRequest) => {
-    const buf = await req.arrayBuffer()
+  const serve_request = async (req: Request, route: string, fn: ServeRequest) => {
+    let decoded: { tensor: sm.Tensor; props?: object }
+    if (req.headers.get('Content-Type') === streamContentType) {
+      decoded = await decodeStream(req.body)
+    } else {
+      const buf = await req.arrayBuffer()
+      decoded = buf.byteLength ? decodeBinary(buf) : null
+    }
     let ret = null
     let s: Stats
-    if (buf.byteLength) {
-      const { tensor: t, props } = decodeBinary(buf)
+    let encoding: sm.WireEncoding = 'raw'
+    let residual: sm.Tensor
+    if (decoded) {
+      const { tensor: t, props } = decoded
       // eslint-disable-next-line @typescript-eslint/ban-ts-comment
       // @ts-ignore-next-line
       if (props?.collectStats === true) {
@@ -167,7 +181,17 @@ export function serve(request_dict: Record<string, ServeRequest>, options: Netwo
         s.processId = stats.processId
         s.deviceId = stats.deviceId
       }
-      ret = await fn(get_user_data(t), t)
+      // eslint-disable-next-line @typescript-eslint/ban-ts-comment
+      // @ts-ignore-next-line
+      encoding = props?.encoding || 'raw'
+      const user = get_user_data(t)
+      // eslint-disable-next-line @typescript-eslint/ban-ts-comment
+      // @ts-ignore-next-line
+      if (props?.errorFeedback === true) {
+        user.residuals ||= {}
+        residual = user.residuals[route] ||= sm.scalar(0).untidy()
+      }
+      ret = await fn(user, t)
       if (ret) {
         ret.provenance = t.provenance
       }
@@ -177,8 +201,17 @@ export function serve(request_dict: Record<string, ServeRequest>, options: Netwo
 
     if (ret && ret instanceof sm.Tensor) {
       // even if empty always forward stats if `collectStats` is true
+      const options = { encoding, residual }
+      // logged first so that stats sent back include the response
+      logTransfer(s || stats, ret, options)
       const props: object = s ? { stats: s.toJSON() } : void 0
-      return new Response(encodeBinary(ret, props))
+      const accept = req.headers.get('Accept') || ''
+      if (encoding === 'raw' && accept.includes(streamContentType)) {
+        return new Response(encodeStream(ret, props), {
+          headers: { 'Content-Type': streamContentType }
+        })
+      }
+      return new Response(encodeBinary(ret, props, options))
     } else if (ret && ret.constructor === Object) {
       const headers = new Headers([['Content-Type', 'application/json']])
       headers.set('Access-Control-Allow-Origin', '*')
@@ -200,7 +233,7 @@ export function serve(request_dict: Record<string, ServeRequest>, options: Netwo
       const last_seg = segments[segments.length - 1]
       const route = last_seg in request_dict ? last_seg : 'default'
       const handler = request_dict[route]
-      return handler && serve_request(req, handler)
+      return handler && serve_request(req, route, handler)
     }
   }
   Bun.serve({
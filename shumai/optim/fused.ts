@@ -0,0 +1,93 @@
+import { ptr } from 'bun:ffi'
+import { fl } from '../ffi/ffi_flashlight'
+import { stats } from '../stats'
+import type { Tensor } from '../tensor'
+
+const handles = (tensors: Tensor[]) => new BigInt64Array(tensors.map((t) => BigInt(t.ptr)))
+
+function runStep(op: string, params: Tensor[], grads: Tensor[], step: () => number) {
+  if (!params.length) {
+    return 0
+  }
+  const s = params[0].stats || grads[0].stats || stats
+  const trace = s.enabled && s.startTrace(op)
+  const norm = step()
+  trace && s.stopTrace(trace)
+  if (norm < 0) {
+    throw new Error(`${op} failed; native code likely threw an error...`)
+  }
+  trace && s.logTrace(trace, grads, params[0])
+  for (const p of params) {
+    p.markUpdated()
+  }
+  return norm
+}
+
+/**
+ * @private One Adam update of every parameter (with its moments `m` and `v`), in place and
+ * as a single batched native job. `step_size` is the learning rate with the bias correction
+ * of the current step folded in. Gradients are clipped to a global L2 norm of
+ * `max_grad_norm` unless it is 0.
+ *
+ * @returns The global L2 norm of the gradients before clipping.
+ */
+export function adamStep(
+  params: Tensor[],
+  grads: Tensor[],
+  m: Tensor[],
+  v: Tensor[],
+  step_size: number,
+  b1: number,
+  b2: number,
+  eps: number,
+  weight_decay: number,
+  max_grad_norm = 0
+): number {
+  const [p_h, g_h, m_h, v_h] = [params, grads, m, v].map(handles)
+  return runStep('adamStep', params, grads, () =>
+    fl._adamStep.native(
+      ptr(p_h),
+      ptr(g_h),
+      ptr(m_h),
+      ptr(v_h),
+      params.length,
+      step_size,
+      b1,
+      b2,
+      eps,
+      weight_decay,
+      max_grad_norm
+    )
+  )
+}
+
+/**
+ * @private One SGD update of every parameter (and its momentum buffer, if `momentum` is
+ * set), in place and as a single batched native job. See {@link adamStep} for clipping.
+ *
+ * @returns The global L2 norm of the gradients before clipping.
+ */
+export function sgdStep(
+  params: Tensor[],
+  grads: Tensor[],
+  momentum_buffers: Tensor[] | null,
+  lr: number,
+  momentum: number,
+  weight_decay: number,
+  max_grad_norm = 0
+): number {
+  const [p_h, g_h] = [params, grads].map(handles)
+  const b_h = momentum_buffers ? handles(momentum_buffers) : null
+  return runStep('sgdStep', params, grads, () =>
+    fl._sgdStep.native(
+      ptr(p_h),
+      ptr(g_h),
+      b_h ? ptr(b_h) : null,
+      params.length,
+      lr,
+      momentum,
+      weight_decay,
+      max_grad_norm
+    )
+  )
+}
@@ -1,18 +1,66 @@
 import * as sm from '../tensor'
-import { tidy } from '../util/memory'
+import { sgdStep } from './fused'
+import { Optimizer } from './optim'
 
 export function sgd(
   grads: Record<string, { grad: sm.Tensor; tensor: sm.Tensor }>,
   learning_rate = 1e-3
 ) {
-  tidy(() => {
-    const lr = sm.scalar(-learning_rate)
+  const params: sm.Tensor[] = []
+  const gs: sm.Tensor[] = []
+  for (const [, v] of Object.entries(grads)) {
+    const { tensor: t, grad: g } = v
+    if (t.requires_grad) {
+      params.push(t)
+      gs.push(g)
+    }
+    t.grad = null
+  }
+  sgdStep(params, gs, null, learning_rate, 0, 0)
+}
+
+/** SGD with (optional) momentum and L2 weight decay, updating parameters in place. */
+export class SGD extends Optimizer {
+  lr: number
+  momentum: number
+  weight_decay: number
+  /** Clip gradients to this global L2 norm (0 disables clipping). */
+  max_grad_norm: number
+  /** Global L2 norm of the gradients seen by the last step (before clipping). */
+  grad_norm = 0
+  buffers: Record<number, sm.Tensor>
+  constructor(lr = 1e-3, momentum = 0, weight_decay = 0, max_grad_norm = 0) {
+    super()
+    this.lr = lr
+    this.momentum = momentum
+    this.weight_decay = weight_decay
+    this.max_grad_norm = max_grad_norm
+    this.buffers = {}
+  }
+  step(grads: Record<string, { grad: sm.Tensor; tensor: sm.Tensor; id: number }>) {
+    const params: sm.Tensor[] = []
+    const gs: sm.Tensor[] = []
+    const buffers: sm.Tensor[] = []
     for (const [, v] of Object.entries(grads)) {
-      const { tensor: t, grad: g } = v
+      const { tensor: t, grad: g, id: id } = v
       if (t.requires_grad) {
-        t.update(t.detach().add(g.detach().mul(lr))).untidy()
+        if (this.momentum && this.buffers[id] === undefined) {
+          this.buffers[id] = sm.full(t.shape, 0).untidy().eval()
+        }
+        params.push(t)
+        gs.push(g)
+        buffers.push(this.buffers[id])
       }
       t.grad = null
     }
-  })
+    this.grad_norm = sgdStep(
+      params,
+      gs,
+      this.momentum ? buffers : null,
+      this.lr,
+      this.momentum,
+      this.weight_decay,
+      this.max_grad_norm
+    )
+  }
 }
@@ -27,12 +27,21 @@ export type StatsEntry = {
   gflops: number
 }
 
+/** Tensors sent over the network with one encoding: the bytes of their data and on the wire. */
+export type TransferEntry = {
+  count: bigint
+  rawBytes: bigint
+  bytes: bigint
+}
+
 export type StatsSummary = {
   id: string
   hostId: string
   processId: string
   deviceId: string
   bytesUsed: bigint
+  checkpointBytesSaved: bigint
+  transfersByEncoding: [string, TransferEntry][]
   utilization: number
   startTime: number
   endTime: number
@@ -87,6 +96,8 @@ export class Stats {
   #loggers: StatsLogger[] = []
 
   #bytesUsed = fl.bytesUsed.native() // could track history in future for mean, max, etc
+  #checkpointBytesSaved = 0n
+  #transfersByEncoding: Map<string, TransferEntry> = new Map()
   #stackIds: Map<string, number> = new Map()
   #stackKeys: Map<number, string> = new Map()
   #startTime = 0
@@ -203,12 +214,31 @@ export class Stats {
     this.log(trace, entry)
   }
 
+  /** Record activations that `util.checkpoint` released instead of holding until backward. */
+  logCheckpoint(bytesSaved: bigint) {
+    this.#checkpointBytesSaved += bytesSaved
+  }
+
+  /** Record a tensor sent over the network with `encoding` (see `network.tfetch`). */
+  logTransfer(encoding: string, rawBytes: bigint, bytes: bigint) {
+    const entry = this.#transfersByEncoding.get(encoding)
+    if (!entry) {
+      this.#transfersByEncoding.set(encoding, { count: 1n, rawBytes, bytes })
+    } else {
+      entry.count += 1n
+      entry.rawBytes += rawBytes
+      entry.bytes += bytes
+    }
+  }
+
   reset(): void {
     // create new maps since the old are handed off to the logger to avoid copies
     this.#statsByStack = new Map()
     this.#statsByOp = new Map()
     this.#remoteStats = new Map()
     this.#startTime = this.#endTime = 0
+    this.#checkpointBytesSaved = 0n
+    this.#transfersByEncoding = new Map()
   }
 
   get statsByStack(): Map<number, StatsEntry> {
@@ -235,6 +265,16 @@ export class Stats {
     return this.#bytesUsed
   }
 
+  /** Bytes of activations that checkpointing kept from living until the backward pass. */
+  get checkpointBytesSaved(): bigint {
+    return this.#checkpointBytesSaved
+  }
+
+  /** Tensors sent over the network by encoding, with their size before and after encoding. */
+  get transfersByEncoding(): Map<string, TransferEntry> {
+    return this.#transfersByEncoding
+  }
+
   /**
    * Used to replace existing logger(s)
    */
@@ -259,6 +299,17 @@ export class Stats {
     existing.#endTime = Math.max(existing.#endTime, stats.#endTime)
     existing.#bytesUsed =
       existing.#bytesUsed < stats.#bytesUsed ? stats.#bytesUsed : existing.#bytesUsed
+    existing.#checkpointBytesSaved += stats.#checkpointBytesSaved
+    stats.#transfersByEncoding.forEach((entry, encoding) => {
+      const existingEntry = existing.#transfersByEncoding.get(encoding)
+      if (!existingEntry) {
+        existing.#transfersByEncoding.set(encoding, entry)
+      } else {
+        existingEntry.count += entry.count
+        existingEntry.rawBytes += entry.rawBytes
+        existingEntry.bytes += entry.bytes
+      }
+    })
     stats.#statsByOp.forEach((entry, op) => {
       const existingEntry = existing.#statsByOp.get(op)
       if (!existingEntry) {
@@ -398,6 +449,11 @@ export class Stats {
       entriesByOp,
       utilization: 0,
       bytesUsed: fl.bytesUsed.native(),
+      checkpointBytesSaved: this.#checkpointBytesSaved,
+      transfersByEncoding: [...this.#transfersByEncoding.entries()].map(([encoding, entry]) => [
+        encoding,
+        { ...entry }
+      ]),
       remoteStats: includeRemotes
         ? [...this.#remoteStats.values()].map((s) => s.toJSON(options))
         : []
@@ -466,6 +522,8 @@ export class Stats {
     stats.#statsByStack = new Map(o.entriesByStack)
 
     stats.#bytesUsed = o.bytesUsed
+    stats.#checkpointBytesSaved = o.checkpointBytesSaved ?? 0n
+    stats.#transfersByEncoding = new Map(o.transfersByEncoding ?? [])
     stats.#startTime = o.startTime
     stats.#endTime = o.endTime
 
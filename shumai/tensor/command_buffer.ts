@@ -0,0 +1,371 @@
+import { ptr } from 'bun:ffi'
+import { arrayArg } from '../ffi/ffi_bind_utils'
+import { fl } from '../ffi/ffi_flashlight'
+import { Stats, stats } from '../stats'
+import { dtype, Tensor } from './tensor'
+
+/** @private Opcodes understood by `_runCommands` (keep in sync with flashlight_binding.cc) */
+export enum CommandOp {
+  Full = 0,
+  Negative = 1,
+  Exp = 2,
+  Log = 3,
+  Log1p = 4,
+  Sin = 5,
+  Cos = 6,
+  Sqrt = 7,
+  Tanh = 8,
+  Floor = 9,
+  Ceil = 10,
+  Rint = 11,
+  Absolute = 12,
+  Sigmoid = 13,
+  Erf = 14,
+  Add = 15,
+  Sub = 16,
+  Mul = 17,
+  Div = 18,
+  Minimum = 19,
+  Maximum = 20,
+  Power = 21,
+  Matmul = 22,
+  Eq = 23,
+  Neq = 24,
+  LessThan = 25,
+  LessThanEqual = 26,
+  GreaterThan = 27,
+  GreaterThanEqual = 28,
+  Reshape = 29,
+  Transpose = 30,
+  Sum = 31,
+  Mean = 32,
+  Amin = 33,
+  Amax = 34,
+  Astype = 35
+}
+
+const INSTRUCTION_WIDTH = 6
+
+/** A value inside a {@link CommandBuffer}: either a bound input or the result of a recorded op. */
+export type CommandSlot = number
+
+type Instruction = {
+  op: CommandOp
+  a: CommandSlot
+  b: number
+  imm: number[]
+  value?: number
+}
+
+/**
+ * Records a sequence of tensor ops once and executes all of them with a single native call.
+ *
+ * Every op dispatched through the regular {@link Tensor} API costs an FFI round trip and
+ * a new native handle, which dominates for small tensors. A `CommandBuffer` encodes
+ * its ops as compact bytecode; {@link CommandBuffer.run} executes the whole program
+ * natively, releases intermediates as soon as they are dead and only returns handles
+ * for the declared outputs.
+ *
+ * Command buffers do not record gradients, so inputs must not require them.
+ *
+ * @example
+ * ```javascript
+ * const cb = new sm.CommandBuffer()
+ * const param = cb.input()
+ * const grad = cb.input()
+ * cb.output(cb.sub(param, cb.mul(grad, cb.scalar(1e-3))))
+ *
+ * const [updated] = cb.run(weight.detach(), weight.grad)
+ * ```
+ */
+export class CommandBuffer {
+  private _inputs = 0
+  private _instructions: Instruction[] = []
+  private _outputs: CommandSlot[] = []
+  private _program: BigInt64Array = null
+
+  /** Number of tensors {@link CommandBuffer.run} expects. */
+  get inputs(): number {
+    return this._inputs
+  }
+
+  /** Number of recorded ops. */
+  get length(): number {
+    return this._instructions.length
+  }
+
+  /** Declare the next positional input of {@link CommandBuffer.run}. */
+  input(): CommandSlot {
+    if (this._instructions.length) {
+      throw new Error('CommandBuffer inputs must be declared before any op is recorded')
+    }
+    this._program = null
+    return this._inputs++
+  }
+
+  /** Mark slots to be returned (in order) from {@link CommandBuffer.run}. */
+  output(...slots: CommandSlot[]): this {
+    for (const s of slots) {
+      this._check(s)
+    }
+    this._outputs.push(...slots)
+    return this
+  }
+
+  full(shape: number[], value: number): CommandSlot {
+    return this._record(CommandOp.Full, -1, 0, shape, value)
+  }
+
+  scalar(value: number): CommandSlot {
+    return this.full([], value)
+  }
+
+  negative(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Negative, a)
+  }
+
+  exp(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Exp, a)
+  }
+
+  log(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Log, a)
+  }
+
+  log1p(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Log1p, a)
+  }
+
+  sin(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Sin, a)
+  }
+
+  cos(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Cos, a)
+  }
+
+  sqrt(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Sqrt, a)
+  }
+
+  tanh(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Tanh, a)
+  }
+
+  floor(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Floor, a)
+  }
+
+  ceil(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Ceil, a)
+  }
+
+  rint(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Rint, a)
+  }
+
+  absolute(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Absolute, a)
+  }
+
+  sigmoid(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Sigmoid, a)
+  }
+
+  erf(a: CommandSlot): CommandSlot {
+    return this._unary(CommandOp.Erf, a)
+  }
+
+  add(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Add, a, b)
+  }
+
+  sub(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Sub, a, b)
+  }
+
+  mul(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Mul, a, b)
+  }
+
+  div(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Div, a, b)
+  }
+
+  minimum(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Minimum, a, b)
+  }
+
+  maximum(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Maximum, a, b)
+  }
+
+  power(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Power, a, b)
+  }
+
+  matmul(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Matmul, a, b)
+  }
+
+  eq(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Eq, a, b)
+  }
+
+  neq(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.Neq, a, b)
+  }
+
+  lessThan(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.LessThan, a, b)
+  }
+
+  lessThanEqual(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.LessThanEqual, a, b)
+  }
+
+  greaterThan(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.GreaterThan, a, b)
+  }
+
+  greaterThanEqual(a: CommandSlot, b: CommandSlot): CommandSlot {
+    return this._binary(CommandOp.GreaterThanEqual, a, b)
+  }
+
+  reshape(a: CommandSlot, shape: number[]): CommandSlot {
+    this._check(a)
+    return this._record(CommandOp.Reshape, a, -1, shape)
+  }
+
+  transpose(a: CommandSlot, axes: number[]): CommandSlot {
+    this._check(a)
+    return this._record(CommandOp.Transpose, a, -1, axes)
+  }
+
+  sum(a: CommandSlot, axes: number[] = [], keep_dims = false): CommandSlot {
+    return this._reduce(CommandOp.Sum, a, axes, keep_dims)
+  }
+
+  mean(a: CommandSlot, axes: number[] = [], keep_dims = false): CommandSlot {
+    return this._reduce(CommandOp.Mean, a, axes, keep_dims)
+  }
+
+  amin(a: CommandSlot, axes: number[] = [], keep_dims = false): CommandSlot {
+    return this._reduce(CommandOp.Amin, a, axes, keep_dims)
+  }
+
+  amax(a: CommandSlot, axes: number[] = [], keep_dims = false): CommandSlot {
+    return this._reduce(CommandOp.Amax, a, axes, keep_dims)
+  }
+
+  astype(a: CommandSlot, type: dtype): CommandSlot {
+    this._check(a)
+    return this._record(CommandOp.Astype, a, type)
+  }
+
+  /** Encode the recorded program (cached until more ops are recorded). */
+  compile(): BigInt64Array {
+    if (this._program) {
+      return this._program
+    }
+    const count = this._instructions.length
+    const imm_base = 1 + count * INSTRUCTION_WIDTH
+    const imm_len = this._instructions.reduce((n, ins) => n + ins.imm.length, 0)
+    const program = new BigInt64Array(imm_base + imm_len)
+    const program_f64 = new Float64Array(program.buffer)
+    program[0] = BigInt(count)
+    let imm_off = 0
+    for (let i = 0; i < count; ++i) {
+      const ins = this._instructions[i]
+      const o = 1 + i * INSTRUCTION_WIDTH
+      program[o] = BigInt(ins.op)
+      program[o + 1] = BigInt(this._inputs + i)
+      program[o + 2] = BigInt(ins.a)
+      if (ins.value !== undefined) {
+        program_f64[o + 3] = ins.value
+      } else {
+        program[o + 3] = BigInt(ins.b)
+      }
+      program[o + 4] = BigInt(imm_off)
+      program[o + 5] = BigInt(ins.imm.length)
+      for (const v of ins.imm) {
+        program[imm_base + imm_off++] = BigInt(v)
+      }
+    }
+    this._program = program
+    return program
+  }
+
+  /** Execute the program on `inputs` and return the declared outputs. */
+  run(...inputs: Tensor[]): Tensor[] {
+    if (inputs.length !== this._inputs) {
+      throw new Error(`CommandBuffer expected ${this._inputs} inputs, got ${inputs.length}`)
+    }
+    if (!this._outputs.length) {
+      throw new Error('CommandBuffer has no outputs, call output() before run()')
+    }
+    if (inputs.some((t) => t.requires_grad)) {
+      throw new Error('CommandBuffer does not record gradients, detach() inputs before run()')
+    }
+    const program = this.compile()
+    const outputs = new BigInt64Array(this._outputs.map((s) => BigInt(s)))
+
+    const asyncStats: Stats = inputs.reduce((a, t) => a || t.stats, void 0 as Stats)
+    const s = asyncStats || stats
+    const trace = s.enabled && s.startTrace('runCommands')
+
+    const [inputs_ptr, inputs_len] = arrayArg(inputs)
+    const err = fl._runCommands.native(
+      inputs_ptr,
+      inputs_len,
+      ptr(program),
+      program.length,
+      ptr(outputs),
+      outputs.length
+    )
+
+    trace && s.stopTrace(trace)
+    if (err < 0) {
+      throw new Error(`CommandBuffer failed to run; native code likely threw an error...`)
+    }
+
+    const results: Tensor[] = []
+    for (const handle of outputs) {
+      const t = new Tensor({ _ptr: Number(handle), _deps: [] })
+      t.stats = asyncStats
+      results.push(t)
+    }
+
+    trace && s.logTrace(trace, inputs, results[0])
+
+    return results
+  }
+
+  private _check(slot: CommandSlot) {
+    if (!Number.isInteger(slot) || slot < 0 || slot >= this._inputs + this._instructions.length) {
+      throw new Error(`Invalid CommandBuffer slot ${slot}`)
+    }
+  }
+
+  private _unary(op: CommandOp, a: CommandSlot): CommandSlot {
+    this._check(a)
+    return this._record(op, a)
+  }
+
+  private _binary(op: CommandOp, a: CommandSlot, b: CommandSlot): CommandSlot {
+    this._check(a)
+    this._check(b)
+    return this._record(op, a, b)
+  }
+
+  private _reduce(op: CommandOp, a: CommandSlot, axes: number[], keep_dims: boolean) {
+    this._check(a)
+    return this._record(op, a, keep_dims ? 1 : 0, axes)
+  }
+
+  private _record(op: CommandOp, a = -1, b = -1, imm: number[] = [], value?: number): CommandSlot {
+    this._program = null
+    this._instructions.push({ op, a, b, imm, value })
+    return this._inputs + this._instructions.length - 1
+  }
+}
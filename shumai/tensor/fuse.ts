@@ -0,0 +1,474 @@
+import { ptr } from 'bun:ffi'
+import { arrayArg } from '../ffi/ffi_bind_utils'
+import { fl } from '../ffi/ffi_flashlight'
+import { Stats, stats } from '../stats'
+import { CommandOp } from './command_buffer'
+import type { GradContext } from './register_gradients'
+import { Tensor } from './tensor'
+
+// Node kinds other than elementwise ops (which use their CommandOp value).
+const INPUT = -1
+const CONSTANT = -2
+
+type Node = { op: number; a: number; b: number; value?: number }
+
+/** @private An elementwise expression DAG; identical nodes are only recorded once. */
+export class FuseGraph {
+  nodes: Node[] = []
+  private _memo = new Map<string, number>()
+
+  input(): number {
+    this.nodes.push({ op: INPUT, a: -1, b: -1 })
+    return this.nodes.length - 1
+  }
+
+  constant(value: number): number {
+    return this._intern(`c${value}`, { op: CONSTANT, a: -1, b: -1, value })
+  }
+
+  record(op: CommandOp, a: number, b = -1): number {
+    return this._intern(`${op},${a},${b}`, { op, a, b })
+  }
+
+  /** Encode the nodes `outputs` depend on in the layout `_fused` expects. */
+  encode(outputs: number[]): BigInt64Array {
+    const live = new Array(this.nodes.length).fill(false)
+    for (const o of outputs) {
+      live[o] = true
+    }
+    for (let i = this.nodes.length - 1; i >= 0; --i) {
+      const node = this.nodes[i]
+      if (live[i] || node.op === INPUT) {
+        live[i] = true
+        node.a >= 0 && (live[node.a] = true)
+        node.b >= 0 && (live[node.b] = true)
+      }
+    }
+    // inputs first, then constants, then ops (which keep their relative order)
+    const order = [INPUT, CONSTANT, 0].flatMap((kind) =>
+      this.nodes
+        .map((_, i) => i)
+        .filter((i) => live[i] && Math.min(this.nodes[i].op, 0) === kind)
+    )
+    const remap = new Map<number, number>(order.map((i, j) => [i, j]))
+    const kinds = order.map((i) => this.nodes[i].op)
+    const inputs = kinds.filter((op) => op === INPUT).length
+    const constants = kinds.filter((op) => op === CONSTANT).length
+    const steps = order.length - inputs - constants
+
+    const program = new BigInt64Array(4 + constants + 3 * steps + outputs.length)
+    const program_f64 = new Float64Array(program.buffer)
+    program.set([inputs, constants, steps, outputs.length].map(BigInt))
+    let o = 4
+    for (const i of order.slice(inputs, inputs + constants)) {
+      program_f64[o++] = this.nodes[i].value
+    }
+    for (const i of order.slice(inputs + constants)) {
+      const node = this.nodes[i]
+      program[o++] = BigInt(node.op)
+      program[o++] = BigInt(remap.get(node.a))
+      program[o++] = BigInt(node.b >= 0 ? remap.get(node.b) : -1)
+    }
+    for (const i of outputs) {
+      program[o++] = BigInt(remap.get(i))
+    }
+    return program
+  }
+
+  private _intern(key: string, node: Node): number {
+    let id = this._memo.get(key)
+    if (id === undefined) {
+      this.nodes.push(node)
+      id = this.nodes.length - 1
+      this._memo.set(key, id)
+    }
+    return id
+  }
+}
+
+/**
+ * A value inside a function passed to {@link fuse}. It offers the elementwise subset of the
+ * {@link Tensor} API; numbers are accepted wherever a second operand is expected.
+ */
+export class Fused {
+  /** @private */
+  constructor(readonly graph: FuseGraph, readonly id: number) {}
+
+  negative() {
+    return this._unary(CommandOp.Negative)
+  }
+  negate() {
+    return this.negative()
+  }
+  exp() {
+    return this._unary(CommandOp.Exp)
+  }
+  log() {
+    return this._unary(CommandOp.Log)
+  }
+  log1p() {
+    return this._unary(CommandOp.Log1p)
+  }
+  sin() {
+    return this._unary(CommandOp.Sin)
+  }
+  cos() {
+    return this._unary(CommandOp.Cos)
+  }
+  sqrt() {
+    return this._unary(CommandOp.Sqrt)
+  }
+  tanh() {
+    return this._unary(CommandOp.Tanh)
+  }
+  floor() {
+    return this._unary(CommandOp.Floor)
+  }
+  ceil() {
+    return this._unary(CommandOp.Ceil)
+  }
+  rint() {
+    return this._unary(CommandOp.Rint)
+  }
+  absolute() {
+    return this._unary(CommandOp.Absolute)
+  }
+  abs() {
+    return this.absolute()
+  }
+  sigmoid() {
+    return this._unary(CommandOp.Sigmoid)
+  }
+  erf() {
+    return this._unary(CommandOp.Erf)
+  }
+  add(other: Fused | number) {
+    return this._binary(CommandOp.Add, other)
+  }
+  sub(other: Fused | number) {
+    return this._binary(CommandOp.Sub, other)
+  }
+  mul(other: Fused | number) {
+    return this._binary(CommandOp.Mul, other)
+  }
+  div(other: Fused | number) {
+    return this._binary(CommandOp.Div, other)
+  }
+  minimum(other: Fused | number) {
+    return this._binary(CommandOp.Minimum, other)
+  }
+  maximum(other: Fused | number) {
+    return this._binary(CommandOp.Maximum, other)
+  }
+  power(other: Fused | number) {
+    return this._binary(CommandOp.Power, other)
+  }
+  pow(other: Fused | number) {
+    return this.power(other)
+  }
+  eq(other: Fused | number) {
+    return this._binary(CommandOp.Eq, other)
+  }
+  neq(other: Fused | number) {
+    return this._binary(CommandOp.Neq, other)
+  }
+  lessThan(other: Fused | number) {
+    return this._binary(CommandOp.LessThan, other)
+  }
+  lt(other: Fused | number) {
+    return this.lessThan(other)
+  }
+  lessThanEqual(other: Fused | number) {
+    return this._binary(CommandOp.LessThanEqual, other)
+  }
+  lte(other: Fused | number) {
+    return this.lessThanEqual(other)
+  }
+  greaterThan(other: Fused | number) {
+    return this._binary(CommandOp.GreaterThan, other)
+  }
+  gt(other: Fused | number) {
+    return this.greaterThan(other)
+  }
+  greaterThanEqual(other: Fused | number) {
+    return this._binary(CommandOp.GreaterThanEqual, other)
+  }
+  gte(other: Fused | number) {
+    return this.greaterThanEqual(other)
+  }
+
+  private _unary(op: CommandOp) {
+    return new Fused(this.graph, this.graph.record(op, this.id))
+  }
+
+  private _binary(op: CommandOp, other: Fused | number) {
+    let b: number
+    if (other instanceof Fused) {
+      if (other.graph !== this.graph) {
+        throw new Error('Fused values from different fuse() calls cannot be mixed')
+      }
+      b = other.id
+    } else {
+      b = this.graph.constant(other)
+    }
+    return new Fused(this.graph, this.graph.record(op, this.id, b))
+  }
+}
+
+/** @private A traced function: its graph, outputs and (lazily built) gradient programs. */
+class FuseProgram {
+  readonly encoded: BigInt64Array
+  private _gradients = new Map<string, FuseProgram>()
+
+  constructor(readonly graph: FuseGraph, readonly outputs: number[]) {
+    this.encoded = graph.encode(outputs)
+  }
+
+  run(inputs: Tensor[], record: boolean): Tensor[] {
+    const asyncStats: Stats = inputs.reduce((a, t) => a || t.stats, void 0 as Stats)
+    const s = asyncStats || stats
+    const trace = s.enabled && s.startTrace('fused')
+
+    const handles = new BigInt64Array(this.outputs.length)
+    const [inputs_ptr, inputs_len] = arrayArg(inputs)
+    const err = fl._fused.native(
+      inputs_ptr,
+      inputs_len,
+      ptr(this.encoded),
+      this.encoded.length,
+      ptr(handles),
+      handles.length
+    )
+
+    trace && s.stopTrace(trace)
+    if (err < 0) {
+      throw new Error(`Fused program failed to run; native code likely threw an error...`)
+    }
+
+    const requires_grad = record && inputs.some((t) => t.requires_grad)
+    const provenance = inputs.reduce((a, t) => a || t.provenance, null)
+    const results = Array.from(handles, (handle, index) => {
+      const t = new Tensor({ _ptr: Number(handle), _deps: requires_grad ? inputs : [] })
+      t.stats = asyncStats
+      t.provenance = provenance
+      t.requires_grad = requires_grad
+      t.op = 'fused'
+      if (requires_grad) {
+        fusedOutputs.set(t, { program: this, index })
+      }
+      return t
+    })
+
+    trace && s.logTrace(trace, inputs, results[0])
+    return results
+  }
+
+  /**
+   * A program taking this one's inputs followed by the gradient of output `index` and
+   * returning the gradients of the inputs in `wrt`. The forward expression is recomputed
+   * inside it rather than saved.
+   */
+  gradient(index: number, wrt: number[]): FuseProgram {
+    const key = `${index}:${wrt}`
+    let program = this._gradients.get(key)
+    if (!program) {
+      program = new FuseProgram(...differentiate(this.graph, this.outputs[index], wrt))
+      this._gradients.set(key, program)
+    }
+    return program
+  }
+}
+
+function differentiate(forward: FuseGraph, output: number, wrt: number[]): [FuseGraph, number[]] {
+  const g = new FuseGraph()
+  const map = forward.nodes.map((node) => {
+    if (node.op === INPUT) {
+      return g.input()
+    } else if (node.op === CONSTANT) {
+      return g.constant(node.value)
+    }
+    return -1
+  })
+  const seed = g.input()
+  const inputIds = forward.nodes.flatMap((node, i) => (node.op === INPUT ? [i] : []))
+
+  // only propagate into nodes that depend on an input being differentiated
+  const needed = forward.nodes.map(() => false)
+  for (const i of wrt) {
+    needed[inputIds[i]] = true
+  }
+  forward.nodes.forEach((node, i) => {
+    if (node.op >= 0) {
+      map[i] = g.record(node.op, map[node.a], node.b >= 0 ? map[node.b] : -1)
+      needed[i] = needed[node.a] || (node.b >= 0 && needed[node.b])
+    }
+  })
+
+  const F = (id: number) => new Fused(g, id)
+  const adjoint = new Map<number, Fused>([[output, F(seed)]])
+  const accumulate = (i: number, grad: Fused) => {
+    if (needed[i]) {
+      const prev = adjoint.get(i)
+      adjoint.set(i, prev ? prev.add(grad) : grad)
+    }
+  }
+  for (let i = forward.nodes.length - 1; i >= 0; --i) {
+    const node = forward.nodes[i]
+    const dy = adjoint.get(i)
+    if (!dy || node.op < 0) {
+      continue
+    }
+    const a = F(map[node.a])
+    const b = node.b >= 0 ? F(map[node.b]) : null
+    const y = F(map[i])
+    switch (node.op) {
+      case CommandOp.Negative:
+        accumulate(node.a, dy.negative())
+        break
+      case CommandOp.Exp:
+        accumulate(node.a, dy.mul(y))
+        break
+      case CommandOp.Log:
+        accumulate(node.a, dy.div(a))
+        break
+      case CommandOp.Log1p:
+        accumulate(node.a, dy.div(a.add(1)))
+        break
+      case CommandOp.Sin:
+        accumulate(node.a, dy.mul(a.cos()))
+        break
+      case CommandOp.Cos:
+        accumulate(node.a, dy.mul(a.sin()).negative())
+        break
+      case CommandOp.Sqrt:
+        accumulate(node.a, dy.mul(0.5).div(y))
+        break
+      case CommandOp.Tanh:
+        accumulate(node.a, dy.mul(y.mul(y).negative().add(1)))
+        break
+      case CommandOp.Absolute:
+        accumulate(node.a, dy.mul(a.gt(0).sub(a.lt(0))))
+        break
+      case CommandOp.Sigmoid:
+        accumulate(node.a, dy.mul(y).mul(y.negative().add(1)))
+        break
+      case CommandOp.Erf:
+        accumulate(node.a, dy.mul(a.mul(a).negative().exp()).mul(2 / Math.sqrt(Math.PI)))
+        break
+      case CommandOp.Add:
+        accumulate(node.a, dy)
+        accumulate(node.b, dy)
+        break
+      case CommandOp.Sub:
+        accumulate(node.a, dy)
+        accumulate(node.b, dy.negative())
+        break
+      case CommandOp.Mul:
+        accumulate(node.a, dy.mul(b))
+        accumulate(node.b, dy.mul(a))
+        break
+      case CommandOp.Div:
+        accumulate(node.a, dy.div(b))
+        accumulate(node.b, dy.mul(y).div(b).negative())
+        break
+      case CommandOp.Minimum:
+        accumulate(node.a, dy.mul(a.lte(b)))
+        accumulate(node.b, dy.mul(a.gt(b)))
+        break
+      case CommandOp.Maximum:
+        accumulate(node.a, dy.mul(a.gte(b)))
+        accumulate(node.b, dy.mul(a.lt(b)))
+        break
+      case CommandOp.Power:
+        accumulate(node.a, dy.mul(b).mul(a.power(b.sub(1))))
+        accumulate(node.b, dy.mul(y).mul(a.log()))
+        break
+      // floor, ceil, rint and comparisons have no gradient
+    }
+  }
+  const outputs = wrt.map((i) => {
+    const grad = adjoint.get(inputIds[i])
+    return grad ? grad.id : g.constant(0)
+  })
+  return [g, outputs]
+}
+
+const fusedOutputs = new WeakMap<Tensor, { program: FuseProgram; index: number }>()
+// One backward program yields the gradients of every input; keep them for the other calls.
+const fusedGrads = new WeakMap<Tensor, { grad: Tensor; grads: Tensor[] }>()
+
+/** Sum `grad` over the axes along which `shape` was broadcast. */
+function sumToShape(grad: Tensor, shape: number[]): Tensor {
+  const padded = [...Array(grad.shape.length - shape.length).fill(1), ...shape]
+  const axes = padded.flatMap((d, i) => (d === 1 && grad.shape[i] !== 1 ? [i] : []))
+  return (axes.length ? grad.sum(axes, true) : grad).reshape(shape)
+}
+
+/** @private Gradient function of fused outputs, see register_gradients.ts */
+export function fusedGradient(ctx: GradContext): Tensor {
+  const inputs = <Tensor[]>ctx.forward_inputs
+  let cached = fusedGrads.get(ctx.forward_output)
+  if (!cached || cached.grad !== ctx.backward_input) {
+    const { program, index } = fusedOutputs.get(ctx.forward_output)
+    const wrt = inputs.flatMap((t, i) => (t.requires_grad ? [i] : []))
+    const results = program.gradient(index, wrt).run([...inputs, ctx.backward_input], false)
+    const grads: Tensor[] = []
+    wrt.forEach((i, k) => {
+      grads[i] = sumToShape(results[k], inputs[i].shape)
+    })
+    cached = { grad: ctx.backward_input, grads }
+    fusedGrads.set(ctx.forward_output, cached)
+  }
+  return cached.grads[ctx.backward_output_index]
+}
+
+/**
+ * Compile `fn`, a function of elementwise ops, into a single native loop.
+ *
+ * Each op on a {@link Tensor} is its own native call writing a full-size result, so a chain
+ * such as `x.mul(a).add(b).sigmoid()` reads and writes memory once per op. The function
+ * returned by `fuse` traces `fn` once (per number of arguments) on {@link Fused} values and
+ * then evaluates the whole expression in one pass over the broadcast shape of its inputs,
+ * block by block, so that only the inputs are read and only the results are written.
+ * Compiled programs are cached natively by their encoding, so identical expressions share
+ * one. Gradients are supported: the backward pass is another fused program which
+ * recomputes the forward expression instead of saving intermediates.
+ *
+ * Numbers used inside `fn` are baked in when it is traced; pass values that change
+ * between calls as (scalar) tensors. Results are Float32, or Float64 if any input is;
+ * comparisons yield 0 or 1.
+ *
+ * @example
+ * ```javascript
+ * const gate = sm.fuse((x, a, b) => x.mul(a).add(b).sigmoid())
+ * const y = gate(x, a, b)
+ *
+ * const [lo, hi] = sm.fuse((x) => [x.minimum(0), x.maximum(0)])(x)
+ * ```
+ */
+export function fuse(fn: (...inputs: Fused[]) => Fused): (...inputs: Tensor[]) => Tensor
+export function fuse(fn: (...inputs: Fused[]) => Fused[]): (...inputs: Tensor[]) => Tensor[]
+export function fuse(fn: (...inputs: Fused[]) => Fused | Fused[]) {
+  const traced = new Map<number, { program: FuseProgram; multiple: boolean }>()
+  return (...inputs: Tensor[]) => {
+    let entry = traced.get(inputs.length)
+    if (!entry) {
+      const graph = new FuseGraph()
+      const args = inputs.map(() => new Fused(graph, graph.input()))
+      const result = fn(...args)
+      const outputs = Array.isArray(result) ? result : [result]
+      for (const o of outputs) {
+        if (!(o instanceof Fused) || o.graph !== graph) {
+          throw new Error('fuse() functions must return Fused values built from their arguments')
+        }
+      }
+      entry = {
+        program: new FuseProgram(graph, outputs.map((o) => o.id)),
+        multiple: Array.isArray(result)
+      }
+      traced.set(inputs.length, entry)
+    }
+    const results = entry.program.run(inputs, true)
+    return entry.multiple ? results : results[0]
+  }
+}
@@ -1,5 +1,7 @@
 export * from '../stats/op_to_flops'
+export * from './command_buffer'
 export * from './dtype'
+export { fuse, Fused } from './fuse'
 export * from './tensor'
 export * from './tensor_ops'
 import './register_gradients'
@@ -1,3 +1,5 @@
+import { checkpointGradient } from '../util/checkpoint'
+import { fusedGradient } from './fuse'
 import type { Tensor } from './tensor'
 import * as base from './tensor'
 import * as ops from './tensor_ops'
@@ -12,6 +14,36 @@ export interface GradContext {
   backward_output_index: number // // index of the associated forward input to be differentiated
 }
 
+// The attention backward computes all three input gradients at once; keep them around for
+// the calls asking for the others.
+const attentionGrads = new WeakMap<Tensor, { grad: Tensor; grads: [Tensor, Tensor, Tensor] }>()
+// Likewise for layerNorm (x, gamma and beta) and each lstmSequence output (six inputs).
+const layerNormGrads = new WeakMap<Tensor, { grad: Tensor; grads: Tensor[] }>()
+const lstmGrads = new WeakMap<Tensor, { grad: Tensor; grads: Tensor[] }>()
+
+function lstmSequenceGrad(ctx: GradContext, hidden: boolean): Tensor {
+  const [x, h0, c0, W, U, b, gates, cells] = <Tensor[]>ctx.forward_inputs
+  let cached = lstmGrads.get(ctx.forward_output)
+  if (!cached || cached.grad !== ctx.backward_input) {
+    const grad = ctx.backward_input
+    const grads = sm.lstmSequenceBackward(
+      hidden ? grad : null,
+      hidden ? null : grad,
+      x,
+      h0,
+      c0,
+      W,
+      U,
+      b,
+      gates,
+      cells
+    )
+    cached = { grad, grads }
+    lstmGrads.set(ctx.forward_output, cached)
+  }
+  return cached.grads[ctx.backward_output_index]
+}
+
 function recoverShape(tensor: Tensor, originalShape: number[], lostAxes: number[]) {
   const shapeForBroadcast = [...originalShape]
   for (let axis of lostAxes) {
@@ -317,6 +349,104 @@ const impls = {
     } else {
       throw new Error(`Invalid Grad argument`)
     }
+  },
+  // Gather/scatter gradients scatter-add (or gather) only the touched slices instead of
+  // materializing a one-hot matrix, so embedding lookups cost O(rows used) to differentiate.
+  gather: (ctx: GradContext): Tensor => {
+    const [x, axis, index] = <[Tensor, number, Tensor]>ctx.forward_inputs
+    if (ctx.backward_output_index !== 0) {
+      throw new Error(`Gradient cannot be propagated to the index Tensor`)
+    }
+    return sm.scatterAdd(sm.full(x.shape, 0), axis, index, ctx.backward_input)
+  },
+  scatterAdd: (ctx: GradContext): Tensor => {
+    const [, axis, index] = <[Tensor, number, Tensor, Tensor]>ctx.forward_inputs
+    if (ctx.backward_output_index === 0) {
+      return ctx.backward_input
+    } else if (ctx.backward_output_index === 3) {
+      return sm.gather(ctx.backward_input, axis, index)
+    }
+    throw new Error(`Gradient cannot be propagated to the index Tensor`)
+  },
+  indexSelect: (ctx: GradContext): Tensor => {
+    const [x, axis, index] = <[Tensor, number, Tensor]>ctx.forward_inputs
+    if (ctx.backward_output_index !== 0) {
+      throw new Error(`Gradient cannot be propagated to the index Tensor`)
+    }
+    return sm.indexAdd(sm.full(x.shape, 0), axis, index, ctx.backward_input)
+  },
+  scaledDotProductAttention: (ctx: GradContext): Tensor => {
+    const [q, k, v, mask, scale, causal, lse] = <
+      [Tensor, Tensor, Tensor, Tensor | 0, number, number, Tensor]
+    >ctx.forward_inputs
+    if (ctx.backward_output_index > 2) {
+      throw new Error(`Gradient cannot be propagated to the attention mask`)
+    }
+    let cached = attentionGrads.get(ctx.forward_output)
+    if (!cached || cached.grad !== ctx.backward_input) {
+      const grads = sm.scaledDotProductAttentionBackward(
+        ctx.backward_input,
+        q,
+        k,
+        v,
+        ctx.forward_output,
+        lse,
+        mask || undefined,
+        causal === 1,
+        scale
+      )
+      cached = { grad: ctx.backward_input, grads }
+      attentionGrads.set(ctx.forward_output, cached)
+    }
+    return cached.grads[ctx.backward_output_index]
+  },
+  softmax: (ctx: GradContext): Tensor => {
+    const axis = <number>ctx.forward_inputs[1]
+    return sm.softmaxBackward(ctx.backward_input, ctx.forward_output, axis)
+  },
+  logSoftmax: (ctx: GradContext): Tensor => {
+    const axis = <number>ctx.forward_inputs[1]
+    return sm.logSoftmaxBackward(ctx.backward_input, ctx.forward_output, axis)
+  },
+  crossEntropyWithLogits: (ctx: GradContext): Tensor => {
+    const [logits, labels, lse] = <Tensor[]>ctx.forward_inputs
+    if (ctx.backward_output_index !== 0) {
+      throw new Error(`Gradient cannot be propagated to the labels Tensor`)
+    }
+    return sm.crossEntropyWithLogitsBackward(ctx.backward_input, logits, labels, lse)
+  },
+  fused: (ctx: GradContext): Tensor => fusedGradient(ctx),
+  checkpoint: (ctx: GradContext): Tensor => checkpointGradient(ctx),
+  layerNorm: (ctx: GradContext): Tensor => {
+    const [x, gamma, beta, dims, , mean, rstd] = <
+      [Tensor, Tensor | 0, Tensor | 0, number, number, Tensor, Tensor]
+    >ctx.forward_inputs
+    let cached = layerNormGrads.get(ctx.forward_output)
+    if (!cached || cached.grad !== ctx.backward_input) {
+      const grads = sm.layerNormBackward(
+        ctx.backward_input,
+        x,
+        gamma || undefined,
+        mean,
+        rstd,
+        dims,
+        !!(gamma || beta)
+      )
+      cached = { grad: ctx.backward_input, grads }
+      layerNormGrads.set(ctx.forward_output, cached)
+    }
+    return cached.grads[ctx.backward_output_index]
+  },
+  lstmSequence: (ctx: GradContext): Tensor => lstmSequenceGrad(ctx, true),
+  lstmSequenceCell: (ctx: GradContext): Tensor => lstmSequenceGrad(ctx, false),
+  indexAdd: (ctx: GradContext): Tensor => {
+    const [, axis, index] = <[Tensor, number, Tensor, Tensor]>ctx.forward_inputs
+    if (ctx.backward_output_index === 0) {
+      return ctx.backward_input
+    } else if (ctx.backward_output_index === 3) {
+      return sm.indexSelect(ctx.backward_input, axis, index)
+    }
+    throw new Error(`Gradient cannot be propagated to the index Tensor`)
   }
 }
 
@@ -2,8 +2,10 @@ import { ptr, toArrayBuffer } from 'bun:ffi'
 import { existsSync } from 'fs'
 import { arrayArg } from '../ffi/ffi_bind_utils'
 import { fl } from '../ffi/ffi_flashlight'
+import { CheckpointStore } from '../io/checkpoint_store'
 import { Stats, stats } from '../stats'
-import { _tidyTracker, cyrb53, Float16Array, gcAsNeeded } from '../util'
+import { _tidyTracker, ArrayLike, cyrb53, Float16Array, gcAsNeeded } from '../util'
+import { CommandOp } from './command_buffer'
 import { GradContext } from './register_gradients'
 import { full } from './tensor_ops'
 import * as ops from './tensor_ops'
@@ -86,6 +88,34 @@ export function wrapFLTensor(op: string, closure: CallableFunction, ...args: unk
   return t
 }
 
+/**
+ * Read back `t` as host memory of the requested dtype. If `t` already has that dtype and
+ * is contiguous in host memory, the returned buffer borrows the tensor's storage (kept
+ * alive until the buffer is collected); otherwise the native side makes one cast+copy.
+ */
+function hostView(t: Tensor, type: dtype, bytesPerElement: number): ArrayBuffer {
+  const byteLength = t.elements * bytesPerElement
+  if (byteLength === 0) {
+    return new ArrayBuffer(0)
+  }
+  const data = new BigInt64Array(1)
+  const view = fl._hostView.native(t.ptr, type, ptr(data))
+  if (!view) {
+    throw new Error(
+      `Host view returned from native code is null; native code likely threw an error...`
+    )
+  }
+  return toArrayBuffer(
+    Number(data[0]),
+    0,
+    byteLength,
+    // eslint-disable-next-line @typescript-eslint/ban-ts-comment
+    // @ts-ignore - overload toArrayBuffer params
+    view,
+    fl.genHostViewDestroyer.native()
+  )
+}
+
 function traverse_gradients(
   sorted_traversal: Tensor[],
   jacobian: Tensor
@@ -172,6 +202,117 @@ async function async_traverse_gradients(
   return all_grads_dict
 }
 
+let native_tape = false
+
+let native_tape_ops: Record<string, CommandOp> = null
+
+// The `CommandOp` (see command_buffer.ts) of an op the native tape can differentiate, by
+// `Tensor.op` (`Log1p` is `log1p`); `Add` through `Matmul` take two tensors. The table is
+// built on first use, as command_buffer.ts imports this module.
+function nativeTapeOp(name: string): CommandOp | undefined {
+  if (!native_tape_ops) {
+    const ops = [
+      CommandOp.Negative,
+      CommandOp.Exp,
+      CommandOp.Log,
+      CommandOp.Log1p,
+      CommandOp.Sin,
+      CommandOp.Cos,
+      CommandOp.Sqrt,
+      CommandOp.Tanh,
+      CommandOp.Absolute,
+      CommandOp.Sigmoid,
+      CommandOp.Erf,
+      CommandOp.Add,
+      CommandOp.Sub,
+      CommandOp.Mul,
+      CommandOp.Div,
+      CommandOp.Minimum,
+      CommandOp.Maximum,
+      CommandOp.Power,
+      CommandOp.Matmul,
+      CommandOp.Reshape,
+      CommandOp.Transpose,
+      CommandOp.Sum,
+      CommandOp.Mean
+    ]
+    native_tape_ops = Object.fromEntries(
+      ops.map((op) => [CommandOp[op][0].toLowerCase() + CommandOp[op].slice(1), op])
+    )
+  }
+  return native_tape_ops[name]
+}
+
+// Runs the whole backward pass in one native call (see `runTape` in flashlight_binding.cc)
+// instead of dispatching every gradient op from JS. Returns null if the graph contains an
+// op without a native gradient, in which case the JS traversal is used.
+function native_traverse_gradients(
+  sorted_traversal: Tensor[],
+  jacobian: Tensor
+): Record<number, [Tensor, Tensor, number]> {
+  const tensors: Tensor[] = []
+  const slots = new Map<number, number>()
+  const slot = (t: Tensor) => {
+    if (!slots.has(t.ptr)) {
+      slots.set(t.ptr, tensors.length)
+      tensors.push(t)
+    }
+    return slots.get(t.ptr)
+  }
+  const code: number[] = []
+  const imm: number[] = []
+  // the traversal starts at the output, the tape is replayed in forward order
+  for (let i = sorted_traversal.length - 1; i >= 0; --i) {
+    const t = sorted_traversal[i]
+    const op = nativeTapeOp(t.op)
+    const [a, b] = t.deps
+    const binary = op >= CommandOp.Add && op <= CommandOp.Matmul
+    if (op === undefined || !(a instanceof Tensor) || binary !== (b instanceof Tensor)) {
+      return null
+    }
+    const args = binary || !b ? [] : Array.from(<ArrayLike<number | bigint>>b, Number)
+    code.push(op, slot(t), slot(a), binary ? slot(<Tensor>b) : -1, imm.length, args.length)
+    imm.push(...args)
+  }
+  const program = new BigInt64Array([sorted_traversal.length, ...code, ...imm].map(BigInt))
+  const wanted = tensors.filter((t) => t.requires_grad)
+  const grads = new BigInt64Array(wanted.map((t) => BigInt(slots.get(t.ptr))))
+
+  const asyncStats: Stats = tensors.reduce((a, t) => a || t.stats, void 0 as Stats)
+  const s = asyncStats || stats
+  const trace = s.enabled && s.startTrace('tapeBackward')
+
+  const [tensors_ptr, tensors_len] = arrayArg(tensors)
+  const err = fl._tapeBackward.native(
+    tensors_ptr,
+    tensors_len,
+    ptr(program),
+    program.length,
+    jacobian.ptr,
+    ptr(grads),
+    grads.length
+  )
+
+  trace && s.stopTrace(trace)
+  if (err < 0) {
+    throw new Error(`Native backward pass failed; native code likely threw an error...`)
+  }
+
+  const all_grads_dict: Record<number, [Tensor, Tensor, number]> = {}
+  let id = 0
+  wanted.forEach((t, i) => {
+    if (grads[i]) {
+      const g = new Tensor({ _ptr: Number(grads[i]), _deps: [] })
+      g.stats = asyncStats
+      all_grads_dict[t.ptr] = [t, g, id++]
+    }
+  })
+
+  trace && s.logTrace(trace, tensors, jacobian)
+
+  return all_grads_dict
+}
+
 // differentiate t with respect to all
 // dependencies with requires_grad === True
 export function backward(
@@ -256,6 +397,13 @@ export function backward(
     })()
   }
 
+  if (native_tape && base_t.deps.length) {
+    const all_grads_dict = native_traverse_gradients(sorted_traversal, jacobian)
+    if (all_grads_dict) {
+      return calc_grads(all_grads_dict)
+    }
+  }
+
   return calc_grads(traverse_gradients(sorted_traversal, jacobian))
 }
 
@@ -265,6 +413,7 @@ export class Tensor {
   private _deps: Array<Tensor> = []
   private _update_count = 0
   private _checkpoint_file: string
+  private _checkpoint_store: CheckpointStore
   private _checkpoint_callback: () => boolean
   requires_grad = false
   provenance = null
@@ -410,30 +559,58 @@ export class Tensor {
     this._ptr = ptr(tensor._underlying)
     this._deps = tensor.deps
     this.eval()
+    return this.markUpdated()
+  }
+
+  /**
+   * @private Bookkeeping (checkpointing) after the value of this tensor changed, either
+   * through {@link Tensor.update} or in place (e.g. a fused optimizer step).
+   */
+  markUpdated() {
     this._update_count += 1
-    if (this._checkpoint_file) {
+    if (this._checkpoint_store) {
       if (this._checkpoint_callback(this._update_count)) {
-        this.save(this._checkpoint_file)
+        this._checkpoint_store.updated(this)
+      }
+    } else if (this._checkpoint_file) {
+      if (this._checkpoint_callback(this._update_count)) {
+        this.saveAsync(this._checkpoint_file)
       }
     }
     return this
   }
 
-  checkpoint(file?: (() => boolean) | any, callback?: () => boolean) {
+  /**
+   * Restore this tensor from `file` if it exists, and save it there whenever it is updated
+   * (and `callback` returns true).
+   *
+   * `file` may also be a {@link CheckpointStore}, which only writes tensors whose contents
+   * changed; `name` identifies the tensor within the store.
+   */
+  checkpoint(file?: (() => boolean) | any, callback?: () => boolean, name?: string) {
     if (file instanceof Function) {
       callback = file
       file = undefined
     }
-    if (file === undefined) {
-      this._checkpoint_file = `tensor_${cyrb53(getStack(true))}.fl`
-    } else {
-      this._checkpoint_file = file.toString()
-    }
     if (callback !== undefined) {
       this._checkpoint_callback = callback
     } else {
       this._checkpoint_callback = () => true
     }
+    if (file instanceof CheckpointStore) {
+      this._checkpoint_file = undefined
+      this._checkpoint_store = undefined
+      file.track(name ?? `tensor_${cyrb53(getStack(true))}`, this)
+      this._checkpoint_store = file
+      return this
+    }
+    if (file === undefined) {
+      this._checkpoint_file = `tensor_${cyrb53(getStack(true))}.fl`
+    } else {
+      this._checkpoint_file = file.toString()
+    }
+    // the file may still be queued for writing
+    flushSaves()
     if (existsSync(this._checkpoint_file)) {
       const t = new Tensor(this._checkpoint_file)
       if (t.elements != this.elements) {
@@ -441,7 +618,7 @@ export class Tensor {
       }
       this.update(t)
     } else {
-      this.save(this._checkpoint_file)
+      this.saveAsync(this._checkpoint_file)
     }
     return this
   }
@@ -451,6 +628,52 @@ export class Tensor {
     return fl._save(this.ptr, cstr_buffer, cstr_buffer.length)
   }
 
+  /**
+   * @returns A 64-bit hash (XXH64) of the contents of this tensor, including its dtype and
+   * shape but not its memory layout.
+   */
+  contentHash(): bigint {
+    const hash = fl._contentHash.native(this.ptr)
+    if (!hash) {
+      throw new Error('Failed to hash tensor; native code likely threw an error...')
+    }
+    return hash
+  }
+
+  /**
+   * Like {@link Tensor.save}, but written by a background thread so the caller doesn't wait
+   * for the disk. The value at the time of the call is written, even if the tensor is updated
+   * in place afterwards, and the file is replaced atomically. Checkpoints (see
+   * {@link Tensor.checkpoint}) are saved this way.
+   *
+   * @param raw - Write the format read by {@link loadRaw} instead.
+   * @returns A ticket to wait for with {@link flushSaves}.
+   */
+  saveAsync(filename: string, raw = false): number {
+    const cstr_buffer = new TextEncoder().encode(filename)
+    const ticket = Number(fl._saveAsync.native(this.ptr, cstr_buffer, cstr_buffer.length, raw))
+    if (ticket < 0) {
+      throw new Error(`Failed to queue ${filename}; native code likely threw an error...`)
+    }
+    return ticket
+  }
+
+  /**
+   * Save in the raw format read by {@link loadRaw}: a fixed header followed by the data
+   * exactly as it is laid out in memory, which lets loading map the file instead of reading
+   * it. The file is replaced atomically.
+   *
+   * @returns The size of the file in bytes.
+   */
+  saveRaw(filename: string): number {
+    const cstr_buffer = new TextEncoder().encode(filename)
+    const bytes = Number(fl._saveRaw.native(this.ptr, cstr_buffer, cstr_buffer.length))
+    if (bytes < 0) {
+      throw new Error(`Failed to save ${filename}; native code likely threw an error...`)
+    }
+    return bytes
+  }
+
   astype(dtype: dtype) {
     return wrapFLTensor('astype', fl._astype.native, this.ptr, dtype)
   }
@@ -630,69 +853,47 @@ export class Tensor {
     console.warn(
       'Float16Arrays are not natively supported by Bun, this will be polyfilled with a Float32Array'
     )
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Float16Array(toArrayBuffer(fl._float16Buffer.native(contig.ptr), 0, elems * 4))
+    return new Float16Array(hostView(this, dtype.Float32, 4))
   }
 
   toFloat32Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Float32Array(toArrayBuffer(fl._float32Buffer.native(contig.ptr), 0, elems * 4))
+    return new Float32Array(hostView(this, dtype.Float32, 4))
   }
 
   toFloat64Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Float64Array(toArrayBuffer(fl._float64Buffer.native(contig.ptr), 0, elems * 8))
+    return new Float64Array(hostView(this, dtype.Float64, 8))
   }
 
   toBoolInt8Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Int8Array(toArrayBuffer(fl._boolInt8Buffer.native(contig.ptr), 0, elems))
+    return new Int8Array(hostView(this, dtype.BoolInt8, 1))
   }
 
   toInt16Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Int16Array(toArrayBuffer(fl._int16Buffer.native(contig.ptr), 0, elems * 2))
+    return new Int16Array(hostView(this, dtype.Int16, 2))
   }
 
   toInt32Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Int32Array(toArrayBuffer(fl._int32Buffer.native(contig.ptr), 0, elems * 4))
+    return new Int32Array(hostView(this, dtype.Int32, 4))
   }
 
   toBigInt64Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new BigInt64Array(toArrayBuffer(fl._int64Buffer.native(contig.ptr), 0, elems * 8))
+    return new BigInt64Array(hostView(this, dtype.Int64, 8))
   }
 
   toUint8Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Uint8Array(toArrayBuffer(fl._uint8Buffer.native(contig.ptr), 0, elems))
+    return new Uint8Array(hostView(this, dtype.Uint8, 1))
   }
 
   toUint16Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Uint16Array(toArrayBuffer(fl._uint16Buffer.native(contig.ptr), 0, elems * 2))
+    return new Uint16Array(hostView(this, dtype.Uint16, 2))
   }
 
   toUint32Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new Uint32Array(toArrayBuffer(fl._uint32Buffer.native(contig.ptr), 0, elems * 4))
+    return new Uint32Array(hostView(this, dtype.Uint32, 4))
   }
 
   toBigUint64Array() {
-    const contig = this.asContiguousTensor()
-    const elems = contig.elements
-    return new BigUint64Array(toArrayBuffer(fl._uint64Buffer.native(contig.ptr), 0, elems * 8))
+    return new BigUint64Array(hostView(this, dtype.Uint64, 8))
   }
 
   toFloat16() {
@@ -793,6 +994,10 @@ export class Tensor {
     return wrapFLTensor('index', fl._index.native, this, ...arrayArg(processed_args))
   }
 
+  /**
+   * Return a copy of this tensor with `t` written into the region selected by `args`.
+   * `this` is left untouched; see {@link Tensor.indexedAssignInPlace} to avoid the copy.
+   */
   indexedAssign(t, args) {
     const processed_args = this._index_args(args)
     return wrapFLTensor(
@@ -804,6 +1009,47 @@ export class Tensor {
     )
   }
 
+  /**
+   * Overwrite the region of this tensor selected by `args` with `t` and return `this`.
+   * Only the selected elements are written. Neither tensor may require gradients, and
+   * don't use it on tensors that an op recorded for `backward` still depends on.
+   */
+  indexedAssignInPlace(t, args) {
+    if (this.requires_grad || t.requires_grad) {
+      throw new Error('indexedAssignInPlace is not differentiable, use indexedAssign instead')
+    }
+    const processed_args = this._index_args(args)
+    const s = this.stats || t.stats || stats
+    const trace = s.enabled && s.startTrace('indexedAssignInPlace')
+    const err = fl._indexedAssignInPlace.native(this.ptr, t.ptr, ...arrayArg(processed_args))
+    trace && s.stopTrace(trace)
+    if (err < 0) {
+      throw new Error(`indexedAssignInPlace failed; native code likely threw an error...`)
+    }
+    trace && s.logTrace(trace, [this, t], this)
+    return this
+  }
+
+  /** See {@link gather}. */
+  gather(axis: number, index: Tensor): Tensor {
+    return gather(this, axis, index)
+  }
+
+  /** See {@link scatterAdd}. */
+  scatterAdd(axis: number, index: Tensor, src: Tensor): Tensor {
+    return scatterAdd(this, axis, index, src)
+  }
+
+  /** See {@link indexSelect}. */
+  indexSelect(axis: number, index: Tensor): Tensor {
+    return indexSelect(this, axis, index)
+  }
+
+  /** See {@link indexAdd}. */
+  indexAdd(axis: number, index: Tensor, src: Tensor): Tensor {
+    return indexAdd(this, axis, index, src)
+  }
+
   T(): Tensor {
     if (this.shape.length === 0) {
       return this
@@ -820,6 +1066,10 @@ export class Tensor {
     return ops.softmax(this, axis)
   }
 
+  logSoftmax(axis: number): Tensor {
+    return ops.logSoftmax(this, axis)
+  }
+
   relu(): Tensor {
     return ops.relu(this)
   }
@@ -858,13 +1108,359 @@ export function tensor(obj) {
   return new Tensor(obj)
 }
 
+const adopts_buffers: boolean = fl.canAdoptBuffers.native()
+
+/**
+ * @returns Whether tensors can wrap host memory (see {@link adopt} and {@link loadRaw}) on the
+ * current backend. Backends that cannot address host memory directly copy it instead.
+ */
+export function canAdoptBuffers(): boolean {
+  return adopts_buffers
+}
+
+/** @private TypedArrays pinned while native tensors still reference their memory */
+const _adoptedBuffers: Map<number, ArrayLike> = new Map()
+
+function adoptableType(array: ArrayLike): dtype | undefined {
+  switch (array.constructor) {
+    case Float32Array:
+      return dtype.Float32
+    case Float64Array:
+      return dtype.Float64
+    case Int8Array:
+      return dtype.BoolInt8
+    case Int16Array:
+      return dtype.Int16
+    case Int32Array:
+      return dtype.Int32
+    case BigInt64Array:
+      return dtype.BigInt64
+    case Uint8Array:
+      return dtype.Uint8
+    case Uint16Array:
+      return dtype.Uint16
+    case Uint32Array:
+      return dtype.Uint32
+    case BigUint64Array:
+      return dtype.BigUint64
+  }
+  return undefined
+}
+
+/** @private Unpin adopted TypedArrays that no native tensor references anymore. */
+export function releaseAdoptedBuffers() {
+  if (!_adoptedBuffers.size) {
+    return
+  }
+  const released = new BigInt64Array(64)
+  let count = 0
+  do {
+    count = Number(fl.drainAdoptedBuffers.native(ptr(released), released.length))
+    for (let i = 0; i < count; ++i) {
+      _adoptedBuffers.delete(Number(released[i]))
+    }
+  } while (count === released.length)
+}
+
+/**
+ * Create a 1D tensor that wraps the memory of `array` instead of copying it.
+ *
+ * The array is kept alive for as long as any tensor (including views such as reshapes)
+ * references its memory and must not be modified in the meantime. Adopted memory is
+ * reported by {@link bytesShared} rather than {@link bytesUsed}. Backends that cannot
+ * address host memory directly (e.g. CUDA) fall back to a regular copy.
+ */
+export function adopt(array: ArrayLike): Tensor {
+  const type = adoptableType(array)
+  if (!adopts_buffers || type === undefined || array.length === 0) {
+    return new Tensor(array)
+  }
+  releaseAdoptedBuffers()
+  const array_ptr = ptr(array as ArrayBufferView)
+  const _ptr = fl.tensorAdoptBuffer.native(BigInt(array.length), type, array_ptr)
+  if (!_ptr) {
+    throw new Error(`Tensor returned from adopt is null; native code likely threw an error...`)
+  }
+  _adoptedBuffers.set(array_ptr, array)
+  return new Tensor({ _ptr: _ptr, _deps: [] })
+}
+
+function bytesOf(buffer: ArrayBuffer | ArrayBufferView, offset: number, length?: number) {
+  if (buffer instanceof ArrayBuffer) {
+    return new Uint8Array(buffer, offset, length)
+  }
+  return new Uint8Array(buffer.buffer, buffer.byteOffset + offset, length)
+}
+
+/**
+ * Encodings of tensor data written by {@link encodeInto}: the raw data, or lossy float16,
+ * bfloat16 (both rounded to nearest), or int8 with a float32 scale per block of 128 values
+ * (about a quarter of the float32 size). Lossy encodings apply to Float32 and Float64 tensors,
+ * which decode with their dtype but the precision of the encoding; other dtypes are always
+ * written raw.
+ */
+export type WireEncoding = 'raw' | 'float16' | 'bfloat16' | 'int8'
+
+const wireEncodings: Record<WireEncoding, number> = { raw: 0, float16: 1, bfloat16: 2, int8: 3 }
+
+function wireEncodingArg(encoding: WireEncoding = 'raw') {
+  const e = wireEncodings[encoding]
+  if (e === undefined) {
+    throw new Error(`Unknown wire encoding ${encoding}`)
+  }
+  return e
+}
+
+/** @returns The encoding {@link encodeInto} uses for `tensor` when asked for `encoding`. */
+export function wireEncodingOf(tensor: Tensor, encoding: WireEncoding = 'raw'): WireEncoding {
+  wireEncodingArg(encoding)
+  const t = tensor.dtype
+  return t === dtype.Float32 || t === dtype.Float64 ? encoding : 'raw'
+}
+
+export type EncodeOptions = {
+  encoding?: WireEncoding
+  /**
+   * Error feedback for lossy encodings: what encoding lost is kept in `residual` and added to
+   * the next tensor encoded with it, so the decoded values of repeated transfers (e.g. of
+   * gradients) add up to the sum of the originals rather than drifting. Any tensor can start
+   * out as the residual (e.g. `sm.scalar(0)`); it is reset to zeros when it does not match.
+   */
+  residual?: Tensor
+}
+
+/**
+ * @returns The size in bytes of the encoding of `tensor` written by {@link encodeInto}.
+ */
+export function encodedSize(tensor: Tensor, { encoding }: EncodeOptions = {}): number {
+  const size = Number(fl._encodedSize.native(tensor.ptr, wireEncodingArg(encoding)))
+  if (size < 0) {
+    throw new Error('Failed to size encoding; native code likely threw an error...')
+  }
+  return size
+}
+
+/**
+ * Write `tensor` (dtype, shape and data) to `buffer` at `offset`. Raw data is copied once,
+ * straight from tensor memory; lossy encodings (see {@link WireEncoding}) are converted
+ * natively, in parallel. The buffer needs {@link encodedSize} bytes from `offset`, which
+ * should be a multiple of 8 for {@link decode} to wrap raw data in place.
+ *
+ * @returns The number of bytes written.
+ */
+export function encodeInto(
+  tensor: Tensor,
+  buffer: ArrayBuffer | ArrayBufferView,
+  offset = 0,
+  { encoding, residual }: EncodeOptions = {}
+): number {
+  const bytes = bytesOf(buffer, offset)
+  const written = Number(
+    fl._encodeInto.native(
+      tensor.ptr,
+      ptr(bytes),
+      bytes.byteLength,
+      wireEncodingArg(encoding),
+      residual ? residual.ptr : null
+    )
+  )
+  if (written < 0) {
+    throw new Error('Failed to encode tensor; native code likely threw an error...')
+  }
+  return written
+}
+
 /**
- * @returns The current number of bytes allocated and managed by Shumai.
+ * Read a tensor written by {@link encodeInto}, with its original dtype and shape. Where
+ * possible (see {@link adopt}), the tensor wraps the data in `buffer`, which must not be
+ * modified while the tensor is alive.
+ */
+export function decode(buffer: ArrayBuffer | ArrayBufferView, offset = 0, length?: number): Tensor {
+  const bytes = bytesOf(buffer, offset, length)
+  releaseAdoptedBuffers()
+  const adopted = new BigInt64Array(1)
+  const _ptr = fl._decode.native(ptr(bytes), bytes.byteLength, adopts_buffers, ptr(adopted))
+  if (!_ptr) {
+    throw new Error('Failed to decode tensor; native code likely threw an error...')
+  }
+  if (adopted[0]) {
+    _adoptedBuffers.set(Number(adopted[0]), bytes)
+  }
+  return new Tensor({ _ptr: _ptr, _deps: [] })
+}
+
+/**
+ * Load a tensor saved with {@link Tensor.saveRaw} by memory-mapping the file.
+ *
+ * Nothing is read or copied up front: the tensor is backed by the page cache, so pages are
+ * read on first use and shared between all processes loading the same file. Writes to the
+ * tensor (e.g. in-place optimizer steps) copy the affected pages and never reach the file.
+ * Mapped memory is reported by {@link bytesShared} and unmapped with the last tensor
+ * referencing it. Backends that cannot address host memory directly (e.g. CUDA) load a copy.
+ *
+ * `new Tensor(filename)` detects raw files too, without verifying them.
+ *
+ * @param verify - Check the checksum stored in the file first, which reads every page (and so
+ * gives up loading lazily).
+ */
+export function loadRaw(filename: string, verify = false): Tensor {
+  const cstr_buffer = new TextEncoder().encode(filename)
+  const _ptr = fl._loadRaw.native(cstr_buffer, cstr_buffer.length, verify)
+  if (!_ptr) {
+    throw new Error(`Failed to load ${filename}; native code likely threw an error...`)
+  }
+  return new Tensor({ _ptr: _ptr, _deps: [] })
+}
+
+/**
+ * Wait for saves queued by {@link Tensor.saveAsync} (and checkpoints) to be written.
+ *
+ * @param ticket - Only wait for the save that returned this ticket; if a later save of the same
+ * file replaced it before it was written, that save is waited for instead. By default, every
+ * save queued so far is waited for.
+ * @throws If any queued save failed since the last flush.
+ */
+export function flushSaves(ticket = 0) {
+  if (Number(fl._flushSaves.native(ticket)) < 0) {
+    throw new Error('Failed to save tensors; native code likely threw an error...')
+  }
+}
+
+/**
+ * @returns The number of saves queued by {@link Tensor.saveAsync} that are not written yet.
+ */
+export function pendingSaves(): number {
+  return Number(fl.pendingSaves.native())
+}
+
+// Queued saves are written before the process exits.
+process.on('exit', () => {
+  fl._flushSaves.native(0)
+})
+
+/**
+ * @returns The current number of bytes allocated and managed by Shumai. Every underlying
+ * buffer is counted once, regardless of how many tensors (e.g. views or reshapes) share it.
  */
 export function bytesUsed(): bigint {
   return fl.bytesUsed.native()
 }
 
+/**
+ * @returns The highest {@link bytesUsed} since startup or the last call to {@link resetBytesPeak}.
+ */
+export function bytesPeak(): bigint {
+  return fl.bytesPeak.native()
+}
+
+export function resetBytesPeak() {
+  fl.resetBytesPeak.native()
+}
+
+/**
+ * @returns The number of tensors that have not been disposed or garbage collected.
+ */
+export function liveTensors(): number {
+  return Number(fl.liveTensors.native())
+}
+
+/**
+ * @returns The number of tensors created and not yet disposed (or garbage collected) by the
+ * calling thread, i.e. the main thread or the current worker. Unlike {@link liveTensors}, this
+ * does not depend on what other workers do.
+ */
+export function threadTensors(): number {
+  return Number(fl.threadTensors.native())
+}
+
+/**
+ * @returns The logical size of the tensors counted by {@link threadTensors}.
+ */
+export function threadTensorBytes(): bigint {
+  return fl.threadTensorBytes.native()
+}
+
+/**
+ * @returns The logical size (elements times element size) of all live tensors, by dtype.
+ * Unlike {@link bytesUsed}, tensors sharing a buffer are each counted in full.
+ */
+export function bytesByDtype(): { [key: string]: bigint } {
+  const out = new BigInt64Array(16)
+  const count = Number(fl.bytesByDtype.native(ptr(out), out.length))
+  const totals: { [key: string]: bigint } = {}
+  for (const name of Object.keys(dtype)) {
+    const type = dtype[name]
+    // skip reverse mappings and aliases (BigInt64 -> Int64, BigUint64 -> Uint64)
+    if (typeof type !== 'number' || name.startsWith('Big') || type >= count) {
+      continue
+    }
+    totals[name] = out[type]
+  }
+  return totals
+}
+
+/**
+ * @returns The number of bytes of adopted (see {@link adopt}) memory referenced by tensors.
+ */
+export function bytesShared(): bigint {
+  return fl.bytesShared.native()
+}
+
+/**
+ * @returns The number of bytes held by the native allocator, including freed blocks it caches
+ * for reuse. The difference to {@link bytesInUse} is cache, not leaked memory.
+ */
+export function bytesReserved(): bigint {
+  return fl.bytesReserved.native()
+}
+
+/**
+ * @returns The number of bytes of allocator blocks backing live buffers (rounded up to the
+ * allocator's size classes, so slightly above {@link bytesUsed}).
+ */
+export function bytesInUse(): bigint {
+  return fl.bytesInUse.native()
+}
+
+/** Return all freed blocks cached by the native allocator to the system. */
+export function emptyCache() {
+  fl.emptyCache.native()
+}
+
+export type HandleStats = {
+  /** Native tensor handles currently alive */
+  live: number
+  /** Handle slots allocated across all slabs */
+  capacity: number
+  slabs: number
+  /** Handles created since startup */
+  allocations: number
+  /** Handle creations served by recycling a freed slot */
+  reused: number
+  /** `live / capacity` */
+  occupancy: number
+  /** `reused / allocations` */
+  reuseRate: number
+}
+
+/**
+ * @returns Counters of the slab allocator that backs native tensor handles.
+ */
+export function handleStats(): HandleStats {
+  const out = new BigInt64Array(5)
+  fl.tensorHandleStats.native(ptr(out), out.length)
+  const [live, capacity, slabs, allocations, reused] = Array.from(out, Number)
+  return {
+    live,
+    capacity,
+    slabs,
+    allocations,
+    reused,
+    occupancy: capacity ? live / capacity : 0,
+    reuseRate: allocations ? reused / allocations : 0
+  }
+}
+
 export const conv2dBackwardData = (
   bw: Tensor,
   x: Tensor,
@@ -897,6 +1493,390 @@ export const conv2dBackwardFilter = (
   return wrapFLTensor('conv2dBackwardFilter', fl._conv2dBackwardFilter, bw, x, w, params)
 }
 
+// Gather/scatter ops record their axis alongside the tensors so the gradients in
+// register_gradients.ts can replay them.
+function wrapIndexOp(op: string, closure: CallableFunction, ...args: (Tensor | number)[]) {
+  const t = wrapFLTensor(op, closure, ...args)
+  if (t.requires_grad) {
+    t.setDeps(args)
+  }
+  t.op = op
+  return t
+}
+
+/**
+ * Pick elements of `tensor` along `axis` with an integer index tensor (like `torch.gather`).
+ *
+ * `index` has the shape of `tensor` except along `axis`, and so does the result:
+ * `out[i][j] = tensor[index[i][j]][j]` for `axis = 0`.
+ */
+export const gather = (tensor: Tensor, axis: number, index: Tensor) => {
+  return wrapIndexOp('gather', fl._gather.native, tensor, axis, index)
+}
+
+/**
+ * The inverse of {@link gather}: a copy of `base` with every element of `src` added at the
+ * position along `axis` named by `index` (shaped like `src`). Repeated indices accumulate.
+ */
+export const scatterAdd = (base: Tensor, axis: number, index: Tensor, src: Tensor) => {
+  return wrapIndexOp('scatterAdd', fl._scatterAdd.native, base, axis, index, src)
+}
+
+/**
+ * Select the slices of `tensor` along `axis` named by the 1D integer tensor `index`,
+ * e.g. rows of an embedding table.
+ */
+export const indexSelect = (tensor: Tensor, axis: number, index: Tensor) => {
+  return wrapIndexOp('indexSelect', fl._indexSelect.native, tensor, axis, index)
+}
+
+/**
+ * The inverse of {@link indexSelect}: a copy of `base` with slice `k` of `src` added to
+ * slice `index[k]` along `axis`. Repeated indices accumulate.
+ */
+export const indexAdd = (base: Tensor, axis: number, index: Tensor, src: Tensor) => {
+  return wrapIndexOp('indexAdd', fl._indexAdd.native, base, axis, index, src)
+}
+
+/**
+ * Fused scaled dot-product attention, `softmax(scale * queries @ keys^T) @ values`.
+ *
+ * Runs natively in cache-sized tiles with an online softmax, so the
+ * `[queryTokens, keyTokens]` score matrix is never materialized, in the forward or the
+ * backward pass. Masks are applied on the fly rather than tiled over batch dimensions.
+ *
+ * @param queries - Float32 or Float64, shape `[..., queryTokens, dim]`
+ * @param keys - shape `[..., keyTokens, dim]`
+ * @param values - shape `[..., keyTokens, valueDim]`
+ * @param mask - Optional `[queryTokens, keyTokens]` mask, shared by all batch dimensions; a
+ * nonzero entry $(i, j)$ means query $i$ does not attend to key $j$
+ * @param causal - If true, query $i$ also ignores every key $j > i$
+ * @param scale - Defaults to $\frac{1}{\sqrt{dim}}$
+ * @returns A Tensor of shape `[..., queryTokens, valueDim]`
+ */
+export function scaledDotProductAttention(
+  queries: Tensor,
+  keys: Tensor,
+  values: Tensor,
+  mask?: Tensor,
+  causal = false,
+  scale = 1 / Math.sqrt(queries.shape[queries.shape.length - 1])
+): Tensor {
+  const lse_out = new BigInt64Array(1)
+  const t = wrapFLTensor(
+    'scaledDotProductAttention',
+    fl._attention.native,
+    queries,
+    keys,
+    values,
+    mask ?? null,
+    scale,
+    causal,
+    lse_out
+  )
+  // log-sum-exp of every score row, kept for the backward pass
+  const lse = new Tensor({ _ptr: Number(lse_out[0]), _deps: [] })
+  lse.stats = t.stats
+  if (t.requires_grad) {
+    t.setDeps([queries, keys, values, mask ?? 0, scale, causal ? 1 : 0, lse])
+  }
+  t.op = 'scaledDotProductAttention'
+  return t
+}
+
+/**
+ * Gradients of {@link scaledDotProductAttention} with respect to its queries, keys and
+ * values, recomputing attention probabilities tile by tile from the forward pass's
+ * log-sum-exp `lse`.
+ */
+export function scaledDotProductAttentionBackward(
+  grad: Tensor,
+  queries: Tensor,
+  keys: Tensor,
+  values: Tensor,
+  output: Tensor,
+  lse: Tensor,
+  mask: Tensor | undefined,
+  causal: boolean,
+  scale: number
+): [Tensor, Tensor, Tensor] {
+  const grads_out = new BigInt64Array(3)
+  const s = grad.stats || stats
+  const trace = s.enabled && s.startTrace('scaledDotProductAttentionBackward')
+  const err = fl._attentionBackward.native(
+    grad.ptr,
+    queries.ptr,
+    keys.ptr,
+    values.ptr,
+    output.ptr,
+    lse.ptr,
+    mask ? mask.ptr : null,
+    scale,
+    causal,
+    ptr(grads_out)
+  )
+  trace && s.stopTrace(trace)
+  if (err < 0) {
+    throw new Error(
+      `scaledDotProductAttentionBackward failed; native code likely threw an error...`
+    )
+  }
+  const grads = Array.from(grads_out, (handle) => {
+    const t = new Tensor({ _ptr: Number(handle), _deps: [] })
+    t.stats = grad.stats
+    return t
+  })
+  trace && s.logTrace(trace, [grad, queries, keys, values], grads[0])
+  return grads as [Tensor, Tensor | undefined, Tensor | undefined]
+}
+
+/**
+ * Mean cross-entropy of unnormalized `logits` against integer class `labels`, i.e.
+ * `-mean(logSoftmax(logits)[label])`, without materializing the probabilities or a
+ * one-hot target.
+ *
+ * Runs natively: each row's log-sum-exp and loss are computed in one pass over its
+ * logits, and the gradient `softmax(logits) - onehot(labels)` is recomputed from the saved
+ * log-sum-exp in the backward pass.
+ *
+ * @param logits - Shape `[..., classes]`
+ * @param labels - Int32 or Int64 class indices, shape `[...]`
+ * @returns A scalar Tensor
+ */
+export function crossEntropyWithLogits(logits: Tensor, labels: Tensor): Tensor {
+  const lse_out = new BigInt64Array(1)
+  const t = wrapFLTensor(
+    'crossEntropyWithLogits',
+    fl._crossEntropyWithLogits.native,
+    logits,
+    labels,
+    lse_out
+  )
+  // log-sum-exp of every row, kept for the backward pass
+  const lse = new Tensor({ _ptr: Number(lse_out[0]), _deps: [] })
+  lse.stats = t.stats
+  if (t.requires_grad) {
+    t.setDeps([logits, labels, lse])
+  }
+  t.op = 'crossEntropyWithLogits'
+  return t
+}
+
+/**
+ * Gradient of {@link crossEntropyWithLogits} with respect to its logits, given the
+ * gradient `grad` of the loss and the log-sum-exp `lse` saved by the forward pass.
+ */
+export function crossEntropyWithLogitsBackward(
+  grad: Tensor,
+  logits: Tensor,
+  labels: Tensor,
+  lse: Tensor
+): Tensor {
+  const s = grad.stats || stats
+  const trace = s.enabled && s.startTrace('crossEntropyWithLogitsBackward')
+  const _ptr = fl._crossEntropyWithLogitsBackward.native(grad.ptr, logits.ptr, labels.ptr, lse.ptr)
+  trace && s.stopTrace(trace)
+  if (!_ptr) {
+    throw new Error(`crossEntropyWithLogitsBackward failed; native code likely threw an error...`)
+  }
+  const t = new Tensor({ _ptr: _ptr, _deps: [] })
+  t.stats = grad.stats
+  trace && s.logTrace(trace, [grad, logits, labels], t)
+  t.op = 'crossEntropyWithLogitsBackward'
+  return t
+}
+
+/**
+ * Layer normalization over the last `dims` axes of `tensor`, optionally followed by an
+ * elementwise scale (`gamma`) and shift (`beta`) shaped like those axes.
+ *
+ * Runs natively in one sweep per row: mean and variance are computed in a single
+ * (Welford) pass and the scale and shift are applied while the row is still in cache.
+ * The per-row statistics are kept for the backward pass.
+ *
+ * @param tensor - Float32 or Float64
+ * @param dims - Number of trailing axes to normalize over
+ * @param eps - Added to the variance for numerical stability
+ */
+export function layerNorm(
+  tensor: Tensor,
+  dims: number,
+  gamma?: Tensor,
+  beta?: Tensor,
+  eps = 1e-6
+): Tensor {
+  const stats_out = new BigInt64Array(2)
+  const t = wrapFLTensor(
+    'layerNorm',
+    fl._layerNorm.native,
+    tensor,
+    gamma ?? null,
+    beta ?? null,
+    dims,
+    eps,
+    stats_out
+  )
+  // mean and reciprocal standard deviation of every row, kept for the backward pass
+  const [mean, rstd] = Array.from(stats_out, (handle) => {
+    const s = new Tensor({ _ptr: Number(handle), _deps: [] })
+    s.stats = t.stats
+    return s
+  })
+  if (t.requires_grad) {
+    t.setDeps([tensor, gamma ?? 0, beta ?? 0, dims, eps, mean, rstd])
+  }
+  t.op = 'layerNorm'
+  return t
+}
+
+/**
+ * Gradients of {@link layerNorm} with respect to its input, `gamma` and `beta`, reusing
+ * the row statistics `mean` and `rstd` saved by the forward pass.
+ *
+ * @param param_grads - Whether to compute the `gamma` and `beta` gradients; if not, those
+ * are returned as `undefined`.
+ */
+export function layerNormBackward(
+  grad: Tensor,
+  tensor: Tensor,
+  gamma: Tensor | undefined,
+  mean: Tensor,
+  rstd: Tensor,
+  dims: number,
+  param_grads = true
+): [Tensor, Tensor | undefined, Tensor | undefined] {
+  const grads_out = new BigInt64Array(3)
+  const s = grad.stats || stats
+  const trace = s.enabled && s.startTrace('layerNormBackward')
+  const err = fl._layerNormBackward.native(
+    grad.ptr,
+    tensor.ptr,
+    gamma ? gamma.ptr : null,
+    mean.ptr,
+    rstd.ptr,
+    dims,
+    param_grads,
+    ptr(grads_out)
+  )
+  trace && s.stopTrace(trace)
+  if (err < 0) {
+    throw new Error(`layerNormBackward failed; native code likely threw an error...`)
+  }
+  const grads = Array.from(grads_out, (handle) => {
+    if (handle === 0n) {
+      return undefined
+    }
+    const t = new Tensor({ _ptr: Number(handle), _deps: [] })
+    t.stats = grad.stats
+    return t
+  })
+  trace && s.logTrace(trace, [grad, tensor], grads[0])
+  return grads as [Tensor, Tensor | undefined, Tensor | undefined]
+}
+
+/**
+ * Run an LSTM layer over a whole sequence in one native call.
+ *
+ * The four gates' weights are packed into single matrices, in the order input, forget,
+ * cell, output: the input projection of every step is one matmul, after which each step
+ * costs one `[batch, out] @ [out, 4 * out]` matmul and a single fused pass over the gates.
+ * The backward pass (backpropagation through time) is native as well.
+ *
+ * @param x - Float32 or Float64 inputs, shape `[steps, batch, inp]`
+ * @param h0 - Initial hidden state, shape `[batch, out]`
+ * @param c0 - Initial cell state, shape `[batch, out]`
+ * @param W - Input weights, shape `[inp, 4 * out]`
+ * @param U - Recurrent weights, shape `[out, 4 * out]`
+ * @param b - Biases, shape `[4 * out]`
+ * @returns The hidden state of every step (`[steps, batch, out]`) and the final cell state
+ * (`[batch, out]`)
+ */
+export function lstmSequence(
+  x: Tensor,
+  h0: Tensor,
+  c0: Tensor,
+  W: Tensor,
+  U: Tensor,
+  b: Tensor
+): [Tensor, Tensor] {
+  const inputs = [x, h0, c0, W, U, b]
+  const out = new BigInt64Array(4)
+  const asyncStats: Stats = inputs.reduce((a, t) => a || t.stats, void 0 as Stats)
+  const s = asyncStats || stats
+  const trace = s.enabled && s.startTrace('lstmSequence')
+  const err = fl._lstm.native(x.ptr, h0.ptr, c0.ptr, W.ptr, U.ptr, b.ptr, ptr(out))
+  trace && s.stopTrace(trace)
+  if (err < 0) {
+    throw new Error(`lstmSequence failed; native code likely threw an error...`)
+  }
+  const [hidden, cell, gates, cells] = Array.from(out, (handle) => {
+    const t = new Tensor({ _ptr: Number(handle), _deps: [] })
+    t.stats = asyncStats
+    return t
+  })
+  // both outputs share the saved gates and cells; their gradients are computed
+  // separately and add up, since the backward pass is linear in them
+  const requires_grad = inputs.some((t) => t.requires_grad)
+  hidden.op = 'lstmSequence'
+  cell.op = 'lstmSequenceCell'
+  for (const t of [hidden, cell]) {
+    t.requires_grad = requires_grad
+    if (requires_grad) {
+      t.setDeps([...inputs, gates, cells])
+    }
+  }
+  trace && s.logTrace(trace, inputs, hidden)
+  return [hidden, cell]
+}
+
+/**
+ * Gradients of {@link lstmSequence} with respect to `x`, `h0`, `c0`, `W`, `U` and `b`
+ * (in that order), given the gradient of its hidden states and/or of its final cell state
+ * and the gate activations and cell states the forward pass saved.
+ */
+export function lstmSequenceBackward(
+  grad_hidden: Tensor | null,
+  grad_cell: Tensor | null,
+  x: Tensor,
+  h0: Tensor,
+  c0: Tensor,
+  W: Tensor,
+  U: Tensor,
+  b: Tensor,
+  gates: Tensor,
+  cells: Tensor
+): [Tensor, Tensor, Tensor, Tensor, Tensor, Tensor] {
+  const grad = grad_hidden || grad_cell
+  const grads_out = new BigInt64Array(6)
+  const s = grad.stats || stats
+  const trace = s.enabled && s.startTrace('lstmSequenceBackward')
+  const err = fl._lstmBackward.native(
+    grad_hidden ? grad_hidden.ptr : null,
+    grad_cell ? grad_cell.ptr : null,
+    x.ptr,
+    h0.ptr,
+    c0.ptr,
+    W.ptr,
+    U.ptr,
+    b.ptr,
+    gates.ptr,
+    cells.ptr,
+    ptr(grads_out)
+  )
+  trace && s.stopTrace(trace)
+  if (err < 0) {
+    throw new Error(`lstmSequenceBackward failed; native code likely threw an error...`)
+  }
+  const grads = Array.from(grads_out, (handle) => {
+    const t = new Tensor({ _ptr: Number(handle), _deps: [] })
+    t.stats = grad.stats
+    return t
+  })
+  trace && s.logTrace(trace, [grad, x, W, U], grads[0])
+  return grads as [Tensor, Tensor, Tensor, Tensor, Tensor, Tensor]
+}
+
+/** The layout is set per thread, so every worker starts out row major. */
 export const layout = {
   /** Set the framework layout to be row major (default). */
   setRowMajor: () => {
@@ -916,6 +1896,28 @@ export const layout = {
   }
 }
 
+/**
+ * By default `backward` walks the graph in JS and calls the gradient function of every op,
+ * each of which dispatches more native ops. With the native tape enabled, graphs made only
+ * of elementwise ops, `matmul`, `reshape`, `transpose`, `sum` and `mean` are instead
+ * differentiated by Flashlight's autograd in a single native call; other graphs still use
+ * the JS traversal. Like the layout, this is set per thread.
+ */
+export const autograd = {
+  /** Differentiate with the native tape whenever the graph allows it. */
+  enableNativeTape: () => {
+    native_tape = true
+  },
+  /** Always differentiate with the JS gradient functions (default). */
+  disableNativeTape: () => {
+    native_tape = false
+  },
+  /** Return true if the native tape is enabled. */
+  isNativeTape: (): boolean => {
+    return native_tape
+  }
+}
+
 export function fromDLTensor(ptr) {
   const _ptr = fl.fromDLTensor(ptr)
   return new Tensor({
@@ -1,4 +1,6 @@
-import type { Tensor } from './tensor'
+import { fl } from '../ffi/ffi_flashlight'
+import { stats } from '../stats'
+import { Tensor } from './tensor'
 import { _var, conv2d, full, rand, randn, scalar, sigmoid } from './tensor_ops_gen'
 
 export * from './tensor_ops_gen'
@@ -29,9 +31,78 @@ export function xavier_normal(
   return randn(shape).mul(scalar(a))
 }
 
+function wrapSoftmax(op: string, closure: CallableFunction, tensor: Tensor, axis: number) {
+  const ts = tensor.stats
+  const s = ts || stats
+  const trace = s.enabled && s.startTrace(op)
+
+  const _ptr = closure(tensor.ptr, axis | 0)
+  if (!_ptr)
+    throw new Error(`Tensor returned from \`${op}\` is null; native code likely threw an error...`)
+
+  trace && s.stopTrace(trace)
+
+  const requires_grad = tensor.requires_grad
+  const deps = requires_grad ? [tensor, axis | 0] : []
+  const t = new Tensor({ _ptr: _ptr, _deps: deps })
+  t.stats = ts
+  t.provenance = tensor.provenance
+  t.requires_grad = requires_grad
+
+  trace && s.logTrace(trace, [tensor], t)
+
+  t.op = op
+  return t
+}
+
+function wrapSoftmaxBackward(
+  op: string,
+  closure: CallableFunction,
+  grad: Tensor,
+  output: Tensor,
+  axis: number
+) {
+  const ts = grad.stats || output.stats
+  const s = ts || stats
+  const trace = s.enabled && s.startTrace(op)
+
+  const _ptr = closure(grad.ptr, output.ptr, axis | 0)
+  if (!_ptr)
+    throw new Error(`Tensor returned from \`${op}\` is null; native code likely threw an error...`)
+
+  trace && s.stopTrace(trace)
+
+  const t = new Tensor({ _ptr: _ptr, _deps: [] })
+  t.stats = ts
+
+  trace && s.logTrace(trace, [grad, output], t)
+
+  t.op = op
+  return t
+}
+
+/**
+ * Softmax along `axis`, computed natively in two sweeps (the max, then exp, sum and
+ * normalization). The gradient only needs the output.
+ */
 export function softmax(tensor: Tensor, axis: number): Tensor {
-  const exp = tensor.sub(tensor.amax([axis], true)).exp()
-  return exp.div(exp.sum([axis], true))
+  return wrapSoftmax('softmax', fl._softmax.native, tensor, axis)
+}
+
+/** Log of {@link softmax} along `axis`, without ever taking the log of a probability. */
+export function logSoftmax(tensor: Tensor, axis: number): Tensor {
+  return wrapSoftmax('logSoftmax', fl._logSoftmax.native, tensor, axis)
+}
+
+/** Gradient of {@link softmax} given the gradient `grad` of its `output`. */
+export function softmaxBackward(grad: Tensor, output: Tensor, axis: number): Tensor {
+  return wrapSoftmaxBackward('softmaxBackward', fl._softmaxBackward.native, grad, output, axis)
+}
+
+/** Gradient of {@link logSoftmax} given the gradient `grad` of its `output`. */
+export function logSoftmaxBackward(grad: Tensor, output: Tensor, axis: number): Tensor {
+  const closure = fl._logSoftmaxBackward.native
+  return wrapSoftmaxBackward('logSoftmaxBackward', closure, grad, output, axis)
 }
 
 export function relu(tensor: Tensor): Tensor {
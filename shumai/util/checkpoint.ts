@@ -0,0 +1,133 @@
+import { arrayArg } from '../ffi/ffi_bind_utils'
+import { fl } from '../ffi/ffi_flashlight'
+import type { Module } from '../module'
+import { stats } from '../stats'
+import type { GradContext } from '../tensor/register_gradients'
+import { backward, Tensor } from '../tensor/tensor'
+import { full } from '../tensor/tensor_ops'
+
+type CheckpointFn = (...args: unknown[]) => Tensor | Tensor[]
+
+// The function and number of leading inputs behind every checkpointed output.
+const checkpoints = new WeakMap<Tensor, { fn: CheckpointFn; inputs: number }>()
+// A recomputation yields the gradients of all inputs and parameters at once; keep them
+// around for the calls asking for the others.
+const recomputed = new WeakMap<Tensor, { grad: Tensor; grads: Tensor[] }>()
+
+function single(result: Tensor | Tensor[]): Tensor {
+  if (!(result instanceof Tensor)) {
+    throw new Error('checkpoint expects the module to return a single Tensor')
+  }
+  return result
+}
+
+/**
+ * Run `module(...inputs)` without keeping its intermediate activations alive until `backward`.
+ *
+ * Every tensor produced in a forward pass is normally referenced (through its consumers'
+ * dependencies) until the backward pass finishes, so activation memory grows with the depth
+ * of the model. The output of `checkpoint` instead depends directly on `inputs` and on the
+ * parameters it read (the leaves of its graph that require gradients); everything in
+ * between can be collected once this returns. During `backward`, the module is run again on
+ * the same inputs to recompute the activations it needs, trading one extra forward pass for
+ * its activation memory.
+ *
+ * `module` may be a {@link Module} or any function; it must be deterministic (e.g. no
+ * dropout) and return a single {@link Tensor}. Tensors that require gradients should be passed
+ * in `inputs` rather than captured by the function. When stats are enabled, the bytes of the
+ * activations released are added to `checkpointBytesSaved`.
+ *
+ * @example
+ * ```javascript
+ * let x = input
+ * for (const layer of layers) {
+ *   x = sm.util.checkpoint(layer, x)
+ * }
+ * x.sum().backward()
+ * ```
+ */
+export function checkpoint(module: Module | CheckpointFn, ...inputs: unknown[]): Tensor {
+  // modules are callable
+  const fn = <CheckpointFn>module
+  const result = single(fn(...inputs))
+  if (!result.requires_grad) {
+    return result
+  }
+
+  const boundary = new Set<number>()
+  for (const input of inputs) {
+    if (input instanceof Tensor) {
+      boundary.add(input.ptr)
+    }
+  }
+  if (boundary.has(result.ptr)) {
+    return result
+  }
+
+  // Walk the graph of the module to find the parameters it read and the activations to drop.
+  const s = result.stats || stats
+  const params: Tensor[] = []
+  const seen = new Set<number>([result.ptr])
+  const frontier: Tensor[] = [result]
+  const dropped: Tensor[] = []
+  while (frontier.length) {
+    const t = frontier.pop()
+    for (const dep of t.deps) {
+      if (!(dep instanceof Tensor) || !dep.requires_grad || seen.has(dep.ptr)) {
+        continue
+      }
+      seen.add(dep.ptr)
+      if (boundary.has(dep.ptr)) {
+        continue
+      }
+      if (!dep.deps.length) {
+        params.push(dep)
+        continue
+      }
+      if (s.enabled) {
+        dropped.push(dep)
+      }
+      frontier.push(dep)
+    }
+  }
+
+  // Views of one buffer (reshapes, slices) share its memory, so count every buffer once.
+  s.enabled && s.logCheckpoint(BigInt(fl._uniqueBytes.native(...arrayArg(dropped))))
+
+  result.setDeps([...inputs, ...params])
+  result.op = 'checkpoint'
+  checkpoints.set(result, { fn, inputs: inputs.length })
+  return result
+}
+
+/** @private Gradient of {@link checkpoint}: recompute the activations and differentiate them. */
+export function checkpointGradient(ctx: GradContext): Tensor {
+  let cached = recomputed.get(ctx.forward_output)
+  if (!cached || cached.grad !== ctx.backward_input) {
+    const { fn, inputs } = checkpoints.get(ctx.forward_output)
+    const args = ctx.forward_inputs
+      .slice(0, inputs)
+      .map((a) => (a instanceof Tensor && a.requires_grad ? a.detach().requireGrad() : a))
+    const params = <Tensor[]>ctx.forward_inputs.slice(inputs)
+
+    // `backward` assigns `.grad`, so park the parameters' gradients while it runs; the
+    // enclosing backward pass assigns their totals once it is done.
+    const parked = params.map((p) => p.grad)
+    params.forEach((p) => (p.grad = null))
+    let grads: Tensor[]
+    try {
+      const result = single(fn(...args))
+      if (backward(result, ctx.backward_input) instanceof Promise) {
+        throw new Error('checkpoint does not support asynchronous gradients')
+      }
+      grads = [...args, ...params].map((a) =>
+        a instanceof Tensor && a.requires_grad ? a.grad || full(a.shape, 0) : null
+      )
+    } finally {
+      params.forEach((p, i) => (p.grad = parked[i]))
+    }
+    cached = { grad: ctx.backward_input, grads }
+    recomputed.set(ctx.forward_output, cached)
+  }
+  return cached.grads[ctx.backward_output_index]
+}
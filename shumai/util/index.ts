@@ -1,4 +1,5 @@
 export * from './async'
+export * from './checkpoint'
 export * from './hash'
 export * from './iterators'
 export * from './memory'
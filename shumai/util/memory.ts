@@ -1,5 +1,5 @@
 import { fl } from '../ffi/ffi_flashlight'
-import { Tensor } from '../tensor/tensor'
+import { releaseAdoptedBuffers, Tensor } from '../tensor/tensor'
 
 export let _tidyTracker: Map<number, Tensor> = null
 
@@ -76,12 +76,15 @@ export type MemoryOptions = {
   lowerBoundThreshold?: number
   upperBoundThreshold?: number
   delayBetweenGCs?: number
+  /** Freed native blocks are returned to the system instead of cached past this many bytes */
+  cacheHighWaterMark?: number
 }
 
 const DEFAULT_MEMORY_OPTIONS: MemoryOptions = {
   lowerBoundThreshold: 100e6, // 100MB
   upperBoundThreshold: 5e9, // 5GB
-  delayBetweenGCs: 1000 // 1s
+  delayBetweenGCs: 1000, // 1s
+  cacheHighWaterMark: Infinity
 }
 
 /** @private */
@@ -100,6 +103,7 @@ export function gcAsNeeded(bytesNeeded = 0) {
     (now >= nextGC && bytesUsed >= gOptions.lowerBoundThreshold)
   ) {
     Bun.gc(true)
+    releaseAdoptedBuffers()
     nextGC = now + gOptions.delayBetweenGCs
   }
 }
@@ -108,6 +112,13 @@ export function memoryOptions(opts: MemoryOptions): MemoryOptions {
   gOptions.lowerBoundThreshold = opts?.lowerBoundThreshold ?? gOptions.lowerBoundThreshold
   gOptions.upperBoundThreshold = opts?.upperBoundThreshold ?? gOptions.upperBoundThreshold
   gOptions.delayBetweenGCs = opts?.delayBetweenGCs ?? gOptions.delayBetweenGCs
+  if (opts?.cacheHighWaterMark !== undefined) {
+    gOptions.cacheHighWaterMark = opts.cacheHighWaterMark
+    const limit = Number.isFinite(opts.cacheHighWaterMark)
+      ? BigInt(Math.max(0, Math.floor(opts.cacheHighWaterMark)))
+      : BigInt.asUintN(64, -1n)
+    fl.setCacheHighWaterMark.native(limit)
+  }
 
   return gOptions
 }
@@ -8,6 +8,13 @@ function stddev(vals: number[]): number {
   return Math.sqrt(variance)
 }
 
+// the unfused computation the kernel replaces
+function reference(tensor: sm.Tensor, axes: number[], gamma: sm.Tensor, beta: sm.Tensor) {
+  const mean = tensor.mean(axes, true)
+  const std = tensor.variance(axes, false, true).add(sm.scalar(1e-6)).sqrt()
+  return tensor.sub(mean).div(std).mul(gamma).add(beta)
+}
+
 describe('LayerNorm', () => {
   it('1D norm', () => {
     const module = new sm.module.LayerNorm([3])
@@ -161,4 +168,50 @@ describe('LayerNorm', () => {
     result.backward()
     expect(!!tensor.grad).toBe(true)
   })
+  it('fused op matches the unfused computation', () => {
+    const tensor = sm.randn([4, 5, 6, 3]).mul(sm.scalar(3)).add(sm.scalar(2))
+    const gamma = sm.randn([6, 3])
+    const beta = sm.randn([6, 3])
+    const result = sm.layerNorm(tensor, 2, gamma, beta)
+    areSameShape(result, tensor)
+    const expected = reference(tensor, [-1, -2], gamma, beta)
+    expectArraysClose(result.toFloat32Array(), expected.toFloat32Array(), 1e-4)
+  })
+  it('fused gradients match the unfused computation', () => {
+    const tensor = sm.randn([7, 2, 8]).requireGrad()
+    const gamma = sm.randn([8]).requireGrad()
+    const beta = sm.randn([8]).requireGrad()
+    const g = sm.randn([7, 2, 8])
+    sm.layerNorm(tensor, 1, gamma, beta).mul(g).sum().backward()
+    const fused = [tensor.grad, gamma.grad, beta.grad].map((t) => t.toFloat32Array())
+    tensor.grad = gamma.grad = beta.grad = null
+    reference(tensor, [-1], gamma, beta).mul(g).sum().backward()
+    expectArraysClose(fused[0], tensor.grad.toFloat32Array(), 1e-4)
+    expectArraysClose(fused[1], gamma.grad.toFloat32Array(), 1e-4)
+    expectArraysClose(fused[2], beta.grad.toFloat32Array(), 1e-4)
+  })
+  it('fused gradients over many rows', () => {
+    const tensor = sm.randn([1024, 16]).requireGrad()
+    const gamma = sm.randn([16]).requireGrad()
+    const beta = sm.randn([16]).requireGrad()
+    const g = sm.randn([1024, 16])
+    sm.layerNorm(tensor, 1, gamma, beta).mul(g).sum().backward()
+    const fused = [tensor.grad, gamma.grad, beta.grad].map((t) => t.toFloat32Array())
+    tensor.grad = gamma.grad = beta.grad = null
+    reference(tensor, [-1], gamma, beta).mul(g).sum().backward()
+    expectArraysClose(fused[0], tensor.grad.toFloat32Array(), 1e-4)
+    expectArraysClose(fused[1], gamma.grad.toFloat32Array(), 1e-3)
+    expectArraysClose(fused[2], beta.grad.toFloat32Array(), 1e-3)
+  })
+  it('skips parameter gradients without gamma and beta', () => {
+    const tensor = sm.randn([7, 8]).requireGrad()
+    const g = sm.randn([7, 8])
+    const result = sm.layerNorm(tensor, 1)
+    const [mean, rstd] = <sm.Tensor[]>result.deps.slice(5)
+    const [dx, dgamma, dbeta] = sm.layerNormBackward(g, tensor, undefined, mean, rstd, 1, false)
+    expect(dgamma).toBeUndefined()
+    expect(dbeta).toBeUndefined()
+    result.mul(g).sum().backward()
+    expectArraysClose(dx.toFloat32Array(), tensor.grad.toFloat32Array(), 1e-4)
+  })
 })
@@ -0,0 +1,42 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose } from './utils'
+
+describe('adopt', () => {
+  it('values', () => {
+    const data = new Float32Array([1, 2, 3, 4])
+    const t = sm.adopt(data)
+    expect(t.dtype).toBe(sm.dtype.Float32)
+    expect(t.shape).toEqual([4])
+    expectArraysClose(t.mul(sm.scalar(2)).toFloat32Array(), [2, 4, 6, 8])
+  })
+  it('dtypes', () => {
+    expect(sm.adopt(new Int32Array([1, -2])).toInt32Array()).toEqual(new Int32Array([1, -2]))
+    expect(sm.adopt(new Float64Array([0.5])).dtype).toBe(sm.dtype.Float64)
+    expect(sm.adopt([1, 2, 3]).dtype).toBe(sm.dtype.Float32)
+    expect(sm.adopt(new Float32Array(0)).elements).toBe(0)
+  })
+  it('views outlive the adopted tensor', () => {
+    const data = new Float32Array([1, 2, 3, 4, 5, 6])
+    let t = sm.adopt(data)
+    const r = t.reshape([2, 3])
+    t.dispose()
+    t = null
+    Bun.gc(true)
+    sm.releaseAdoptedBuffers()
+    expectArraysClose(r.sum([1]).toFloat32Array(), [6, 15])
+  })
+  // backends that cannot address host memory copy instead
+  const itAdopts = sm.canAdoptBuffers() ? it : it.skip
+  itAdopts('accounted as shared', () => {
+    const before_used = sm.bytesUsed()
+    const before_shared = sm.bytesShared()
+    const t = sm.adopt(new Float32Array(1024))
+    expect(sm.bytesShared() - before_shared).toBe(4096n)
+    expect(sm.bytesUsed()).toBe(before_used)
+    t.dispose()
+    Bun.gc(true)
+    sm.releaseAdoptedBuffers()
+    expect(sm.bytesShared()).toBe(before_shared)
+  })
+})
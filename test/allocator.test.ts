@@ -0,0 +1,54 @@
+import * as sm from '@shumai/shumai'
+import { dlopen, FFIType, ptr } from 'bun:ffi'
+import { describe, expect, it } from 'bun:test'
+
+describe('allocator', () => {
+  it('reserved covers in use', () => {
+    const t = sm.randn([128, 128])
+    t.eval()
+    expect(sm.bytesInUse()).toBeGreaterThanOrEqual(BigInt(128 * 128 * 4))
+    expect(sm.bytesReserved()).toBeGreaterThanOrEqual(sm.bytesInUse())
+    t.dispose()
+  })
+  it('caches freed blocks', () => {
+    sm.emptyCache()
+    const t = sm.randn([1024, 256])
+    t.eval()
+    const in_use = sm.bytesInUse()
+    const reserved = sm.bytesReserved()
+    t.dispose()
+    expect(sm.bytesInUse()).toBeLessThan(in_use)
+    expect(sm.bytesReserved()).toBe(reserved)
+
+    const u = sm.randn([1024, 256])
+    u.eval()
+    expect(sm.bytesReserved()).toBe(reserved)
+    u.dispose()
+
+    sm.emptyCache()
+    expect(sm.bytesReserved()).toBe(sm.bytesInUse())
+  })
+  it('high-water mark', () => {
+    sm.util.memoryOptions({ cacheHighWaterMark: 0 })
+    const t = sm.randn([1024, 256])
+    t.eval()
+    t.dispose()
+    expect(sm.bytesReserved()).toBe(sm.bytesInUse())
+    sm.util.memoryOptions({ cacheHighWaterMark: Infinity })
+  })
+  it('releases user-locked allocations', () => {
+    // ArrayFire allocates these user-locked (and not manager-locked)
+    const { symbols: af, close } = dlopen(sm.NATIVE_FILE, {
+      af_alloc_device_v2: { args: [FFIType.ptr, FFIType.i64], returns: FFIType.i32 },
+      af_free_device_v2: { args: [FFIType.ptr], returns: FFIType.i32 }
+    })
+    const bytes = 1 << 20
+    const in_use = sm.bytesInUse()
+    const out = new BigInt64Array(1)
+    expect(af.af_alloc_device_v2(ptr(out), bytes)).toBe(0)
+    expect(sm.bytesInUse() - in_use).toBeGreaterThanOrEqual(BigInt(bytes))
+    expect(af.af_free_device_v2(Number(out[0]))).toBe(0)
+    expect(sm.bytesInUse()).toBe(in_use)
+    close()
+  })
+})
@@ -0,0 +1,78 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose, isShape } from './utils'
+
+// the unfused computation the kernel replaces
+function reference(q: sm.Tensor, k: sm.Tensor, v: sm.Tensor, mask?: sm.Tensor) {
+  let scores = q.matmul(k.T()).mul(sm.scalar(1 / Math.sqrt(q.shape[q.shape.length - 1])))
+  if (mask) {
+    const tile = scores.shape.slice(0, -2).concat([1, 1])
+    scores = sm.where(mask.tile(tile), sm.full([1], -Infinity).tile(scores.shape), scores)
+  }
+  return scores.softmax(-1).matmul(v)
+}
+
+const causalMask = (tq: number, tk: number) =>
+  sm.full([tq, tk], 1).astype(sm.dtype.BoolInt8).tril().logicalNot()
+
+const inputs = (batch: number[], tq: number, tk: number, dim: number) => [
+  sm.randn([...batch, tq, dim]).requireGrad(),
+  sm.randn([...batch, tk, dim]).requireGrad(),
+  sm.randn([...batch, tk, dim]).requireGrad()
+]
+
+describe('scaledDotProductAttention', () => {
+  it('matches the unfused computation', () => {
+    const [q, k, v] = inputs([2, 3], 20, 70, 8)
+    const out = sm.scaledDotProductAttention(q, k, v)
+    expect(isShape(out, [2, 3, 20, 8])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), reference(q, k, v).toFloat32Array(), 1e-4)
+  })
+  it('explicit mask', () => {
+    const [q, k, v] = inputs([2], 5, 7, 4)
+    const mask = sm.tensor(new Int8Array(35).map((_, i) => (i % 3 === 1 ? 1 : 0))).reshape([5, 7])
+    const out = sm.scaledDotProductAttention(q, k, v, mask)
+    expectArraysClose(out.toFloat32Array(), reference(q, k, v, mask).toFloat32Array(), 1e-4)
+  })
+  it('causal', () => {
+    const [q, k, v] = inputs([], 33, 33, 6)
+    const out = sm.scaledDotProductAttention(q, k, v, undefined, true)
+    const expected = reference(q, k, v, causalMask(33, 33))
+    expectArraysClose(out.toFloat32Array(), expected.toFloat32Array(), 1e-4)
+  })
+  it('gradients match the unfused computation', () => {
+    const [q, k, v] = inputs([2], 18, 70, 5)
+    const g = sm.randn([2, 18, 5])
+    const mask = causalMask(18, 70)
+    sm.scaledDotProductAttention(q, k, v, mask).mul(g).sum().backward()
+    const fused = [q.grad, k.grad, v.grad].map((t) => t.toFloat32Array())
+    q.grad = k.grad = v.grad = null
+    reference(q, k, v, mask).mul(g).sum().backward()
+    expectArraysClose(fused[0], q.grad.toFloat32Array(), 1e-4)
+    expectArraysClose(fused[1], k.grad.toFloat32Array(), 1e-4)
+    expectArraysClose(fused[2], v.grad.toFloat32Array(), 1e-4)
+  })
+  it('causal module flag', () => {
+    const module = new sm.module.TransformerDotProductAttention(4)
+    const [q, k, v] = inputs([], 6, 6, 4)
+    const out = module(q, k, v, undefined, true)
+    const masked = module(q, k, v, sm.module.TransformerDecoderLayer.getSelfAttentionMask(6))
+    expectArraysClose(out.toFloat32Array(), masked.toFloat32Array(), 1e-5)
+  })
+  it('causal module flag without the fused kernel', () => {
+    // overriding `scale` (here with the same 1 / sqrt(dim)) takes the unfused branch
+    class Unfused extends sm.module.TransformerDotProductAttention {
+      protected scale(tensor: sm.Tensor) {
+        return tensor.mul(sm.scalar(0.5))
+      }
+    }
+    const fused = new sm.module.TransformerDotProductAttention(4)
+    const unfused = new Unfused(4)
+    const [q, k, v] = inputs([2], 6, 6, 4)
+    const mask = sm.tensor(new Int8Array(36).map((_, i) => (i % 5 === 3 ? 1 : 0))).reshape([6, 6])
+    for (const m of [undefined, mask]) {
+      const expected = fused(q, k, v, m, true).toFloat32Array()
+      expectArraysClose(unfused(q, k, v, m, true).toFloat32Array(), expected, 1e-5)
+    }
+  })
+})
@@ -0,0 +1,60 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose, expectThrows } from './utils'
+
+class Block extends sm.module.Module {
+  l0 = sm.module.linear(16, 32)
+  l1 = sm.module.linear(32, 16)
+  forward(x: sm.Tensor): sm.Tensor {
+    return this.l1(this.l0(x).tanh()).sigmoid().mul(x)
+  }
+}
+
+const params = (blocks: Block[]) =>
+  blocks.flatMap((b) => [b.l0.weight, b.l0.bias, b.l1.weight, b.l1.bias])
+
+describe('checkpoint', () => {
+  it('gradients match the stored activations', () => {
+    const blocks = [new Block(), new Block(), new Block()]
+    const x = sm.randn([4, 16]).requireGrad()
+    const run = (checkpointed: boolean) => {
+      let y = x
+      for (const b of blocks) {
+        y = checkpointed ? sm.util.checkpoint(b, y) : b(y)
+      }
+      y.sum().backward()
+      return [x, ...params(blocks)].map((t) => t.grad.toFloat32Array())
+    }
+    const expected = run(false)
+    const actual = run(true)
+    expected.forEach((g, i) => expectArraysClose(actual[i], g, 1e-4))
+  })
+  it('depends only on inputs and parameters', () => {
+    const block = new Block()
+    const y = sm.util.checkpoint(block, sm.randn([2, 16]).requireGrad())
+    expect(y.op).toBe('checkpoint')
+    expect(y.deps.length).toBe(5)
+    expect(y.deps.slice(1).every((t: sm.Tensor) => t.deps.length === 0)).toBe(true)
+  })
+  it('reports the activations released', () => {
+    const block = new Block()
+    const x = sm.randn([8, 16]).requireGrad()
+    const s = sm.collectStats(() => sm.util.checkpoint(block, x), { enabled: true })
+    expect(s.checkpointBytesSaved > 0n).toBe(true)
+  })
+  it('counts activations sharing a buffer once', () => {
+    const x = sm.randn([8, 16]).requireGrad()
+    const fn = (x: sm.Tensor) => {
+      const h = x.mul(sm.scalar(2))
+      h.eval()
+      // both reshapes are views of h
+      return h.reshape([16, 8]).add(h.reshape([16, 8]))
+    }
+    const s = sm.collectStats(() => sm.util.checkpoint(fn, x), { enabled: true })
+    expect(s.checkpointBytesSaved).toBe(BigInt(8 * 16 * 4))
+  })
+  it('requires a single output', () => {
+    const x = sm.randn([3]).requireGrad()
+    expectThrows(() => sm.util.checkpoint((x) => [x.mul(x)], x), new RegExp('single Tensor'))
+  })
+})
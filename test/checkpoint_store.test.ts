@@ -0,0 +1,83 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { existsSync, mkdirSync, readdirSync, rmSync } from 'fs'
+import { expectArraysClose } from './utils'
+
+const tmpDir = () => `/tmp/store_${Math.round(1e8 * Math.random())}`
+
+describe('CheckpointStore', () => {
+  it('restores through checkpoint', () => {
+    const dir = tmpDir()
+    const store = new sm.io.CheckpointStore(dir)
+    const a = sm.randn([8, 8]).checkpoint(store, undefined, 'a')
+    const next = a.mul(sm.scalar(3))
+    a.update(next)
+    store.commit()
+    sm.flushSaves()
+
+    const restored = sm.randn([8, 8]).checkpoint(new sm.io.CheckpointStore(dir), undefined, 'a')
+    expectArraysClose(restored.toFloat32Array(), next.toFloat32Array())
+  })
+  it('only changed tensors are written', () => {
+    const dir = tmpDir()
+    const store = new sm.io.CheckpointStore(dir)
+    const frozen = sm.randn([1024]).checkpoint(store, undefined, 'frozen')
+    const trained = sm.randn([16]).checkpoint(store, undefined, 'trained')
+    store.commit()
+    const initial = store.bytesWritten
+    expect(initial).toBe(1024n * 4n + 16n * 4n)
+    for (let i = 0; i < 5; ++i) {
+      frozen.update(frozen.add(sm.scalar(0)))
+      trained.update(trained.add(sm.scalar(1)))
+      store.commit()
+    }
+    expect(store.bytesWritten - initial).toBe(5n * 16n * 4n)
+    expect(store.step).toBe(6)
+    sm.flushSaves()
+    expect(readdirSync(`${dir}/chunks`).length).toBe(7)
+    expect(existsSync(`${dir}/manifest_6.json`)).toBe(true)
+  })
+  it('commits once per step', async () => {
+    const dir = tmpDir()
+    const store = new sm.io.CheckpointStore(dir)
+    const ts = [0, 1, 2].map((i) => sm.randn([4]).checkpoint(store, undefined, `t${i}`))
+    await Promise.resolve()
+    expect(store.step).toBe(1)
+    ts.forEach((t) => t.update(t.mul(sm.scalar(2))))
+    ts.forEach((t) => t.update(t.mul(sm.scalar(2))))
+    await Promise.resolve()
+    expect(store.step).toBe(3)
+  })
+  it('does not commit steps whose chunks failed', () => {
+    const dir = tmpDir()
+    const store = new sm.io.CheckpointStore(dir)
+    const a = sm.randn([16]).checkpoint(store, undefined, 'a')
+    store.commit()
+    sm.flushSaves()
+    rmSync(`${dir}/chunks`, { recursive: true })
+    const next = a.add(sm.scalar(1))
+    a.update(next)
+    expect(store.commit()).toBe(2)
+    expect(() => sm.flushSaves()).toThrow()
+    expect(existsSync(`${dir}/manifest_2.json`)).toBe(false)
+    mkdirSync(`${dir}/chunks`)
+    expect(() => store.commit()).toThrow(new RegExp('Failed to write checkpoint chunks'))
+    // the tensor is written again
+    expect(store.commit()).toBe(3)
+    sm.flushSaves()
+    const restored = sm.randn([16]).checkpoint(new sm.io.CheckpointStore(dir), undefined, 'a')
+    expectArraysClose(restored.toFloat32Array(), next.toFloat32Array())
+  })
+  it('modules', () => {
+    const dir = tmpDir()
+    const model = sm.module.linear(4, 2)
+    const store = new sm.io.CheckpointStore(dir)
+    model.checkpoint(store)
+    model.weight.update(model.weight.mul(sm.scalar(-1)))
+    store.commit()
+    sm.flushSaves()
+    const restored = sm.module.linear(4, 2)
+    restored.checkpoint(new sm.io.CheckpointStore(dir))
+    expectArraysClose(restored.weight.toFloat32Array(), model.weight.toFloat32Array())
+  })
+})
@@ -0,0 +1,69 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose, expectThrows, isShape } from './utils'
+
+describe('CommandBuffer', () => {
+  it('matches the per-op path', () => {
+    const x = sm.randn([8, 16])
+    const w = sm.randn([16, 4])
+    const b = sm.randn([4])
+
+    const cb = new sm.CommandBuffer()
+    const x_s = cb.input()
+    const w_s = cb.input()
+    const b_s = cb.input()
+    const h = cb.sigmoid(cb.add(cb.matmul(x_s, w_s), b_s))
+    cb.output(h, cb.sum(h, [1], true))
+
+    const [out, summed] = cb.run(x, w, b)
+    const ref = x.matmul(w).add(b).sigmoid()
+    expect(isShape(out, [8, 4])).toBe(true)
+    expect(isShape(summed, [8, 1])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), ref.toFloat32Array())
+    expectArraysClose(summed.toFloat32Array(), ref.sum([1], true).toFloat32Array())
+  })
+  it('scalars, reshape and transpose', () => {
+    const p = sm.randn([3, 5])
+    const g = sm.randn([3, 5])
+
+    const cb = new sm.CommandBuffer()
+    const p_s = cb.input()
+    const g_s = cb.input()
+    const updated = cb.sub(p_s, cb.mul(g_s, cb.scalar(0.1)))
+    cb.output(cb.transpose(cb.reshape(updated, [5, 3]), [1, 0]))
+
+    const [out] = cb.run(p, g)
+    const ref = p.sub(g.mul(sm.scalar(0.1))).reshape([5, 3]).transpose([1, 0])
+    expect(isShape(out, [3, 5])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), ref.toFloat32Array())
+  })
+  it('reuses a compiled program', () => {
+    const cb = new sm.CommandBuffer()
+    const a = cb.input()
+    cb.output(cb.mean(cb.exp(a)))
+    const program = cb.compile()
+    for (let i = 0; i < 4; ++i) {
+      const t = sm.randn([32])
+      const [m] = cb.run(t)
+      expectArraysClose([m.toFloat32()], [t.exp().mean().toFloat32()])
+    }
+    expect(cb.compile()).toBe(program)
+  })
+  it('astype', () => {
+    const cb = new sm.CommandBuffer()
+    const a = cb.input()
+    cb.output(cb.astype(a, sm.dtype.Int32))
+    const [out] = cb.run(sm.tensor(new Float32Array([1, 2, 3])))
+    expect(out.dtype).toBe(sm.dtype.Int32)
+    expectArraysClose(out.toInt32Array(), [1, 2, 3])
+  })
+  it('rejects invalid programs', () => {
+    const cb = new sm.CommandBuffer()
+    const a = cb.input()
+    expectThrows(() => cb.exp(a + 1), /Invalid CommandBuffer slot/)
+    expectThrows(() => cb.run(sm.randn([2])), /no outputs/)
+    cb.output(cb.exp(a))
+    expectThrows(() => cb.run(), /expected 1 inputs/)
+    expectThrows(() => cb.run(sm.randn([2]).requireGrad()), /does not record gradients/)
+  })
+})
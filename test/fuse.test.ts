@@ -0,0 +1,77 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose, expectThrows, isShape } from './utils'
+
+const gate = sm.fuse((x, a, b) => x.mul(a).add(b).sigmoid())
+
+describe('fuse', () => {
+  it('matches the unfused chain', () => {
+    const x = sm.randn([4, 5])
+    const a = sm.randn([5])
+    const b = sm.scalar(0.25)
+    const y = gate(x, a, b)
+    expect(isShape(y, [4, 5])).toBe(true)
+    expectArraysClose(y.toFloat32Array(), x.mul(a).add(b).sigmoid().toFloat32Array())
+  })
+  it('reuses the traced program for other shapes', () => {
+    const x = sm.randn([3, 2, 7])
+    const a = sm.randn([2, 1])
+    const b = sm.randn([7])
+    expectArraysClose(gate(x, a, b).toFloat32Array(), x.mul(a).add(b).sigmoid().toFloat32Array())
+  })
+  it('multiple outputs and constants', () => {
+    const x = sm.randn([64, 33])
+    const [lo, hi, mixed] = sm.fuse((x) => [
+      x.minimum(0),
+      x.maximum(0),
+      x.mul(x).sub(x.abs().sqrt()).div(2).add(x.gt(0.5))
+    ])(x)
+    expectArraysClose(lo.toFloat32Array(), x.minimum(sm.scalar(0)).toFloat32Array())
+    expectArraysClose(hi.toFloat32Array(), x.maximum(sm.scalar(0)).toFloat32Array())
+    const expected = x
+      .mul(x)
+      .sub(x.abs().sqrt())
+      .div(sm.scalar(2))
+      .add(x.gt(sm.scalar(0.5)).astype(sm.dtype.Float32))
+    expectArraysClose(mixed.toFloat32Array(), expected.toFloat32Array())
+  })
+  it('gradients match the unfused chain', () => {
+    const x = sm.randn([6, 4]).requireGrad()
+    const a = sm.randn([4]).requireGrad()
+    const b = sm.randn([6, 1]).requireGrad()
+    const g = sm.randn([6, 4])
+    const chain = sm.fuse((x, a, b) => x.mul(a).add(b).tanh().mul(x.exp()).div(a.mul(a).add(1)))
+    chain(x, a, b).mul(g).sum().backward()
+    const fused = [x, a, b].map((t) => t.grad.toFloat32Array())
+    x.grad = a.grad = b.grad = null
+    x.mul(a)
+      .add(b)
+      .tanh()
+      .mul(x.exp())
+      .div(a.mul(a).add(sm.scalar(1)))
+      .mul(g)
+      .sum()
+      .backward()
+    ;[x, a, b].forEach((t, i) => expectArraysClose(fused[i], t.grad.toFloat32Array(), 1e-4))
+  })
+  it('inputs must broadcast', () => {
+    expectThrows(
+      () => gate(sm.randn([4, 5]), sm.randn([4]), sm.scalar(1)),
+      new RegExp('Fused program failed')
+    )
+  })
+  it('broadcasts like the layout', () => {
+    const x = sm.randn([4, 5])
+    const a = sm.randn([5])
+    const expected = x.mul(a).add(sm.scalar(1)).sigmoid()
+    expectArraysClose(gate(x, a, sm.scalar(1)).toFloat32Array(), expected.toFloat32Array(), 1e-5)
+    sm.layout.setColMajor()
+    try {
+      // the leading dims match, but a lower rank pads leading (JS) dims when broadcasting
+      const y = sm.randn([5, 4])
+      expectThrows(() => gate(y, sm.randn([5]), sm.scalar(1)), new RegExp('Fused program failed'))
+    } finally {
+      sm.layout.setRowMajor()
+    }
+  })
+})
@@ -0,0 +1,102 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose, isShape, nativeError } from './utils'
+
+const ints = (data: number[], shape: number[]) => sm.tensor(new Int32Array(data)).reshape(shape)
+const floats = (data: number[], shape: number[]) =>
+  sm.tensor(new Float32Array(data)).reshape(shape)
+
+describe('gather', () => {
+  const x = floats([1, 2, 3, 4, 5, 6], [2, 3])
+  it('last axis', () => {
+    const out = x.gather(1, ints([2, 0, 1, 1], [2, 2]))
+    expect(isShape(out, [2, 2])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), [3, 1, 5, 5])
+  })
+  it('first axis', () => {
+    const out = sm.gather(x, 0, ints([1, 0, 1], [1, 3]))
+    expect(isShape(out, [1, 3])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), [4, 2, 6])
+  })
+  it('negative and int64 indices', () => {
+    const index = sm.tensor(new BigInt64Array([-1n, 0n])).reshape([2, 1])
+    expectArraysClose(x.gather(1, index).toFloat32Array(), [3, 4])
+  })
+  it('out of range', () => {
+    expect(() => x.gather(1, ints([3, 0], [2, 1]))).toThrow(nativeError)
+  })
+  it('gradient', () => {
+    const a = floats([1, 2, 3, 4, 5, 6], [2, 3]).requireGrad()
+    a.gather(1, ints([2, 2, 0, 1], [2, 2])).sum().backward()
+    expectArraysClose(a.grad.toFloat32Array(), [0, 0, 2, 1, 1, 0])
+  })
+})
+
+describe('scatterAdd', () => {
+  it('accumulates repeated indices', () => {
+    const base = sm.full([2, 3], 0)
+    const out = base.scatterAdd(1, ints([0, 0, 2, 1], [2, 2]), floats([1, 2, 3, 4], [2, 2]))
+    expectArraysClose(out.toFloat32Array(), [3, 0, 0, 0, 4, 3])
+    expectArraysClose(base.toFloat32Array(), [0, 0, 0, 0, 0, 0])
+  })
+  it('gradient', () => {
+    const base = sm.full([2, 3], 1).requireGrad()
+    const src = floats([1, 2, 3, 4], [2, 2]).requireGrad()
+    const scale = floats([1, 2, 3, 4, 5, 6], [2, 3])
+    sm.scatterAdd(base, 1, ints([0, 0, 2, 1], [2, 2]), src).mul(scale).sum().backward()
+    expectArraysClose(base.grad.toFloat32Array(), [1, 2, 3, 4, 5, 6])
+    expectArraysClose(src.grad.toFloat32Array(), [1, 1, 6, 5])
+  })
+})
+
+describe('indexSelect', () => {
+  const table = floats([1, 2, 3, 4, 5, 6], [3, 2])
+  it('rows', () => {
+    const out = table.indexSelect(0, ints([2, 0, 2], [3]))
+    expect(isShape(out, [3, 2])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), [5, 6, 1, 2, 5, 6])
+  })
+  it('columns', () => {
+    const out = sm.indexSelect(table, 1, ints([1], [1]))
+    expect(isShape(out, [3, 1])).toBe(true)
+    expectArraysClose(out.toFloat32Array(), [2, 4, 6])
+  })
+  it('out of range', () => {
+    expect(() => table.indexSelect(0, ints([3], [1]))).toThrow(nativeError)
+  })
+  it('gradient is a scatter-add of the used rows', () => {
+    const t = floats([1, 2, 3, 4, 5, 6], [3, 2]).requireGrad()
+    t.indexSelect(0, ints([1, 1, 0], [3])).sum().backward()
+    expectArraysClose(t.grad.toFloat32Array(), [1, 1, 2, 2, 0, 0])
+  })
+  it('large', () => {
+    const [rows, cols, n] = [1000, 64, 5000]
+    const data = new Float32Array(rows * cols).map((_, i) => i)
+    const idx = new Int32Array(n).map(() => Math.floor(Math.random() * rows))
+    const out = sm.tensor(data).reshape([rows, cols]).indexSelect(0, sm.tensor(idx))
+    const expected = new Float32Array(n * cols)
+    for (let k = 0; k < n; ++k) {
+      expected.set(data.subarray(idx[k] * cols, (idx[k] + 1) * cols), k * cols)
+    }
+    expectArraysClose(out.toFloat32Array(), expected)
+  })
+})
+
+describe('indexAdd', () => {
+  it('accumulates repeated indices', () => {
+    const out = sm.indexAdd(sm.full([3, 2], 1), 0, ints([2, 2, 0], [3]), sm.full([3, 2], 1))
+    expectArraysClose(out.toFloat32Array(), [2, 2, 1, 1, 3, 3])
+  })
+  it('large', () => {
+    const [rows, cols, n] = [100, 32, 10000]
+    const idx = new Int32Array(n).map(() => Math.floor(Math.random() * rows))
+    const out = sm.full([rows, cols], 0).indexAdd(0, sm.tensor(idx), sm.full([n, cols], 1))
+    const expected = new Float32Array(rows * cols)
+    for (const i of idx) {
+      for (let c = 0; c < cols; ++c) {
+        expected[i * cols + c] += 1
+      }
+    }
+    expectArraysClose(out.toFloat32Array(), expected)
+  })
+})
@@ -0,0 +1,30 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+
+describe('handleStats', () => {
+  it('counts live handles', () => {
+    const before = sm.handleStats()
+    const ts = []
+    for (let i = 0; i < 100; ++i) {
+      ts.push(sm.scalar(i))
+    }
+    const after = sm.handleStats()
+    expect(after.live - before.live).toBeGreaterThanOrEqual(100)
+    expect(after.allocations - before.allocations).toBeGreaterThanOrEqual(100)
+    expect(after.capacity).toBeGreaterThanOrEqual(after.live)
+    expect(after.occupancy).toBeLessThanOrEqual(1)
+  })
+  it('reuses freed handles', () => {
+    for (let i = 0; i < 100; ++i) {
+      sm.scalar(i)
+    }
+    Bun.gc(true)
+    const before = sm.handleStats()
+    for (let i = 0; i < 100; ++i) {
+      sm.scalar(i)
+    }
+    const after = sm.handleStats()
+    expect(after.reused).toBeGreaterThan(before.reused)
+    expect(after.reuseRate).toBeGreaterThan(0)
+  })
+})
@@ -49,4 +49,35 @@ describe('indexedAssign', () => {
       expect(isClose(ref[i], check)).toBe(true)
     }
   })
+  it('returns a new tensor', () => {
+    const t = sm.full([3], 0)
+    const s = t.indexedAssign(sm.full([1], 2), [0])
+    expect(s).not.toBe(t)
+    expect(t.toFloat32Array()[0]).toBe(0)
+    expect(s.toFloat32Array()[0]).toBe(2)
+  })
+  it('in place', () => {
+    const t = sm.full([4, 3], 0)
+    const view = t.reshape([12])
+    const s = t.indexedAssignInPlace(sm.full([3], 1), [2])
+    expect(s).toBe(t)
+    expect(Array.from(t.toFloat32Array())).toEqual([0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0])
+    // tensors sharing the old buffer keep their values
+    expect(view.sum().toFloat32()).toBe(0)
+  })
+  it('leaves adopted memory untouched', () => {
+    const data = new Float32Array(4)
+    const t = sm.adopt(data)
+    t.indexedAssignInPlace(sm.full([1], 5), [1])
+    expect(t.toFloat32Array()[1]).toBe(5)
+    expect(data[1]).toBe(0)
+  })
+  it('with gradients', () => {
+    const t = sm.full([3], 0).requireGrad()
+    const s = t.indexedAssign(sm.full([1], 2), [0])
+    expect(s).not.toBe(t)
+    expect(t.toFloat32Array()[0]).toBe(0)
+    expect(s.toFloat32Array()[0]).toBe(2)
+    expect(() => t.indexedAssignInPlace(sm.full([1], 2), [0])).toThrow()
+  })
 })
@@ -1,6 +1,6 @@
 import * as sm from '@shumai/shumai'
 import { describe, it } from 'bun:test'
-import { expectArraysClose } from './utils'
+import { expectArraysClose, expectThrows, nativeError } from './utils'
 
 describe('mse', () => {
   it('should be near zero', () => {
@@ -76,5 +76,47 @@ describe('binaryCrossEntropy', () => {
   })
 })
 
+describe('crossEntropyWithLogits', () => {
+  // the composed computation on one-hot targets
+  const reference = (logits: sm.Tensor, labels: number[]) => {
+    const classes = logits.shape[logits.shape.length - 1]
+    const onehot = tableToTensor(labels.map((l) => [...Array(classes)].map((_, k) => +(k === l))))
+    return onehot.mul(logits.logSoftmax(-1)).sum([1]).mean().mul(sm.scalar(-1))
+  }
+  const labelTensor = (labels: number[]) => sm.tensor(new Int32Array(labels))
+
+  it('matches crossEntropy on softmax outputs', () => {
+    const logits = tableToTensor([
+      [1, 2, 0.5],
+      [-1, 3, 2]
+    ])
+    const onehot = tableToTensor([
+      [0, 1, 0],
+      [0, 0, 1]
+    ])
+    const loss = sm.loss.crossEntropyWithLogits()
+    const expected = sm.loss.crossEntropy()(onehot, logits.softmax(-1))
+    expectArraysClose(loss(labelTensor([1, 2]), logits).toFloat32Array(), expected.toFloat32Array())
+  })
+  it('is stable for large logits', () => {
+    const logits = tableToTensor([[1000, 0, -1000]])
+    expectArraysClose(sm.crossEntropyWithLogits(logits, labelTensor([1])).toFloat32Array(), [1000])
+  })
+  it('gradient matches the composed computation', () => {
+    const labels = [3, 0, 4, 4, 1, 2]
+    const logits = sm.randn([6, 5]).mul(sm.scalar(3)).requireGrad()
+    sm.crossEntropyWithLogits(logits, labelTensor(labels)).mul(sm.scalar(2)).backward()
+    const fused = logits.grad.toFloat32Array()
+    logits.grad = null
+    reference(logits, labels).mul(sm.scalar(2)).backward()
+    expectArraysClose(fused, logits.grad.toFloat32Array(), 1e-4)
+  })
+  it('invalid labels', () => {
+    const logits = sm.randn([2, 3])
+    expectThrows(() => sm.crossEntropyWithLogits(logits, labelTensor([0, 3])), nativeError)
+    expectThrows(() => sm.crossEntropyWithLogits(logits, labelTensor([0])), nativeError)
+  })
+})
+
 const tableToTensor = (table: number[][]): sm.Tensor =>
   sm.tensor(new Float32Array(table.flat())).reshape([table.length, table[0].length])
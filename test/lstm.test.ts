@@ -1,6 +1,44 @@
 import * as sm from '@shumai/shumai'
 import { describe, expect, it } from 'bun:test'
-import { areSameShape } from './utils'
+import { areSameShape, expectArraysClose, isShape } from './utils'
+
+// the unfused per-step computation, with separate weights for each gate
+function reference(
+  xs: sm.Tensor,
+  h: sm.Tensor,
+  c: sm.Tensor,
+  W: sm.Tensor[],
+  U: sm.Tensor[],
+  b: sm.Tensor[]
+) {
+  const hs = []
+  for (let t = 0; t < xs.shape[0]; ++t) {
+    const x = sm.indexSelect(xs, 0, sm.tensor(new Int32Array([t]))).reshape(xs.shape.slice(1))
+    const z = (k: number) => x.matmul(W[k]).add(h.matmul(U[k])).add(b[k])
+    const [i, f, g, o] = [z(0).sigmoid(), z(1).sigmoid(), z(2).tanh(), z(3).sigmoid()]
+    c = f.mul(c).add(i.mul(g))
+    h = o.mul(c.tanh())
+    hs.push(h.reshape([1, ...h.shape]))
+  }
+  return [sm.concatenate(hs, 0), c]
+}
+
+const params = (inp: number, out: number) => {
+  const gates = (shape: number[]) =>
+    [0, 1, 2, 3].map(() => sm.randn(shape).mul(sm.scalar(0.5)).requireGrad())
+  return { W: gates([inp, out]), U: gates([out, out]), b: gates([out]) }
+}
+
+// packed [i | f | g | o] weights for lstmSequence
+const pack = (
+  W: sm.Tensor[],
+  U: sm.Tensor[],
+  b: sm.Tensor[]
+): [sm.Tensor, sm.Tensor, sm.Tensor] => [
+  sm.concatenate(W, 1),
+  sm.concatenate(U, 1),
+  sm.concatenate(b, 0)
+]
 
 describe('lstm', () => {
   it('basic construction', () => {
@@ -22,4 +60,33 @@ describe('lstm', () => {
     hn.sum().backward()
     expect(!!x.grad).toBe(true)
   })
+  it('sequence matches the unfused computation', () => {
+    const { W, U, b } = params(6, 5)
+    const xs = sm.randn([7, 3, 6])
+    const h = sm.randn([3, 5])
+    const c = sm.randn([3, 5])
+    const [hs, cn] = sm.lstmSequence(xs, h, c, ...pack(W, U, b))
+    const [ref_hs, ref_c] = reference(xs, h, c, W, U, b)
+    expect(isShape(hs, [7, 3, 5])).toBe(true)
+    expectArraysClose(hs.toFloat32Array(), ref_hs.toFloat32Array(), 1e-4)
+    expectArraysClose(cn.toFloat32Array(), ref_c.toFloat32Array(), 1e-4)
+  })
+  it('gradients match the unfused computation', () => {
+    const { W, U, b } = params(4, 3)
+    const xs = sm.randn([5, 2, 4]).requireGrad()
+    const h = sm.randn([2, 3]).requireGrad()
+    const c = sm.randn([2, 3]).requireGrad()
+    const g_hs = sm.randn([5, 2, 3])
+    const g_c = sm.randn([2, 3])
+    const inputs = [xs, h, c, ...W, ...U, ...b]
+    const loss = ([hs, cn]: sm.Tensor[]) => hs.mul(g_hs).sum().add(cn.mul(g_c).sum())
+
+    loss(sm.lstmSequence(xs, h, c, ...pack(W, U, b))).backward()
+    const fused = inputs.map((t) => t.grad.toFloat32Array())
+    for (const t of inputs) {
+      t.grad = null
+    }
+    loss(reference(xs, h, c, W, U, b)).backward()
+    inputs.forEach((t, i) => expectArraysClose(fused[i], t.grad.toFloat32Array(), 1e-4))
+  })
 })
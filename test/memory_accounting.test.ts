@@ -0,0 +1,39 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+
+describe('memory accounting', () => {
+  it('views share their buffer', () => {
+    const a = sm.randn([64, 64])
+    a.eval()
+    const used = sm.bytesUsed()
+    const live = sm.liveTensors()
+    const f32 = sm.bytesByDtype().Float32
+
+    const r = a.reshape([4096])
+    expect(sm.bytesUsed()).toBe(used)
+    expect(sm.liveTensors()).toBe(live + 1)
+    expect(sm.bytesByDtype().Float32 - f32).toBe(BigInt(4096 * 4))
+
+    r.dispose()
+    a.dispose()
+    expect(sm.bytesUsed()).toBe(used - BigInt(4096 * 4))
+    expect(sm.liveTensors()).toBe(live - 1)
+  })
+  it('per dtype', () => {
+    const before = sm.bytesByDtype()
+    const t = sm.full([10], 1).astype(sm.dtype.Int32)
+    expect(sm.bytesByDtype().Int32 - before.Int32).toBe(40n)
+    t.dispose()
+    expect(sm.bytesByDtype().Int32).toBe(before.Int32)
+  })
+  it('peak', () => {
+    sm.resetBytesPeak()
+    const start = sm.bytesUsed()
+    expect(sm.bytesPeak()).toBe(start)
+    const t = sm.randn([256, 256])
+    t.eval()
+    t.dispose()
+    expect(sm.bytesUsed()).toBe(start)
+    expect(sm.bytesPeak() - start).toBeGreaterThanOrEqual(BigInt(256 * 256 * 4))
+  })
+})
@@ -0,0 +1,133 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose } from './utils'
+
+// loss = sum(p * p), so the gradient is 2p
+const quadratic = (values: number[]) => {
+  const p = sm.tensor(new Float32Array(values)).requireGrad()
+  const grads = () => p.mul(p).sum().backward()
+  return { p, grads }
+}
+
+describe('sgd', () => {
+  it('plain', () => {
+    const { p, grads } = quadratic([1, 2, 3])
+    sm.optim.sgd(grads(), 0.1)
+    expectArraysClose(p.toFloat32Array(), [0.8, 1.6, 2.4])
+    expect(p.grad).toBe(null)
+  })
+  it('momentum and weight decay', () => {
+    const [lr, mu, wd] = [0.1, 0.9, 0.01]
+    const { p, grads } = quadratic([1, -2])
+    const opt = new sm.optim.SGD(lr, mu, wd)
+    const expected = [1, -2]
+    const buf = [0, 0]
+    for (let step = 0; step < 3; ++step) {
+      opt(grads())
+      for (let i = 0; i < expected.length; ++i) {
+        buf[i] = mu * buf[i] + 2 * expected[i] + wd * expected[i]
+        expected[i] -= lr * buf[i]
+      }
+    }
+    expectArraysClose(p.toFloat32Array(), expected)
+  })
+  it('keeps momentum across tidy scopes', () => {
+    const [lr, mu] = [0.1, 0.9]
+    const { p, grads } = quadratic([1, -2])
+    const opt = new sm.optim.SGD(lr, mu)
+    const expected = [1, -2]
+    const buf = [0, 0]
+    for (let step = 0; step < 3; ++step) {
+      sm.util.tidy(() => opt(grads()))
+      for (let i = 0; i < expected.length; ++i) {
+        buf[i] = mu * buf[i] + 2 * expected[i]
+        expected[i] -= lr * buf[i]
+      }
+    }
+    expectArraysClose(p.toFloat32Array(), expected)
+  })
+})
+
+describe('Adam', () => {
+  it('matches the reference update', () => {
+    const [lr, b1, b2, eps] = [0.01, 0.9, 0.999, 1e-8]
+    const { p, grads } = quadratic([1, -2, 0.5])
+    const opt = new sm.optim.Adam(lr, b1, b2, eps)
+    const expected = [1, -2, 0.5]
+    const m = [0, 0, 0]
+    const v = [0, 0, 0]
+    for (let t = 1; t <= 3; ++t) {
+      opt(grads())
+      const step_size = (lr * Math.sqrt(1 - b2 ** t)) / Math.sqrt(1 - b1 ** t)
+      for (let i = 0; i < expected.length; ++i) {
+        const g = 2 * expected[i]
+        m[i] = b1 * m[i] + (1 - b1) * g
+        v[i] = b2 * v[i] + (1 - b2) * g * g
+        expected[i] -= (step_size * m[i]) / (Math.sqrt(v[i]) + eps)
+      }
+    }
+    expectArraysClose(p.toFloat32Array(), expected)
+  })
+  it('keeps its state across tidy scopes', () => {
+    const { p, grads } = quadratic([1, -2])
+    const reference = quadratic([1, -2])
+    const opt = sm.util.tidy(() => new sm.optim.Adam(0.1))
+    const reference_opt = new sm.optim.Adam(0.1)
+    for (let t = 0; t < 3; ++t) {
+      sm.util.tidy(() => opt(grads()))
+      reference_opt(reference.grads())
+    }
+    expectArraysClose(p.toFloat32Array(), reference.p.toFloat32Array())
+  })
+  it('updates in place without touching copies', () => {
+    const { p, grads } = quadratic([1, 2])
+    const before = p.detach()
+    const ptr = p.ptr
+    new sm.optim.Adam(0.1)(grads())
+    expect(p.ptr).toBe(ptr)
+    expectArraysClose(before.toFloat32Array(), [1, 2])
+    expect(p.toFloat32Array()[0]).toBeLessThan(1)
+  })
+  it('large parameters', () => {
+    const n = 1 << 20
+    const p = sm.full([n], 1).requireGrad()
+    new sm.optim.Adam(0.1)(p.sum().backward())
+    // the first step moves every element by lr * sqrt(1 - b2) / sqrt(1 - b1) for g = 1
+    const expected = 1 - 0.1 * Math.sqrt(0.1)
+    const out = p.toFloat32Array()
+    expect(out[0]).toBeCloseTo(expected, 4)
+    expect(out[n - 1]).toBeCloseTo(expected, 4)
+  })
+})
+
+describe('multi-tensor step', () => {
+  const model = () => {
+    const a = sm.tensor(new Float32Array([1, 2])).requireGrad()
+    const b = sm.tensor(new Float32Array([3, -4, 5])).requireGrad()
+    const grads = () => a.mul(a).sum().add(b.mul(b).sum()).backward()
+    return { a, b, grads }
+  }
+  it('updates every parameter in one step', () => {
+    const { a, b, grads } = model()
+    sm.optim.sgd(grads(), 0.1)
+    expectArraysClose(a.toFloat32Array(), [0.8, 1.6])
+    expectArraysClose(b.toFloat32Array(), [2.4, -3.2, 4])
+  })
+  it('reports the global gradient norm', () => {
+    const { grads } = model()
+    const opt = new sm.optim.Adam()
+    opt(grads())
+    // gradients are 2 * [1, 2, 3, -4, 5]
+    expect(opt.grad_norm).toBeCloseTo(2 * Math.sqrt(55), 4)
+  })
+  it('clips to the global norm', () => {
+    const { a, b, grads } = model()
+    const norm = 2 * Math.sqrt(55)
+    const opt = new sm.optim.SGD(1, 0, 0, 1)
+    opt(grads())
+    expect(opt.grad_norm).toBeCloseTo(norm, 4)
+    const scale = 1 / norm
+    expectArraysClose(a.toFloat32Array(), [1 - 2 * scale, 2 - 4 * scale])
+    expectArraysClose(b.toFloat32Array(), [3 - 6 * scale, -4 + 8 * scale, 5 - 10 * scale])
+  })
+})
@@ -0,0 +1,59 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { readFileSync, writeFileSync } from 'fs'
+import { areSameShape, expectArraysClose, expectThrows } from './utils'
+
+const tmpFile = () => `/tmp/raw_${Math.round(1e8 * Math.random())}.bin`
+
+describe('raw files', () => {
+  it('round trip', () => {
+    const a = sm.randn([3, 4, 5])
+    const file = tmpFile()
+    expect(a.saveRaw(file)).toBe(4096 + 3 * 4 * 5 * 4)
+    const b = sm.loadRaw(file)
+    expect(areSameShape(a, b)).toBe(true)
+    expect(b.dtype).toBe(sm.dtype.Float32)
+    expectArraysClose(b.toFloat32Array(), a.toFloat32Array())
+  })
+  it('dtypes, views and scalars', () => {
+    const file = tmpFile()
+    const i = sm.tensor(new Int32Array([1, -2, 3, -4, 5, -6])).reshape([2, 3])
+    i.transpose([1, 0]).saveRaw(file)
+    const j = sm.loadRaw(file)
+    expect(j.dtype).toBe(sm.dtype.Int32)
+    expect(j.shape).toEqual([3, 2])
+    expect(j.toInt32Array()).toEqual(i.transpose([1, 0]).toInt32Array())
+    sm.scalar(7).astype(sm.dtype.Float64).saveRaw(file)
+    expect(sm.loadRaw(file).toFloat64()).toBe(7)
+  })
+  it('loaded through new Tensor', () => {
+    const a = sm.randn([16])
+    const file = tmpFile()
+    a.saveRaw(file)
+    expectArraysClose(sm.tensor(file).toFloat32Array(), a.toFloat32Array())
+  })
+  // backends that cannot address host memory load a copy
+  const itMaps = sm.canAdoptBuffers() ? it : it.skip
+  itMaps('mapped memory is shared', () => {
+    const file = tmpFile()
+    sm.randn([1024]).saveRaw(file)
+    const before = sm.bytesShared()
+    const t = sm.loadRaw(file)
+    expect(sm.bytesShared() - before).toBe(4096n)
+    const doubled = t.mul(sm.scalar(2))
+    t.dispose()
+    Bun.gc(true)
+    // unmapped once no tensor references it
+    expect(sm.bytesShared()).toBe(before)
+    expect(doubled.elements).toBe(1024)
+  })
+  it('detects corruption', () => {
+    const file = tmpFile()
+    sm.randn([64]).saveRaw(file)
+    const bytes = readFileSync(file)
+    bytes[4096 + 10] ^= 0xff
+    writeFileSync(file, bytes)
+    expectThrows(() => sm.loadRaw(file, true), new RegExp('Failed to load'))
+    expect(sm.loadRaw(file).elements).toBe(64)
+  })
+})
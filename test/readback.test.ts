@@ -0,0 +1,32 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { expectArraysClose } from './utils'
+
+describe('readback', () => {
+  it('matching dtype', () => {
+    const data = new Float32Array([1, 2, 3, 4, 5, 6])
+    const t = sm.tensor(data).reshape([2, 3])
+    expectArraysClose(t.toFloat32Array(), data)
+  })
+  it('non-contiguous', () => {
+    const t = sm.tensor(new Float32Array([1, 2, 3, 4, 5, 6])).reshape([2, 3])
+    expectArraysClose(t.T().toFloat32Array(), [1, 4, 2, 5, 3, 6])
+  })
+  it('casting', () => {
+    const t = sm.tensor(new Float32Array([1, -2, 3]))
+    expectArraysClose(t.toInt32Array(), [1, -2, 3])
+    expectArraysClose(t.toFloat64Array(), [1, -2, 3])
+    expect(t.toBigInt64Array()).toEqual(new BigInt64Array([1n, -2n, 3n]))
+  })
+  it('outlives the tensor', () => {
+    const t = sm.tensor(new Float32Array([7, 8, 9]))
+    const view = t.toFloat32Array()
+    t.dispose()
+    Bun.gc(true)
+    expectArraysClose(view, [7, 8, 9])
+  })
+  it('empty', () => {
+    const t = sm.full([0], 1)
+    expect(t.toFloat32Array().length).toBe(0)
+  })
+})
@@ -0,0 +1,72 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { existsSync } from 'fs'
+import { expectArraysClose, expectThrows } from './utils'
+
+const tmpFile = () => `/tmp/async_${Math.round(1e8 * Math.random())}`
+
+describe('saveAsync', () => {
+  it('written after a flush', () => {
+    const a = sm.randn([64, 64])
+    const file = tmpFile()
+    const ticket = a.saveAsync(file)
+    sm.flushSaves(ticket)
+    expect(sm.pendingSaves()).toBe(0)
+    expectArraysClose(sm.tensor(file).toFloat32Array(), a.toFloat32Array())
+  })
+  it('raw files', () => {
+    const a = sm.randn([8])
+    const file = tmpFile()
+    a.saveAsync(file, true)
+    sm.flushSaves()
+    expectArraysClose(sm.loadRaw(file).toFloat32Array(), a.toFloat32Array())
+  })
+  it('the latest value wins', () => {
+    const file = tmpFile()
+    const values = [...Array(20).keys()].map((i) => sm.full([256], i))
+    values.forEach((v) => v.saveAsync(file))
+    sm.flushSaves()
+    expectArraysClose(sm.tensor(file).toFloat32Array(), values[19].toFloat32Array())
+  })
+  it('a superseded save is flushed with the one replacing it', () => {
+    const file = tmpFile()
+    // keeps the writer busy, so that the first save to `file` is skipped
+    sm.randn([4096, 4096]).saveAsync(tmpFile())
+    const a = sm.full([256], 1)
+    const b = sm.full([256], 2)
+    const ticket = a.saveAsync(file)
+    b.saveAsync(file)
+    sm.flushSaves(ticket)
+    expectArraysClose(sm.tensor(file).toFloat32Array(), b.toFloat32Array())
+    sm.flushSaves()
+  })
+  it('a save queued while the path is being written', () => {
+    const file = tmpFile()
+    const a = sm.randn([4096, 4096])
+    const b = sm.full([256], 2)
+    a.saveAsync(file)
+    // let the writer start on `a`
+    Bun.sleepSync(10)
+    const ticket = b.saveAsync(file)
+    sm.flushSaves(ticket)
+    expectArraysClose(sm.tensor(file).toFloat32Array(), b.toFloat32Array())
+    expect(sm.pendingSaves()).toBe(0)
+  })
+  it('checkpoints on update', () => {
+    const file = tmpFile()
+    const w = sm.randn([16]).checkpoint(file)
+    const next = w.mul(sm.scalar(2))
+    w.update(next)
+    sm.flushSaves()
+    expectArraysClose(sm.tensor(file).toFloat32Array(), next.toFloat32Array())
+    const restored = sm.randn([16]).checkpoint(file)
+    expectArraysClose(restored.toFloat32Array(), next.toFloat32Array())
+  })
+  it('failures are reported by flush', () => {
+    const file = `/tmp/missing_${Math.round(1e8 * Math.random())}/t`
+    sm.randn([4]).saveAsync(file)
+    expectThrows(() => sm.flushSaves(), new RegExp('Failed to save'))
+    expect(existsSync(file)).toBe(false)
+    sm.flushSaves()
+  })
+})
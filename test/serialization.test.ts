@@ -63,6 +63,40 @@ describe('encode/decode Binary', () => {
   })
 })
 
+describe('encodeInto/decode', () => {
+  it('preserves dtype', () => {
+    const big = new BigInt64Array([2n ** 60n + 1n, -3n, 7n])
+    const a = sm.tensor(big)
+    const buf = new Uint8Array(sm.encodedSize(a))
+    expect(sm.encodeInto(a, buf)).toBe(buf.byteLength)
+    const b = sm.decode(buf)
+    expect(b.dtype).toBe(sm.dtype.BigInt64)
+    expect(b.toBigInt64Array()).toEqual(big)
+
+    const h = sm.randn([3, 5]).astype(sm.dtype.Float16)
+    const g = sm.io.decodeBinary(sm.io.encodeBinary(h)).tensor
+    expect(g.dtype).toBe(sm.dtype.Float16)
+    expect(areSameShape(h, g)).toBe(true)
+    expectArraysClose(g.toFloat32Array(), h.toFloat32Array())
+  })
+  it('several tensors in one buffer', () => {
+    const a = sm.randn([4, 3])
+    const b = sm.tensor(new Int32Array([5, -6]))
+    const buf = new ArrayBuffer(sm.encodedSize(a) + sm.encodedSize(b))
+    const offset = sm.encodeInto(a, buf)
+    sm.encodeInto(b, buf, offset)
+    expectArraysClose(sm.decode(buf, 0, offset).toFloat32Array(), a.toFloat32Array())
+    expect(sm.decode(buf, offset).toInt32Array()).toEqual(new Int32Array([5, -6]))
+  })
+  it('views and too small buffers', () => {
+    const a = sm.randn([6, 4]).transpose([1, 0])
+    const b = sm.decode(sm.io.encodeBinary(a).slice(24))
+    expect(areSameShape(a, b)).toBe(true)
+    expectArraysClose(b.toFloat32Array(), a.toFloat32Array())
+    expectThrows(() => sm.encodeInto(a, new Uint8Array(16)), new RegExp('Failed to encode'))
+  })
+})
+
 describe('encode/decode Base64', () => {
   it('1D Tensor', () => {
     const a = sm.tensor(new Float32Array([1, 0, 3, 2]))
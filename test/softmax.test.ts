@@ -217,4 +217,45 @@ describe('softmax', () => {
     const result = tensor.softmax(0)
     expect(result.toFloat32Array().some(Number.isNaN)).toBe(false)
   })
+  it('gradient matches the composed computation', () => {
+    for (const axis of [0, 1, -1]) {
+      const tensor = sm.randn([4, 5, 6]).requireGrad()
+      const g = sm.randn([4, 5, 6])
+      sm.softmax(tensor, axis).mul(g).sum().backward()
+      const fused = tensor.grad.toFloat32Array()
+      tensor.grad = null
+      const exp = tensor.sub(tensor.amax([axis], true).detach()).exp()
+      exp.div(exp.sum([axis], true)).mul(g).sum().backward()
+      expectArraysClose(fused, tensor.grad.toFloat32Array(), 1e-4)
+    }
+  })
+})
+
+describe('logSoftmax', () => {
+  it('matches log of softmax', () => {
+    for (const axis of [0, -1]) {
+      const tensor = sm.randn([3, 7]).mul(sm.scalar(4))
+      const result = sm.logSoftmax(tensor, axis)
+      expect(isShape(result, tensor.shape)).toBe(true)
+      expectArraysClose(result.toFloat32Array(), tensor.softmax(axis).log().toFloat32Array(), 1e-4)
+    }
+  })
+  it('numerically stable', () => {
+    const result = sm.tensor(new Float32Array([1000, 0, 0])).logSoftmax(0)
+    expectArraysClose(result.toFloat32Array(), [0, -1000, -1000])
+  })
+  it('gradient', () => {
+    for (const axis of [0, 1]) {
+      const tensor = sm.randn([6, 5]).requireGrad()
+      const g = sm.randn([6, 5])
+      sm.logSoftmax(tensor, axis).mul(g).sum().backward()
+      // d/dx = g - softmax(x) * sum(g)
+      const expected = g.sub(tensor.detach().softmax(axis).mul(g.sum([axis], true)))
+      expectArraysClose(tensor.grad.toFloat32Array(), expected.toFloat32Array(), 1e-4)
+    }
+  })
+  it('invalid axis', () => {
+    const tensor = sm.tensor(new Float32Array([1, 2, 3]))
+    expectThrows(() => sm.logSoftmax(tensor, 1), nativeError)
+  })
 })
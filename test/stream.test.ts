@@ -0,0 +1,78 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { areSameShape, expectArraysClose } from './utils'
+
+// Re-chunk a stream into pieces of `size` bytes, as a network might.
+function rechunk(stream: ReadableStream<Uint8Array>, size: number) {
+  let pending = new Uint8Array(0)
+  return stream.pipeThrough(
+    new TransformStream<Uint8Array, Uint8Array>({
+      transform(chunk, controller) {
+        const joined = new Uint8Array(pending.byteLength + chunk.byteLength)
+        joined.set(pending)
+        joined.set(chunk, pending.byteLength)
+        let offset = 0
+        for (; offset + size <= joined.byteLength; offset += size) {
+          controller.enqueue(joined.slice(offset, offset + size))
+        }
+        pending = joined.slice(offset)
+      },
+      flush(controller) {
+        if (pending.byteLength) {
+          controller.enqueue(pending)
+        }
+      }
+    })
+  )
+}
+
+describe('encodeStream/decodeStream', () => {
+  it('round trip in frames', async () => {
+    const a = sm.randn([37, 19]).requireGrad()
+    a.provenance = 'abcd1234'
+    const { tensor: b, props } = await sm.io.decodeStream(
+      sm.io.encodeStream(a, { note: 'hi', big: 2n ** 40n }, { chunkBytes: 64 })
+    )
+    expect(areSameShape(a, b)).toBe(true)
+    expectArraysClose(b.toFloat32Array(), a.toFloat32Array())
+    expect(b.provenance).toBe('abcd1234')
+    expect(b.requires_grad).toBe(true)
+    expect(props).toEqual({ note: 'hi', big: 2n ** 40n })
+  })
+  it('whatever the chunks received', async () => {
+    const a = sm.tensor(new BigInt64Array([1n, -(2n ** 50n), 3n, 4n, 5n]))
+    for (const size of [1, 5, 13, 1000]) {
+      const { tensor: b, props } = await sm.io.decodeStream(
+        rechunk(sm.io.encodeStream(a, undefined, { chunkBytes: 16 }), size)
+      )
+      expect(b.dtype).toBe(sm.dtype.BigInt64)
+      expect(b.toBigInt64Array()).toEqual(a.toBigInt64Array())
+      expect(props).toBeUndefined()
+    }
+  })
+  it('views and empty tensors', async () => {
+    const a = sm.randn([8, 5]).transpose([1, 0])
+    const { tensor: b } = await sm.io.decodeStream(sm.io.encodeStream(a, null, { chunkBytes: 24 }))
+    expect(areSameShape(a, b)).toBe(true)
+    expectArraysClose(b.toFloat32Array(), a.toFloat32Array())
+    const { tensor: e } = await sm.io.decodeStream(sm.io.encodeStream(sm.randn([0, 3])))
+    expect(e.elements).toBe(0)
+  })
+  it('rejects truncated streams', async () => {
+    const a = sm.randn([64])
+    const truncated = rechunk(sm.io.encodeStream(a, null, { chunkBytes: 32 }), 5).pipeThrough(
+      new TransformStream<Uint8Array, Uint8Array>({
+        transform(chunk, controller) {
+          if (chunk.byteLength === 5) controller.enqueue(chunk)
+        }
+      })
+    )
+    let error: unknown
+    try {
+      await sm.io.decodeStream(truncated)
+    } catch (e) {
+      error = e
+    }
+    expect(String(error)).toMatch(new RegExp('stream cannot be decoded'))
+  })
+})
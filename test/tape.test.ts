@@ -0,0 +1,94 @@
+import * as sm from '@shumai/shumai'
+import { afterEach, describe, expect, it } from 'bun:test'
+import { expectArraysClose } from './utils'
+
+// Gradients of `inputs` from the JS traversal and from the native tape, checking that the
+// tape actually ran (or, unless `tapeRuns`, that backward fell back to JS).
+function bothGrads(f: (...ts: sm.Tensor[]) => sm.Tensor, inputs: sm.Tensor[], tapeRuns = true) {
+  let stats: sm.Stats
+  const run = () => {
+    stats = new sm.Stats({ enabled: true, logger: null })
+    inputs.forEach((t) => {
+      t.grad = null
+      t.stats = stats
+    })
+    f(...inputs).backward()
+    return inputs.map((t) => t.grad.toFloat32Array())
+  }
+  sm.autograd.disableNativeTape()
+  const js = run()
+  expect(stats.statsByOp.has('tapeBackward')).toBe(false)
+  sm.autograd.enableNativeTape()
+  const native = run()
+  expect(stats.statsByOp.has('tapeBackward')).toBe(tapeRuns)
+  return [js, native]
+}
+
+describe('native tape', () => {
+  afterEach(() => sm.autograd.disableNativeTape())
+
+  it('matches the JS traversal for a small MLP', () => {
+    const x = sm.randn([8, 16])
+    const W1 = sm.randn([16, 32]).requireGrad()
+    const b1 = sm.randn([32]).requireGrad()
+    const W2 = sm.randn([32, 4]).requireGrad()
+    const mlp = (W1, b1, W2) => x.matmul(W1).add(b1).sigmoid().matmul(W2).tanh()
+    const [js, native] = bothGrads(
+      (W1, b1, W2) => mlp(W1, b1, W2).mul(x.sum([1], true)).mean(),
+      [W1, b1, W2]
+    )
+    js.forEach((g, i) => expectArraysClose(native[i], g, 1e-4))
+  })
+  it('broadcasting, reductions and reshapes', () => {
+    const a = sm.randn([3, 4, 5]).requireGrad()
+    const b = sm.randn([4, 1]).requireGrad()
+    const [js, native] = bothGrads(
+      (a, b) =>
+        a
+          .mul(b.mul(b).add(sm.scalar(1)))
+          .div(sm.scalar(4))
+          .sub(b)
+          .exp()
+          .sum([0])
+          .transpose([1, 0])
+          .reshape([20])
+          .sqrt()
+          .sum(),
+      [a, b]
+    )
+    js.forEach((g, i) => expectArraysClose(native[i], g, 1e-4))
+  })
+  it('a tensor used more than once', () => {
+    const x = sm.randn([10]).requireGrad()
+    x.stats = new sm.Stats({ enabled: true, logger: null })
+    sm.autograd.enableNativeTape()
+    x.mul(x).mul(x).sum().backward()
+    expect(x.stats.statsByOp.has('tapeBackward')).toBe(true)
+    expectArraysClose(x.grad.toFloat32Array(), x.mul(x).mul(sm.scalar(3)).toFloat32Array())
+  })
+  it('falls back to JS for ops without a native gradient', () => {
+    const x = sm.randn([4, 6]).requireGrad()
+    const [js, native] = bothGrads((x) => x.softmax(1).mul(x).sum(), [x], false)
+    expectArraysClose(native[0], js[0])
+    expect(sm.autograd.isNativeTape()).toBe(true)
+  })
+  it('differentiates ops missing from the native table in JS', () => {
+    const x = sm.randn([4, 6]).requireGrad()
+    const w = sm.randn([4, 6])
+    const runsNatively = (f: () => sm.Tensor) => {
+      x.stats = new sm.Stats({ enabled: true, logger: null })
+      f().backward()
+      return x.stats.statsByOp.has('tapeBackward')
+    }
+    sm.autograd.enableNativeTape()
+    x.grad = null
+    expect(runsNatively(() => x.exp().mul(w).sum())).toBe(true)
+    // softmax has no native gradient
+    x.grad = null
+    expect(runsNatively(() => x.softmax(1).mul(w).sum())).toBe(false)
+    // d/dx sum(softmax(x) * w) = s * (w - sum(s * w))
+    const s = x.detach().softmax(1)
+    const expected = s.mul(w.sub(s.mul(w).sum([1], true)))
+    expectArraysClose(x.grad.toFloat32Array(), expected.toFloat32Array(), 1e-4)
+  })
+})
@@ -0,0 +1,92 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+import { areSameShape, expectArraysClose, expectThrows } from './utils'
+
+const roundTrip = (t: sm.Tensor, options: sm.EncodeOptions) => {
+  const buf = new Uint8Array(sm.encodedSize(t, options))
+  expect(sm.encodeInto(t, buf, 0, options)).toBe(buf.byteLength)
+  return sm.decode(buf)
+}
+
+describe('wire encodings', () => {
+  it('round trip within the precision of the encoding', () => {
+    const a = sm.randn([33, 70])
+    const expected = a.toFloat32Array()
+    const tolerances = { raw: 1e-6, float16: 1e-2, bfloat16: 1e-1, int8: 1e-1 }
+    for (const [encoding, tolerance] of Object.entries(tolerances)) {
+      const b = roundTrip(a, { encoding: <sm.WireEncoding>encoding })
+      expect(b.dtype).toBe(sm.dtype.Float32)
+      expect(areSameShape(a, b)).toBe(true)
+      expectArraysClose(b.toFloat32Array(), expected, tolerance)
+    }
+    const d = roundTrip(a.astype(sm.dtype.Float64), { encoding: 'bfloat16' })
+    expect(d.dtype).toBe(sm.dtype.Float64)
+    expectArraysClose(d.toFloat32Array(), expected, 1e-1)
+  })
+  it('shrinks the payload', () => {
+    const a = sm.randn([256, 256])
+    const raw = sm.encodedSize(a)
+    expect(sm.encodedSize(a, { encoding: 'float16' }) / raw).toBeLessThan(0.51)
+    expect(sm.encodedSize(a, { encoding: 'bfloat16' }) / raw).toBeLessThan(0.51)
+    expect(sm.encodedSize(a, { encoding: 'int8' }) / raw).toBeLessThan(0.27)
+  })
+  it('sends other dtypes raw', () => {
+    const a = sm.tensor(new Int32Array([1, -2, 1 << 30]))
+    expect(sm.wireEncodingOf(a, 'int8')).toBe('raw')
+    expect(sm.encodedSize(a, { encoding: 'int8' })).toBe(sm.encodedSize(a))
+    expect(roundTrip(a, { encoding: 'int8' }).toInt32Array()).toEqual(
+      new Int32Array([1, -2, 1 << 30])
+    )
+    expectThrows(
+      () => sm.encodedSize(a, { encoding: <sm.WireEncoding>'int4' }),
+      new RegExp('Unknown wire encoding')
+    )
+  })
+  it('error feedback keeps repeated transfers unbiased', () => {
+    const g = sm.randn([1000]).mul(sm.scalar(1e-3))
+    const residual = sm.scalar(0)
+    let withFeedback = sm.full([1000], 0)
+    let without = sm.full([1000], 0)
+    for (let i = 0; i < 50; ++i) {
+      withFeedback = withFeedback.add(roundTrip(g, { encoding: 'int8', residual }))
+      without = without.add(roundTrip(g, { encoding: 'int8' }))
+    }
+    expect(areSameShape(residual, g)).toBe(true)
+    const exact = g.mul(sm.scalar(50))
+    const error = (t: sm.Tensor) => t.sub(exact).abs().max().toFloat32()
+    expect(error(withFeedback)).toBeLessThan(error(without) / 10)
+  })
+  it('error feedback residuals outlive tidy scopes', async () => {
+    const server = Bun.serve({
+      port: 0,
+      fetch: async (req) => new Response(await req.arrayBuffer())
+    })
+    const url = `http://localhost:${server.port}`
+    const g = sm.randn([256]).mul(sm.scalar(1e-3))
+    try {
+      for (let i = 0; i < 3; ++i) {
+        // the residual is created (and the request encoded) before tidy returns
+        const out = await sm.util.tidy(() =>
+          sm.network.tfetch(url, g, { encoding: 'int8', errorFeedback: true })
+        )
+        expectArraysClose(out.toFloat32Array(), g.toFloat32Array(), 1e-4)
+      }
+    } finally {
+      server.stop(true)
+    }
+  })
+  it('transfers are counted by encoding', () => {
+    const a = sm.randn([64, 64])
+    const s = new sm.Stats({ enabled: true, logger: null })
+    sm.network.logTransfer(s, a, { encoding: 'bfloat16' })
+    sm.network.logTransfer(s, a, { encoding: 'bfloat16' })
+    sm.network.logTransfer(s, sm.tensor(new Int32Array([1])), { encoding: 'bfloat16' })
+    const entry = s.transfersByEncoding.get('bfloat16')
+    expect(entry.count).toBe(2n)
+    expect(entry.rawBytes).toBe(2n * 64n * 64n * 4n)
+    expect(entry.bytes < entry.rawBytes / 2n + 100n).toBe(true)
+    expect(s.transfersByEncoding.get('raw').count).toBe(1n)
+    const copy = sm.Stats.fromJSON(s.toJSON())
+    expect(copy.transfersByEncoding.get('bfloat16').bytes).toBe(entry.bytes)
+  })
+})
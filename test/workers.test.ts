@@ -0,0 +1,41 @@
+import * as sm from '@shumai/shumai'
+import { describe, expect, it } from 'bun:test'
+
+const WORKERS = 4
+const ITERATIONS = 200
+
+type Report = { id: number; errors: number; tensors: number; bytes: bigint }
+
+function run(workers: Worker[]): Promise<Report[]> {
+  return Promise.all(
+    workers.map(
+      (worker, id) =>
+        new Promise<Report>((resolve) => {
+          worker.onmessage = (event: MessageEvent) => resolve(event.data)
+          worker.postMessage({ id, iterations: ITERATIONS, colMajor: id % 2 === 1 })
+        })
+    )
+  )
+}
+
+describe('workers', () => {
+  it('concurrent ops', async () => {
+    const url = new URL('./workers/ops_worker.ts', import.meta.url).href
+    const workers = Array.from({ length: WORKERS }, () => new Worker(url))
+    // the first round also covers each worker loading the library
+    for (let round = 0; round < 2; ++round) {
+      for (const { errors, tensors, bytes } of await run(workers)) {
+        expect(errors).toBe(0)
+        // every worker released what it allocated
+        expect(tensors).toBe(0)
+        expect(bytes).toBe(0n)
+      }
+    }
+    // layout is per thread, so the column-major workers did not change ours
+    expect(sm.layout.isRowMajor()).toBe(true)
+
+    for (const worker of workers) {
+      worker.terminate()
+    }
+  })
+})
@@ -0,0 +1,39 @@
+import * as sm from '@shumai/shumai'
+
+declare const self: Worker
+
+// Issues a stream of small ops and reports how many results were wrong, and how many tensors
+// (and bytes) this worker left allocated.
+self.onmessage = (event: MessageEvent) => {
+  const { id, iterations, colMajor } = event.data
+  if (colMajor) {
+    sm.layout.setColMajor()
+  }
+  const tensors = sm.threadTensors()
+  const bytes = sm.threadTensorBytes()
+  let errors = 0
+  for (let i = 0; i < iterations; ++i) {
+    sm.util.tidy(() => {
+      const n = 8 + ((id + i) % 8)
+      const a = sm.full([n, n - 1], id + 1)
+      const b = sm.full([n - 1, n], 1)
+      const c = a.matmul(b).add(sm.scalar(i))
+      const expected = n * n * ((id + 1) * (n - 1) + i)
+      if (Math.abs(c.sum().toFloat32() - expected) > 1e-4 * expected) {
+        errors++
+      }
+      if (c.shape[0] !== n || c.reshape([n * n]).shape[0] !== n * n) {
+        errors++
+      }
+      if (sm.layout.isColMajor() !== !!colMajor) {
+        errors++
+      }
+    })
+  }
+  postMessage({
+    id,
+    errors,
+    tensors: sm.threadTensors() - tensors,
+    bytes: sm.threadTensorBytes() - bytes
+  })
+}